@@ -26,6 +26,7 @@ static void syntax(void)
     printf("Syntax: avifdec [options] input.avif output.[jpg|jpeg|png|y4m]\n");
     printf("Options:\n");
     printf("    -h,--help         : Show syntax help\n");
+    printf("    -j,--jobs J       : Number of jobs (worker threads, default: 1)\n");
     printf("    -c,--codec C      : AV1 codec to use (choose from versions list below)\n");
     printf("    -d,--depth D      : Output depth [8,16]. (PNG only; For y4m, depth is retained, and JPEG is always 8bpc)\n");
     printf("    -q,--quality Q    : Output quality [0-100]. (JPEG only, default: %d)\n", DEFAULT_JPEG_QUALITY);
@@ -39,6 +40,7 @@ int main(int argc, char * argv[])
     const char * outputFilename = NULL;
     int requestedDepth = 0;
     int jpegQuality = DEFAULT_JPEG_QUALITY;
+    int jobs = 1;
     avifCodecChoice codecChoice = AVIF_CODEC_CHOICE_AUTO;
 
     if (argc < 2) {
@@ -53,6 +55,12 @@ int main(int argc, char * argv[])
         if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
             syntax();
             return 0;
+        } else if (!strcmp(arg, "-j") || !strcmp(arg, "--jobs")) {
+            NEXTARG();
+            jobs = atoi(arg);
+            if (jobs < 1) {
+                jobs = 1;
+            }
         } else if (!strcmp(arg, "-c") || !strcmp(arg, "--codec")) {
             NEXTARG();
             codecChoice = avifCodecChoiceFromName(arg);
@@ -134,6 +142,7 @@ int main(int argc, char * argv[])
     int returnCode = 0;
     avifImage * avif = avifImageCreateEmpty();
     avifDecoder * decoder = avifDecoderCreate();
+    decoder->maxThreads = jobs;
     avifResult decodeResult = avifDecoderRead(decoder, avif, (avifROData *)&raw);
     if (decodeResult == AVIF_RESULT_OK) {
         printf("Image decoded: %s\n", inputFilename);
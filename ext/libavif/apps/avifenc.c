@@ -26,7 +26,7 @@ static void syntax(void)
     printf("    -h,--help                         : Show syntax help\n");
     printf("    -j,--jobs J                       : Number of jobs (worker threads, default: 1)\n");
     printf("    -d,--depth D                      : Output depth [8,10,12]. (JPEG/PNG only; For y4m, depth is retained)\n");
-    printf("    -y,--yuv FORMAT                   : Output format [default=444, 422, 420]. (JPEG/PNG only; For y4m, format is retained)\n");
+    printf("    -y,--yuv FORMAT                   : Output format [default=444, 422, 420, 400]. (JPEG/PNG only; For y4m, format is retained)\n");
     printf("    -n,--nclx P/T/M                   : Set nclx colr box values (3 raw numbers, use -r to set range flag)\n");
     printf("                                        P = enum avifNclxColourPrimaries\n");
     printf("                                        T = enum avifNclxTransferCharacteristics\n");
@@ -52,6 +52,7 @@ static void syntax(void)
            AVIF_SPEED_SLOWEST,
            AVIF_SPEED_FASTEST);
     printf("    -c,--codec C                      : AV1 codec to use (choose from versions list below)\n");
+    printf("    --grid W,H                        : Encode as a grid of WxH cells (each cell is a separate AV1 image)\n");
     printf("    --pasp H,V                        : Add pasp property (aspect ratio). H=horizontal spacing, V=vertical spacing\n");
     printf("    --clap WN,WD,HN,HD,HON,HOD,VON,VOD: Add clap property (clean aperture). Width, Height, HOffset, VOffset (in num/denom pairs)\n");
     printf("    --irot ANGLE                      : Add irot property (rotation). [0-3], makes (90 * ANGLE) degree rotation anti-clockwise\n");
@@ -146,6 +147,8 @@ int main(int argc, char * argv[])
     int minQuantizerAlpha = AVIF_QUANTIZER_LOSSLESS;
     int maxQuantizerAlpha = AVIF_QUANTIZER_LOSSLESS;
     int speed = 8;
+    int gridCount = 0;
+    uint32_t gridValues[8]; // only the first two are used
     int paspCount = 0;
     uint32_t paspValues[8]; // only the first two are used
     int clapCount = 0;
@@ -189,6 +192,8 @@ int main(int argc, char * argv[])
                 requestedFormat = AVIF_PIXEL_FORMAT_YUV422;
             } else if (!strcmp(arg, "420")) {
                 requestedFormat = AVIF_PIXEL_FORMAT_YUV420;
+            } else if (!strcmp(arg, "400")) {
+                requestedFormat = AVIF_PIXEL_FORMAT_YUV400;
             } else {
                 fprintf(stderr, "ERROR: invalid format: %s\n", arg);
                 return 1;
@@ -272,6 +277,13 @@ int main(int argc, char * argv[])
                     return 1;
                 }
             }
+        } else if (!strcmp(arg, "--grid")) {
+            NEXTARG();
+            gridCount = parseU32List(gridValues, arg);
+            if ((gridCount != 2) || !gridValues[0] || !gridValues[1]) {
+                fprintf(stderr, "ERROR: Invalid grid cell size: %s\n", arg);
+                return 1;
+            }
         } else if (!strcmp(arg, "--pasp")) {
             NEXTARG();
             paspCount = parseU32List(paspValues, arg);
@@ -418,6 +430,10 @@ int main(int argc, char * argv[])
     encoder->maxQuantizerAlpha = maxQuantizerAlpha;
     encoder->codecChoice = codecChoice;
     encoder->speed = speed;
+    if (gridCount == 2) {
+        encoder->gridCellWidth = gridValues[0];
+        encoder->gridCellHeight = gridValues[1];
+    }
     avifResult encodeResult = avifEncoderWrite(encoder, avif, &raw);
     if (encodeResult != AVIF_RESULT_OK) {
         fprintf(stderr, "ERROR: Failed to encode image: %s\n", avifResultToString(encodeResult));
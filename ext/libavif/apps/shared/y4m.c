@@ -80,6 +80,21 @@ static avifBool y4mColorSpaceParse(const char * formatString, avifPixelFormat *
         *depth = 8;
         return AVIF_TRUE;
     }
+    if (!strcmp(formatString, "Cmono")) {
+        *format = AVIF_PIXEL_FORMAT_YUV400;
+        *depth = 8;
+        return AVIF_TRUE;
+    }
+    if (!strcmp(formatString, "Cmono10")) {
+        *format = AVIF_PIXEL_FORMAT_YUV400;
+        *depth = 10;
+        return AVIF_TRUE;
+    }
+    if (!strcmp(formatString, "Cmono12")) {
+        *format = AVIF_PIXEL_FORMAT_YUV400;
+        *depth = 12;
+        return AVIF_TRUE;
+    }
     return AVIF_FALSE;
 }
 
@@ -244,10 +259,13 @@ avifBool y4mRead(avifImage * avif, const char * inputFilename)
     avifPixelFormatInfo info;
     avifGetPixelFormatInfo(avif->yuvFormat, &info);
 
-    uint32_t planeBytes[4];
+    uint32_t planeBytes[4] = { 0, 0, 0, 0 };
+    const int planeCount = info.monochrome ? 1 : 3;
     planeBytes[0] = avif->yuvRowBytes[0] * avif->height;
-    planeBytes[1] = avif->yuvRowBytes[1] * (avif->height >> info.chromaShiftY);
-    planeBytes[2] = avif->yuvRowBytes[2] * (avif->height >> info.chromaShiftY);
+    if (!info.monochrome) {
+        planeBytes[1] = avif->yuvRowBytes[1] * (avif->height >> info.chromaShiftY);
+        planeBytes[2] = avif->yuvRowBytes[2] * (avif->height >> info.chromaShiftY);
+    }
     if (hasAlpha) {
         planeBytes[3] = avif->alphaRowBytes * avif->height;
     } else {
@@ -261,7 +279,7 @@ avifBool y4mRead(avifImage * avif, const char * inputFilename)
         goto cleanup;
     }
 
-    for (int i = 0; i < 3; ++i) {
+    for (int i = 0; i < planeCount; ++i) {
         memcpy(avif->yuvPlanes[i], p, planeBytes[i]);
         p += planeBytes[i];
     }
@@ -308,6 +326,9 @@ avifBool y4mWrite(avifImage * avif, const char * outputFilename)
                     y4mHeaderFormat = "C420jpeg XYSCSS=420JPEG";
                     swapUV = AVIF_TRUE;
                     break;
+                case AVIF_PIXEL_FORMAT_YUV400:
+                    y4mHeaderFormat = "Cmono XYSCSS=400";
+                    break;
                 case AVIF_PIXEL_FORMAT_NONE:
                     // will error later; this case is here for warning's sake
                     break;
@@ -328,6 +349,9 @@ avifBool y4mWrite(avifImage * avif, const char * outputFilename)
                     y4mHeaderFormat = "C422p10 XYSCSS=422P10";
                     swapUV = AVIF_TRUE;
                     break;
+                case AVIF_PIXEL_FORMAT_YUV400:
+                    y4mHeaderFormat = "Cmono10 XYSCSS=400";
+                    break;
                 case AVIF_PIXEL_FORMAT_NONE:
                     // will error later; this case is here for warning's sake
                     break;
@@ -348,6 +372,9 @@ avifBool y4mWrite(avifImage * avif, const char * outputFilename)
                     y4mHeaderFormat = "C422p12 XYSCSS=422P12";
                     swapUV = AVIF_TRUE;
                     break;
+                case AVIF_PIXEL_FORMAT_YUV400:
+                    y4mHeaderFormat = "Cmono12 XYSCSS=400";
+                    break;
                 case AVIF_PIXEL_FORMAT_NONE:
                     // will error later; this case is here for warning's sake
                     break;
@@ -385,13 +412,16 @@ avifBool y4mWrite(avifImage * avif, const char * outputFilename)
     }
 
     uint8_t * planes[3];
-    uint32_t planeBytes[3];
+    uint32_t planeBytes[3] = { 0, 0, 0 };
+    const int planeCount = info.monochrome ? 1 : 3;
     planes[0] = avif->yuvPlanes[0];
     planes[1] = avif->yuvPlanes[1];
     planes[2] = avif->yuvPlanes[2];
     planeBytes[0] = avif->yuvRowBytes[0] * avif->height;
-    planeBytes[1] = avif->yuvRowBytes[1] * (avif->height >> info.chromaShiftY);
-    planeBytes[2] = avif->yuvRowBytes[2] * (avif->height >> info.chromaShiftY);
+    if (!info.monochrome) {
+        planeBytes[1] = avif->yuvRowBytes[1] * (avif->height >> info.chromaShiftY);
+        planeBytes[2] = avif->yuvRowBytes[2] * (avif->height >> info.chromaShiftY);
+    }
     if (swapUV) {
         uint8_t * tmpPtr;
         uint32_t tmp;
@@ -403,7 +433,7 @@ avifBool y4mWrite(avifImage * avif, const char * outputFilename)
         planeBytes[2] = tmp;
     }
 
-    for (int i = 0; i < 3; ++i) {
+    for (int i = 0; i < planeCount; ++i) {
         if (fwrite(planes[i], 1, planeBytes[i], f) != planeBytes[i]) {
             fprintf(stderr, "Failed to write %" PRIu32 " bytes: %s\n", planeBytes[i], outputFilename);
             success = AVIF_FALSE;
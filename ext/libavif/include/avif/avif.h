@@ -59,6 +59,7 @@ enum avifChannelIndex
 
 const char * avifVersion(void);
 void avifCodecVersions(char outBuffer[256]);
+unsigned int avifLibYUVVersion(void); // returns 0 if libavif wasn't compiled with libyuv support
 
 // ---------------------------------------------------------------------------
 // Memory management
@@ -89,7 +90,10 @@ typedef enum avifResult
     AVIF_RESULT_NO_CODEC_AVAILABLE,
     AVIF_RESULT_NO_IMAGES_REMAINING,
     AVIF_RESULT_INVALID_EXIF_PAYLOAD,
-    AVIF_RESULT_INVALID_IMAGE_GRID
+    AVIF_RESULT_INVALID_IMAGE_GRID,
+    AVIF_RESULT_IO_ERROR,
+    AVIF_RESULT_INCOMPATIBLE_IMAGE,
+    AVIF_RESULT_INVALID_REGION
 } avifResult;
 
 const char * avifResultToString(avifResult result);
@@ -108,15 +112,20 @@ typedef struct avifROData
 typedef struct avifRWData
 {
     uint8_t * data;
-    size_t size;
+    size_t size;     // bytes in use
+    size_t capacity; // bytes allocated at data; shrinking size keeps the allocation
 } avifRWData;
 
 // clang-format off
-// Initialize avifROData/avifRWData on the stack with this
-#define AVIF_DATA_EMPTY { NULL, 0 }
+// Initialize avifROData/avifRWData on the stack with this (the universal zero initializer fits both)
+#define AVIF_DATA_EMPTY { 0 }
 // clang-format on
 
+// Sets size, keeping the contents up to the smaller of the old and new sizes. Only reallocates
+// (to exactly newSize) when newSize exceeds the capacity.
 void avifRWDataRealloc(avifRWData * raw, size_t newSize);
+// Grows the allocation to at least capacity bytes without changing size or contents
+void avifRWDataReserve(avifRWData * raw, size_t capacity);
 void avifRWDataSet(avifRWData * raw, const uint8_t * data, size_t len);
 void avifRWDataFree(avifRWData * raw);
 
@@ -131,12 +140,14 @@ typedef enum avifPixelFormat
     AVIF_PIXEL_FORMAT_YUV444,
     AVIF_PIXEL_FORMAT_YUV422,
     AVIF_PIXEL_FORMAT_YUV420,
-    AVIF_PIXEL_FORMAT_YV12
+    AVIF_PIXEL_FORMAT_YV12,
+    AVIF_PIXEL_FORMAT_YUV400 // monochrome: only the Y plane is present
 } avifPixelFormat;
 const char * avifPixelFormatToString(avifPixelFormat format);
 
 typedef struct avifPixelFormatInfo
 {
+    avifBool monochrome; // no U/V planes; the chroma shifts describe the 4:2:0 layout AV1 codes it in
     int chromaShiftX;
     int chromaShiftY;
     int aomIndexU; // maps U plane to AOM-side plane index
@@ -367,6 +378,11 @@ void avifImageAllocatePlanes(avifImage * image, uint32_t planes); // Ignores any
 void avifImageFreePlanes(avifImage * image, uint32_t planes);     // Ignores already-freed planes
 void avifImageStealPlanes(avifImage * dstImage, avifImage * srcImage, uint32_t planes);
 
+// PSNR in dB of the Y, U and V planes of image against refImage (100 if they are identical), measured
+// like avifEncoder measures its PSNR targets. Returns 0 if the two don't match in size, depth and
+// YUV format, or lack YUV planes.
+double avifImagePSNR(const avifImage * image, const avifImage * refImage);
+
 // ---------------------------------------------------------------------------
 // Optional YUV<->RGB support
 
@@ -395,13 +411,22 @@ avifBool avifRGBFormatHasAlpha(avifRGBFormat format);
 
 typedef struct avifRGBImage
 {
-    uint32_t width;       // must match associated avifImage
-    uint32_t height;      // must match associated avifImage
+    uint32_t width;       // must match associated avifImage (or be smaller, see avifImageYUVToRGBScaled())
+    uint32_t height;      // must match associated avifImage (or be smaller, see avifImageYUVToRGBScaled())
     uint32_t depth;       // legal depths [8, 10, 12, 16]. if depth>8, pixels must be uint16_t internally
     avifRGBFormat format; // all channels are always full range
 
     uint8_t * pixels;
     uint32_t rowBytes;
+
+    // Defaults to 1. If (maxThreads > 1), avifImageRGBToYUV(), avifImageRGBToYUVRows(), avifImageYUVToRGB(),
+    // avifImageYUVToRGBRows() and avifImageYUVToRGBScaled() convert bands of rows concurrently.
+    int maxThreads;
+
+    // Defaults to AVIF_FALSE. When libavif is built with libyuv, 8-bit 4:2:0 and 4:2:2 BT.601
+    // conversions use its fixed-point kernels, which can be off by a few codepoints compared to the
+    // generic path. Set this to force the generic path.
+    avifBool avoidLibYUV;
 } avifRGBImage;
 
 void avifRGBImageSetDefaults(avifRGBImage * rgb, avifImage * image);
@@ -415,6 +440,22 @@ void avifRGBImageFreePixels(avifRGBImage * rgb);
 avifResult avifImageRGBToYUV(avifImage * image, avifRGBImage * rgb);
 avifResult avifImageYUVToRGB(avifImage * image, avifRGBImage * rgb);
 
+// Converts only rows [firstRow, firstRow + rowCount) of image. The first row of rgb->pixels receives
+// image row firstRow, so the pixel buffer only needs to hold rowCount rows (rgb->height is ignored).
+// This allows converting a large image in bands through a small scratch buffer.
+avifResult avifImageYUVToRGBRows(avifImage * image, avifRGBImage * rgb, uint32_t firstRow, uint32_t rowCount);
+
+// Converts image while shrinking it to rgb->width x rgb->height (each at most the image's), every
+// RGB pixel averaging the image pixels it covers. Meant for thumbnails: only the output pixels are
+// converted, and no full size RGB buffer is needed.
+avifResult avifImageYUVToRGBScaled(avifImage * image, avifRGBImage * rgb);
+
+// The encoding counterpart: fills rows [firstRow, firstRow + rowCount) of image (allocating its
+// planes on the first call) from rgb, whose first row holds image row firstRow. With vertically
+// subsampled chroma (4:2:0), firstRow must be even and rowCount must be even unless the band ends
+// the image, so no chroma row is split between two bands.
+avifResult avifImageRGBToYUVRows(avifImage * image, avifRGBImage * rgb, uint32_t firstRow, uint32_t rowCount);
+
 // ---------------------------------------------------------------------------
 // YUV Utils
 
@@ -480,15 +521,53 @@ avifCodecChoice avifCodecChoiceFromName(const char * name);
 // ---------------------------------------------------------------------------
 // avifDecoder
 
-// Useful stats related to a read/write
+// Useful stats related to a read/write. Times are in seconds, measured on a monotonic clock. Work
+// done on several threads at once (grid cells, color and alpha items) is summed up, so a stage may
+// take longer than the whole read or write did.
 typedef struct avifIOStats
 {
     size_t colorOBUSize;
     size_t alphaOBUSize;
+
+    double parseSeconds;      // read: parsing the boxes and setting up the tiles
+    double colorCodecSeconds; // AV1 decode (read) or encode (write) of the color item, cells or track
+    double alphaCodecSeconds; // AV1 decode (read) or encode (write) of the alpha item, cells or track
+    double gridSeconds;       // read: copying cells into the image; write: cutting the image into cells
+    double writeSeconds;      // write: assembling the boxes and handing them (and the payloads) out
+    uint32_t tileCount;       // read: tiles decoded so far, see avifDecoderTileSeconds()
+    size_t planeBytes;        // image planes allocated along the way, by libavif or the AV1 codec
+
+    // write, with an avifEncoder target: the color quantizer written, its PSNR or SSIM (quality targets
+    // only), whether it met the target, and how many candidates were encoded to find it
+    int targetQuantizer;
+    double targetQuality;
+    avifBool targetMet;
+    uint32_t targetCandidates;
+
+    // read: cells avifDecoderDecodeRegion() took from its cache instead of decoding them again
+    uint32_t cellCacheHits;
 } avifIOStats;
 
 struct avifDecoderData;
 
+// Random access input for avifDecoderParseIO(). read() points out at up to size bytes starting at
+// offset and returns AVIF_RESULT_OK; out->size is only smaller than size at the end of the input
+// (0 at or past it). Any other result (such as AVIF_RESULT_IO_ERROR) aborts the parse or decode.
+// * sizeHint is the total input size if known (0 otherwise), used to reject out-of-range offsets
+//   without reading.
+// * If persistent is AVIF_TRUE, the memory read() returns stays valid as long as the decoder uses the
+//   reader, and the decoder points straight into it. Otherwise it only needs to stay valid until the
+//   next read() call, and the decoder copies what it keeps.
+// read() is never called concurrently, but may be called from a worker thread.
+typedef avifResult (*avifIOReadFunc)(void * userData, uint64_t offset, size_t size, avifROData * out);
+typedef struct avifIOReader
+{
+    avifIOReadFunc read;
+    void * userData;
+    uint64_t sizeHint;
+    avifBool persistent;
+} avifIOReader;
+
 typedef enum avifDecoderSource
 {
     // If a moov box is present in the .avif(s), use the tracks in it, otherwise decode the primary item.
@@ -502,8 +581,9 @@ typedef enum avifDecoderSource
     // This is where avifs image sequences store their images.
     AVIF_DECODER_SOURCE_TRACKS,
 
-    // Decode the thumbnail item. Currently unimplemented.
-    // AVIF_DECODER_SOURCE_THUMBNAIL_ITEM
+    // Use the thumbnail item (thmb reference) of the primary item, and its aux (alpha) item.
+    // avifDecoderReset() returns AVIF_RESULT_NO_AV1_ITEMS_FOUND if there is none.
+    AVIF_DECODER_SOURCE_THUMBNAIL_ITEM
 } avifDecoderSource;
 
 // Information about the timing of a single image in an image sequence
@@ -521,6 +601,10 @@ typedef struct avifDecoder
     // Defaults to AVIF_CODEC_CHOICE_AUTO: Preference determined by order in availableCodecs table (avif.c)
     avifCodecChoice codecChoice;
 
+    // Defaults to 1. If (maxThreads < 2), multithreading is disabled in the AV1 codec.
+    // Changes take effect on the next avifDecoderReset() / avifDecoderParse().
+    int maxThreads;
+
     // avifs can have multiple sets of images in them. This specifies which to decode.
     // Set this via avifDecoderSetSource().
     avifDecoderSource requestedSource;
@@ -560,6 +644,11 @@ typedef struct avifDecoder
     // * Else it will be set to 0.
     uint32_t containerDepth;
 
+    // Upper bound for the decoded cells avifDecoderDecodeRegion() keeps between calls, in bytes of
+    // their planes. Defaults to 128 MiB; 0 disables the cache. The cells of the region being decoded
+    // are kept until it is done, even if they don't fit.
+    size_t regionCacheBytes;
+
     // stats from the most recent read, possibly 0s if reading an image sequence
     avifIOStats ioStats;
 
@@ -593,6 +682,10 @@ avifResult avifDecoderRead(avifDecoder * decoder, avifImage * image, avifROData
 // Parse again. Normally AVIF_DECODER_SOURCE_AUTO is enough for the common path.
 avifResult avifDecoderSetSource(avifDecoder * decoder, avifDecoderSource source);
 avifResult avifDecoderParse(avifDecoder * decoder, avifROData * input);
+// Like avifDecoderParse(), but reads the input through io: only the ftyp, meta and moov boxes are
+// read while parsing, and each payload is read when its image is decoded. io is copied, but its
+// userData must stay valid until the decoder is destroyed or parses another input.
+avifResult avifDecoderParseIO(avifDecoder * decoder, const avifIOReader * io);
 avifResult avifDecoderNextImage(avifDecoder * decoder);
 avifResult avifDecoderNthImage(avifDecoder * decoder, uint32_t frameIndex);
 avifResult avifDecoderReset(avifDecoder * decoder);
@@ -606,14 +699,38 @@ uint32_t avifDecoderNearestKeyframe(avifDecoder * decoder, uint32_t frameIndex);
 // Timing helper - This does not change the current image or invoke the codec (safe to call repeatedly)
 avifResult avifDecoderNthImageTiming(avifDecoder * decoder, uint32_t frameIndex, avifImageTiming * outTiming);
 
+// Decodes the width x height region at (x, y) of the image into decoder->image, which is sized to the
+// region. Only the grid cells (color and alpha) which intersect it are decoded, concurrently given
+// maxThreads, and they are cached for later overlapping regions (see regionCacheBytes); an image
+// which isn't a grid is decoded whole once and then cropped. May be called any number of times
+// after avifDecoderParse() or avifDecoderParseIO(), also mixed with avifDecoderNextImage().
+// * Returns AVIF_RESULT_INVALID_REGION if the region is empty, isn't inside the image, or x or y
+//   is odd while the chroma is subsampled along that axis.
+// * Image sequences are decoded from tracks, which have no cells: AVIF_RESULT_NO_AV1_ITEMS_FOUND.
+avifResult avifDecoderDecodeRegion(avifDecoder * decoder, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+// Time spent decoding one tile since the last parse or reset, in seconds. tileIndex is bound by
+// ioStats.tileCount; color tiles (grid cells in raster order) come first, then the alpha ones.
+double avifDecoderTileSeconds(const avifDecoder * decoder, uint32_t tileIndex);
+
 // ---------------------------------------------------------------------------
 // avifEncoder
 
 struct avifEncoderData;
 
+typedef enum avifEncoderTarget
+{
+    AVIF_ENCODER_TARGET_NONE = 0, // minQuantizer/maxQuantizer are used as they are
+    AVIF_ENCODER_TARGET_SIZE,     // the best quality whose file is at most targetSize bytes
+    AVIF_ENCODER_TARGET_PSNR,     // the smallest file whose color PSNR is at least targetQuality dB
+    AVIF_ENCODER_TARGET_SSIM      // the smallest file whose color SSIM is at least targetQuality [0-1]
+} avifEncoderTarget;
+
 // Notes:
 // * If avifEncoderWrite() returns AVIF_RESULT_OK, output must be freed with avifRWDataFree()
-// * If (maxThreads < 2), multithreading is disabled
+// * If (maxThreads < 2), multithreading is disabled. Otherwise the color and alpha items (and grid
+//   cells) are encoded concurrently, splitting maxThreads between them by pixel count; the output
+//   is identical to encoding them one at a time.
 // * Quality range: [AVIF_QUANTIZER_BEST_QUALITY - AVIF_QUANTIZER_WORST_QUALITY]
 // * To enable tiling, set tileRowsLog2 > 0 and/or tileColsLog2 > 0.
 //   Tiling values range [0-6], where the value indicates a request for 2^n tiles in that dimension.
@@ -621,6 +738,34 @@ struct avifEncoderData;
 //   image in less bytes. AVIF_SPEED_DEFAULT means "Leave the AV1 codec to its default speed settings"./
 //   If avifEncoder uses rav1e, the speed value is directly passed through (0-10). If libaom is used,
 //   a combination of settings are tweaked to simulate this speed range.
+// * To encode a grid, set gridCellWidth > 0 and gridCellHeight > 0. The image is split into cells of
+//   that size (cells on the right/bottom edge are padded), each cell is encoded as its own AV1 item,
+//   and a 'grid' derived item reassembles them. Cells must be at least 64x64 (a MIAF requirement) and
+//   multiples of the chroma subsampling in size, and there can be at most 256 columns and 256 rows. An image fitting into a single cell is written
+//   without a grid.
+// * Image sequences: call avifEncoderAddImage() once per frame, then avifEncoderFinish() or
+//   avifEncoderFinishToIO(). Frame durations are given in timescales (Hz, default 1). All frames
+//   must match the first one in size, depth and YUV format, and have alpha if it does. The frames
+//   are coded as one AV1 stream per track, predicted from each other where the codec supports it,
+//   and the first one is also written as the primary item for still image readers. Grids are not
+//   supported for sequences.
+// * An encoder can write any number of files (still images and sequences) one after another, each
+//   starting from scratch. To encode a batch of images faster, set keepCodecs: the codec contexts
+//   of a still image are then kept alive, and reused for the next image with the same size, format
+//   and settings instead of being set up again. libaom can't reset a context, so its rate control
+//   and coding state carry over and the output is NOT the same as a fresh encoder's: with a range
+//   of quantizers the sizes can differ by tens of percent, and even with minQuantizer ==
+//   maxQuantizer some blocks may be coded differently. Only lossless images (quantizer 0) are
+//   guaranteed to decode the same. Once keepCodecs is cleared, the next write drops the kept
+//   contexts. Targets never reuse contexts for their candidates.
+// * Targets: with a target other than AVIF_ENCODER_TARGET_NONE, still images are searched for the
+//   color quantizer within [minQuantizer, maxQuantizer] that meets it, each candidate being coded at a
+//   single quantizer. A quick search at AVIF_SPEED_FASTEST picks where to start, then each round
+//   encodes up to 4 candidates concurrently (each one with at least 2 of maxThreads), and the OBUs
+//   of the winner are written without encoding it again. Alpha keeps its own quantizers, but counts
+//   towards targetSize. PSNR and SSIM are measured like libaom does, on the decoded YUV planes (so a
+//   decoder must be available). If no quantizer meets the target, the closest one is written and
+//   ioStats.targetMet is AVIF_FALSE. Sequences ignore the target.
 typedef struct avifEncoder
 {
     // Defaults to AVIF_CODEC_CHOICE_AUTO: Preference determined by order in availableCodecs table (avif.c)
@@ -635,6 +780,13 @@ typedef struct avifEncoder
     int tileRowsLog2;
     int tileColsLog2;
     int speed;
+    uint32_t gridCellWidth;
+    uint32_t gridCellHeight;
+    uint64_t timescale;
+    avifBool keepCodecs;
+    avifEncoderTarget target;
+    size_t targetSize;
+    double targetQuality;
 
     // stats from the most recent write
     avifIOStats ioStats;
@@ -643,8 +795,26 @@ typedef struct avifEncoder
     struct avifEncoderData * data;
 } avifEncoder;
 
+// Output sink for avifEncoderWriteToIO(). write() receives consecutive pieces of the file in order
+// and returns AVIF_RESULT_OK, or an error (such as AVIF_RESULT_IO_ERROR) which aborts the write and
+// is returned by avifEncoderWriteToIO().
+typedef avifResult (*avifIOWriteFunc)(void * userData, const uint8_t * data, size_t size);
+typedef struct avifIOWriter
+{
+    avifIOWriteFunc write;
+    void * userData;
+} avifIOWriter;
+
 avifEncoder * avifEncoderCreate(void);
 avifResult avifEncoderWrite(avifEncoder * encoder, avifImage * image, avifRWData * output);
+// Like avifEncoderWrite(), but streams the file to io instead of assembling it in memory: the header
+// boxes are written first, then each encoded payload straight from the buffer it was encoded into.
+avifResult avifEncoderWriteToIO(avifEncoder * encoder, avifImage * image, avifIOWriter * io);
+// Image sequences (see Notes above). The frame is encoded (or queued in the codec's lookahead) before
+// avifEncoderAddImage() returns, so image may be reused or freed right after.
+avifResult avifEncoderAddImage(avifEncoder * encoder, avifImage * image, uint64_t durationInTimescales);
+avifResult avifEncoderFinish(avifEncoder * encoder, avifRWData * output);
+avifResult avifEncoderFinishToIO(avifEncoder * encoder, avifIOWriter * io);
 void avifEncoderDestroy(avifEncoder * encoder);
 
 // Helpers
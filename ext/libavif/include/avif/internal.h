@@ -13,6 +13,7 @@ extern "C" {
 // Yes, clamp macros are nasty. Do not use them.
 #define AVIF_CLAMP(x, low, high) (((x) < (low))) ? (low) : (((high) < (x)) ? (high) : (x))
 #define AVIF_MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define AVIF_MAX(a, b) (((a) > (b)) ? (a) : (b))
 
 // Used by stream related things.
 #define CHECK(A)               \
@@ -43,6 +44,32 @@ uint64_t avifNTOH64(uint64_t l);
 
 void avifCalcYUVCoefficients(avifImage * image, float * outR, float * outG, float * outB);
 
+// Seconds on a monotonic clock with an arbitrary origin; only differences between two calls are meaningful
+double avifTimeSeconds(void);
+
+// Bytes held by the given planes of image (rowBytes * plane height), whoever allocated them
+size_t avifImagePlaneBytes(const avifImage * image, uint32_t planes);
+
+// ---------------------------------------------------------------------------
+// Quality metrics (quality.c)
+
+// Running totals for the PSNR and SSIM of the YUV planes of decoded images against their sources,
+// summed over any number of image pairs (such as the cells of a grid). Start zeroed.
+typedef struct avifQuality
+{
+    uint64_t sse;
+    uint64_t samples;
+    double ssimSum[AVIF_PLANE_COUNT_YUV];
+    uint32_t ssimWindows[AVIF_PLANE_COUNT_YUV];
+    uint32_t depth;
+    int planeCount;
+} avifQuality;
+
+// a and b must match in size, depth and YUV format. Set ssim to also gather the (slower) SSIM sums.
+void avifQualityAdd(avifQuality * quality, const avifImage * a, const avifImage * b, avifBool ssim);
+double avifQualityPSNR(const avifQuality * quality); // in dB, 100 if lossless
+double avifQualitySSIM(const avifQuality * quality); // [0-1]
+
 #define AVIF_ARRAY_DECLARE(TYPENAME, ITEMSTYPE, ITEMSNAME) \
     typedef struct TYPENAME                                \
     {                                                      \
@@ -84,25 +111,45 @@ typedef struct avifAlphaParams
 avifBool avifFillAlpha(const avifAlphaParams * const params);
 avifBool avifReformatAlpha(const avifAlphaParams * const params);
 
+// ---------------------------------------------------------------------------
+// libyuv (reformat_libyuv.c)
+
+// Returns AVIF_TRUE if libyuv has a kernel for this conversion; always AVIF_FALSE without libyuv.
+avifBool avifLibYUVSupportsReformat(const avifImage * image, const avifRGBImage * rgb, const avifReformatState * state);
+
+// Both convert rows [rowStart, rowEnd) with libyuv. rowStart must be even for 4:2:0. The first
+// row of rgb->pixels holds image row rowStart. Neither touches alpha.
+avifResult avifImageRGBToYUVLibYUV(avifImage * image, avifRGBImage * rgb, uint32_t rowStart, uint32_t rowEnd);
+avifResult avifImageYUVToRGBLibYUV(avifImage * image, avifRGBImage * rgb, avifReformatState * state, uint32_t rowStart, uint32_t rowEnd);
+
 // ---------------------------------------------------------------------------
 // avifCodecDecodeInput
 
 typedef struct avifSample
 {
-    avifROData data;
-    avifBool sync; // is sync sample (keyframe)
+    avifROData data; // data.data is NULL until read if the sample is read lazily; data.size is always set
+    uint64_t offset; // offset of the sample in the input, for lazily read samples
+    avifBool sync;   // is sync sample (keyframe)
 } avifSample;
 AVIF_ARRAY_DECLARE(avifSampleArray, avifSample, sample);
 
+struct avifDecoderIO;
+
 typedef struct avifCodecDecodeInput
 {
     avifSampleArray samples;
-    avifBool alpha; // if true, this is decoding an alpha plane
+    avifBool alpha;            // if true, this is decoding an alpha plane
+    struct avifDecoderIO * io; // reads lazily read samples; owned by the avifDecoder
+    avifRWData buffer;         // holds the last sample read through a non-persistent avifIOReader
 } avifCodecDecodeInput;
 
 avifCodecDecodeInput * avifCodecDecodeInputCreate(void);
 void avifCodecDecodeInputDestroy(avifCodecDecodeInput * decodeInput);
 
+// Points data at the payload of sample sampleIndex, reading it first if needed. data stays valid
+// until the next call on this decodeInput. Codecs must fetch samples through this.
+avifBool avifCodecDecodeInputGetSampleData(avifCodecDecodeInput * decodeInput, uint32_t sampleIndex, avifROData * data);
+
 // ---------------------------------------------------------------------------
 // avifCodec (abstraction layer to use different AV1 implementations)
 
@@ -137,6 +184,25 @@ typedef avifBool (*avifCodecOpenFunc)(struct avifCodec * codec, uint32_t firstSa
 typedef avifBool (*avifCodecGetNextImageFunc)(struct avifCodec * codec, avifImage * image);
 // avifCodecEncodeImageFunc: if either OBU* is null, skip its encode. alpha should always be lossless
 typedef avifBool (*avifCodecEncodeImageFunc)(struct avifCodec * codec, avifImage * image, avifEncoder * encoder, avifRWData * obu, avifBool alpha);
+
+// One temporal unit of an encoded image sequence
+typedef struct avifEncodeSample
+{
+    avifRWData data;
+    avifBool sync; // key frame, decodable without any earlier sample
+} avifEncodeSample;
+AVIF_ARRAY_DECLARE(avifEncodeSampleArray, avifEncodeSample, sample);
+
+// Optional sequence encoding: avifCodecEncodeFrameFunc feeds one frame to an encoder context which
+// lives until avifCodecEncodeFinishFunc has flushed it, appending every sample the codec emits on the
+// way. Codecs without them get each frame encoded as an independent key frame by encodeImage.
+typedef avifBool (*avifCodecEncodeFrameFunc)(struct avifCodec * codec,
+                                             avifImage * image,
+                                             avifEncoder * encoder,
+                                             uint64_t durationInTimescales,
+                                             avifEncodeSampleArray * samples,
+                                             avifBool alpha);
+typedef avifBool (*avifCodecEncodeFinishFunc)(struct avifCodec * codec, avifEncodeSampleArray * samples);
 typedef void (*avifCodecDestroyInternalFunc)(struct avifCodec * codec);
 
 typedef struct avifCodec
@@ -144,10 +210,13 @@ typedef struct avifCodec
     avifCodecDecodeInput * decodeInput;
     avifCodecConfigurationBox configBox; // Pre-populated by avifEncoderWrite(), available and overridable by codec impls
     struct avifCodecInternal * internal; // up to each codec to use how it wants
+    int maxThreads;                      // Copied from avifDecoder before open(), or set per item by avifEncoderWrite() before encodeImage()
 
     avifCodecOpenFunc open;
     avifCodecGetNextImageFunc getNextImage;
     avifCodecEncodeImageFunc encodeImage;
+    avifCodecEncodeFrameFunc encodeFrame;   // optional
+    avifCodecEncodeFinishFunc encodeFinish; // optional, required with encodeFrame
     avifCodecDestroyInternalFunc destroyInternal;
 } avifCodec;
 
@@ -213,12 +282,42 @@ void avifRWStreamFinishWrite(avifRWStream * stream);
 void avifRWStreamWrite(avifRWStream * stream, const uint8_t * data, size_t size);
 void avifRWStreamWriteChars(avifRWStream * stream, const char * chars, size_t size);
 avifBoxMarker avifRWStreamWriteBox(avifRWStream * stream, const char * type, int version /* -1 for "not a FullBox" */, size_t contentSize);
+avifBoxMarker avifRWStreamWriteFullBox(avifRWStream * stream, const char * type, int version, uint32_t flags, size_t contentSize);
 void avifRWStreamFinishBox(avifRWStream * stream, avifBoxMarker marker);
 void avifRWStreamWriteU8(avifRWStream * stream, uint8_t v);
 void avifRWStreamWriteU16(avifRWStream * stream, uint16_t v);
 void avifRWStreamWriteU32(avifRWStream * stream, uint32_t v);
+void avifRWStreamWriteU64(avifRWStream * stream, uint64_t v);
 void avifRWStreamWriteZeros(avifRWStream * stream, size_t byteCount);
 
+// ---------------------------------------------------------------------------
+// Threads (pthreads or Win32; everything degrades to the calling thread when built with AVIF_THREADS_DISABLED)
+
+#define AVIF_MAX_WORKERS 64
+
+typedef struct avifThread avifThread;
+typedef struct avifMutex avifMutex;
+typedef struct avifCond avifCond;
+typedef void (*avifThreadFunc)(void * userData);
+
+avifThread * avifThreadCreate(avifThreadFunc func, void * userData); // Returns NULL if a thread cannot be started
+void avifThreadJoin(avifThread * thread);                             // Waits for the thread to finish and frees it
+
+// Calls func(userData) on up to workerCount threads (the calling thread being one of them) and waits for all
+// of them to return. Fewer workers may run if threads are unavailable, so func must pull its work from a
+// shared queue rather than assume a fixed split.
+void avifRunWorkers(avifThreadFunc func, void * userData, int workerCount);
+
+avifMutex * avifMutexCreate(void);
+void avifMutexDestroy(avifMutex * mutex);
+void avifMutexLock(avifMutex * mutex);
+void avifMutexUnlock(avifMutex * mutex);
+
+avifCond * avifCondCreate(void);
+void avifCondDestroy(avifCond * cond);
+void avifCondWait(avifCond * cond, avifMutex * mutex);
+void avifCondBroadcast(avifCond * cond);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
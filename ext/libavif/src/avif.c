@@ -25,6 +25,8 @@ const char * avifPixelFormatToString(avifPixelFormat format)
             return "YUV422";
         case AVIF_PIXEL_FORMAT_YV12:
             return "YV12";
+        case AVIF_PIXEL_FORMAT_YUV400:
+            return "YUV400";
         case AVIF_PIXEL_FORMAT_NONE:
         default:
             break;
@@ -61,6 +63,12 @@ void avifGetPixelFormatInfo(avifPixelFormat format, avifPixelFormatInfo * info)
             info->aomIndexV = 1;
             break;
 
+        case AVIF_PIXEL_FORMAT_YUV400:
+            info->monochrome = AVIF_TRUE;
+            info->chromaShiftX = 1;
+            info->chromaShiftY = 1;
+            break;
+
         case AVIF_PIXEL_FORMAT_NONE:
         default:
             break;
@@ -89,6 +97,9 @@ const char * avifResultToString(avifResult result)
         case AVIF_RESULT_NO_IMAGES_REMAINING:       return "No images remaining";
         case AVIF_RESULT_INVALID_EXIF_PAYLOAD:      return "Invalid Exif payload";
         case AVIF_RESULT_INVALID_IMAGE_GRID:        return "Invalid image grid";
+        case AVIF_RESULT_IO_ERROR:                  return "IO error";
+        case AVIF_RESULT_INCOMPATIBLE_IMAGE:        return "Image does not match the earlier frames";
+        case AVIF_RESULT_INVALID_REGION:            return "Region is empty, outside of the image or not chroma aligned";
         case AVIF_RESULT_UNKNOWN_ERROR:
         default:
             break;
@@ -253,13 +264,15 @@ void avifImageAllocatePlanes(avifImage * image, uint32_t planes)
             image->yuvRowBytes[AVIF_CHAN_Y] = fullRowBytes;
             image->yuvPlanes[AVIF_CHAN_Y] = avifAlloc(fullSize);
         }
-        if (!image->yuvPlanes[AVIF_CHAN_U]) {
-            image->yuvRowBytes[AVIF_CHAN_U] = uvRowBytes;
-            image->yuvPlanes[AVIF_CHAN_U] = avifAlloc(uvSize);
-        }
-        if (!image->yuvPlanes[AVIF_CHAN_V]) {
-            image->yuvRowBytes[AVIF_CHAN_V] = uvRowBytes;
-            image->yuvPlanes[AVIF_CHAN_V] = avifAlloc(uvSize);
+        if (!info.monochrome) {
+            if (!image->yuvPlanes[AVIF_CHAN_U]) {
+                image->yuvRowBytes[AVIF_CHAN_U] = uvRowBytes;
+                image->yuvPlanes[AVIF_CHAN_U] = avifAlloc(uvSize);
+            }
+            if (!image->yuvPlanes[AVIF_CHAN_V]) {
+                image->yuvRowBytes[AVIF_CHAN_V] = uvRowBytes;
+                image->yuvPlanes[AVIF_CHAN_V] = avifAlloc(uvSize);
+            }
         }
     }
     if (planes & AVIF_PLANES_A) {
@@ -270,6 +283,25 @@ void avifImageAllocatePlanes(avifImage * image, uint32_t planes)
     }
 }
 
+size_t avifImagePlaneBytes(const avifImage * image, uint32_t planes)
+{
+    size_t bytes = 0;
+    if ((planes & AVIF_PLANES_YUV) && (image->yuvFormat != AVIF_PIXEL_FORMAT_NONE)) {
+        avifPixelFormatInfo info;
+        avifGetPixelFormatInfo(image->yuvFormat, &info);
+        for (int yuvPlane = 0; yuvPlane < AVIF_PLANE_COUNT_YUV; ++yuvPlane) {
+            if (image->yuvPlanes[yuvPlane]) {
+                uint32_t planeHeight = (yuvPlane == AVIF_CHAN_Y) ? image->height : ((image->height + info.chromaShiftY) >> info.chromaShiftY);
+                bytes += (size_t)image->yuvRowBytes[yuvPlane] * planeHeight;
+            }
+        }
+    }
+    if ((planes & AVIF_PLANES_A) && image->alphaPlane) {
+        bytes += (size_t)image->alphaRowBytes * image->height;
+    }
+    return bytes;
+}
+
 void avifImageFreePlanes(avifImage * image, uint32_t planes)
 {
     if ((planes & AVIF_PLANES_YUV) && (image->yuvFormat != AVIF_PIXEL_FORMAT_NONE)) {
@@ -374,6 +406,8 @@ void avifRGBImageSetDefaults(avifRGBImage * rgb, avifImage * image)
     rgb->format = AVIF_RGB_FORMAT_RGBA;
     rgb->pixels = NULL;
     rgb->rowBytes = 0;
+    rgb->maxThreads = 1;
+    rgb->avoidLibYUV = AVIF_FALSE;
 }
 
 void avifRGBImageAllocatePixels(avifRGBImage * rgb)
@@ -27,6 +27,29 @@
 
 #include <string.h>
 
+// Everything aomCodecEncoderInit() configures the encoder from. A context is only reused for an
+// image with the same settings, anything else gets a new one.
+typedef struct aomEncoderSettings
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+    avifPixelFormat yuvFormat;
+    avifRange range;
+    avifProfileFormat profileFormat;
+    avifNclxColorProfile nclx;
+    avifBool alpha;
+    avifBool alphaIsMask;
+    avifBool sequence;
+    int minQuantizer;
+    int maxQuantizer;
+    int speed;
+    int tileRowsLog2;
+    int tileColsLog2;
+    int maxThreads;
+    uint64_t timescale;
+} aomEncoderSettings;
+
 struct avifCodecInternal
 {
     avifBool decoderInitialized;
@@ -34,6 +57,13 @@ struct avifCodecInternal
     aom_codec_iter_t iter;
     uint32_t inputSampleIndex;
     aom_image_t * image;
+
+    // One context for all frames of a sequence, or (encoder->keepCodecs) for consecutive still
+    // images with the same settings
+    avifBool encoderInitialized;
+    aomEncoderSettings encoderSettings;
+    aom_codec_ctx_t encoder;
+    aom_codec_pts_t encodePTS;
 };
 
 static void aomCodecDestroyInternal(avifCodec * codec)
@@ -41,17 +71,29 @@ static void aomCodecDestroyInternal(avifCodec * codec)
     if (codec->internal->decoderInitialized) {
         aom_codec_destroy(&codec->internal->decoder);
     }
+    if (codec->internal->encoderInitialized) {
+        aom_codec_destroy(&codec->internal->encoder);
+    }
     avifFree(codec->internal);
 }
 
 static avifBool aomCodecOpen(struct avifCodec * codec, uint32_t firstSampleIndex)
 {
     aom_codec_iface_t * decoder_interface = aom_codec_av1_dx();
-    if (aom_codec_dec_init(&codec->internal->decoder, decoder_interface, NULL, 0)) {
+    aom_codec_dec_cfg_t cfg;
+    memset(&cfg, 0, sizeof(aom_codec_dec_cfg_t));
+    cfg.threads = (codec->maxThreads > 1) ? (unsigned int)codec->maxThreads : 1;
+    cfg.allow_lowbitdepth = 1;
+    if (aom_codec_dec_init(&codec->internal->decoder, decoder_interface, &cfg, 0)) {
         return AVIF_FALSE;
     }
     codec->internal->decoderInitialized = AVIF_TRUE;
 
+    // Row-based multithreading lets libaom use all threads even on images with a single tile
+    if (aom_codec_control(&codec->internal->decoder, AV1D_SET_ROW_MT, (codec->maxThreads > 1) ? 1 : 0)) {
+        return AVIF_FALSE;
+    }
+
     if (aom_codec_control(&codec->internal->decoder, AV1D_SET_OUTPUT_ALL_LAYERS, 1)) {
         return AVIF_FALSE;
     }
@@ -71,10 +113,13 @@ static avifBool aomCodecGetNextImage(avifCodec * codec, avifImage * image)
             break;
         } else if (codec->internal->inputSampleIndex < codec->decodeInput->samples.count) {
             // Feed another sample
-            avifSample * sample = &codec->decodeInput->samples.sample[codec->internal->inputSampleIndex];
+            avifROData sampleData;
+            if (!avifCodecDecodeInputGetSampleData(codec->decodeInput, codec->internal->inputSampleIndex, &sampleData)) {
+                return AVIF_FALSE;
+            }
             ++codec->internal->inputSampleIndex;
             codec->internal->iter = NULL;
-            if (aom_codec_decode(&codec->internal->decoder, sample->data.data, sample->data.size, NULL)) {
+            if (aom_codec_decode(&codec->internal->decoder, sampleData.data, sampleData.size, NULL)) {
                 return AVIF_FALSE;
             }
         } else {
@@ -121,6 +166,9 @@ static avifBool aomCodecGetNextImage(avifCodec * codec, avifImage * image)
             default:
                 break;
         }
+        if (codec->internal->image->monochrome) {
+            yuvFormat = AVIF_PIXEL_FORMAT_YUV400;
+        }
 
         if (image->width && image->height) {
             if ((image->width != codec->internal->image->d_w) || (image->height != codec->internal->image->d_h) ||
@@ -151,7 +199,8 @@ static avifBool aomCodecGetNextImage(avifCodec * codec, avifImage * image)
 
         // Steal the pointers from the decoder's image directly
         avifImageFreePlanes(image, AVIF_PLANES_YUV);
-        for (int yuvPlane = 0; yuvPlane < 3; ++yuvPlane) {
+        int yuvPlaneCount = formatInfo.monochrome ? 1 : 3;
+        for (int yuvPlane = 0; yuvPlane < yuvPlaneCount; ++yuvPlane) {
             int aomPlaneIndex = yuvPlane;
             if (yuvPlane == AVIF_CHAN_U) {
                 aomPlaneIndex = formatInfo.aomIndexU;
@@ -186,15 +235,12 @@ static avifBool aomCodecGetNextImage(avifCodec * codec, avifImage * image)
     return AVIF_TRUE;
 }
 
-static aom_img_fmt_t avifImageCalcAOMFmt(avifImage * image, avifBool alpha, int * yShift)
+static aom_img_fmt_t avifImageCalcAOMFmt(avifImage * image, avifBool alpha)
 {
-    *yShift = 0;
-
     aom_img_fmt_t fmt;
     if (alpha) {
         // We're going monochrome, who cares about chroma quality
         fmt = AOM_IMG_FMT_I420;
-        *yShift = 1;
     } else {
         switch (image->yuvFormat) {
             case AVIF_PIXEL_FORMAT_YUV444:
@@ -205,11 +251,12 @@ static aom_img_fmt_t avifImageCalcAOMFmt(avifImage * image, avifBool alpha, int
                 break;
             case AVIF_PIXEL_FORMAT_YUV420:
                 fmt = AOM_IMG_FMT_I420;
-                *yShift = 1;
                 break;
             case AVIF_PIXEL_FORMAT_YV12:
                 fmt = AOM_IMG_FMT_YV12;
-                *yShift = 1;
+                break;
+            case AVIF_PIXEL_FORMAT_YUV400:
+                fmt = AOM_IMG_FMT_I420;
                 break;
             case AVIF_PIXEL_FORMAT_NONE:
             default:
@@ -224,12 +271,44 @@ static aom_img_fmt_t avifImageCalcAOMFmt(avifImage * image, avifBool alpha, int
     return fmt;
 }
 
-static avifBool aomCodecEncodeImage(avifCodec * codec, avifImage * image, avifEncoder * encoder, avifRWData * obu, avifBool alpha)
+// Returns AVIF_TRUE if at most 1/8th of the alpha plane is neither fully transparent nor fully
+// opaque, which is what cut-outs (even anti-aliased ones) and masks look like.
+static avifBool avifAlphaIsMask(avifImage * image)
 {
-    avifBool success = AVIF_FALSE;
-    aom_codec_iface_t * encoder_interface = aom_codec_av1_cx();
-    aom_codec_ctx_t aomEncoder;
+    uint32_t maxChannel = (1 << image->depth) - 1;
+    uint64_t maxPartial = ((uint64_t)image->width * image->height) / 8;
+    uint64_t partial = 0;
+    for (uint32_t j = 0; j < image->height; ++j) {
+        const uint8_t * row = &image->alphaPlane[j * image->alphaRowBytes];
+        if (avifImageUsesU16(image)) {
+            const uint16_t * row16 = (const uint16_t *)row;
+            for (uint32_t i = 0; i < image->width; ++i) {
+                partial += (row16[i] != 0) && (row16[i] != maxChannel);
+            }
+        } else {
+            for (uint32_t i = 0; i < image->width; ++i) {
+                partial += (row[i] != 0) && (row[i] != maxChannel);
+            }
+        }
+        if (partial > maxPartial) {
+            return AVIF_FALSE;
+        }
+    }
+    return AVIF_TRUE;
+}
 
+// Configures aomEncoder for image (or its alpha plane) from settings, which aomCodecEncoderSettingsInit()
+// derived from the same image. Sequences use constant quality rate control and encoder->timescale
+// as timebase, so frame durations don't skew the quality.
+static avifBool aomCodecEncoderInit(avifCodec * codec,
+                                    aom_codec_ctx_t * aomEncoder,
+                                    avifImage * image,
+                                    avifEncoder * encoder,
+                                    const aomEncoderSettings * settings)
+{
+    const avifBool alpha = settings->alpha;
+    const avifBool sequence = settings->sequence;
+    aom_codec_iface_t * encoder_interface = aom_codec_av1_cx();
     // Map encoder speed to AOM usage + CpuUsed:
     // Speed  0: GoodQuality CpuUsed 0
     // Speed  1: GoodQuality CpuUsed 1
@@ -274,14 +353,20 @@ static avifBool aomCodecEncodeImage(avifCodec * codec, avifImage * image, avifEn
         }
     }
 
-    int yShift = 0;
-    aom_img_fmt_t aomFormat = avifImageCalcAOMFmt(image, alpha, &yShift);
-    if (aomFormat == AOM_IMG_FMT_NONE) {
+    if (avifImageCalcAOMFmt(image, alpha) == AOM_IMG_FMT_NONE) {
         return AVIF_FALSE;
     }
 
     avifPixelFormatInfo formatInfo;
     avifGetPixelFormatInfo(image->yuvFormat, &formatInfo);
+    const avifBool monochrome = alpha || formatInfo.monochrome;
+
+    if (sequence && monochrome && (aomUsage == AOM_USAGE_REALTIME)) {
+        // libaom's realtime partitioning compares the chroma planes of inter frames even when the
+        // stream is monochrome (so the source has none), and crashes. Monochrome sequences (such
+        // as alpha tracks) keep the same cpu-used, with the good quality usage.
+        aomUsage = AOM_USAGE_GOOD_QUALITY;
+    }
 
     struct aom_codec_enc_cfg cfg;
     aom_codec_enc_config_default(encoder_interface, &cfg, aomUsage);
@@ -291,8 +376,12 @@ static avifBool aomCodecEncodeImage(avifCodec * codec, avifImage * image, avifEn
     cfg.g_input_bit_depth = image->depth;
     cfg.g_w = image->width;
     cfg.g_h = image->height;
-    if (encoder->maxThreads > 1) {
-        cfg.g_threads = encoder->maxThreads;
+    if (monochrome) {
+        // Alpha and YUV400 are true monochrome streams: no chroma planes are allocated, copied or coded for them
+        cfg.monochrome = 1;
+    }
+    if (codec->maxThreads > 1) {
+        cfg.g_threads = codec->maxThreads;
     }
 
     int minQuantizer = AVIF_CLAMP(encoder->minQuantizer, 0, 63);
@@ -304,89 +393,201 @@ static avifBool aomCodecEncodeImage(avifCodec * codec, avifImage * image, avifEn
     avifBool lossless = ((minQuantizer == AVIF_QUANTIZER_LOSSLESS) && (maxQuantizer == AVIF_QUANTIZER_LOSSLESS));
     cfg.rc_min_quantizer = minQuantizer;
     cfg.rc_max_quantizer = maxQuantizer;
+    if (sequence) {
+        cfg.g_timebase.num = 1;
+        cfg.g_timebase.den = (int)AVIF_CLAMP(encoder->timescale, 1, INT32_MAX);
+        cfg.rc_end_usage = AOM_Q;
+    }
 
     aom_codec_flags_t encoderFlags = 0;
     if (image->depth > 8) {
         encoderFlags |= AOM_CODEC_USE_HIGHBITDEPTH;
     }
-    aom_codec_enc_init(&aomEncoder, encoder_interface, &cfg, encoderFlags);
+    if (aom_codec_enc_init(aomEncoder, encoder_interface, &cfg, encoderFlags) != AOM_CODEC_OK) {
+        return AVIF_FALSE;
+    }
 
     if (lossless) {
-        aom_codec_control(&aomEncoder, AV1E_SET_LOSSLESS, 1);
+        aom_codec_control(aomEncoder, AV1E_SET_LOSSLESS, 1);
+    } else if (sequence) {
+        aom_codec_control(aomEncoder, AOME_SET_CQ_LEVEL, (minQuantizer + maxQuantizer) / 2);
     }
-    if (encoder->maxThreads > 1) {
-        aom_codec_control(&aomEncoder, AV1E_SET_ROW_MT, 1);
+    if (codec->maxThreads > 1) {
+        aom_codec_control(aomEncoder, AV1E_SET_ROW_MT, 1);
     }
     if (encoder->tileRowsLog2 != 0) {
         int tileRowsLog2 = AVIF_CLAMP(encoder->tileRowsLog2, 0, 6);
-        aom_codec_control(&aomEncoder, AV1E_SET_TILE_ROWS, tileRowsLog2);
+        aom_codec_control(aomEncoder, AV1E_SET_TILE_ROWS, tileRowsLog2);
     }
     if (encoder->tileColsLog2 != 0) {
         int tileColsLog2 = AVIF_CLAMP(encoder->tileColsLog2, 0, 6);
-        aom_codec_control(&aomEncoder, AV1E_SET_TILE_COLUMNS, tileColsLog2);
+        aom_codec_control(aomEncoder, AV1E_SET_TILE_COLUMNS, tileColsLog2);
     }
     if (aomCpuUsed != -1) {
-        aom_codec_control(&aomEncoder, AOME_SET_CPUUSED, aomCpuUsed);
+        aom_codec_control(aomEncoder, AOME_SET_CPUUSED, aomCpuUsed);
     }
 
-    uint32_t uvHeight = (image->height + yShift) >> yShift;
-    aom_image_t * aomImage = aom_img_alloc(NULL, aomFormat, image->width, image->height, 16);
-
     if (alpha) {
-        aomImage->range = (image->alphaRange == AVIF_RANGE_FULL) ? AOM_CR_FULL_RANGE : AOM_CR_STUDIO_RANGE;
-        aom_codec_control(&aomEncoder, AV1E_SET_COLOR_RANGE, aomImage->range);
-        aomImage->monochrome = 1;
-        for (uint32_t j = 0; j < image->height; ++j) {
-            uint8_t * srcAlphaRow = &image->alphaPlane[j * image->alphaRowBytes];
-            uint8_t * dstAlphaRow = &aomImage->planes[0][j * aomImage->stride[0]];
-            memcpy(dstAlphaRow, srcAlphaRow, image->alphaRowBytes);
+        aom_codec_control(aomEncoder, AV1E_SET_COLOR_RANGE, (image->alphaRange == AVIF_RANGE_FULL) ? AOM_CR_FULL_RANGE : AOM_CR_STUDIO_RANGE);
+
+        if (settings->alphaIsMask) {
+            // Cut-outs and masks are flat areas with hard edges: force the screen content tools
+            // (palette, IntraBC) on, and skip the partition and transform searches that only pay
+            // off on natural content.
+            aom_codec_control(aomEncoder, AV1E_SET_TUNE_CONTENT, AOM_CONTENT_SCREEN);
+            aom_codec_control(aomEncoder, AV1E_SET_ENABLE_PALETTE, 1);
+            aom_codec_control(aomEncoder, AV1E_SET_ENABLE_INTRABC, 1);
+            aom_codec_control(aomEncoder, AV1E_SET_ENABLE_RECT_PARTITIONS, 0);
+            aom_codec_control(aomEncoder, AV1E_SET_ENABLE_AB_PARTITIONS, 0);
+            aom_codec_control(aomEncoder, AV1E_SET_ENABLE_1TO4_PARTITIONS, 0);
+            aom_codec_control(aomEncoder, AV1E_SET_ENABLE_TX64, 0);
         }
-
-        // Zero out U and V
-        memset(aomImage->planes[1], 0, aomImage->stride[1] * uvHeight);
-        memset(aomImage->planes[2], 0, aomImage->stride[2] * uvHeight);
     } else {
-        aomImage->range = (image->yuvRange == AVIF_RANGE_FULL) ? AOM_CR_FULL_RANGE : AOM_CR_STUDIO_RANGE;
-        aom_codec_control(&aomEncoder, AV1E_SET_COLOR_RANGE, aomImage->range);
-        for (int yuvPlane = 0; yuvPlane < 3; ++yuvPlane) {
-            int aomPlaneIndex = yuvPlane;
-            int planeHeight = image->height;
-            if (yuvPlane == AVIF_CHAN_U) {
-                aomPlaneIndex = formatInfo.aomIndexU;
-                planeHeight = uvHeight;
-            } else if (yuvPlane == AVIF_CHAN_V) {
-                aomPlaneIndex = formatInfo.aomIndexV;
-                planeHeight = uvHeight;
-            }
+        aom_codec_control(aomEncoder, AV1E_SET_COLOR_RANGE, (image->yuvRange == AVIF_RANGE_FULL) ? AOM_CR_FULL_RANGE : AOM_CR_STUDIO_RANGE);
 
-            for (int j = 0; j < planeHeight; ++j) {
-                uint8_t * srcRow = &image->yuvPlanes[yuvPlane][j * image->yuvRowBytes[yuvPlane]];
-                uint8_t * dstRow = &aomImage->planes[aomPlaneIndex][j * aomImage->stride[aomPlaneIndex]];
-                memcpy(dstRow, srcRow, image->yuvRowBytes[yuvPlane]);
-            }
+        if (image->profileFormat == AVIF_PROFILE_FORMAT_NCLX) {
+            aom_codec_control(aomEncoder, AV1E_SET_COLOR_PRIMARIES, (aom_color_primaries_t)image->nclx.colourPrimaries);
+            aom_codec_control(aomEncoder, AV1E_SET_TRANSFER_CHARACTERISTICS, (aom_transfer_characteristics_t)image->nclx.transferCharacteristics);
+            aom_codec_control(aomEncoder, AV1E_SET_MATRIX_COEFFICIENTS, (aom_matrix_coefficients_t)image->nclx.matrixCoefficients);
         }
+    }
+    return AVIF_TRUE;
+}
+
+// libaom copies the source into its own lookahead buffers, so the encoder reads the avif planes
+// in place through a wrapped image instead of a separately allocated and copied aom_image_t.
+// Only the plane pointers and strides are taken from the avifImage; the rows may be a view into
+// a wider image (grid cells).
+static void aomCodecWrapImage(aom_image_t * aomImage, avifImage * image, avifBool alpha)
+{
+    avifPixelFormatInfo formatInfo;
+    avifGetPixelFormatInfo(image->yuvFormat, &formatInfo);
+    const avifBool monochrome = alpha || formatInfo.monochrome;
+
+    uint8_t * planeY = alpha ? image->alphaPlane : image->yuvPlanes[AVIF_CHAN_Y];
+    aom_img_wrap(aomImage, avifImageCalcAOMFmt(image, alpha), image->width, image->height, 1, planeY);
+    aomImage->planes[AOM_PLANE_Y] = planeY;
+    aomImage->stride[AOM_PLANE_Y] = alpha ? image->alphaRowBytes : image->yuvRowBytes[AVIF_CHAN_Y];
+    if (monochrome) {
+        // libaom reads only the Y plane of a monochrome image
+        aomImage->planes[AOM_PLANE_U] = NULL;
+        aomImage->planes[AOM_PLANE_V] = NULL;
+        aomImage->stride[AOM_PLANE_U] = 0;
+        aomImage->stride[AOM_PLANE_V] = 0;
+        aomImage->monochrome = 1;
+    } else {
+        aomImage->planes[formatInfo.aomIndexU] = image->yuvPlanes[AVIF_CHAN_U];
+        aomImage->planes[formatInfo.aomIndexV] = image->yuvPlanes[AVIF_CHAN_V];
+        aomImage->stride[formatInfo.aomIndexU] = image->yuvRowBytes[AVIF_CHAN_U];
+        aomImage->stride[formatInfo.aomIndexV] = image->yuvRowBytes[AVIF_CHAN_V];
+    }
 
+    if (alpha) {
+        aomImage->range = (image->alphaRange == AVIF_RANGE_FULL) ? AOM_CR_FULL_RANGE : AOM_CR_STUDIO_RANGE;
+    } else {
+        aomImage->range = (image->yuvRange == AVIF_RANGE_FULL) ? AOM_CR_FULL_RANGE : AOM_CR_STUDIO_RANGE;
         if (image->profileFormat == AVIF_PROFILE_FORMAT_NCLX) {
             aomImage->cp = (aom_color_primaries_t)image->nclx.colourPrimaries;
             aomImage->tc = (aom_transfer_characteristics_t)image->nclx.transferCharacteristics;
             aomImage->mc = (aom_matrix_coefficients_t)image->nclx.matrixCoefficients;
-            aom_codec_control(&aomEncoder, AV1E_SET_COLOR_PRIMARIES, aomImage->cp);
-            aom_codec_control(&aomEncoder, AV1E_SET_TRANSFER_CHARACTERISTICS, aomImage->tc);
-            aom_codec_control(&aomEncoder, AV1E_SET_MATRIX_COEFFICIENTS, aomImage->mc);
         }
     }
+}
 
-    aom_codec_encode(&aomEncoder, aomImage, 0, 1, 0);
+static void aomCodecEncoderSettingsInit(aomEncoderSettings * settings,
+                                        avifCodec * codec,
+                                        avifImage * image,
+                                        avifEncoder * encoder,
+                                        avifBool alpha,
+                                        avifBool sequence)
+{
+    memset(settings, 0, sizeof(aomEncoderSettings)); // compared with memcmp()
+    settings->width = image->width;
+    settings->height = image->height;
+    settings->depth = image->depth;
+    settings->yuvFormat = image->yuvFormat;
+    settings->alpha = alpha;
+    if (alpha) {
+        settings->range = image->alphaRange;
+        settings->alphaIsMask = avifAlphaIsMask(image);
+        settings->minQuantizer = encoder->minQuantizerAlpha;
+        settings->maxQuantizer = encoder->maxQuantizerAlpha;
+    } else {
+        settings->range = image->yuvRange;
+        settings->profileFormat = image->profileFormat;
+        if (image->profileFormat == AVIF_PROFILE_FORMAT_NCLX) {
+            settings->nclx = image->nclx;
+        }
+        settings->minQuantizer = encoder->minQuantizer;
+        settings->maxQuantizer = encoder->maxQuantizer;
+    }
+    settings->sequence = sequence;
+    settings->speed = encoder->speed;
+    settings->tileRowsLog2 = encoder->tileRowsLog2;
+    settings->tileColsLog2 = encoder->tileColsLog2;
+    settings->maxThreads = codec->maxThreads;
+    settings->timescale = sequence ? encoder->timescale : 0;
+}
+
+// Makes sure codec->internal->encoder is set up for image, keeping the current context if it was
+// set up with the same settings
+static avifBool aomCodecEncoderPrepare(avifCodec * codec, avifImage * image, avifEncoder * encoder, avifBool alpha, avifBool sequence)
+{
+    aomEncoderSettings settings;
+    aomCodecEncoderSettingsInit(&settings, codec, image, encoder, alpha, sequence);
+    if (codec->internal->encoderInitialized) {
+        if (!memcmp(&settings, &codec->internal->encoderSettings, sizeof(aomEncoderSettings))) {
+            return AVIF_TRUE;
+        }
+        aom_codec_destroy(&codec->internal->encoder);
+        codec->internal->encoderInitialized = AVIF_FALSE;
+    }
+
+    if (!aomCodecEncoderInit(codec, &codec->internal->encoder, image, encoder, &settings)) {
+        return AVIF_FALSE;
+    }
+    codec->internal->encoderInitialized = AVIF_TRUE;
+    codec->internal->encoderSettings = settings;
+    codec->internal->encodePTS = 0;
+    return AVIF_TRUE;
+}
 
+static void aomCodecEncoderDestroy(avifCodec * codec)
+{
+    if (codec->internal->encoderInitialized) {
+        aom_codec_destroy(&codec->internal->encoder);
+        codec->internal->encoderInitialized = AVIF_FALSE;
+    }
+}
+
+static avifBool aomCodecEncodeImage(avifCodec * codec, avifImage * image, avifEncoder * encoder, avifRWData * obu, avifBool alpha)
+{
+    if (!aomCodecEncoderPrepare(codec, image, encoder, alpha, AVIF_FALSE)) {
+        return AVIF_FALSE;
+    }
+    aom_codec_ctx_t * aomEncoder = &codec->internal->encoder;
+
+    // Every still image is a key frame of its own, even in a reused context
+    aom_image_t aomImage;
+    aomCodecWrapImage(&aomImage, image, alpha);
+    if (aom_codec_encode(aomEncoder, &aomImage, codec->internal->encodePTS, 1, AOM_EFLAG_FORCE_KF) != AOM_CODEC_OK) {
+        aomCodecEncoderDestroy(codec);
+        return AVIF_FALSE;
+    }
+    ++codec->internal->encodePTS;
+
+    avifBool success = AVIF_FALSE;
     avifBool flushed = AVIF_FALSE;
     aom_codec_iter_t iter = NULL;
     for (;;) {
-        const aom_codec_cx_pkt_t * pkt = aom_codec_get_cx_data(&aomEncoder, &iter);
+        const aom_codec_cx_pkt_t * pkt = aom_codec_get_cx_data(aomEncoder, &iter);
         if (pkt == NULL) {
             if (flushed)
                 break;
 
-            aom_codec_encode(&aomEncoder, NULL, 0, 1, 0); // flush
+            if (aom_codec_encode(aomEncoder, NULL, 0, 1, 0) != AOM_CODEC_OK) { // flush
+                break;
+            }
             flushed = AVIF_TRUE;
             continue;
         }
@@ -397,8 +598,77 @@ static avifBool aomCodecEncodeImage(avifCodec * codec, avifImage * image, avifEn
         }
     }
 
-    aom_img_free(aomImage);
-    aom_codec_destroy(&aomEncoder);
+    if (!success || !encoder->keepCodecs) {
+        aomCodecEncoderDestroy(codec);
+    }
+    return success;
+}
+
+// Moves every finished temporal unit out of the sequence encoder, returns AVIF_TRUE if there was any
+static avifBool aomCodecCollectSamples(avifCodec * codec, avifEncodeSampleArray * samples)
+{
+    avifBool collected = AVIF_FALSE;
+    aom_codec_iter_t iter = NULL;
+    for (;;) {
+        const aom_codec_cx_pkt_t * pkt = aom_codec_get_cx_data(&codec->internal->encoder, &iter);
+        if (pkt == NULL) {
+            break;
+        }
+        if (pkt->kind == AOM_CODEC_CX_FRAME_PKT) {
+            avifEncodeSample * sample = (avifEncodeSample *)avifArrayPushPtr(samples);
+            avifRWDataSet(&sample->data, pkt->data.frame.buf, pkt->data.frame.sz);
+            sample->sync = (pkt->data.frame.flags & AOM_FRAME_IS_KEY) ? AVIF_TRUE : AVIF_FALSE;
+            collected = AVIF_TRUE;
+        }
+    }
+    return collected;
+}
+
+static avifBool aomCodecEncodeFrame(avifCodec * codec,
+                                    avifImage * image,
+                                    avifEncoder * encoder,
+                                    uint64_t durationInTimescales,
+                                    avifEncodeSampleArray * samples,
+                                    avifBool alpha)
+{
+    // The first frame of a sequence always gets a new context: sequence codecs are never reused
+    // after their sequence, and a context left by still images has other settings. Later frames
+    // continue the stream whatever their content.
+    if (!codec->internal->encoderInitialized || !codec->internal->encoderSettings.sequence) {
+        if (!aomCodecEncoderPrepare(codec, image, encoder, alpha, AVIF_TRUE)) {
+            return AVIF_FALSE;
+        }
+    }
+
+    aom_image_t aomImage;
+    aomCodecWrapImage(&aomImage, image, alpha);
+    if (aom_codec_encode(&codec->internal->encoder, &aomImage, codec->internal->encodePTS, (unsigned long)durationInTimescales, 0) !=
+        AOM_CODEC_OK) {
+        return AVIF_FALSE;
+    }
+    codec->internal->encodePTS += (aom_codec_pts_t)durationInTimescales;
+    aomCodecCollectSamples(codec, samples);
+    return AVIF_TRUE;
+}
+
+static avifBool aomCodecEncodeFinish(avifCodec * codec, avifEncodeSampleArray * samples)
+{
+    if (!codec->internal->encoderInitialized) {
+        return AVIF_TRUE;
+    }
+    // libaom hands out the frames held back for lookahead one flush call at a time
+    avifBool success = AVIF_TRUE;
+    for (;;) {
+        if (aom_codec_encode(&codec->internal->encoder, NULL, 0, 1, 0) != AOM_CODEC_OK) {
+            success = AVIF_FALSE;
+            break;
+        }
+        if (!aomCodecCollectSamples(codec, samples)) {
+            break;
+        }
+    }
+    // A flushed stream can't be continued
+    aomCodecEncoderDestroy(codec);
     return success;
 }
 
@@ -414,6 +684,8 @@ avifCodec * avifCodecCreateAOM(void)
     codec->open = aomCodecOpen;
     codec->getNextImage = aomCodecGetNextImage;
     codec->encodeImage = aomCodecEncodeImage;
+    codec->encodeFrame = aomCodecEncodeFrame;
+    codec->encodeFinish = aomCodecEncodeFinish;
     codec->destroyInternal = aomCodecDestroyInternal;
 
     codec->internal = (struct avifCodecInternal *)avifAlloc(sizeof(struct avifCodecInternal));
@@ -45,12 +45,15 @@ static avifBool dav1dFeedData(avifCodec * codec)
 {
     if (!codec->internal->dav1dData.sz) {
         if (codec->internal->inputSampleIndex < codec->decodeInput->samples.count) {
-            avifSample * sample = &codec->decodeInput->samples.sample[codec->internal->inputSampleIndex];
+            avifROData sampleData;
+            if (!avifCodecDecodeInputGetSampleData(codec->decodeInput, codec->internal->inputSampleIndex, &sampleData)) {
+                return AVIF_FALSE;
+            }
             ++codec->internal->inputSampleIndex;
 
             // OPTIMIZE: Carefully switch this to use dav1d_data_wrap or dav1d_data_wrap_user_data
-            uint8_t * dav1dDataPtr = dav1d_data_create(&codec->internal->dav1dData, sample->data.size);
-            memcpy(dav1dDataPtr, sample->data.data, sample->data.size);
+            uint8_t * dav1dDataPtr = dav1d_data_create(&codec->internal->dav1dData, sampleData.size);
+            memcpy(dav1dDataPtr, sampleData.data, sampleData.size);
         } else {
             // No more data
             return AVIF_FALSE;
@@ -67,6 +70,10 @@ static avifBool dav1dFeedData(avifCodec * codec)
 static avifBool dav1dCodecOpen(avifCodec * codec, uint32_t firstSampleIndex)
 {
     if (codec->internal->dav1dContext == NULL) {
+        // Give all available threads to decode a single frame as fast as possible
+        codec->internal->dav1dSettings.n_frame_threads = 1;
+        codec->internal->dav1dSettings.n_tile_threads = AVIF_CLAMP(codec->maxThreads, 1, DAV1D_MAX_TILE_THREADS);
+
         if (dav1d_open(&codec->internal->dav1dContext, &codec->internal->dav1dSettings) != 0) {
             return AVIF_FALSE;
         }
@@ -119,6 +126,8 @@ static avifBool dav1dCodecGetNextImage(avifCodec * codec, avifImage * image)
         avifPixelFormat yuvFormat = AVIF_PIXEL_FORMAT_NONE;
         switch (dav1dImage->p.layout) {
             case DAV1D_PIXEL_LAYOUT_I400:
+                yuvFormat = AVIF_PIXEL_FORMAT_YUV400;
+                break;
             case DAV1D_PIXEL_LAYOUT_I420:
                 yuvFormat = AVIF_PIXEL_FORMAT_YUV420;
                 break;
@@ -158,7 +167,8 @@ static avifBool dav1dCodecGetNextImage(avifCodec * codec, avifImage * image)
         avifGetPixelFormatInfo(yuvFormat, &formatInfo);
 
         avifImageFreePlanes(image, AVIF_PLANES_YUV);
-        for (int yuvPlane = 0; yuvPlane < 3; ++yuvPlane) {
+        int yuvPlaneCount = formatInfo.monochrome ? 1 : 3;
+        for (int yuvPlane = 0; yuvPlane < yuvPlaneCount; ++yuvPlane) {
             image->yuvPlanes[yuvPlane] = dav1dImage->data[yuvPlane];
             image->yuvRowBytes[yuvPlane] = (uint32_t)dav1dImage->stride[(yuvPlane == AVIF_CHAN_Y) ? 0 : 1];
         }
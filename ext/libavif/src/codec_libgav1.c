@@ -27,6 +27,8 @@ static void gav1CodecDestroyInternal(avifCodec * codec)
 static avifBool gav1CodecOpen(avifCodec * codec, uint32_t firstSampleIndex)
 {
     if (codec->internal->gav1Decoder == NULL) {
+        codec->internal->gav1Settings.threads = AVIF_CLAMP(codec->maxThreads, 1, 64);
+
         if (Libgav1DecoderCreate(&codec->internal->gav1Settings, &codec->internal->gav1Decoder) != kLibgav1StatusOk) {
             return AVIF_FALSE;
         }
@@ -42,11 +44,14 @@ static avifBool gav1CodecGetNextImage(avifCodec * codec, avifImage * image)
     // Check if there are more samples to feed
     if (codec->internal->inputSampleIndex < codec->decodeInput->samples.count) {
         // Feed another sample
-        avifSample * sample = &codec->decodeInput->samples.sample[codec->internal->inputSampleIndex];
+        avifROData sampleData;
+        if (!avifCodecDecodeInputGetSampleData(codec->decodeInput, codec->internal->inputSampleIndex, &sampleData)) {
+            return AVIF_FALSE;
+        }
         ++codec->internal->inputSampleIndex;
         if (Libgav1DecoderEnqueueFrame(codec->internal->gav1Decoder,
-                                       sample->data.data,
-                                       sample->data.size,
+                                       sampleData.data,
+                                       sampleData.size,
                                        /*user_private_data=*/0,
                                        /*buffer_private_data=*/NULL) != kLibgav1StatusOk) {
             return AVIF_FALSE;
@@ -80,6 +85,8 @@ static avifBool gav1CodecGetNextImage(avifCodec * codec, avifImage * image)
         avifPixelFormat yuvFormat = AVIF_PIXEL_FORMAT_NONE;
         switch (gav1Image->image_format) {
             case kLibgav1ImageFormatMonochrome400:
+                yuvFormat = AVIF_PIXEL_FORMAT_YUV400;
+                break;
             case kLibgav1ImageFormatYuv420:
                 yuvFormat = AVIF_PIXEL_FORMAT_YUV420;
                 break;
@@ -121,7 +128,8 @@ static avifBool gav1CodecGetNextImage(avifCodec * codec, avifImage * image)
 
         // Steal the pointers from the decoder's image directly
         avifImageFreePlanes(image, AVIF_PLANES_YUV);
-        for (int yuvPlane = 0; yuvPlane < 3; ++yuvPlane) {
+        int yuvPlaneCount = formatInfo.monochrome ? 1 : 3;
+        for (int yuvPlane = 0; yuvPlane < yuvPlaneCount; ++yuvPlane) {
             image->yuvPlanes[yuvPlane] = gav1Image->plane[yuvPlane];
             image->yuvRowBytes[yuvPlane] = gav1Image->stride[yuvPlane];
         }
@@ -166,8 +174,5 @@ avifCodec * avifCodecCreateGav1(void)
     codec->internal = (struct avifCodecInternal *)avifAlloc(sizeof(struct avifCodecInternal));
     memset(codec->internal, 0, sizeof(struct avifCodecInternal));
     Libgav1DecoderSettingsInitDefault(&codec->internal->gav1Settings);
-    // The number of threads (default to 1) should depend on the number of
-    // processor cores. For now use a hardcoded value of 2.
-    codec->internal->gav1Settings.threads = 2;
     return codec;
 }
@@ -55,6 +55,7 @@ static avifBool rav1eCodecEncodeImage(avifCodec * codec, avifImage * image, avif
                 yShift = 1;
                 break;
             case AVIF_PIXEL_FORMAT_YV12:
+            case AVIF_PIXEL_FORMAT_YUV400: // see the RA_CHROMA_SAMPLING_CS400 note above
             case AVIF_PIXEL_FORMAT_NONE:
             default:
                 return AVIF_FALSE;
@@ -76,7 +77,7 @@ static avifBool rav1eCodecEncodeImage(avifCodec * codec, avifImage * image, avif
     if (rav1e_config_parse_int(rav1eConfig, "height", image->height) == -1) {
         goto cleanup;
     }
-    if (rav1e_config_parse_int(rav1eConfig, "threads", encoder->maxThreads) == -1) {
+    if (rav1e_config_parse_int(rav1eConfig, "threads", codec->maxThreads) == -1) {
         goto cleanup;
     }
 
@@ -0,0 +1,157 @@
+// Copyright 2020 Joe Drago. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "avif/internal.h"
+
+#include <math.h>
+#include <string.h>
+
+// Same formulas as libaom's aom_dsp/psnr.c and aom_dsp/ssim.c, which avifEncoder can't call: they
+// aren't part of libaom's API, and libavif may be built without it.
+
+#define AVIF_MAX_PSNR 100.0
+
+typedef struct avifQualityPlane
+{
+    const uint8_t * a;
+    const uint8_t * b;
+    uint32_t aRowBytes;
+    uint32_t bRowBytes;
+    uint32_t width;
+    uint32_t height;
+} avifQualityPlane;
+
+// Fills planes with the Y (and unless monochrome, U and V) planes of a and b, returns how many there are
+static int avifQualityPlanes(const avifImage * a, const avifImage * b, avifQualityPlane planes[AVIF_PLANE_COUNT_YUV])
+{
+    avifPixelFormatInfo formatInfo;
+    avifGetPixelFormatInfo(a->yuvFormat, &formatInfo);
+    const int planeCount = formatInfo.monochrome ? 1 : AVIF_PLANE_COUNT_YUV;
+    for (int yuvPlane = 0; yuvPlane < planeCount; ++yuvPlane) {
+        const uint32_t shiftX = (yuvPlane == AVIF_CHAN_Y) ? 0 : formatInfo.chromaShiftX;
+        const uint32_t shiftY = (yuvPlane == AVIF_CHAN_Y) ? 0 : formatInfo.chromaShiftY;
+        planes[yuvPlane].a = a->yuvPlanes[yuvPlane];
+        planes[yuvPlane].b = b->yuvPlanes[yuvPlane];
+        planes[yuvPlane].aRowBytes = a->yuvRowBytes[yuvPlane];
+        planes[yuvPlane].bRowBytes = b->yuvRowBytes[yuvPlane];
+        planes[yuvPlane].width = (a->width + shiftX) >> shiftX;
+        planes[yuvPlane].height = (a->height + shiftY) >> shiftY;
+    }
+    return planeCount;
+}
+
+static uint32_t avifQualitySample(const uint8_t * row, uint32_t i, avifBool usesU16)
+{
+    return usesU16 ? ((const uint16_t *)row)[i] : row[i];
+}
+
+// SSIM of one window of a plane, starting at (x, y)
+static double avifQualityWindowSSIM(const avifQualityPlane * plane, uint32_t x, uint32_t y, uint32_t width, uint32_t height, avifBool usesU16, double c1, double c2)
+{
+    double sumA = 0.0, sumB = 0.0, sumSqA = 0.0, sumSqB = 0.0, sumAB = 0.0;
+    for (uint32_t j = y; j < (y + height); ++j) {
+        const uint8_t * aRow = &plane->a[j * plane->aRowBytes];
+        const uint8_t * bRow = &plane->b[j * plane->bRowBytes];
+        for (uint32_t i = x; i < (x + width); ++i) {
+            const double sampleA = (double)avifQualitySample(aRow, i, usesU16);
+            const double sampleB = (double)avifQualitySample(bRow, i, usesU16);
+            sumA += sampleA;
+            sumB += sampleB;
+            sumSqA += sampleA * sampleA;
+            sumSqB += sampleB * sampleB;
+            sumAB += sampleA * sampleB;
+        }
+    }
+
+    const double count = (double)width * height;
+    const double meanA = sumA / count;
+    const double meanB = sumB / count;
+    const double varianceA = sumSqA / count - meanA * meanA;
+    const double varianceB = sumSqB / count - meanB * meanB;
+    const double covariance = sumAB / count - meanA * meanB;
+    return ((2.0 * meanA * meanB + c1) * (2.0 * covariance + c2)) /
+           ((meanA * meanA + meanB * meanB + c1) * (varianceA + varianceB + c2));
+}
+
+// Adds up the SSIM of 8x8 windows every 4 samples (or of a single window if the plane is smaller than that)
+static void avifQualityAddPlaneSSIM(avifQuality * quality, int planeIndex, const avifQualityPlane * plane, avifBool usesU16)
+{
+    const double peak = (double)((1 << quality->depth) - 1);
+    const double c1 = (0.01 * peak) * (0.01 * peak);
+    const double c2 = (0.03 * peak) * (0.03 * peak);
+    const uint32_t windowWidth = AVIF_MIN(plane->width, 8);
+    const uint32_t windowHeight = AVIF_MIN(plane->height, 8);
+
+    for (uint32_t y = 0; (y + windowHeight) <= plane->height; y += 4) {
+        for (uint32_t x = 0; (x + windowWidth) <= plane->width; x += 4) {
+            quality->ssimSum[planeIndex] += avifQualityWindowSSIM(plane, x, y, windowWidth, windowHeight, usesU16, c1, c2);
+            ++quality->ssimWindows[planeIndex];
+        }
+    }
+}
+
+void avifQualityAdd(avifQuality * quality, const avifImage * a, const avifImage * b, avifBool ssim)
+{
+    avifQualityPlane planes[AVIF_PLANE_COUNT_YUV];
+    const int planeCount = avifQualityPlanes(a, b, planes);
+    const avifBool usesU16 = avifImageUsesU16((avifImage *)a);
+    quality->depth = a->depth;
+    quality->planeCount = planeCount;
+
+    for (int planeIndex = 0; planeIndex < planeCount; ++planeIndex) {
+        const avifQualityPlane * plane = &planes[planeIndex];
+        uint64_t sse = 0;
+        for (uint32_t j = 0; j < plane->height; ++j) {
+            const uint8_t * aRow = &plane->a[j * plane->aRowBytes];
+            const uint8_t * bRow = &plane->b[j * plane->bRowBytes];
+            for (uint32_t i = 0; i < plane->width; ++i) {
+                const int64_t diff = (int64_t)avifQualitySample(aRow, i, usesU16) - avifQualitySample(bRow, i, usesU16);
+                sse += (uint64_t)(diff * diff);
+            }
+        }
+        quality->sse += sse;
+        quality->samples += (uint64_t)plane->width * plane->height;
+
+        if (ssim) {
+            avifQualityAddPlaneSSIM(quality, planeIndex, plane, usesU16);
+        }
+    }
+}
+
+double avifQualityPSNR(const avifQuality * quality)
+{
+    if (quality->sse == 0) {
+        return AVIF_MAX_PSNR;
+    }
+    const double peak = (double)((1 << quality->depth) - 1);
+    const double psnr = 10.0 * log10((double)quality->samples * peak * peak / (double)quality->sse);
+    return AVIF_MIN(psnr, AVIF_MAX_PSNR);
+}
+
+// Y weighs 0.8, U and V 0.1 each, like aom_calc_ssim()
+double avifQualitySSIM(const avifQuality * quality)
+{
+    double ssim[AVIF_PLANE_COUNT_YUV] = { 1.0, 1.0, 1.0 };
+    for (int planeIndex = 0; planeIndex < quality->planeCount; ++planeIndex) {
+        if (quality->ssimWindows[planeIndex]) {
+            ssim[planeIndex] = quality->ssimSum[planeIndex] / quality->ssimWindows[planeIndex];
+        }
+    }
+    if (quality->planeCount == 1) {
+        return ssim[AVIF_CHAN_Y];
+    }
+    return 0.8 * ssim[AVIF_CHAN_Y] + 0.1 * (ssim[AVIF_CHAN_U] + ssim[AVIF_CHAN_V]);
+}
+
+double avifImagePSNR(const avifImage * image, const avifImage * refImage)
+{
+    if ((image->width != refImage->width) || (image->height != refImage->height) || (image->depth != refImage->depth) ||
+        (image->yuvFormat != refImage->yuvFormat) || !image->yuvPlanes[AVIF_CHAN_Y] || !refImage->yuvPlanes[AVIF_CHAN_Y]) {
+        return 0.0;
+    }
+
+    avifQuality quality;
+    memset(&quality, 0, sizeof(quality));
+    avifQualityAdd(&quality, image, refImage, AVIF_FALSE);
+    return avifQualityPSNR(&quality);
+}
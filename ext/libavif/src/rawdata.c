@@ -7,17 +7,25 @@
 
 void avifRWDataRealloc(avifRWData * raw, size_t newSize)
 {
-    if (raw->size != newSize) {
-        uint8_t * old = raw->data;
-        size_t oldSize = raw->size;
-        raw->data = avifAlloc(newSize);
-        raw->size = newSize;
-        if (oldSize) {
-            size_t bytesToCopy = (oldSize < raw->size) ? oldSize : raw->size;
-            memcpy(raw->data, old, bytesToCopy);
-            avifFree(old);
-        }
+    if (newSize > raw->capacity) {
+        avifRWDataReserve(raw, newSize);
     }
+    raw->size = newSize;
+}
+
+void avifRWDataReserve(avifRWData * raw, size_t capacity)
+{
+    if (capacity <= raw->capacity) {
+        return;
+    }
+
+    uint8_t * old = raw->data;
+    raw->data = avifAlloc(capacity);
+    raw->capacity = capacity;
+    if (raw->size) {
+        memcpy(raw->data, old, raw->size);
+    }
+    avifFree(old);
 }
 
 void avifRWDataSet(avifRWData * raw, const uint8_t * data, size_t len)
@@ -35,4 +43,5 @@ void avifRWDataFree(avifRWData * raw)
     avifFree(raw->data);
     raw->data = NULL;
     raw->size = 0;
+    raw->capacity = 0;
 }
@@ -113,6 +113,7 @@ typedef struct avifDecoderItem
     uint32_t descForID;      // if non-zero, this item is a content description for Item #{descForID}
     uint32_t dimgForID;      // if non-zero, this item is a derived image for Item #{dimgForID}
     avifBool hasUnsupportedEssentialProperty; // If true, this file cites a property flagged as 'essential' that libavif doesn't support (yet). Ignore the item, if so.
+    avifRWData ownedData; // Copy of the payload, if it was read through a non-persistent avifIOReader
 } avifDecoderItem;
 AVIF_ARRAY_DECLARE(avifDecoderItemArray, avifDecoderItem, item);
 
@@ -287,6 +288,54 @@ typedef struct avifTrack
 } avifTrack;
 AVIF_ARRAY_DECLARE(avifTrackArray, avifTrack, track);
 
+// ---------------------------------------------------------------------------
+// avifDecoderIO
+
+typedef struct avifDecoderIO
+{
+    avifIOReader reader;
+    avifROData memory;     // Input of avifDecoderParse(), read through avifMemoryRead()
+    avifMutex * mutex;     // Serializes reads from grid cells decoded concurrently
+    avifResult readResult; // First failure returned by reader.read(), reported instead of a parse error
+} avifDecoderIO;
+
+static avifResult avifMemoryRead(void * userData, uint64_t offset, size_t size, avifROData * out)
+{
+    const avifROData * memory = (const avifROData *)userData;
+    if (offset >= memory->size) {
+        out->data = NULL;
+        out->size = 0;
+        return AVIF_RESULT_OK;
+    }
+    uint64_t available = memory->size - offset;
+    out->data = memory->data + offset;
+    out->size = ((uint64_t)size > available) ? (size_t)available : size;
+    return AVIF_RESULT_OK;
+}
+
+// Reads exactly size bytes at offset. If copy is non-NULL and the reader isn't persistent, they are
+// copied into it (and out points there), so they outlive the next read.
+static avifBool avifDecoderIORead(avifDecoderIO * io, uint64_t offset, size_t size, avifRWData * copy, avifROData * out)
+{
+    avifMutexLock(io->mutex);
+    avifResult result = io->reader.read(io->reader.userData, offset, size, out);
+    avifBool complete = (result == AVIF_RESULT_OK) && (out->size == size);
+    if (complete && copy && !io->reader.persistent) {
+        avifRWDataSet(copy, out->data, out->size);
+        out->data = copy->data;
+    }
+    if ((result != AVIF_RESULT_OK) && (io->readResult == AVIF_RESULT_OK)) {
+        io->readResult = result;
+    }
+    avifMutexUnlock(io->mutex);
+    return complete;
+}
+
+static avifResult avifDecoderIOFailure(const avifDecoderIO * io, avifResult parseFailure)
+{
+    return (io->readResult != AVIF_RESULT_OK) ? io->readResult : parseFailure;
+}
+
 // ---------------------------------------------------------------------------
 // avifCodecDecodeInput
 
@@ -301,10 +350,31 @@ avifCodecDecodeInput * avifCodecDecodeInputCreate(void)
 void avifCodecDecodeInputDestroy(avifCodecDecodeInput * decodeInput)
 {
     avifArrayDestroy(&decodeInput->samples);
+    avifRWDataFree(&decodeInput->buffer);
     avifFree(decodeInput);
 }
 
-static avifBool avifCodecDecodeInputGetSamples(avifCodecDecodeInput * decodeInput, avifSampleTable * sampleTable, avifROData * rawInput)
+avifBool avifCodecDecodeInputGetSampleData(avifCodecDecodeInput * decodeInput, uint32_t sampleIndex, avifROData * data)
+{
+    if (sampleIndex >= decodeInput->samples.count) {
+        return AVIF_FALSE;
+    }
+    avifSample * sample = &decodeInput->samples.sample[sampleIndex];
+    if (sample->data.data || !sample->data.size) {
+        *data = sample->data;
+        return AVIF_TRUE;
+    }
+    if (!decodeInput->io || !avifDecoderIORead(decodeInput->io, sample->offset, sample->data.size, &decodeInput->buffer, data)) {
+        return AVIF_FALSE;
+    }
+    if (decodeInput->io->reader.persistent) {
+        // Later calls can skip the reader
+        sample->data = *data;
+    }
+    return AVIF_TRUE;
+}
+
+static avifBool avifCodecDecodeInputGetSamples(avifCodecDecodeInput * decodeInput, avifSampleTable * sampleTable, const avifDecoderIO * io)
 {
     uint32_t sampleSizeIndex = 0;
     for (uint32_t chunkIndex = 0; chunkIndex < sampleTable->chunks.count; ++chunkIndex) {
@@ -337,11 +407,12 @@ static avifBool avifCodecDecodeInputGetSamples(avifCodecDecodeInput * decodeInpu
             }
 
             avifSample * sample = (avifSample *)avifArrayPushPtr(&decodeInput->samples);
-            sample->data.data = rawInput->data + sampleOffset;
+            sample->data.data = NULL; // read when the codec asks for it
             sample->data.size = sampleSize;
+            sample->offset = sampleOffset;
             sample->sync = AVIF_FALSE; // to potentially be set to true following the outer loop
 
-            if (sampleOffset > (uint64_t)rawInput->size) {
+            if (io->reader.sizeHint && ((sampleOffset + sampleSize) > io->reader.sizeHint)) {
                 return AVIF_FALSE;
             }
 
@@ -373,6 +444,12 @@ typedef struct avifTile
     avifCodecDecodeInput * input;
     struct avifCodec * codec;
     avifImage * image;
+    double decodeSeconds; // codec setup and decode time, see avifDecoderTileSeconds()
+    size_t planeBytes;    // sum of the decoded frames' plane sizes
+    uint32_t width;       // from the item's ispe, 0 if unknown
+    uint32_t height;      // from the item's ispe, 0 if unknown
+    avifImage * cell;     // decoded copy kept by avifDecoderDecodeRegion(), NULL if not cached
+    uint64_t cellStamp;   // when cell was last used, for evicting the least recently used cells
 } avifTile;
 AVIF_ARRAY_DECLARE(avifTileArray, avifTile, tile);
 
@@ -383,10 +460,13 @@ typedef struct avifDecoderData
     avifPropertyArray properties;
     avifDecoderItemDataArray idats;
     avifTrackArray tracks;
-    avifROData rawInput;
+    avifDecoderIO io;
+    avifRWDataArray boxes; // Copies of the top-level boxes parsed, if the reader isn't persistent
     avifTileArray tiles;
     unsigned int colorTileCount;
     unsigned int alphaTileCount;
+    size_t cellBytes;   // plane bytes of all the tiles' cached cells
+    uint64_t cellClock; // last cellStamp handed out
     avifImageGrid colorGrid;
     avifImageGrid alphaGrid;
     avifDecoderSource source;
@@ -403,7 +483,9 @@ static avifDecoderData * avifDecoderDataCreate()
     avifArrayCreate(&data->properties, sizeof(avifProperty), 16);
     avifArrayCreate(&data->idats, sizeof(avifDecoderItemData), 1);
     avifArrayCreate(&data->tracks, sizeof(avifTrack), 2);
+    avifArrayCreate(&data->boxes, sizeof(avifRWData), 2);
     avifArrayCreate(&data->tiles, sizeof(avifTile), 8);
+    data->io.mutex = avifMutexCreate();
     return data;
 }
 
@@ -424,8 +506,10 @@ static void avifDecoderDataResetCodec(avifDecoderData * data)
 static avifTile * avifDecoderDataCreateTile(avifDecoderData * data)
 {
     avifTile * tile = (avifTile *)avifArrayPushPtr(&data->tiles);
+    memset(tile, 0, sizeof(avifTile)); // the slot may have been used by a previous reset
     tile->image = avifImageCreateEmpty();
     tile->input = avifCodecDecodeInputCreate();
+    tile->input->io = &data->io;
     return tile;
 }
 
@@ -445,14 +529,22 @@ static void avifDecoderDataClearTiles(avifDecoderData * data)
             avifImageDestroy(tile->image);
             tile->image = NULL;
         }
+        if (tile->cell) {
+            avifImageDestroy(tile->cell);
+            tile->cell = NULL;
+        }
     }
     data->tiles.count = 0;
+    data->cellBytes = 0;
     data->colorTileCount = 0;
     data->alphaTileCount = 0;
 }
 
 static void avifDecoderDataDestroy(avifDecoderData * data)
 {
+    for (uint32_t i = 0; i < data->items.count; ++i) {
+        avifRWDataFree(&data->items.item[i].ownedData);
+    }
     avifArrayDestroy(&data->items);
     avifArrayDestroy(&data->properties);
     avifArrayDestroy(&data->idats);
@@ -462,8 +554,13 @@ static void avifDecoderDataDestroy(avifDecoderData * data)
         }
     }
     avifArrayDestroy(&data->tracks);
+    for (uint32_t i = 0; i < data->boxes.count; ++i) {
+        avifRWDataFree(&data->boxes.raw[i]);
+    }
+    avifArrayDestroy(&data->boxes);
     avifDecoderDataClearTiles(data);
     avifArrayDestroy(&data->tiles);
+    avifMutexDestroy(data->io.mutex);
     avifFree(data);
 }
 
@@ -484,38 +581,57 @@ static avifDecoderItem * avifDecoderDataFindItem(avifDecoderData * data, uint32_
     return item;
 }
 
-static const uint8_t * avifDecoderDataCalcItemPtr(avifDecoderData * data, avifDecoderItem * item)
+// Locates an item's payload. Items in an idat box are already in memory and get data pointed at
+// them; the others get a NULL data.data and their offset in the input, to be read when needed.
+static avifBool avifDecoderDataLocateItem(avifDecoderData * data, avifDecoderItem * item, avifROData * outData, uint64_t * outOffset)
 {
-    avifROData * offsetBuffer = NULL;
+    uint64_t offsetSize = (uint64_t)item->offset + (uint64_t)item->size;
     if (item->idatID == 0) {
         // construction_method: file(0)
 
-        offsetBuffer = &data->rawInput;
-    } else {
-        // construction_method: idat(1)
-
-        // Find associated idat block
-        for (uint32_t i = 0; i < data->idats.count; ++i) {
-            if (data->idats.idat[i].id == item->idatID) {
-                offsetBuffer = &data->idats.idat[i].data;
-                break;
-            }
+        if (data->io.reader.sizeHint && (offsetSize > data->io.reader.sizeHint)) {
+            return AVIF_FALSE;
         }
+        outData->data = NULL;
+        outData->size = item->size;
+        *outOffset = item->offset;
+        return AVIF_TRUE;
+    }
+
+    // construction_method: idat(1)
 
-        if (offsetBuffer == NULL) {
-            // no idat box was found in this meta box, bail out
-            return NULL;
+    // Find associated idat block
+    avifROData * offsetBuffer = NULL;
+    for (uint32_t i = 0; i < data->idats.count; ++i) {
+        if (data->idats.idat[i].id == item->idatID) {
+            offsetBuffer = &data->idats.idat[i].data;
+            break;
         }
     }
 
-    if (item->offset > offsetBuffer->size) {
-        return NULL;
+    if (offsetBuffer == NULL) {
+        // no idat box was found in this meta box, bail out
+        return AVIF_FALSE;
     }
-    uint64_t offsetSize = (uint64_t)item->offset + (uint64_t)item->size;
+
     if (offsetSize > (uint64_t)offsetBuffer->size) {
-        return NULL;
+        return AVIF_FALSE;
     }
-    return offsetBuffer->data + item->offset;
+    outData->data = offsetBuffer->data + item->offset;
+    outData->size = item->size;
+    *outOffset = 0;
+    return AVIF_TRUE;
+}
+
+// Reads an item's payload into memory that lives as long as the decoder data
+static avifBool avifDecoderDataReadItem(avifDecoderData * data, avifDecoderItem * item, avifROData * out)
+{
+    uint64_t offset;
+    CHECK(avifDecoderDataLocateItem(data, item, out, &offset));
+    if (out->data || !out->size) {
+        return AVIF_TRUE;
+    }
+    return avifDecoderIORead(&data->io, offset, out->size, &item->ownedData, out);
 }
 
 static avifBool avifDecoderDataGenerateImageGridTiles(avifDecoderData * data, avifImageGrid * grid, avifDecoderItem * gridItem, avifBool alpha)
@@ -555,9 +671,12 @@ static avifBool avifDecoderDataGenerateImageGridTiles(avifDecoderData * data, av
             }
 
             avifTile * tile = avifDecoderDataCreateTile(data);
+            if (item->ispePresent) {
+                tile->width = item->ispe.width;
+                tile->height = item->ispe.height;
+            }
             avifSample * sample = (avifSample *)avifArrayPushPtr(&tile->input->samples);
-            sample->data.data = avifDecoderDataCalcItemPtr(data, item);
-            sample->data.size = item->size;
+            CHECK(avifDecoderDataLocateItem(data, item, &sample->data, &sample->offset));
             sample->sync = AVIF_TRUE;
             tile->input->alpha = alpha;
         }
@@ -565,43 +684,35 @@ static avifBool avifDecoderDataGenerateImageGridTiles(avifDecoderData * data, av
     return AVIF_TRUE;
 }
 
-static avifBool avifDecoderDataFillImageGrid(avifDecoderData * data,
-                                             avifImageGrid * grid,
-                                             avifImage * dstImage,
-                                             unsigned int firstTileIndex,
-                                             unsigned int tileCount,
-                                             avifBool alpha)
+// Returns AVIF_TRUE if tile can be stitched into the same grid as refTile
+static avifBool avifImageGridTileMatches(const avifImage * refTile, const avifImage * tile)
 {
-    if (tileCount == 0) {
+    avifBool refUVPresent = (refTile->yuvPlanes[AVIF_CHAN_U] && refTile->yuvPlanes[AVIF_CHAN_V]);
+    avifBool uvPresent = (tile->yuvPlanes[AVIF_CHAN_U] && tile->yuvPlanes[AVIF_CHAN_V]);
+    if ((tile->width != refTile->width) || (tile->height != refTile->height) || (tile->depth != refTile->depth) ||
+        (tile->yuvFormat != refTile->yuvFormat) || (tile->yuvRange != refTile->yuvRange) || (uvPresent != refUVPresent) ||
+        ((refTile->profileFormat == AVIF_PROFILE_FORMAT_NCLX) &&
+         ((tile->profileFormat != refTile->profileFormat) || (tile->nclx.colourPrimaries != refTile->nclx.colourPrimaries) ||
+          (tile->nclx.transferCharacteristics != refTile->nclx.transferCharacteristics) ||
+          (tile->nclx.matrixCoefficients != refTile->nclx.matrixCoefficients) || (tile->nclx.range != refTile->nclx.range)))) {
         return AVIF_FALSE;
     }
+    return AVIF_TRUE;
+}
 
-    avifTile * firstTile = &data->tiles.tile[firstTileIndex];
-    unsigned int tileWidth = firstTile->image->width;
-    unsigned int tileHeight = firstTile->image->height;
-    unsigned int tileDepth = firstTile->image->depth;
-    avifPixelFormat tileFormat = firstTile->image->yuvFormat;
-
-    avifProfileFormat tileProfile = firstTile->image->profileFormat;
-    avifNclxColorProfile * tileNCLX = &firstTile->image->nclx;
-    avifRange tileRange = firstTile->image->yuvRange;
-    avifBool tileUVPresent = (firstTile->image->yuvPlanes[AVIF_CHAN_U] && firstTile->image->yuvPlanes[AVIF_CHAN_V]);
-
-    for (unsigned int i = 1; i < tileCount; ++i) {
-        avifTile * tile = &data->tiles.tile[firstTileIndex + i];
-        avifBool uvPresent = (tile->image->yuvPlanes[AVIF_CHAN_U] && tile->image->yuvPlanes[AVIF_CHAN_V]);
-        if ((tile->image->width != tileWidth) || (tile->image->height != tileHeight) || (tile->image->depth != tileDepth) ||
-            (tile->image->yuvFormat != tileFormat) || (tile->image->yuvRange != tileRange) || (uvPresent != tileUVPresent) ||
-            ((tileProfile == AVIF_PROFILE_FORMAT_NCLX) &&
-             ((tile->image->profileFormat != tileProfile) || (tile->image->nclx.colourPrimaries != tileNCLX->colourPrimaries) ||
-              (tile->image->nclx.transferCharacteristics != tileNCLX->transferCharacteristics) ||
-              (tile->image->nclx.matrixCoefficients != tileNCLX->matrixCoefficients) || (tile->image->nclx.range != tileNCLX->range)))) {
-            return AVIF_FALSE;
-        }
+// Sizes dstImage for the grid (using refTile as the template for every cell) and allocates its planes
+static avifBool avifImageGridPrepare(avifImageGrid * grid, avifImage * dstImage, avifImage * refTile, avifBool alpha)
+{
+    // The cells must cover the output, with only the last row / column allowed to hang over its edge
+    if (!refTile->width || !refTile->height || ((refTile->width * (grid->columns - 1)) >= grid->outputWidth) ||
+        ((refTile->width * grid->columns) < grid->outputWidth) || ((refTile->height * (grid->rows - 1)) >= grid->outputHeight) ||
+        ((refTile->height * grid->rows) < grid->outputHeight)) {
+        return AVIF_FALSE;
     }
 
-    if ((dstImage->width != grid->outputWidth) || (dstImage->height != grid->outputHeight) || (dstImage->depth != tileDepth) ||
-        (dstImage->yuvFormat != tileFormat)) {
+    // Alpha cells are decoded without a YUV format, so only their size and depth can be checked
+    if ((dstImage->width != grid->outputWidth) || (dstImage->height != grid->outputHeight) || (dstImage->depth != refTile->depth) ||
+        (!alpha && (dstImage->yuvFormat != refTile->yuvFormat))) {
         if (alpha) {
             // Alpha doesn't match size, just bail out
             return AVIF_FALSE;
@@ -610,82 +721,112 @@ static avifBool avifDecoderDataFillImageGrid(avifDecoderData * data,
         avifImageFreePlanes(dstImage, AVIF_PLANES_ALL);
         dstImage->width = grid->outputWidth;
         dstImage->height = grid->outputHeight;
-        dstImage->depth = tileDepth;
-        dstImage->yuvFormat = tileFormat;
-        dstImage->yuvRange = tileRange;
-        if ((dstImage->profileFormat == AVIF_PROFILE_FORMAT_NONE) && (tileProfile == AVIF_PROFILE_FORMAT_NCLX)) {
-            avifImageSetProfileNCLX(dstImage, tileNCLX);
+        dstImage->depth = refTile->depth;
+        dstImage->yuvFormat = refTile->yuvFormat;
+        dstImage->yuvRange = refTile->yuvRange;
+        if ((dstImage->profileFormat == AVIF_PROFILE_FORMAT_NONE) && (refTile->profileFormat == AVIF_PROFILE_FORMAT_NCLX)) {
+            avifImageSetProfileNCLX(dstImage, &refTile->nclx);
         }
     }
 
     avifImageAllocatePlanes(dstImage, alpha ? AVIF_PLANES_A : AVIF_PLANES_YUV);
+    return AVIF_TRUE;
+}
 
-    avifPixelFormatInfo formatInfo;
-    avifGetPixelFormatInfo(tileFormat, &formatInfo);
+// Copies one decoded cell into its place in dstImage. gridTileIndex is the cell index in row-major
+// order. Cells cover disjoint regions of dstImage, so different cells may be copied concurrently.
+static void avifImageGridCopyTile(const avifImageGrid * grid, avifImage * dstImage, const avifImage * tileImage, unsigned int gridTileIndex, avifBool alpha)
+{
+    unsigned int rowIndex = gridTileIndex / grid->columns;
+    unsigned int colIndex = gridTileIndex % grid->columns;
+    unsigned int tileWidth = tileImage->width;
+    unsigned int tileHeight = tileImage->height;
 
-    unsigned int tileIndex = firstTileIndex;
+    unsigned int widthToCopy = tileWidth;
+    unsigned int maxX = tileWidth * (colIndex + 1);
+    if (maxX > grid->outputWidth) {
+        widthToCopy -= maxX - grid->outputWidth;
+    }
+
+    unsigned int heightToCopy = tileHeight;
+    unsigned int maxY = tileHeight * (rowIndex + 1);
+    if (maxY > grid->outputHeight) {
+        heightToCopy -= maxY - grid->outputHeight;
+    }
+
+    // Y and A channels
     size_t pixelBytes = avifImageUsesU16(dstImage) ? 2 : 1;
-    for (unsigned int rowIndex = 0; rowIndex < grid->rows; ++rowIndex) {
-        for (unsigned int colIndex = 0; colIndex < grid->columns; ++colIndex, ++tileIndex) {
-            avifTile * tile = &data->tiles.tile[tileIndex];
+    size_t yaColOffset = colIndex * tileWidth;
+    size_t yaRowOffset = rowIndex * tileHeight;
+    size_t yaRowBytes = widthToCopy * pixelBytes;
 
-            unsigned int widthToCopy = tileWidth;
-            unsigned int maxX = tileWidth * (colIndex + 1);
-            if (maxX > grid->outputWidth) {
-                widthToCopy -= maxX - grid->outputWidth;
-            }
+    if (alpha) {
+        // A
+        for (unsigned int j = 0; j < heightToCopy; ++j) {
+            uint8_t * src = &tileImage->alphaPlane[j * tileImage->alphaRowBytes];
+            uint8_t * dst = &dstImage->alphaPlane[(yaColOffset * pixelBytes) + ((yaRowOffset + j) * dstImage->alphaRowBytes)];
+            memcpy(dst, src, yaRowBytes);
+        }
+        return;
+    }
 
-            unsigned int heightToCopy = tileHeight;
-            unsigned int maxY = tileHeight * (rowIndex + 1);
-            if (maxY > grid->outputHeight) {
-                heightToCopy -= maxY - grid->outputHeight;
-            }
+    // Y
+    for (unsigned int j = 0; j < heightToCopy; ++j) {
+        uint8_t * src = &tileImage->yuvPlanes[AVIF_CHAN_Y][j * tileImage->yuvRowBytes[AVIF_CHAN_Y]];
+        uint8_t * dst = &dstImage->yuvPlanes[AVIF_CHAN_Y][(yaColOffset * pixelBytes) + ((yaRowOffset + j) * dstImage->yuvRowBytes[AVIF_CHAN_Y])];
+        memcpy(dst, src, yaRowBytes);
+    }
 
-            // Y and A channels
-            size_t yaColOffset = colIndex * tileWidth;
-            size_t yaRowOffset = rowIndex * tileHeight;
-            size_t yaRowBytes = widthToCopy * pixelBytes;
+    if (!tileImage->yuvPlanes[AVIF_CHAN_U] || !tileImage->yuvPlanes[AVIF_CHAN_V]) {
+        return;
+    }
 
-            if (alpha) {
-                // A
-                for (unsigned int j = 0; j < heightToCopy; ++j) {
-                    uint8_t * src = &tile->image->alphaPlane[j * tile->image->alphaRowBytes];
-                    uint8_t * dst = &dstImage->alphaPlane[(yaColOffset * pixelBytes) + ((yaRowOffset + j) * dstImage->alphaRowBytes)];
-                    memcpy(dst, src, yaRowBytes);
-                }
-            } else {
-                // Y
-                for (unsigned int j = 0; j < heightToCopy; ++j) {
-                    uint8_t * src = &tile->image->yuvPlanes[AVIF_CHAN_Y][j * tile->image->yuvRowBytes[AVIF_CHAN_Y]];
-                    uint8_t * dst =
-                        &dstImage->yuvPlanes[AVIF_CHAN_Y][(yaColOffset * pixelBytes) + ((yaRowOffset + j) * dstImage->yuvRowBytes[AVIF_CHAN_Y])];
-                    memcpy(dst, src, yaRowBytes);
-                }
+    // UV
+    avifPixelFormatInfo formatInfo;
+    avifGetPixelFormatInfo(tileImage->yuvFormat, &formatInfo);
 
-                if (!tileUVPresent) {
-                    continue;
-                }
+    // Round up, so the last chroma sample of an odd-sized output is copied too
+    unsigned int uvHeightToCopy = (heightToCopy + formatInfo.chromaShiftY) >> formatInfo.chromaShiftY;
+    size_t uvColOffset = yaColOffset >> formatInfo.chromaShiftX;
+    size_t uvRowOffset = yaRowOffset >> formatInfo.chromaShiftY;
+    size_t uvRowBytes = ((widthToCopy + formatInfo.chromaShiftX) >> formatInfo.chromaShiftX) * pixelBytes;
+    for (unsigned int j = 0; j < uvHeightToCopy; ++j) {
+        uint8_t * srcU = &tileImage->yuvPlanes[AVIF_CHAN_U][j * tileImage->yuvRowBytes[AVIF_CHAN_U]];
+        uint8_t * dstU = &dstImage->yuvPlanes[AVIF_CHAN_U][(uvColOffset * pixelBytes) + ((uvRowOffset + j) * dstImage->yuvRowBytes[AVIF_CHAN_U])];
+        memcpy(dstU, srcU, uvRowBytes);
 
-                // UV
-                heightToCopy >>= formatInfo.chromaShiftY;
-                size_t uvColOffset = yaColOffset >> formatInfo.chromaShiftX;
-                size_t uvRowOffset = yaRowOffset >> formatInfo.chromaShiftY;
-                size_t uvRowBytes = yaRowBytes >> formatInfo.chromaShiftX;
-                for (unsigned int j = 0; j < heightToCopy; ++j) {
-                    uint8_t * srcU = &tile->image->yuvPlanes[AVIF_CHAN_U][j * tile->image->yuvRowBytes[AVIF_CHAN_U]];
-                    uint8_t * dstU =
-                        &dstImage->yuvPlanes[AVIF_CHAN_U][(uvColOffset * pixelBytes) + ((uvRowOffset + j) * dstImage->yuvRowBytes[AVIF_CHAN_U])];
-                    memcpy(dstU, srcU, uvRowBytes);
-
-                    uint8_t * srcV = &tile->image->yuvPlanes[AVIF_CHAN_V][j * tile->image->yuvRowBytes[AVIF_CHAN_V]];
-                    uint8_t * dstV =
-                        &dstImage->yuvPlanes[AVIF_CHAN_V][(uvColOffset * pixelBytes) + ((uvRowOffset + j) * dstImage->yuvRowBytes[AVIF_CHAN_V])];
-                    memcpy(dstV, srcV, uvRowBytes);
-                }
-            }
+        uint8_t * srcV = &tileImage->yuvPlanes[AVIF_CHAN_V][j * tileImage->yuvRowBytes[AVIF_CHAN_V]];
+        uint8_t * dstV = &dstImage->yuvPlanes[AVIF_CHAN_V][(uvColOffset * pixelBytes) + ((uvRowOffset + j) * dstImage->yuvRowBytes[AVIF_CHAN_V])];
+        memcpy(dstV, srcV, uvRowBytes);
+    }
+}
+
+static avifBool avifDecoderDataFillImageGrid(avifDecoderData * data,
+                                             avifImageGrid * grid,
+                                             avifImage * dstImage,
+                                             unsigned int firstTileIndex,
+                                             unsigned int tileCount,
+                                             avifBool alpha)
+{
+    if (tileCount == 0) {
+        return AVIF_FALSE;
+    }
+
+    avifTile * firstTile = &data->tiles.tile[firstTileIndex];
+    for (unsigned int i = 1; i < tileCount; ++i) {
+        avifTile * tile = &data->tiles.tile[firstTileIndex + i];
+        if (!avifImageGridTileMatches(firstTile->image, tile->image)) {
+            return AVIF_FALSE;
         }
     }
 
+    if (!avifImageGridPrepare(grid, dstImage, firstTile->image, alpha)) {
+        return AVIF_FALSE;
+    }
+
+    for (unsigned int i = 0; i < tileCount; ++i) {
+        avifImageGridCopyTile(grid, dstImage, data->tiles.tile[firstTileIndex + i].image, i, alpha);
+    }
     return AVIF_TRUE;
 }
 
@@ -1736,23 +1877,72 @@ static avifBool avifParseFileTypeBox(avifFileType * ftyp, const uint8_t * raw, s
     return AVIF_TRUE;
 }
 
-static avifBool avifParse(avifDecoderData * data, const uint8_t * raw, size_t rawLen)
+// Walks the top-level boxes, reading only the headers of all but ftyp, meta and moov (so the
+// payloads in mdat are skipped)
+static avifBool avifParse(avifDecoderData * data)
 {
-    BEGIN_STREAM(s, raw, rawLen);
+    avifDecoderIO * io = &data->io;
+    uint64_t offset = 0;
+    for (;;) {
+        // size, type, largesize and usertype: the largest possible box header
+        const size_t maxHeaderSize = 4 + 4 + 8 + 16;
+        avifROData headerData;
+        avifResult result = io->reader.read(io->reader.userData, offset, maxHeaderSize, &headerData);
+        if (result != AVIF_RESULT_OK) {
+            io->readResult = result;
+            return AVIF_FALSE;
+        }
+        if (headerData.size == 0) {
+            break;
+        }
 
-    while (avifROStreamHasBytesLeft(&s, 1)) {
-        avifBoxHeader header;
-        CHECK(avifROStreamReadBoxHeader(&s, &header));
+        BEGIN_STREAM(s, headerData.data, headerData.size);
+        uint32_t smallSize;
+        uint8_t type[4];
+        CHECK(avifROStreamReadU32(&s, &smallSize));
+        CHECK(avifROStreamRead(&s, type, 4));
+        uint64_t boxSize = smallSize;
+        if (boxSize == 1) {
+            CHECK(avifROStreamReadU64(&s, &boxSize));
+        }
+        if (!memcmp(type, "uuid", 4)) {
+            CHECK(avifROStreamSkip(&s, 16));
+        }
+        const uint64_t headerSize = avifROStreamOffset(&s);
+        if (boxSize < headerSize) {
+            return AVIF_FALSE;
+        }
+        const uint64_t contentOffset = offset + headerSize;
+        const uint64_t contentSize = boxSize - headerSize;
+        if ((offset + boxSize) < offset) {
+            return AVIF_FALSE;
+        }
+        if (io->reader.sizeHint && ((offset + boxSize) > io->reader.sizeHint)) {
+            return AVIF_FALSE;
+        }
+        offset += boxSize;
 
-        if (!memcmp(header.type, "ftyp", 4)) {
-            CHECK(avifParseFileTypeBox(&data->ftyp, avifROStreamCurrent(&s), header.size));
-        } else if (!memcmp(header.type, "meta", 4)) {
-            CHECK(avifParseMetaBox(data, avifROStreamCurrent(&s), header.size));
-        } else if (!memcmp(header.type, "moov", 4)) {
-            CHECK(avifParseMoovBox(data, avifROStreamCurrent(&s), header.size));
+        avifBool isFileType = !memcmp(type, "ftyp", 4);
+        avifBool isMeta = !memcmp(type, "meta", 4);
+        avifBool isMoov = !memcmp(type, "moov", 4);
+        if (!isFileType && !isMeta && !isMoov) {
+            continue;
+        }
+        if ((uint64_t)(size_t)contentSize != contentSize) {
+            return AVIF_FALSE;
         }
 
-        CHECK(avifROStreamSkip(&s, header.size));
+        // Parsed boxes keep pointers into their contents (ICC profiles, idat payloads)
+        avifRWData * copy = io->reader.persistent ? NULL : (avifRWData *)avifArrayPushPtr(&data->boxes);
+        avifROData content;
+        CHECK(avifDecoderIORead(io, contentOffset, (size_t)contentSize, copy, &content));
+        if (isFileType) {
+            CHECK(avifParseFileTypeBox(&data->ftyp, content.data, content.size));
+        } else if (isMeta) {
+            CHECK(avifParseMetaBox(data, content.data, content.size));
+        } else {
+            CHECK(avifParseMoovBox(data, content.data, content.size));
+        }
     }
     return AVIF_TRUE;
 }
@@ -1813,6 +2003,8 @@ avifDecoder * avifDecoderCreate(void)
 {
     avifDecoder * decoder = (avifDecoder *)avifAlloc(sizeof(avifDecoder));
     memset(decoder, 0, sizeof(avifDecoder));
+    decoder->maxThreads = 1;
+    decoder->regionCacheBytes = 128 * 1024 * 1024;
     return decoder;
 }
 
@@ -1841,8 +2033,11 @@ avifResult avifDecoderSetSource(avifDecoder * decoder, avifDecoderSource source)
     return avifDecoderReset(decoder);
 }
 
-avifResult avifDecoderParse(avifDecoder * decoder, avifROData * rawInput)
+// memory is NULL unless io reads it through avifMemoryRead()
+static avifResult avifDecoderParseReader(avifDecoder * decoder, const avifIOReader * io, const avifROData * memory)
 {
+    const double startSeconds = avifTimeSeconds();
+
     // Cleanup anything lingering in the decoder
     avifDecoderCleanup(decoder);
 
@@ -1850,12 +2045,15 @@ avifResult avifDecoderParse(avifDecoder * decoder, avifROData * rawInput)
     // Parse BMFF boxes
 
     decoder->data = avifDecoderDataCreate();
+    memcpy(&decoder->data->io.reader, io, sizeof(avifIOReader));
+    if (memory) {
+        // Shallow copy, on purpose
+        memcpy(&decoder->data->io.memory, memory, sizeof(avifROData));
+        decoder->data->io.reader.userData = &decoder->data->io.memory;
+    }
 
-    // Shallow copy, on purpose
-    memcpy(&decoder->data->rawInput, rawInput, sizeof(avifROData));
-
-    if (!avifParse(decoder->data, decoder->data->rawInput.data, decoder->data->rawInput.size)) {
-        return AVIF_RESULT_BMFF_PARSE_FAILED;
+    if (!avifParse(decoder->data)) {
+        return avifDecoderIOFailure(&decoder->data->io, AVIF_RESULT_BMFF_PARSE_FAILED);
     }
 
     avifBool avifCompatible = avifFileTypeIsCompatible(&decoder->data->ftyp);
@@ -1870,8 +2068,9 @@ avifResult avifDecoderParse(avifDecoder * decoder, avifROData * rawInput)
             // An essential property isn't supported by libavif; ignore the item.
             continue;
         }
-        const uint8_t * p = avifDecoderDataCalcItemPtr(decoder->data, item);
-        if (p == NULL) {
+        avifROData itemData;
+        uint64_t itemOffset;
+        if (!avifDecoderDataLocateItem(decoder->data, item, &itemData, &itemOffset)) {
             return AVIF_RESULT_BMFF_PARSE_FAILED;
         }
     }
@@ -1885,35 +2084,88 @@ avifResult avifDecoderParse(avifDecoder * decoder, avifROData * rawInput)
 
         for (uint32_t chunkIndex = 0; chunkIndex < track->sampleTable->chunks.count; ++chunkIndex) {
             avifSampleTableChunk * chunk = &track->sampleTable->chunks.chunk[chunkIndex];
-            if (chunk->offset > decoder->data->rawInput.size) {
+            if (decoder->data->io.reader.sizeHint && (chunk->offset > decoder->data->io.reader.sizeHint)) {
                 return AVIF_RESULT_BMFF_PARSE_FAILED;
             }
         }
     }
-    return avifDecoderReset(decoder);
+
+    avifResult result = avifDecoderReset(decoder);
+    decoder->ioStats.parseSeconds = avifTimeSeconds() - startSeconds;
+    return result;
 }
 
-static avifCodec * avifCodecCreateInternal(avifCodecChoice choice, avifCodecDecodeInput * decodeInput)
+avifResult avifDecoderParse(avifDecoder * decoder, avifROData * rawInput)
+{
+    avifIOReader io;
+    memset(&io, 0, sizeof(avifIOReader));
+    io.read = avifMemoryRead;
+    io.sizeHint = rawInput->size;
+    io.persistent = AVIF_TRUE;
+    return avifDecoderParseReader(decoder, &io, rawInput);
+}
+
+avifResult avifDecoderParseIO(avifDecoder * decoder, const avifIOReader * io)
+{
+    if (!io || !io->read) {
+        return AVIF_RESULT_IO_ERROR;
+    }
+    return avifDecoderParseReader(decoder, io, NULL);
+}
+
+static avifCodec * avifCodecCreateInternal(avifCodecChoice choice, avifCodecDecodeInput * decodeInput, int maxThreads)
 {
     avifCodec * codec = avifCodecCreate(choice, AVIF_CODEC_FLAG_CAN_DECODE);
     if (codec) {
         codec->decodeInput = decodeInput;
+        codec->maxThreads = maxThreads;
     }
     return codec;
 }
 
+static avifResult avifDecoderCreateTileCodec(avifDecoder * decoder, avifTile * tile, int maxThreads)
+{
+    tile->codec = avifCodecCreateInternal(decoder->codecChoice, tile->input, maxThreads);
+    if (!tile->codec) {
+        return AVIF_RESULT_NO_CODEC_AVAILABLE;
+    }
+    if (!tile->codec->open(tile->codec, decoder->imageIndex + 1)) {
+        return AVIF_RESULT_DECODE_COLOR_FAILED;
+    }
+    return AVIF_RESULT_OK;
+}
+
+// When every tile belongs to a grid, cells are decoded one by one (or concurrently, given maxThreads),
+// stitched into the output as soon as they are decoded and released immediately, so the output image
+// never coexists with more than a handful of decoded cells. Returns how many workers should do this,
+// or 0 if the tiles must go through the regular decode-everything-then-fill path.
+static int avifDecoderGridWorkerCount(const avifDecoder * decoder)
+{
+    const avifDecoderData * data = decoder->data;
+    if ((data->colorGrid.rows == 0) && (data->colorGrid.columns == 0)) {
+        return 0;
+    }
+    if ((data->alphaTileCount > 0) && (data->alphaGrid.rows == 0) && (data->alphaGrid.columns == 0)) {
+        return 0;
+    }
+    int workerCount = AVIF_MIN(decoder->maxThreads, (int)data->tiles.count);
+    return AVIF_CLAMP(workerCount, 1, AVIF_MAX_WORKERS);
+}
+
 static avifResult avifDecoderFlush(avifDecoder * decoder)
 {
     avifDecoderDataResetCodec(decoder->data);
 
+    if (avifDecoderGridWorkerCount(decoder) > 0) {
+        // Grid workers create each cell's codec on demand and destroy it once the cell is stitched,
+        // which bounds the number of live codecs (and decoded cells) by the number of workers.
+        return AVIF_RESULT_OK;
+    }
+
     for (unsigned int i = 0; i < decoder->data->tiles.count; ++i) {
-        avifTile * tile = &decoder->data->tiles.tile[i];
-        tile->codec = avifCodecCreateInternal(decoder->codecChoice, tile->input);
-        if (!tile->codec) {
-            return AVIF_RESULT_NO_CODEC_AVAILABLE;
-        }
-        if (!tile->codec->open(tile->codec, decoder->imageIndex + 1)) {
-            return AVIF_RESULT_DECODE_COLOR_FAILED;
+        avifResult result = avifDecoderCreateTileCodec(decoder, &decoder->data->tiles.tile[i], decoder->maxThreads);
+        if (result != AVIF_RESULT_OK) {
+            return result;
         }
     }
     return AVIF_RESULT_OK;
@@ -2004,7 +2256,7 @@ avifResult avifDecoderReset(avifDecoder * decoder)
         }
 
         avifTile * colorTile = avifDecoderDataCreateTile(decoder->data);
-        if (!avifCodecDecodeInputGetSamples(colorTile->input, colorTrack->sampleTable, &decoder->data->rawInput)) {
+        if (!avifCodecDecodeInputGetSamples(colorTile->input, colorTrack->sampleTable, &decoder->data->io)) {
             return AVIF_RESULT_BMFF_PARSE_FAILED;
         }
         decoder->data->colorTileCount = 1;
@@ -2012,7 +2264,7 @@ avifResult avifDecoderReset(avifDecoder * decoder)
         avifTile * alphaTile = NULL;
         if (alphaTrack) {
             alphaTile = avifDecoderDataCreateTile(decoder->data);
-            if (!avifCodecDecodeInputGetSamples(alphaTile->input, alphaTrack->sampleTable, &decoder->data->rawInput)) {
+            if (!avifCodecDecodeInputGetSamples(alphaTile->input, alphaTrack->sampleTable, &decoder->data->io)) {
                 return AVIF_RESULT_BMFF_PARSE_FAILED;
             }
             alphaTile->input->alpha = AVIF_TRUE;
@@ -2042,6 +2294,8 @@ avifResult avifDecoderReset(avifDecoder * decoder)
 
         avifROData colorOBU = AVIF_DATA_EMPTY;
         avifROData alphaOBU = AVIF_DATA_EMPTY;
+        uint64_t colorOBUOffset = 0;
+        uint64_t alphaOBUOffset = 0;
         avifROData exifData = AVIF_DATA_EMPTY;
         avifROData xmpData = AVIF_DATA_EMPTY;
         avifDecoderItem * colorOBUItem = NULL;
@@ -2062,26 +2316,36 @@ avifResult avifDecoderReset(avifDecoder * decoder)
                 // probably exif or some other data
                 continue;
             }
-            if (item->thumbnailForID != 0) {
-                // It's a thumbnail, skip it
-                continue;
-            }
-            if ((data->primaryItemID > 0) && (item->id != data->primaryItemID)) {
-                // a primary item ID was specified, require it
-                continue;
+            if (data->source == AVIF_DECODER_SOURCE_THUMBNAIL_ITEM) {
+                if (item->thumbnailForID == 0) {
+                    // Not a thumbnail, skip it
+                    continue;
+                }
+                if ((data->primaryItemID > 0) && (item->thumbnailForID != data->primaryItemID)) {
+                    // a primary item ID was specified, require its thumbnail
+                    continue;
+                }
+            } else {
+                if (item->thumbnailForID != 0) {
+                    // It's a thumbnail, skip it
+                    continue;
+                }
+                if ((data->primaryItemID > 0) && (item->id != data->primaryItemID)) {
+                    // a primary item ID was specified, require it
+                    continue;
+                }
             }
 
             if (isGrid) {
-                const uint8_t * itemPtr = avifDecoderDataCalcItemPtr(data, item);
-                if (itemPtr == NULL) {
-                    return AVIF_RESULT_BMFF_PARSE_FAILED;
+                avifROData gridData;
+                if (!avifDecoderDataReadItem(data, item, &gridData)) {
+                    return avifDecoderIOFailure(&data->io, AVIF_RESULT_BMFF_PARSE_FAILED);
                 }
-                if (!avifParseImageGridBox(&data->colorGrid, itemPtr, item->size)) {
+                if (!avifParseImageGridBox(&data->colorGrid, gridData.data, gridData.size)) {
                     return AVIF_RESULT_INVALID_IMAGE_GRID;
                 }
-            } else {
-                colorOBU.data = avifDecoderDataCalcItemPtr(data, item);
-                colorOBU.size = item->size;
+            } else if (!avifDecoderDataLocateItem(data, item, &colorOBU, &colorOBUOffset)) {
+                return AVIF_RESULT_BMFF_PARSE_FAILED;
             }
 
             colorOBUItem = item;
@@ -2114,16 +2378,15 @@ avifResult avifDecoderReset(avifDecoder * decoder)
 
             if (isAlphaURN(item->auxC.auxType) && (item->auxForID == colorOBUItem->id)) {
                 if (isGrid) {
-                    const uint8_t * itemPtr = avifDecoderDataCalcItemPtr(data, item);
-                    if (itemPtr == NULL) {
-                        return AVIF_RESULT_BMFF_PARSE_FAILED;
+                    avifROData gridData;
+                    if (!avifDecoderDataReadItem(data, item, &gridData)) {
+                        return avifDecoderIOFailure(&data->io, AVIF_RESULT_BMFF_PARSE_FAILED);
                     }
-                    if (!avifParseImageGridBox(&data->alphaGrid, itemPtr, item->size)) {
+                    if (!avifParseImageGridBox(&data->alphaGrid, gridData.data, gridData.size)) {
                         return AVIF_RESULT_INVALID_IMAGE_GRID;
                     }
-                } else {
-                    alphaOBU.data = avifDecoderDataCalcItemPtr(data, item);
-                    alphaOBU.size = item->size;
+                } else if (!avifDecoderDataLocateItem(data, item, &alphaOBU, &alphaOBUOffset)) {
+                    return AVIF_RESULT_BMFF_PARSE_FAILED;
                 }
 
                 alphaOBUItem = item;
@@ -2149,8 +2412,11 @@ avifResult avifDecoderReset(avifDecoder * decoder)
 
             if (!memcmp(item->type, "Exif", 4)) {
                 // Advance past Annex A.2.1's header
-                const uint8_t * boxPtr = avifDecoderDataCalcItemPtr(data, item);
-                BEGIN_STREAM(exifBoxStream, boxPtr, item->size);
+                avifROData exifBox;
+                if (!avifDecoderDataReadItem(data, item, &exifBox)) {
+                    return avifDecoderIOFailure(&data->io, AVIF_RESULT_BMFF_PARSE_FAILED);
+                }
+                BEGIN_STREAM(exifBoxStream, exifBox.data, exifBox.size);
                 uint32_t exifTiffHeaderOffset;
                 CHECK(avifROStreamReadU32(&exifBoxStream, &exifTiffHeaderOffset)); // unsigned int(32) exif_tiff_header_offset;
 
@@ -2159,8 +2425,9 @@ avifResult avifDecoderReset(avifDecoder * decoder)
             }
 
             if (!memcmp(item->type, "mime", 4) && !memcmp(item->contentType.contentType, xmpContentType, xmpContentTypeSize)) {
-                xmpData.data = avifDecoderDataCalcItemPtr(data, item);
-                xmpData.size = item->size;
+                if (!avifDecoderDataReadItem(data, item, &xmpData)) {
+                    return avifDecoderIOFailure(&data->io, AVIF_RESULT_BMFF_PARSE_FAILED);
+                }
             }
         }
 
@@ -2175,14 +2442,19 @@ avifResult avifDecoderReset(avifDecoder * decoder)
             }
 
             avifTile * colorTile = avifDecoderDataCreateTile(decoder->data);
+            if (colorOBUItem->ispePresent) {
+                colorTile->width = colorOBUItem->ispe.width;
+                colorTile->height = colorOBUItem->ispe.height;
+            }
             avifSample * colorSample = (avifSample *)avifArrayPushPtr(&colorTile->input->samples);
             memcpy(&colorSample->data, &colorOBU, sizeof(avifROData));
+            colorSample->offset = colorOBUOffset;
             colorSample->sync = AVIF_TRUE;
             decoder->data->colorTileCount = 1;
         }
 
         if ((data->alphaGrid.rows > 0) && (data->alphaGrid.columns > 0) && alphaOBUItem) {
-            if (!avifDecoderDataGenerateImageGridTiles(data, &data->alphaGrid, alphaOBUItem, AVIF_FALSE)) {
+            if (!avifDecoderDataGenerateImageGridTiles(data, &data->alphaGrid, alphaOBUItem, AVIF_TRUE)) {
                 return AVIF_RESULT_INVALID_IMAGE_GRID;
             }
             data->alphaTileCount = data->tiles.count - data->colorTileCount;
@@ -2190,9 +2462,14 @@ avifResult avifDecoderReset(avifDecoder * decoder)
             avifTile * alphaTile = NULL;
             if (alphaOBU.size > 0) {
                 alphaTile = avifDecoderDataCreateTile(decoder->data);
+                if (alphaOBUItem->ispePresent) {
+                    alphaTile->width = alphaOBUItem->ispe.width;
+                    alphaTile->height = alphaOBUItem->ispe.height;
+                }
 
                 avifSample * alphaSample = (avifSample *)avifArrayPushPtr(&alphaTile->input->samples);
                 memcpy(&alphaSample->data, &alphaOBU, sizeof(avifROData));
+                alphaSample->offset = alphaOBUOffset;
                 alphaSample->sync = AVIF_TRUE;
                 alphaTile->input->alpha = AVIF_TRUE;
                 decoder->data->alphaTileCount = 1;
@@ -2264,83 +2541,252 @@ avifResult avifDecoderReset(avifDecoder * decoder)
     return avifDecoderFlush(decoder);
 }
 
-avifResult avifDecoderNextImage(avifDecoder * decoder)
+static avifResult avifDecoderDecodeTile(avifDecoder * decoder, avifTile * tile, int codecThreads)
 {
-    for (unsigned int tileIndex = 0; tileIndex < decoder->data->tiles.count; ++tileIndex) {
-        avifTile * tile = &decoder->data->tiles.tile[tileIndex];
+    const double startSeconds = avifTimeSeconds();
+    if (!tile->codec) {
+        avifResult result = avifDecoderCreateTileCodec(decoder, tile, codecThreads);
+        if (result != AVIF_RESULT_OK) {
+            return result;
+        }
+    }
 
-        if (!tile->codec->getNextImage(tile->codec, tile->image)) {
-            if (tile->input->alpha) {
-                return AVIF_RESULT_DECODE_ALPHA_FAILED;
-            } else {
-                if (tile->image->width) {
-                    // We've sent at least one image, but we've run out now.
-                    return AVIF_RESULT_NO_IMAGES_REMAINING;
-                }
-                return AVIF_RESULT_DECODE_COLOR_FAILED;
+    avifBool decoded = tile->codec->getNextImage(tile->codec, tile->image);
+    tile->decodeSeconds += avifTimeSeconds() - startSeconds;
+    if (!decoded) {
+        if (tile->input->alpha) {
+            return AVIF_RESULT_DECODE_ALPHA_FAILED;
+        } else {
+            if (tile->image->width) {
+                // We've sent at least one image, but we've run out now.
+                return AVIF_RESULT_NO_IMAGES_REMAINING;
             }
+            return AVIF_RESULT_DECODE_COLOR_FAILED;
         }
     }
+    tile->planeBytes += avifImagePlaneBytes(tile->image, AVIF_PLANES_ALL);
+    return AVIF_RESULT_OK;
+}
 
-    if (decoder->data->tiles.count != (decoder->data->colorTileCount + decoder->data->alphaTileCount)) {
-        // TODO: assert here? This should be impossible.
-        return AVIF_RESULT_UNKNOWN_ERROR;
+// Sums the tiles' counters up into ioStats. Tiles are decoded concurrently, so this is done once
+// they are all back, instead of updating ioStats from each of them.
+static void avifDecoderUpdateTileStats(avifDecoder * decoder)
+{
+    avifDecoderData * data = decoder->data;
+    avifIOStats * ioStats = &decoder->ioStats;
+    ioStats->colorCodecSeconds = 0.0;
+    ioStats->alphaCodecSeconds = 0.0;
+    ioStats->tileCount = data->tiles.count;
+    ioStats->planeBytes = 0;
+    for (uint32_t tileIndex = 0; tileIndex < data->tiles.count; ++tileIndex) {
+        const avifTile * tile = &data->tiles.tile[tileIndex];
+        if (tile->input->alpha) {
+            ioStats->alphaCodecSeconds += tile->decodeSeconds;
+        } else {
+            ioStats->colorCodecSeconds += tile->decodeSeconds;
+        }
+        ioStats->planeBytes += tile->planeBytes;
+    }
+    if ((data->colorGrid.rows > 0) || (data->colorGrid.columns > 0) || (data->alphaGrid.rows > 0) || (data->alphaGrid.columns > 0)) {
+        // The cells were copied into planes of decoder->image's own
+        ioStats->planeBytes += avifImagePlaneBytes(decoder->image, AVIF_PLANES_ALL);
     }
+}
 
-    if ((decoder->data->colorGrid.rows > 0) || (decoder->data->colorGrid.columns > 0)) {
-        if (!avifDecoderDataFillImageGrid(
-                decoder->data, &decoder->data->colorGrid, decoder->image, 0, decoder->data->colorTileCount, AVIF_FALSE)) {
-            return AVIF_RESULT_INVALID_IMAGE_GRID;
-        }
-    } else {
-        // Normal (most common) non-grid path. Just steal the planes from the only "tile".
+// ---------------------------------------------------------------------------
+// Grid cell worker pool
 
-        if (decoder->data->colorTileCount != 1) {
-            return AVIF_RESULT_DECODE_COLOR_FAILED;
-        }
+typedef struct avifGridDecodeJob
+{
+    avifDecoder * decoder;
+    avifMutex * mutex;
+    avifCond * colorGridReady; // broadcast once the color planes exist (or on failure); alpha cells wait on it
+    int codecThreads;          // maxThreads handed to each cell's codec
+    unsigned int nextTileIndex;
+    avifImage refTile[2];      // [alpha] shallow copy of the first decoded cell; only its properties are used
+    avifBool refTileSet[2];
+    avifResult result;
+} avifGridDecodeJob;
 
-        avifImage * srcColor = decoder->data->tiles.tile[0].image;
+static void avifGridDecodeWorker(void * userData)
+{
+    avifGridDecodeJob * job = (avifGridDecodeJob *)userData;
+    avifDecoder * decoder = job->decoder;
+    avifDecoderData * data = decoder->data;
+    double gridSeconds = 0.0;
 
-        if ((decoder->image->width != srcColor->width) || (decoder->image->height != srcColor->height) ||
-            (decoder->image->depth != srcColor->depth)) {
-            avifImageFreePlanes(decoder->image, AVIF_PLANES_ALL);
+    for (;;) {
+        avifMutexLock(job->mutex);
+        if ((job->result != AVIF_RESULT_OK) || (job->nextTileIndex >= data->tiles.count)) {
+            decoder->ioStats.gridSeconds += gridSeconds;
+            avifMutexUnlock(job->mutex);
+            break;
+        }
+        unsigned int tileIndex = job->nextTileIndex++;
+        avifMutexUnlock(job->mutex);
 
-            decoder->image->width = srcColor->width;
-            decoder->image->height = srcColor->height;
-            decoder->image->depth = srcColor->depth;
+        avifTile * tile = &data->tiles.tile[tileIndex];
+        const avifBool alpha = tile->input->alpha;
+        avifImageGrid * grid = alpha ? &data->alphaGrid : &data->colorGrid;
+        avifResult tileResult = avifDecoderDecodeTile(decoder, tile, job->codecThreads);
 
-            if (decoder->image->profileFormat == AVIF_PROFILE_FORMAT_NONE && srcColor->profileFormat == AVIF_PROFILE_FORMAT_NCLX) {
-                avifImageSetProfileNCLX(decoder->image, &srcColor->nclx);
+        avifMutexLock(job->mutex);
+        if (tileResult == AVIF_RESULT_OK) {
+            // Color cells are handed out first, so one is always in flight while alpha cells wait here.
+            // The color grid has to size decoder->image before the alpha planes can be added to it.
+            while (alpha && !job->refTileSet[0] && (job->result == AVIF_RESULT_OK)) {
+                avifCondWait(job->colorGridReady, job->mutex);
             }
+
+            if (job->result == AVIF_RESULT_OK) {
+                if (!job->refTileSet[alpha]) {
+                    job->refTile[alpha] = *tile->image;
+                    job->refTileSet[alpha] = AVIF_TRUE;
+                    if (!avifImageGridPrepare(grid, decoder->image, &job->refTile[alpha], alpha)) {
+                        tileResult = AVIF_RESULT_INVALID_IMAGE_GRID;
+                    }
+                    if (!alpha) {
+                        avifCondBroadcast(job->colorGridReady);
+                    }
+                } else if (!avifImageGridTileMatches(&job->refTile[alpha], tile->image)) {
+                    tileResult = AVIF_RESULT_INVALID_IMAGE_GRID;
+                }
+            }
+        }
+        if ((tileResult != AVIF_RESULT_OK) && (job->result == AVIF_RESULT_OK)) {
+            job->result = tileResult;
+            avifCondBroadcast(job->colorGridReady);
         }
+        const avifBool stitch = (job->result == AVIF_RESULT_OK);
+        avifMutexUnlock(job->mutex);
 
-        avifImageStealPlanes(decoder->image, srcColor, AVIF_PLANES_YUV);
+        if (stitch) {
+            const double stitchStartSeconds = avifTimeSeconds();
+            unsigned int gridTileIndex = alpha ? (tileIndex - data->colorTileCount) : tileIndex;
+            avifImageGridCopyTile(grid, decoder->image, tile->image, gridTileIndex, alpha);
+            gridSeconds += avifTimeSeconds() - stitchStartSeconds;
+        }
+
+        // The cell is in place; drop the codec (and the frame it owns) right away
+        avifImageFreePlanes(tile->image, AVIF_PLANES_ALL);
+        avifCodecDestroy(tile->codec);
+        tile->codec = NULL;
     }
+}
 
-    if ((decoder->data->alphaGrid.rows > 0) || (decoder->data->alphaGrid.columns > 0)) {
-        if (!avifDecoderDataFillImageGrid(
-                decoder->data, &decoder->data->alphaGrid, decoder->image, decoder->data->colorTileCount, decoder->data->alphaTileCount, AVIF_TRUE)) {
-            return AVIF_RESULT_INVALID_IMAGE_GRID;
+static avifResult avifDecoderDecodeGridTiles(avifDecoder * decoder, int workerCount)
+{
+    avifDecoderData * data = decoder->data;
+    if ((decoder->imageIndex + 1) >= decoder->imageCount) {
+        // Grids are single images, and their cell codecs are released after the first decode
+        return AVIF_RESULT_NO_IMAGES_REMAINING;
+    }
+    if ((data->colorTileCount == 0) || ((data->alphaGrid.rows > 0) && (data->alphaTileCount == 0))) {
+        return AVIF_RESULT_INVALID_IMAGE_GRID;
+    }
+    if (data->alphaTileCount == 0) {
+        avifImageFreePlanes(decoder->image, AVIF_PLANES_A); // no alpha
+    }
+
+    avifGridDecodeJob job;
+    memset(&job, 0, sizeof(avifGridDecodeJob));
+    job.decoder = decoder;
+    job.mutex = avifMutexCreate();
+    job.colorGridReady = avifCondCreate();
+    job.codecThreads = decoder->maxThreads / workerCount;
+    if (job.codecThreads < 1) {
+        job.codecThreads = 1;
+    }
+    job.result = AVIF_RESULT_OK;
+
+    avifRunWorkers(avifGridDecodeWorker, &job, workerCount);
+
+    avifCondDestroy(job.colorGridReady);
+    avifMutexDestroy(job.mutex);
+    return job.result;
+}
+
+avifResult avifDecoderNextImage(avifDecoder * decoder)
+{
+    if (decoder->data->tiles.count != (decoder->data->colorTileCount + decoder->data->alphaTileCount)) {
+        // TODO: assert here? This should be impossible.
+        return AVIF_RESULT_UNKNOWN_ERROR;
+    }
+
+    const int gridWorkerCount = avifDecoderGridWorkerCount(decoder);
+    if (gridWorkerCount > 0) {
+        avifResult result = avifDecoderDecodeGridTiles(decoder, gridWorkerCount);
+        if (result != AVIF_RESULT_OK) {
+            return result;
         }
     } else {
-        // Normal (most common) non-grid path. Just steal the planes from the only "tile".
+        for (unsigned int tileIndex = 0; tileIndex < decoder->data->tiles.count; ++tileIndex) {
+            avifResult result = avifDecoderDecodeTile(decoder, &decoder->data->tiles.tile[tileIndex], decoder->maxThreads);
+            if (result != AVIF_RESULT_OK) {
+                return result;
+            }
+        }
 
-        if (decoder->data->alphaTileCount == 0) {
-            avifImageFreePlanes(decoder->image, AVIF_PLANES_A); // no alpha
+        if ((decoder->data->colorGrid.rows > 0) || (decoder->data->colorGrid.columns > 0)) {
+            const double gridStartSeconds = avifTimeSeconds();
+            if (!avifDecoderDataFillImageGrid(
+                    decoder->data, &decoder->data->colorGrid, decoder->image, 0, decoder->data->colorTileCount, AVIF_FALSE)) {
+                return AVIF_RESULT_INVALID_IMAGE_GRID;
+            }
+            decoder->ioStats.gridSeconds += avifTimeSeconds() - gridStartSeconds;
         } else {
-            if (decoder->data->alphaTileCount != 1) {
-                return AVIF_RESULT_DECODE_ALPHA_FAILED;
+            // Normal (most common) non-grid path. Just steal the planes from the only "tile".
+
+            if (decoder->data->colorTileCount != 1) {
+                return AVIF_RESULT_DECODE_COLOR_FAILED;
+            }
+
+            avifImage * srcColor = decoder->data->tiles.tile[0].image;
+
+            if ((decoder->image->width != srcColor->width) || (decoder->image->height != srcColor->height) ||
+                (decoder->image->depth != srcColor->depth)) {
+                avifImageFreePlanes(decoder->image, AVIF_PLANES_ALL);
+
+                decoder->image->width = srcColor->width;
+                decoder->image->height = srcColor->height;
+                decoder->image->depth = srcColor->depth;
+
+                if (decoder->image->profileFormat == AVIF_PROFILE_FORMAT_NONE && srcColor->profileFormat == AVIF_PROFILE_FORMAT_NCLX) {
+                    avifImageSetProfileNCLX(decoder->image, &srcColor->nclx);
+                }
             }
 
-            avifImage * srcAlpha = decoder->data->tiles.tile[decoder->data->colorTileCount].image;
-            if ((decoder->image->width != srcAlpha->width) || (decoder->image->height != srcAlpha->height) ||
-                (decoder->image->depth != srcAlpha->depth)) {
-                return AVIF_RESULT_DECODE_ALPHA_FAILED;
+            avifImageStealPlanes(decoder->image, srcColor, AVIF_PLANES_YUV);
+        }
+
+        if ((decoder->data->alphaGrid.rows > 0) || (decoder->data->alphaGrid.columns > 0)) {
+            const double gridStartSeconds = avifTimeSeconds();
+            if (!avifDecoderDataFillImageGrid(
+                    decoder->data, &decoder->data->alphaGrid, decoder->image, decoder->data->colorTileCount, decoder->data->alphaTileCount, AVIF_TRUE)) {
+                return AVIF_RESULT_INVALID_IMAGE_GRID;
             }
+            decoder->ioStats.gridSeconds += avifTimeSeconds() - gridStartSeconds;
+        } else {
+            // Normal (most common) non-grid path. Just steal the planes from the only "tile".
 
-            avifImageStealPlanes(decoder->image, srcAlpha, AVIF_PLANES_A);
+            if (decoder->data->alphaTileCount == 0) {
+                avifImageFreePlanes(decoder->image, AVIF_PLANES_A); // no alpha
+            } else {
+                if (decoder->data->alphaTileCount != 1) {
+                    return AVIF_RESULT_DECODE_ALPHA_FAILED;
+                }
+
+                avifImage * srcAlpha = decoder->data->tiles.tile[decoder->data->colorTileCount].image;
+                if ((decoder->image->width != srcAlpha->width) || (decoder->image->height != srcAlpha->height) ||
+                    (decoder->image->depth != srcAlpha->depth)) {
+                    return AVIF_RESULT_DECODE_ALPHA_FAILED;
+                }
+
+                avifImageStealPlanes(decoder->image, srcAlpha, AVIF_PLANES_A);
+            }
         }
     }
+    avifDecoderUpdateTileStats(decoder);
 
     ++decoder->imageIndex;
     if (decoder->data->sourceSampleTable) {
@@ -2444,6 +2890,400 @@ uint32_t avifDecoderNearestKeyframe(avifDecoder * decoder, uint32_t frameIndex)
     return frameIndex;
 }
 
+double avifDecoderTileSeconds(const avifDecoder * decoder, uint32_t tileIndex)
+{
+    if (!decoder->data || (tileIndex >= decoder->data->tiles.count)) {
+        return 0.0;
+    }
+    return decoder->data->tiles.tile[tileIndex].decodeSeconds;
+}
+
+// ---------------------------------------------------------------------------
+// Region of interest
+
+// Where the cells of one plane set (color or alpha) are in the image. An image which isn't a grid
+// is a single cell.
+typedef struct avifRegionLayout
+{
+    unsigned int firstTileIndex;
+    unsigned int tileCount;
+    unsigned int rows;
+    unsigned int columns;
+    uint32_t cellWidth;
+    uint32_t cellHeight;
+    uint32_t width;  // of the whole image
+    uint32_t height; // of the whole image
+} avifRegionLayout;
+
+// Makes sure tile->cell holds the decoded tile. The codec is only used for this one frame, and the
+// cell's planes are a copy, so it outlives the codec.
+static avifResult avifDecoderRegionCell(avifDecoder * decoder, avifTile * tile, int codecThreads)
+{
+    if (tile->cell) {
+        return AVIF_RESULT_OK;
+    }
+
+    // avifDecoderNextImage() may have left a codec behind which is past the tile's only frame
+    if (tile->codec) {
+        avifCodecDestroy(tile->codec);
+    }
+    tile->codec = avifCodecCreateInternal(decoder->codecChoice, tile->input, codecThreads);
+    if (!tile->codec) {
+        return AVIF_RESULT_NO_CODEC_AVAILABLE;
+    }
+
+    avifResult result = tile->input->alpha ? AVIF_RESULT_DECODE_ALPHA_FAILED : AVIF_RESULT_DECODE_COLOR_FAILED;
+    if (tile->codec->open(tile->codec, 0)) {
+        result = avifDecoderDecodeTile(decoder, tile, codecThreads);
+    }
+    if (result == AVIF_RESULT_OK) {
+        tile->cell = avifImageCreateEmpty();
+        avifImageCopy(tile->cell, tile->image);
+    }
+
+    avifImageFreePlanes(tile->image, AVIF_PLANES_ALL);
+    avifCodecDestroy(tile->codec);
+    tile->codec = NULL;
+    return result;
+}
+
+// Fills layout from the grid (if any) and the size of its cells, which comes from the cells' ispe, or
+// else from decoding the first one
+static avifResult avifDecoderRegionLayout(avifDecoder * decoder, avifRegionLayout * layout, const avifImageGrid * grid, unsigned int firstTileIndex, unsigned int tileCount)
+{
+    avifTile * firstTile = &decoder->data->tiles.tile[firstTileIndex];
+    memset(layout, 0, sizeof(avifRegionLayout));
+    layout->firstTileIndex = firstTileIndex;
+    layout->tileCount = tileCount;
+    layout->cellWidth = firstTile->width;
+    layout->cellHeight = firstTile->height;
+    if (!layout->cellWidth || !layout->cellHeight) {
+        const avifBool cached = (firstTile->cell != NULL);
+        avifResult result = avifDecoderRegionCell(decoder, firstTile, decoder->maxThreads);
+        if (result != AVIF_RESULT_OK) {
+            return result;
+        }
+        if (!cached) {
+            decoder->data->cellBytes += avifImagePlaneBytes(firstTile->cell, AVIF_PLANES_ALL);
+        }
+        layout->cellWidth = firstTile->cell->width;
+        layout->cellHeight = firstTile->cell->height;
+    }
+
+    if ((grid->rows > 0) && (grid->columns > 0)) {
+        layout->rows = grid->rows;
+        layout->columns = grid->columns;
+        layout->width = grid->outputWidth;
+        layout->height = grid->outputHeight;
+
+        // Same rule as avifImageGridPrepare(): only the last row / column may hang over the edge
+        if ((tileCount != (layout->rows * layout->columns)) || ((layout->cellWidth * (layout->columns - 1)) >= layout->width) ||
+            ((layout->cellWidth * layout->columns) < layout->width) || ((layout->cellHeight * (layout->rows - 1)) >= layout->height) ||
+            ((layout->cellHeight * layout->rows) < layout->height)) {
+            return AVIF_RESULT_INVALID_IMAGE_GRID;
+        }
+    } else {
+        if (tileCount != 1) {
+            return AVIF_RESULT_DECODE_COLOR_FAILED;
+        }
+        layout->rows = 1;
+        layout->columns = 1;
+        layout->width = layout->cellWidth;
+        layout->height = layout->cellHeight;
+    }
+    return AVIF_RESULT_OK;
+}
+
+// Copies the width x height rectangle at (srcX, srcY) of srcImage to (dstX, dstY) of dstImage. With
+// subsampled chroma, the offsets must be even along the subsampled axes.
+static void avifImageCopyRect(avifImage * dstImage,
+                              uint32_t dstX,
+                              uint32_t dstY,
+                              const avifImage * srcImage,
+                              uint32_t srcX,
+                              uint32_t srcY,
+                              uint32_t width,
+                              uint32_t height,
+                              avifBool alpha)
+{
+    const size_t pixelBytes = avifImageUsesU16(dstImage) ? 2 : 1;
+
+    if (alpha) {
+        for (uint32_t j = 0; j < height; ++j) {
+            const uint8_t * src = &srcImage->alphaPlane[((srcY + j) * srcImage->alphaRowBytes) + (srcX * pixelBytes)];
+            uint8_t * dst = &dstImage->alphaPlane[((dstY + j) * dstImage->alphaRowBytes) + (dstX * pixelBytes)];
+            memcpy(dst, src, width * pixelBytes);
+        }
+        return;
+    }
+
+    avifPixelFormatInfo formatInfo;
+    avifGetPixelFormatInfo(srcImage->yuvFormat, &formatInfo);
+    for (int yuvPlane = 0; yuvPlane < AVIF_PLANE_COUNT_YUV; ++yuvPlane) {
+        if (!srcImage->yuvPlanes[yuvPlane] || !dstImage->yuvPlanes[yuvPlane]) {
+            continue;
+        }
+        const uint32_t shiftX = (yuvPlane == AVIF_CHAN_Y) ? 0 : formatInfo.chromaShiftX;
+        const uint32_t shiftY = (yuvPlane == AVIF_CHAN_Y) ? 0 : formatInfo.chromaShiftY;
+
+        // Round the far edge up, so the last chroma sample of an odd-sized rectangle is copied too
+        const uint32_t planeWidth = ((srcX + width + shiftX) >> shiftX) - (srcX >> shiftX);
+        const uint32_t planeHeight = ((srcY + height + shiftY) >> shiftY) - (srcY >> shiftY);
+        const uint32_t srcRowBytes = srcImage->yuvRowBytes[yuvPlane];
+        const uint32_t dstRowBytes = dstImage->yuvRowBytes[yuvPlane];
+        for (uint32_t j = 0; j < planeHeight; ++j) {
+            const uint8_t * src = &srcImage->yuvPlanes[yuvPlane][(((srcY >> shiftY) + j) * srcRowBytes) + ((srcX >> shiftX) * pixelBytes)];
+            uint8_t * dst = &dstImage->yuvPlanes[yuvPlane][(((dstY >> shiftY) + j) * dstRowBytes) + ((dstX >> shiftX) * pixelBytes)];
+            memcpy(dst, src, planeWidth * pixelBytes);
+        }
+    }
+}
+
+typedef struct avifRegionDecodeJob
+{
+    avifDecoder * decoder;
+    avifMutex * mutex;
+    const avifRegionLayout * layouts[2]; // [alpha], layouts[1] is NULL without alpha
+    const avifImage * refCells[2];       // [alpha] the first cell of the region, every other one must match it
+    uint32_t x, y, width, height;
+    const unsigned int * tileIndices; // cells intersecting the region, color ones first
+    unsigned int tileIndexCount;
+    unsigned int nextTileIndex;
+    int codecThreads;
+    avifResult result;
+} avifRegionDecodeJob;
+
+static void avifRegionDecodeWorker(void * userData)
+{
+    avifRegionDecodeJob * job = (avifRegionDecodeJob *)userData;
+    avifDecoder * decoder = job->decoder;
+    avifDecoderData * data = decoder->data;
+    double gridSeconds = 0.0;
+
+    for (;;) {
+        avifMutexLock(job->mutex);
+        if ((job->result != AVIF_RESULT_OK) || (job->nextTileIndex >= job->tileIndexCount)) {
+            decoder->ioStats.gridSeconds += gridSeconds;
+            avifMutexUnlock(job->mutex);
+            break;
+        }
+        const unsigned int tileIndex = job->tileIndices[job->nextTileIndex++];
+        avifMutexUnlock(job->mutex);
+
+        avifTile * tile = &data->tiles.tile[tileIndex];
+        const avifBool alpha = tile->input->alpha;
+        const avifRegionLayout * layout = job->layouts[alpha];
+        const avifBool cached = (tile->cell != NULL);
+        avifResult result = avifDecoderRegionCell(decoder, tile, job->codecThreads);
+        if (result == AVIF_RESULT_OK) {
+            const avifImage * ref = job->refCells[alpha];
+            if ((tile->cell->width != layout->cellWidth) || (tile->cell->height != layout->cellHeight) ||
+                (alpha ? (tile->cell->depth != ref->depth) : !avifImageGridTileMatches(ref, tile->cell))) {
+                result = AVIF_RESULT_INVALID_IMAGE_GRID;
+            }
+        }
+
+        if (result == AVIF_RESULT_OK) {
+            const double stitchStartSeconds = avifTimeSeconds();
+            const unsigned int cellIndex = tileIndex - layout->firstTileIndex;
+            const uint32_t cellX = (cellIndex % layout->columns) * layout->cellWidth;
+            const uint32_t cellY = (cellIndex / layout->columns) * layout->cellHeight;
+            const uint32_t left = AVIF_MAX(cellX, job->x);
+            const uint32_t top = AVIF_MAX(cellY, job->y);
+            const uint32_t right = AVIF_MIN(cellX + layout->cellWidth, job->x + job->width);
+            const uint32_t bottom = AVIF_MIN(cellY + layout->cellHeight, job->y + job->height);
+            avifImageCopyRect(decoder->image, left - job->x, top - job->y, tile->cell, left - cellX, top - cellY, right - left, bottom - top, alpha);
+            gridSeconds += avifTimeSeconds() - stitchStartSeconds;
+        }
+
+        avifMutexLock(job->mutex);
+        if (!cached && tile->cell) {
+            data->cellBytes += avifImagePlaneBytes(tile->cell, AVIF_PLANES_ALL);
+        }
+        if ((result != AVIF_RESULT_OK) && (job->result == AVIF_RESULT_OK)) {
+            job->result = result;
+        }
+        avifMutexUnlock(job->mutex);
+    }
+}
+
+// Drops the least recently used cells until the rest fit in maxBytes
+static void avifDecoderDataTrimCells(avifDecoderData * data, size_t maxBytes)
+{
+    while (data->cellBytes > maxBytes) {
+        avifTile * oldest = NULL;
+        for (unsigned int i = 0; i < data->tiles.count; ++i) {
+            avifTile * tile = &data->tiles.tile[i];
+            if (tile->cell && (!oldest || (tile->cellStamp < oldest->cellStamp))) {
+                oldest = tile;
+            }
+        }
+        if (!oldest) {
+            data->cellBytes = 0;
+            break;
+        }
+        data->cellBytes -= AVIF_MIN(data->cellBytes, avifImagePlaneBytes(oldest->cell, AVIF_PLANES_ALL));
+        avifImageDestroy(oldest->cell);
+        oldest->cell = NULL;
+    }
+}
+
+// Appends the tiles of layout's cells which intersect the region to tileIndices, stamping them as used
+static void avifRegionCollectTiles(avifDecoder * decoder,
+                                   const avifRegionLayout * layout,
+                                   uint32_t x,
+                                   uint32_t y,
+                                   uint32_t width,
+                                   uint32_t height,
+                                   unsigned int * tileIndices,
+                                   unsigned int * tileIndexCount)
+{
+    avifDecoderData * data = decoder->data;
+    const unsigned int firstColumn = x / layout->cellWidth;
+    const unsigned int lastColumn = (x + width - 1) / layout->cellWidth;
+    const unsigned int firstRow = y / layout->cellHeight;
+    const unsigned int lastRow = (y + height - 1) / layout->cellHeight;
+    for (unsigned int row = firstRow; row <= lastRow; ++row) {
+        for (unsigned int column = firstColumn; column <= lastColumn; ++column) {
+            const unsigned int tileIndex = layout->firstTileIndex + (row * layout->columns) + column;
+            avifTile * tile = &data->tiles.tile[tileIndex];
+            if (tile->cell) {
+                ++decoder->ioStats.cellCacheHits;
+            }
+            tile->cellStamp = ++data->cellClock;
+            tileIndices[(*tileIndexCount)++] = tileIndex;
+        }
+    }
+}
+
+avifResult avifDecoderDecodeRegion(avifDecoder * decoder, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+    avifDecoderData * data = decoder->data;
+    if (!data || (data->tiles.count == 0)) {
+        return AVIF_RESULT_NO_CONTENT;
+    }
+    if (data->source == AVIF_DECODER_SOURCE_TRACKS) {
+        return AVIF_RESULT_NO_AV1_ITEMS_FOUND;
+    }
+    if ((data->colorTileCount == 0) || ((data->alphaGrid.rows > 0) && (data->alphaTileCount == 0))) {
+        return AVIF_RESULT_INVALID_IMAGE_GRID;
+    }
+
+    avifRegionLayout colorLayout;
+    avifRegionLayout alphaLayout;
+    avifResult result = avifDecoderRegionLayout(decoder, &colorLayout, &data->colorGrid, 0, data->colorTileCount);
+    if (result != AVIF_RESULT_OK) {
+        return result;
+    }
+    if (data->alphaTileCount > 0) {
+        result = avifDecoderRegionLayout(decoder, &alphaLayout, &data->alphaGrid, data->colorTileCount, data->alphaTileCount);
+        if (result != AVIF_RESULT_OK) {
+            return result;
+        }
+        if ((alphaLayout.width != colorLayout.width) || (alphaLayout.height != colorLayout.height)) {
+            return AVIF_RESULT_COLOR_ALPHA_SIZE_MISMATCH;
+        }
+    }
+    if ((width == 0) || (height == 0) || (x >= colorLayout.width) || (y >= colorLayout.height) ||
+        (width > (colorLayout.width - x)) || (height > (colorLayout.height - y))) {
+        return AVIF_RESULT_INVALID_REGION;
+    }
+
+    unsigned int * tileIndices = (unsigned int *)avifAlloc(sizeof(unsigned int) * data->tiles.count);
+    unsigned int tileIndexCount = 0;
+    avifRegionCollectTiles(decoder, &colorLayout, x, y, width, height, tileIndices, &tileIndexCount);
+    const unsigned int colorTileIndexCount = tileIndexCount;
+    if (data->alphaTileCount > 0) {
+        avifRegionCollectTiles(decoder, &alphaLayout, x, y, width, height, tileIndices, &tileIndexCount);
+    }
+
+    // The first color (and alpha) cell sizes the output and is what the other cells are checked against
+    avifTile * refTiles[2] = { &data->tiles.tile[tileIndices[0]], NULL };
+    if (data->alphaTileCount > 0) {
+        refTiles[1] = &data->tiles.tile[tileIndices[colorTileIndexCount]];
+    }
+    for (int alpha = 0; (alpha < 2) && (result == AVIF_RESULT_OK); ++alpha) {
+        if (refTiles[alpha]) {
+            const avifBool cached = (refTiles[alpha]->cell != NULL);
+            result = avifDecoderRegionCell(decoder, refTiles[alpha], decoder->maxThreads);
+            if ((result == AVIF_RESULT_OK) && !cached) {
+                data->cellBytes += avifImagePlaneBytes(refTiles[alpha]->cell, AVIF_PLANES_ALL);
+            }
+        }
+    }
+
+    avifImage * refCell = (result == AVIF_RESULT_OK) ? refTiles[0]->cell : NULL;
+    if (refCell) {
+        avifPixelFormatInfo formatInfo;
+        avifGetPixelFormatInfo(refCell->yuvFormat, &formatInfo);
+        if ((x & formatInfo.chromaShiftX) || (y & formatInfo.chromaShiftY)) {
+            result = AVIF_RESULT_INVALID_REGION;
+        } else if (refTiles[1] && (refTiles[1]->cell->depth != refCell->depth)) {
+            result = AVIF_RESULT_DECODE_ALPHA_FAILED;
+        }
+    }
+
+    if (result == AVIF_RESULT_OK) {
+        avifImage * dstImage = decoder->image;
+        // After avifDecoderNextImage(), the planes may still point into a codec which
+        // avifDecoderRegionCell() has destroyed since; let go of them before allocating our own
+        if (dstImage->decoderOwnsYUVPlanes) {
+            avifImageFreePlanes(dstImage, AVIF_PLANES_YUV);
+        }
+        if (dstImage->decoderOwnsAlphaPlane) {
+            avifImageFreePlanes(dstImage, AVIF_PLANES_A);
+        }
+        if ((dstImage->width != width) || (dstImage->height != height) || (dstImage->depth != refCell->depth) ||
+            (dstImage->yuvFormat != refCell->yuvFormat)) {
+            avifImageFreePlanes(dstImage, AVIF_PLANES_ALL);
+            dstImage->width = width;
+            dstImage->height = height;
+            dstImage->depth = refCell->depth;
+            dstImage->yuvFormat = refCell->yuvFormat;
+            dstImage->yuvRange = refCell->yuvRange;
+            if ((dstImage->profileFormat == AVIF_PROFILE_FORMAT_NONE) && (refCell->profileFormat == AVIF_PROFILE_FORMAT_NCLX)) {
+                avifImageSetProfileNCLX(dstImage, &refCell->nclx);
+            }
+        }
+        avifImageAllocatePlanes(dstImage, AVIF_PLANES_YUV);
+        if (data->alphaTileCount > 0) {
+            avifImageAllocatePlanes(dstImage, AVIF_PLANES_A);
+        } else {
+            avifImageFreePlanes(dstImage, AVIF_PLANES_A); // no alpha
+        }
+
+        avifRegionDecodeJob job;
+        memset(&job, 0, sizeof(avifRegionDecodeJob));
+        job.decoder = decoder;
+        job.mutex = avifMutexCreate();
+        job.layouts[0] = &colorLayout;
+        job.layouts[1] = (data->alphaTileCount > 0) ? &alphaLayout : NULL;
+        job.refCells[0] = refCell;
+        job.refCells[1] = refTiles[1] ? refTiles[1]->cell : NULL;
+        job.x = x;
+        job.y = y;
+        job.width = width;
+        job.height = height;
+        job.tileIndices = tileIndices;
+        job.tileIndexCount = tileIndexCount;
+        job.result = AVIF_RESULT_OK;
+
+        int workerCount = AVIF_MIN(decoder->maxThreads, (int)tileIndexCount);
+        workerCount = AVIF_CLAMP(workerCount, 1, AVIF_MAX_WORKERS);
+        job.codecThreads = AVIF_MAX(decoder->maxThreads / workerCount, 1);
+        avifRunWorkers(avifRegionDecodeWorker, &job, workerCount);
+
+        avifMutexDestroy(job.mutex);
+        result = job.result;
+    }
+    avifFree(tileIndices);
+
+    // Only now that every cell of the region is in place may any of them be evicted
+    avifDecoderDataTrimCells(data, decoder->regionCacheBytes);
+    avifDecoderUpdateTileStats(decoder);
+    return result;
+}
+
 avifResult avifDecoderRead(avifDecoder * decoder, avifImage * image, avifROData * input)
 {
     avifResult result = avifDecoderParse(decoder, input);
@@ -6,12 +6,17 @@
 #include <math.h>
 #include <string.h>
 
-struct YUVBlock
-{
-    float y;
-    float u;
-    float v;
-};
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define AVIF_REFORMAT_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define AVIF_REFORMAT_AVX2
+#include <immintrin.h>
+#endif
+
+// Rows per band handed to a conversion worker; even, so 4:2:0 blocks never straddle two bands
+#define AVIF_REFORMAT_BAND_ROWS 32
 
 avifBool avifPrepareReformatState(avifImage * image, avifRGBImage * rgb, avifReformatState * state)
 {
@@ -30,7 +35,8 @@ avifBool avifPrepareReformatState(avifImage * image, avifRGBImage * rgb, avifRef
     state->mode = AVIF_REFORMAT_MODE_YUV_COEFFICIENTS;
 
     if (image->profileFormat == AVIF_PROFILE_FORMAT_NCLX) {
-        if (image->nclx.matrixCoefficients == AVIF_NCLX_MATRIX_COEFFICIENTS_IDENTITY) {
+        // Identity stores G, B and R in Y, U and V; without U and V, Y is plain luma
+        if ((image->nclx.matrixCoefficients == AVIF_NCLX_MATRIX_COEFFICIENTS_IDENTITY) && !state->formatInfo.monochrome) {
             state->mode = AVIF_REFORMAT_MODE_IDENTITY;
         }
 
@@ -107,191 +113,478 @@ avifBool avifPrepareReformatState(avifImage * image, avifRGBImage * rgb, avifRef
     return AVIF_TRUE;
 }
 
-static int yuvToUNorm(int chan, avifRange range, int depth, float maxChannel, float v, avifReformatMode mode)
+// ---------------------------------------------------------------------------
+// RGB -> YUV
+//
+// Rows are converted in runs: each RGB row is unpacked into float runs, turned into Y/U/V floats,
+// then quantized and stored. The SIMD loops handle the bulk of each run and the scalar loops after
+// them handle the tails; the scalar loops are the reference, and the SIMD ones perform the same
+// operations in the same order, so the output is bit-exact with the per-pixel conversion. The only
+// exception is when the compiler is allowed to fuse multiply-adds (-ffp-contract=fast with FMA
+// enabled), which can move an occasional sample by one codepoint.
+
+typedef struct avifRGBToYUVParams
+{
+    avifImage * image;
+    avifRGBImage * rgb;
+    avifReformatState * state;
+    uint32_t firstRow; // image row held by the first row of rgb->pixels
+    float rgbMaxChannel;
+    float yuvMaxChannel;
+    float uvBias;                    // 0.5f, or 0.0f in identity mode where U/V carry raw B/R
+    float uDivisor;                  // 2 * (1 - kb)
+    float vDivisor;                  // 2 * (1 - kr)
+    const uint16_t * limitedTableY;  // full -> limited range Y lookup, NULL when full range
+    const uint16_t * limitedTableUV; // full -> limited range U/V lookup (the Y table in identity mode)
+    avifBool libYUV;                 // convert bands with avifImageRGBToYUVLibYUV() instead
+} avifRGBToYUVParams;
+
+typedef struct avifRGBToYUVScratch
+{
+    float * r;
+    float * g;
+    float * b;
+    float * y;
+    float * u[2]; // U and V of both rows of a 2x2 block
+    float * v[2];
+    float * uvAvg;
+    uint16_t * codepoints;
+} avifRGBToYUVScratch;
+
+// Converts one RGB row to float codepoints (not yet normalized)
+static void avifUnpackRGBRow(const avifRGBToYUVParams * p, uint32_t j, float * r, float * g, float * b)
+{
+    const avifRGBImage * rgb = p->rgb;
+    const uint32_t rgbPixelBytes = p->state->rgbPixelBytes;
+    const uint8_t * row = &rgb->pixels[(j - p->firstRow) * rgb->rowBytes];
+    const uint8_t * ptrR = &row[p->state->rgbOffsetBytesR];
+    const uint8_t * ptrG = &row[p->state->rgbOffsetBytesG];
+    const uint8_t * ptrB = &row[p->state->rgbOffsetBytesB];
+    if (p->state->rgbChannelBytes > 1) {
+        for (uint32_t i = 0; i < rgb->width; ++i) {
+            r[i] = (float)*((const uint16_t *)ptrR);
+            g[i] = (float)*((const uint16_t *)ptrG);
+            b[i] = (float)*((const uint16_t *)ptrB);
+            ptrR += rgbPixelBytes;
+            ptrG += rgbPixelBytes;
+            ptrB += rgbPixelBytes;
+        }
+    } else {
+        for (uint32_t i = 0; i < rgb->width; ++i) {
+            r[i] = (float)*ptrR;
+            g[i] = (float)*ptrG;
+            b[i] = (float)*ptrB;
+            ptrR += rgbPixelBytes;
+            ptrG += rgbPixelBytes;
+            ptrB += rgbPixelBytes;
+        }
+    }
+}
+
+// Normalizes a run of RGB codepoints and converts it to Y/U/V floats (U/V centered on 0)
+static void avifRGBToYUVRun(const avifRGBToYUVParams * p, const float * r, const float * g, const float * b, float * y, float * u, float * v, uint32_t count)
 {
-    if ((chan != AVIF_CHAN_Y) && (mode != AVIF_REFORMAT_MODE_IDENTITY)) { // Don't adjust U or V when data is raw RGB
-        v += 0.5f;
+    const float rgbMaxChannel = p->rgbMaxChannel;
+    uint32_t i = 0;
+
+    if (p->state->mode == AVIF_REFORMAT_MODE_IDENTITY) {
+        // Formulas 41,42,43 from https://www.itu.int/rec/T-REC-H.273-201612-I/en
+        for (; i < count; ++i) {
+            y[i] = g[i] / rgbMaxChannel;
+            u[i] = b[i] / rgbMaxChannel;
+            v[i] = r[i] / rgbMaxChannel;
+        }
+        return;
     }
-    v = AVIF_CLAMP(v, 0.0f, 1.0f);
-    int unorm = (int)avifRoundf(v * maxChannel);
-    if (range == AVIF_RANGE_LIMITED) {
-        if ((chan == AVIF_CHAN_Y) || (mode == AVIF_REFORMAT_MODE_IDENTITY)) { // use Y range for all channels when data is raw RGB
-            unorm = avifFullToLimitedY(depth, unorm);
-        } else {
-            unorm = avifFullToLimitedUV(depth, unorm);
+
+    const float kr = p->state->kr;
+    const float kg = p->state->kg;
+    const float kb = p->state->kb;
+    const float uDivisor = p->uDivisor;
+    const float vDivisor = p->vDivisor;
+
+#if defined(AVIF_REFORMAT_AVX2)
+    {
+        const __m256 maxV = _mm256_set1_ps(rgbMaxChannel);
+        const __m256 krV = _mm256_set1_ps(kr);
+        const __m256 kgV = _mm256_set1_ps(kg);
+        const __m256 kbV = _mm256_set1_ps(kb);
+        const __m256 uDivisorV = _mm256_set1_ps(uDivisor);
+        const __m256 vDivisorV = _mm256_set1_ps(vDivisor);
+        for (; (i + 8) <= count; i += 8) {
+            const __m256 R = _mm256_div_ps(_mm256_loadu_ps(&r[i]), maxV);
+            const __m256 G = _mm256_div_ps(_mm256_loadu_ps(&g[i]), maxV);
+            const __m256 B = _mm256_div_ps(_mm256_loadu_ps(&b[i]), maxV);
+            const __m256 Y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(krV, R), _mm256_mul_ps(kgV, G)), _mm256_mul_ps(kbV, B));
+            _mm256_storeu_ps(&y[i], Y);
+            _mm256_storeu_ps(&u[i], _mm256_div_ps(_mm256_sub_ps(B, Y), uDivisorV));
+            _mm256_storeu_ps(&v[i], _mm256_div_ps(_mm256_sub_ps(R, Y), vDivisorV));
         }
     }
-    return unorm;
+#endif
+#if defined(AVIF_REFORMAT_SSE2)
+    {
+        const __m128 maxV = _mm_set1_ps(rgbMaxChannel);
+        const __m128 krV = _mm_set1_ps(kr);
+        const __m128 kgV = _mm_set1_ps(kg);
+        const __m128 kbV = _mm_set1_ps(kb);
+        const __m128 uDivisorV = _mm_set1_ps(uDivisor);
+        const __m128 vDivisorV = _mm_set1_ps(vDivisor);
+        for (; (i + 4) <= count; i += 4) {
+            const __m128 R = _mm_div_ps(_mm_loadu_ps(&r[i]), maxV);
+            const __m128 G = _mm_div_ps(_mm_loadu_ps(&g[i]), maxV);
+            const __m128 B = _mm_div_ps(_mm_loadu_ps(&b[i]), maxV);
+            const __m128 Y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(krV, R), _mm_mul_ps(kgV, G)), _mm_mul_ps(kbV, B));
+            _mm_storeu_ps(&y[i], Y);
+            _mm_storeu_ps(&u[i], _mm_div_ps(_mm_sub_ps(B, Y), uDivisorV));
+            _mm_storeu_ps(&v[i], _mm_div_ps(_mm_sub_ps(R, Y), vDivisorV));
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        const float R = r[i] / rgbMaxChannel;
+        const float G = g[i] / rgbMaxChannel;
+        const float B = b[i] / rgbMaxChannel;
+        const float Y = (kr * R) + (kg * G) + (kb * B);
+        y[i] = Y;
+        u[i] = (B - Y) / uDivisor;
+        v[i] = (R - Y) / vDivisor;
+    }
 }
 
-avifResult avifImageRGBToYUV(avifImage * image, avifRGBImage * rgb)
+// Averages horizontal pairs of a U or V run (4:2:2), or the 2x2 blocks of two runs (4:2:0) when row1
+// is set. The samples of a block are summed in the same order as the original per-block conversion.
+static void avifAverageChromaRun(const float * row0, const float * row1, uint32_t width, float * avg)
 {
-    if (!rgb->pixels) {
-        return AVIF_RESULT_REFORMAT_FAILED;
+    const uint32_t pairCount = width >> 1;
+    uint32_t x = 0;
+
+#if defined(AVIF_REFORMAT_SSE2)
+    if (row1) {
+        const __m128 blockSamples = _mm_set1_ps(4.0f);
+        for (; (x + 4) <= pairCount; x += 4) {
+            const __m128 a0 = _mm_loadu_ps(&row0[x * 2]);
+            const __m128 a1 = _mm_loadu_ps(&row0[(x * 2) + 4]);
+            const __m128 b0 = _mm_loadu_ps(&row1[x * 2]);
+            const __m128 b1 = _mm_loadu_ps(&row1[(x * 2) + 4]);
+            const __m128 evenA = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 oddA = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1));
+            const __m128 evenB = _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 oddB = _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1));
+            const __m128 sum = _mm_add_ps(_mm_add_ps(_mm_add_ps(evenA, oddA), evenB), oddB);
+            _mm_storeu_ps(&avg[x], _mm_div_ps(sum, blockSamples));
+        }
+    } else {
+        const __m128 blockSamples = _mm_set1_ps(2.0f);
+        for (; (x + 4) <= pairCount; x += 4) {
+            const __m128 a0 = _mm_loadu_ps(&row0[x * 2]);
+            const __m128 a1 = _mm_loadu_ps(&row0[(x * 2) + 4]);
+            const __m128 evenA = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 oddA = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(&avg[x], _mm_div_ps(_mm_add_ps(evenA, oddA), blockSamples));
+        }
     }
+#endif
 
-    avifReformatState state;
-    if (!avifPrepareReformatState(image, rgb, &state)) {
-        return AVIF_RESULT_REFORMAT_FAILED;
+    if (row1) {
+        for (; x < pairCount; ++x) {
+            avg[x] = (row0[x * 2] + row0[(x * 2) + 1] + row1[x * 2] + row1[(x * 2) + 1]) / 4.0f;
+        }
+        if (width & 1) {
+            avg[x] = (row0[x * 2] + row1[x * 2]) / 2.0f;
+        }
+    } else {
+        for (; x < pairCount; ++x) {
+            avg[x] = (row0[x * 2] + row0[(x * 2) + 1]) / 2.0f;
+        }
+        if (width & 1) {
+            avg[x] = row0[x * 2];
+        }
     }
+}
 
-    avifImageAllocatePlanes(image, AVIF_PLANES_YUV);
-    if (avifRGBFormatHasAlpha(rgb->format)) {
-        avifImageAllocatePlanes(image, AVIF_PLANES_A);
+// Rounds a run of normalized floats (plus bias) to full range codepoints
+static void avifQuantizeRun(const float * src, uint32_t count, float bias, float maxChannel, uint16_t * codepoints)
+{
+    uint32_t i = 0;
+
+#if defined(AVIF_REFORMAT_AVX2)
+    {
+        const __m256 biasV = _mm256_set1_ps(bias);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 maxV = _mm256_set1_ps(maxChannel);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256i offset32 = _mm256_set1_epi32(0x8000);
+        const __m128i offset16 = _mm_set1_epi16((short)0x8000);
+        for (; (i + 8) <= count; i += 8) {
+            __m256 v = _mm256_add_ps(_mm256_loadu_ps(&src[i]), biasV);
+            v = _mm256_min_ps(_mm256_max_ps(v, zero), one);
+            // v is never negative here, so truncation rounds down just like floorf()
+            const __m256i unorm = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, maxV), half));
+            // There is no unsigned 32 -> 16 bit pack before SSE4.1, so shift into signed range and back
+            const __m256i biased = _mm256_sub_epi32(unorm, offset32);
+            const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(biased, biased), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128((__m128i *)&codepoints[i], _mm_xor_si128(_mm256_castsi256_si128(packed), offset16));
+        }
+    }
+#endif
+#if defined(AVIF_REFORMAT_SSE2)
+    {
+        const __m128 biasV = _mm_set1_ps(bias);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 maxV = _mm_set1_ps(maxChannel);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128i offset32 = _mm_set1_epi32(0x8000);
+        const __m128i offset16 = _mm_set1_epi16((short)0x8000);
+        for (; (i + 4) <= count; i += 4) {
+            __m128 v = _mm_add_ps(_mm_loadu_ps(&src[i]), biasV);
+            v = _mm_min_ps(_mm_max_ps(v, zero), one);
+            // v is never negative here, so truncation rounds down just like floorf()
+            const __m128i unorm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, maxV), half));
+            // There is no unsigned 32 -> 16 bit pack before SSE4.1, so shift into signed range and back
+            const __m128i biased = _mm_sub_epi32(unorm, offset32);
+            _mm_storel_epi64((__m128i *)&codepoints[i], _mm_xor_si128(_mm_packs_epi32(biased, biased), offset16));
+        }
     }
+#endif
 
-    const float kr = state.kr;
-    const float kg = state.kg;
-    const float kb = state.kb;
+    for (; i < count; ++i) {
+        float v = src[i] + bias;
+        v = AVIF_CLAMP(v, 0.0f, 1.0f);
+        // Same as avifRoundf(v * maxChannel), as the truncated value is never negative
+        codepoints[i] = (uint16_t)((v * maxChannel) + 0.5f);
+    }
+}
 
-    struct YUVBlock yuvBlock[2][2];
-    float rgbPixel[3];
-    float yuvMaxChannel = (float)((1 << image->depth) - 1);
-    float rgbMaxChannel = (float)((1 << rgb->depth) - 1);
-    uint8_t ** yuvPlanes = image->yuvPlanes;
-    uint32_t * yuvRowBytes = image->yuvRowBytes;
-    for (uint32_t outerJ = 0; outerJ < image->height; outerJ += 2) {
-        for (uint32_t outerI = 0; outerI < image->width; outerI += 2) {
-            int blockW = 2, blockH = 2;
-            if ((outerI + 1) >= image->width) {
-                blockW = 1;
+// Stores a run of full range codepoints into a plane row, mapping them to limited range if needed
+static void avifStoreRun(const uint16_t * codepoints, uint32_t count, const uint16_t * limitedTable, uint8_t * dst, uint32_t channelBytes)
+{
+    if (channelBytes > 1) {
+        uint16_t * dst16 = (uint16_t *)dst;
+        if (limitedTable) {
+            for (uint32_t i = 0; i < count; ++i) {
+                dst16[i] = limitedTable[codepoints[i]];
             }
-            if ((outerJ + 1) >= image->height) {
-                blockH = 1;
+        } else {
+            memcpy(dst16, codepoints, count * sizeof(uint16_t));
+        }
+    } else {
+        if (limitedTable) {
+            for (uint32_t i = 0; i < count; ++i) {
+                dst[i] = (uint8_t)limitedTable[codepoints[i]];
             }
+        } else {
+            for (uint32_t i = 0; i < count; ++i) {
+                dst[i] = (uint8_t)codepoints[i];
+            }
+        }
+    }
+}
 
-            // Convert an entire 2x2 block to YUV, and populate any fully sampled channels as we go
-            for (int bJ = 0; bJ < blockH; ++bJ) {
-                for (int bI = 0; bI < blockW; ++bI) {
-                    int i = outerI + bI;
-                    int j = outerJ + bJ;
-
-                    // Unpack RGB into normalized float
-                    if (state.rgbChannelBytes > 1) {
-                        rgbPixel[0] =
-                            *((uint16_t *)(&rgb->pixels[state.rgbOffsetBytesR + (i * state.rgbPixelBytes) + (j * rgb->rowBytes)])) /
-                            rgbMaxChannel;
-                        rgbPixel[1] =
-                            *((uint16_t *)(&rgb->pixels[state.rgbOffsetBytesG + (i * state.rgbPixelBytes) + (j * rgb->rowBytes)])) /
-                            rgbMaxChannel;
-                        rgbPixel[2] =
-                            *((uint16_t *)(&rgb->pixels[state.rgbOffsetBytesB + (i * state.rgbPixelBytes) + (j * rgb->rowBytes)])) /
-                            rgbMaxChannel;
-                    } else {
-                        rgbPixel[0] = rgb->pixels[state.rgbOffsetBytesR + (i * state.rgbPixelBytes) + (j * rgb->rowBytes)] / rgbMaxChannel;
-                        rgbPixel[1] = rgb->pixels[state.rgbOffsetBytesG + (i * state.rgbPixelBytes) + (j * rgb->rowBytes)] / rgbMaxChannel;
-                        rgbPixel[2] = rgb->pixels[state.rgbOffsetBytesB + (i * state.rgbPixelBytes) + (j * rgb->rowBytes)] / rgbMaxChannel;
-                    }
-
-                    // RGB -> YUV conversion
-                    if (state.mode == AVIF_REFORMAT_MODE_IDENTITY) {
-                        // Formulas 41,42,43 from https://www.itu.int/rec/T-REC-H.273-201612-I/en
-                        yuvBlock[bI][bJ].y = rgbPixel[1]; // G
-                        yuvBlock[bI][bJ].u = rgbPixel[2]; // B
-                        yuvBlock[bI][bJ].v = rgbPixel[0]; // R
-                    } else {
-                        float Y = (kr * rgbPixel[0]) + (kg * rgbPixel[1]) + (kb * rgbPixel[2]);
-                        yuvBlock[bI][bJ].y = Y;
-                        yuvBlock[bI][bJ].u = (rgbPixel[2] - Y) / (2 * (1 - kb));
-                        yuvBlock[bI][bJ].v = (rgbPixel[0] - Y) / (2 * (1 - kr));
-                    }
+static void avifStoreChromaRun(const avifRGBToYUVParams * p, avifRGBToYUVScratch * s, const float * src, int chan, uint32_t uvJ)
+{
+    avifImage * image = p->image;
+    const uint32_t uvWidth = (image->width + p->state->formatInfo.chromaShiftX) >> p->state->formatInfo.chromaShiftX;
+    avifQuantizeRun(src, uvWidth, p->uvBias, p->yuvMaxChannel, s->codepoints);
+    avifStoreRun(s->codepoints,
+                 uvWidth,
+                 p->limitedTableUV,
+                 &image->yuvPlanes[chan][uvJ * image->yuvRowBytes[chan]],
+                 p->state->yuvChannelBytes);
+}
 
-                    if (state.yuvChannelBytes > 1) {
-                        uint16_t * pY = (uint16_t *)&yuvPlanes[AVIF_CHAN_Y][(i * 2) + (j * yuvRowBytes[AVIF_CHAN_Y])];
-                        *pY = (uint16_t)yuvToUNorm(
-                            AVIF_CHAN_Y, image->yuvRange, image->depth, yuvMaxChannel, yuvBlock[bI][bJ].y, state.mode);
-                        if (!state.formatInfo.chromaShiftX && !state.formatInfo.chromaShiftY) {
-                            // YUV444, full chroma
-                            uint16_t * pU = (uint16_t *)&yuvPlanes[AVIF_CHAN_U][(i * 2) + (j * yuvRowBytes[AVIF_CHAN_U])];
-                            *pU = (uint16_t)yuvToUNorm(
-                                AVIF_CHAN_U, image->yuvRange, image->depth, yuvMaxChannel, yuvBlock[bI][bJ].u, state.mode);
-                            uint16_t * pV = (uint16_t *)&yuvPlanes[AVIF_CHAN_V][(i * 2) + (j * yuvRowBytes[AVIF_CHAN_V])];
-                            *pV = (uint16_t)yuvToUNorm(
-                                AVIF_CHAN_V, image->yuvRange, image->depth, yuvMaxChannel, yuvBlock[bI][bJ].v, state.mode);
-                        }
-                    } else {
-                        yuvPlanes[AVIF_CHAN_Y][i + (j * yuvRowBytes[AVIF_CHAN_Y])] = (uint8_t)yuvToUNorm(
-                            AVIF_CHAN_Y, image->yuvRange, image->depth, yuvMaxChannel, yuvBlock[bI][bJ].y, state.mode);
-                        if (!state.formatInfo.chromaShiftX && !state.formatInfo.chromaShiftY) {
-                            // YUV444, full chroma
-                            yuvPlanes[AVIF_CHAN_U][i + (j * yuvRowBytes[AVIF_CHAN_U])] = (uint8_t)yuvToUNorm(
-                                AVIF_CHAN_U, image->yuvRange, image->depth, yuvMaxChannel, yuvBlock[bI][bJ].u, state.mode);
-                            yuvPlanes[AVIF_CHAN_V][i + (j * yuvRowBytes[AVIF_CHAN_V])] = (uint8_t)yuvToUNorm(
-                                AVIF_CHAN_V, image->yuvRange, image->depth, yuvMaxChannel, yuvBlock[bI][bJ].v, state.mode);
-                        }
-                    }
+// Converts rows [rowStart, rowEnd); rowStart must be even
+static void avifRGBToYUVRows(const avifRGBToYUVParams * p, avifRGBToYUVScratch * s, uint32_t rowStart, uint32_t rowEnd)
+{
+    avifImage * image = p->image;
+    const avifPixelFormatInfo * formatInfo = &p->state->formatInfo;
+    const uint32_t width = image->width;
+
+    for (uint32_t outerJ = rowStart; outerJ < rowEnd; outerJ += 2) {
+        const uint32_t blockH = ((outerJ + 1) < rowEnd) ? 2 : 1;
+        for (uint32_t bJ = 0; bJ < blockH; ++bJ) {
+            const uint32_t j = outerJ + bJ;
+            avifUnpackRGBRow(p, j, s->r, s->g, s->b);
+            avifRGBToYUVRun(p, s->r, s->g, s->b, s->y, s->u[bJ], s->v[bJ], width);
+
+            avifQuantizeRun(s->y, width, 0.0f, p->yuvMaxChannel, s->codepoints);
+            avifStoreRun(s->codepoints,
+                         width,
+                         p->limitedTableY,
+                         &image->yuvPlanes[AVIF_CHAN_Y][j * image->yuvRowBytes[AVIF_CHAN_Y]],
+                         p->state->yuvChannelBytes);
+
+            if (formatInfo->monochrome) {
+                // YUV400, Y only
+            } else if (!formatInfo->chromaShiftY) {
+                if (formatInfo->chromaShiftX) {
+                    // YUV422, average 2 samples (1x2)
+                    avifAverageChromaRun(s->u[bJ], NULL, width, s->uvAvg);
+                    avifStoreChromaRun(p, s, s->uvAvg, AVIF_CHAN_U, j);
+                    avifAverageChromaRun(s->v[bJ], NULL, width, s->uvAvg);
+                    avifStoreChromaRun(p, s, s->uvAvg, AVIF_CHAN_V, j);
+                } else {
+                    // YUV444, full chroma
+                    avifStoreChromaRun(p, s, s->u[bJ], AVIF_CHAN_U, j);
+                    avifStoreChromaRun(p, s, s->v[bJ], AVIF_CHAN_V, j);
                 }
             }
+        }
 
-            // Populate any subsampled channels with averages from the 2x2 block
-            if (state.formatInfo.chromaShiftX && state.formatInfo.chromaShiftY) {
-                // YUV420, average 4 samples (2x2)
+        if (formatInfo->chromaShiftY && !formatInfo->monochrome) {
+            // YUV420, average 4 samples (2x2)
+            const uint32_t uvJ = outerJ >> formatInfo->chromaShiftY;
+            avifAverageChromaRun(s->u[0], (blockH > 1) ? s->u[1] : NULL, width, s->uvAvg);
+            avifStoreChromaRun(p, s, s->uvAvg, AVIF_CHAN_U, uvJ);
+            avifAverageChromaRun(s->v[0], (blockH > 1) ? s->v[1] : NULL, width, s->uvAvg);
+            avifStoreChromaRun(p, s, s->uvAvg, AVIF_CHAN_V, uvJ);
+        }
+    }
+}
 
-                float sumU = 0.0f;
-                float sumV = 0.0f;
-                for (int bJ = 0; bJ < blockH; ++bJ) {
-                    for (int bI = 0; bI < blockW; ++bI) {
-                        sumU += yuvBlock[bI][bJ].u;
-                        sumV += yuvBlock[bI][bJ].v;
-                    }
-                }
-                float totalSamples = (float)(blockW * blockH);
-                float avgU = sumU / totalSamples;
-                float avgV = sumV / totalSamples;
-
-                int uvI = outerI >> state.formatInfo.chromaShiftX;
-                int uvJ = outerJ >> state.formatInfo.chromaShiftY;
-                if (state.yuvChannelBytes > 1) {
-                    uint16_t * pU = (uint16_t *)&yuvPlanes[AVIF_CHAN_U][(uvI * 2) + (uvJ * yuvRowBytes[AVIF_CHAN_U])];
-                    *pU = (uint16_t)yuvToUNorm(AVIF_CHAN_U, image->yuvRange, image->depth, yuvMaxChannel, avgU, state.mode);
-                    uint16_t * pV = (uint16_t *)&yuvPlanes[AVIF_CHAN_V][(uvI * 2) + (uvJ * yuvRowBytes[AVIF_CHAN_V])];
-                    *pV = (uint16_t)yuvToUNorm(AVIF_CHAN_V, image->yuvRange, image->depth, yuvMaxChannel, avgV, state.mode);
-                } else {
-                    yuvPlanes[AVIF_CHAN_U][uvI + (uvJ * yuvRowBytes[AVIF_CHAN_U])] =
-                        (uint8_t)yuvToUNorm(AVIF_CHAN_U, image->yuvRange, image->depth, yuvMaxChannel, avgU, state.mode);
-                    yuvPlanes[AVIF_CHAN_V][uvI + (uvJ * yuvRowBytes[AVIF_CHAN_V])] =
-                        (uint8_t)yuvToUNorm(AVIF_CHAN_V, image->yuvRange, image->depth, yuvMaxChannel, avgV, state.mode);
-                }
-            } else if (state.formatInfo.chromaShiftX && !state.formatInfo.chromaShiftY) {
-                // YUV422, average 2 samples (1x2), twice
-
-                for (int bJ = 0; bJ < blockH; ++bJ) {
-                    float sumU = 0.0f;
-                    float sumV = 0.0f;
-                    for (int bI = 0; bI < blockW; ++bI) {
-                        sumU += yuvBlock[bI][bJ].u;
-                        sumV += yuvBlock[bI][bJ].v;
-                    }
-                    float totalSamples = (float)blockW;
-                    float avgU = sumU / totalSamples;
-                    float avgV = sumV / totalSamples;
-
-                    int uvI = outerI >> state.formatInfo.chromaShiftX;
-                    int uvJ = outerJ + bJ;
-                    if (state.yuvChannelBytes > 1) {
-                        uint16_t * pU = (uint16_t *)&yuvPlanes[AVIF_CHAN_U][(uvI * 2) + (uvJ * yuvRowBytes[AVIF_CHAN_U])];
-                        *pU = (uint16_t)yuvToUNorm(AVIF_CHAN_U, image->yuvRange, image->depth, yuvMaxChannel, avgU, state.mode);
-                        uint16_t * pV = (uint16_t *)&yuvPlanes[AVIF_CHAN_V][(uvI * 2) + (uvJ * yuvRowBytes[AVIF_CHAN_V])];
-                        *pV = (uint16_t)yuvToUNorm(AVIF_CHAN_V, image->yuvRange, image->depth, yuvMaxChannel, avgV, state.mode);
-                    } else {
-                        yuvPlanes[AVIF_CHAN_U][uvI + (uvJ * yuvRowBytes[AVIF_CHAN_U])] =
-                            (uint8_t)yuvToUNorm(AVIF_CHAN_U, image->yuvRange, image->depth, yuvMaxChannel, avgU, state.mode);
-                        yuvPlanes[AVIF_CHAN_V][uvI + (uvJ * yuvRowBytes[AVIF_CHAN_V])] =
-                            (uint8_t)yuvToUNorm(AVIF_CHAN_V, image->yuvRange, image->depth, yuvMaxChannel, avgV, state.mode);
-                    }
-                }
+typedef struct avifRGBToYUVJob
+{
+    const avifRGBToYUVParams * params;
+    uint32_t endRow;
+    avifMutex * mutex;
+    uint32_t nextRow;
+    avifResult result;
+} avifRGBToYUVJob;
+
+static void avifRGBToYUVWorker(void * userData)
+{
+    avifRGBToYUVJob * job = (avifRGBToYUVJob *)userData;
+    const avifRGBToYUVParams * params = job->params;
+    const uint32_t width = params->image->width;
+
+    // One allocation for all runs; 9 float runs + 1 uint16_t run of the image width
+    float * buffer = (float *)avifAlloc(sizeof(float) * 10 * width);
+    avifRGBToYUVScratch scratch;
+    scratch.r = &buffer[0 * width];
+    scratch.g = &buffer[1 * width];
+    scratch.b = &buffer[2 * width];
+    scratch.y = &buffer[3 * width];
+    scratch.u[0] = &buffer[4 * width];
+    scratch.u[1] = &buffer[5 * width];
+    scratch.v[0] = &buffer[6 * width];
+    scratch.v[1] = &buffer[7 * width];
+    scratch.uvAvg = &buffer[8 * width];
+    scratch.codepoints = (uint16_t *)&buffer[9 * width];
+
+    for (;;) {
+        avifMutexLock(job->mutex);
+        const uint32_t rowStart = job->nextRow;
+        if (rowStart < job->endRow) {
+            job->nextRow = AVIF_MIN(rowStart + AVIF_REFORMAT_BAND_ROWS, job->endRow);
+        }
+        avifMutexUnlock(job->mutex);
+        if (rowStart >= job->endRow) {
+            break;
+        }
+        const uint32_t rowEnd = AVIF_MIN(rowStart + AVIF_REFORMAT_BAND_ROWS, job->endRow);
+        if (params->libYUV) {
+            // A view of rgb starting at rowStart, which is where libyuv begins reading
+            avifRGBImage bandRGB = *params->rgb;
+            bandRGB.pixels = &params->rgb->pixels[(rowStart - params->firstRow) * params->rgb->rowBytes];
+            bandRGB.height = rowEnd - rowStart;
+            avifResult result = avifImageRGBToYUVLibYUV(params->image, &bandRGB, rowStart, rowEnd);
+            if (result != AVIF_RESULT_OK) {
+                avifMutexLock(job->mutex);
+                job->result = result;
+                avifMutexUnlock(job->mutex);
             }
+        } else {
+            avifRGBToYUVRows(params, &scratch, rowStart, rowEnd);
+        }
+    }
+    avifFree(buffer);
+}
+
+avifResult avifImageRGBToYUV(avifImage * image, avifRGBImage * rgb)
+{
+    return avifImageRGBToYUVRows(image, rgb, 0, image->height);
+}
+
+avifResult avifImageRGBToYUVRows(avifImage * image, avifRGBImage * rgb, uint32_t firstRow, uint32_t rowCount)
+{
+    if (!rgb->pixels) {
+        return AVIF_RESULT_REFORMAT_FAILED;
+    }
+    if ((firstRow > image->height) || (rowCount > (image->height - firstRow))) {
+        return AVIF_RESULT_REFORMAT_FAILED;
+    }
+
+    avifReformatState state;
+    if (!avifPrepareReformatState(image, rgb, &state)) {
+        return AVIF_RESULT_REFORMAT_FAILED;
+    }
+    if (state.formatInfo.chromaShiftY && !state.formatInfo.monochrome) {
+        // Each 4:2:0 chroma row averages two image rows, which must arrive in the same band
+        if ((firstRow & 1) || ((rowCount & 1) && ((firstRow + rowCount) != image->height))) {
+            return AVIF_RESULT_REFORMAT_FAILED;
+        }
+    }
+
+    avifImageAllocatePlanes(image, AVIF_PLANES_YUV);
+    if (avifRGBFormatHasAlpha(rgb->format)) {
+        avifImageAllocatePlanes(image, AVIF_PLANES_A);
+    }
+
+    avifRGBToYUVParams runParams;
+    runParams.image = image;
+    runParams.rgb = rgb;
+    runParams.state = &state;
+    runParams.firstRow = firstRow;
+    runParams.rgbMaxChannel = (float)((1 << rgb->depth) - 1);
+    runParams.yuvMaxChannel = (float)((1 << image->depth) - 1);
+    runParams.uvBias = (state.mode == AVIF_REFORMAT_MODE_IDENTITY) ? 0.0f : 0.5f;
+    runParams.uDivisor = 2 * (1 - state.kb);
+    runParams.vDivisor = 2 * (1 - state.kr);
+    runParams.limitedTableY = NULL;
+    runParams.limitedTableUV = NULL;
+    runParams.libYUV = avifLibYUVSupportsReformat(image, rgb, &state);
+
+    // Full -> limited range lookups, indexed by full range codepoint
+    uint16_t * limitedTables = NULL;
+    if ((image->yuvRange == AVIF_RANGE_LIMITED) && !runParams.libYUV) {
+        const int cpCount = 1 << image->depth;
+        limitedTables = (uint16_t *)avifAlloc(sizeof(uint16_t) * 2 * cpCount);
+        for (int cp = 0; cp < cpCount; ++cp) {
+            limitedTables[cp] = (uint16_t)avifFullToLimitedY(image->depth, cp);
+            limitedTables[cpCount + cp] = (uint16_t)avifFullToLimitedUV(image->depth, cp);
         }
+        runParams.limitedTableY = &limitedTables[0];
+        // Use Y range for all channels when data is raw RGB
+        runParams.limitedTableUV = (state.mode == AVIF_REFORMAT_MODE_IDENTITY) ? &limitedTables[0] : &limitedTables[cpCount];
+    }
+
+    avifRGBToYUVJob job;
+    memset(&job, 0, sizeof(job));
+    job.params = &runParams;
+    job.endRow = firstRow + rowCount;
+    job.mutex = avifMutexCreate();
+    job.nextRow = firstRow;
+    job.result = AVIF_RESULT_OK;
+    const int bandCount = (int)((rowCount + AVIF_REFORMAT_BAND_ROWS - 1) / AVIF_REFORMAT_BAND_ROWS);
+    const int maxThreads = (rgb->maxThreads > 1) ? rgb->maxThreads : 1;
+    avifRunWorkers(avifRGBToYUVWorker, &job, AVIF_MIN(maxThreads, bandCount));
+    avifMutexDestroy(job.mutex);
+    avifFree(limitedTables);
+    if (job.result != AVIF_RESULT_OK) {
+        return job.result;
     }
 
     if (image->alphaPlane && image->alphaRowBytes) {
         avifAlphaParams params;
 
         params.width = image->width;
-        params.height = image->height;
+        params.height = rowCount;
         params.dstDepth = image->depth;
         params.dstRange = image->alphaRange;
-        params.dstPlane = image->alphaPlane;
+        params.dstPlane = &image->alphaPlane[firstRow * image->alphaRowBytes];
         params.dstRowBytes = image->alphaRowBytes;
         params.dstOffsetBytes = 0;
         params.dstPixelBytes = state.yuvChannelBytes;
@@ -312,397 +605,209 @@ avifResult avifImageRGBToYUV(avifImage * image, avifRGBImage * rgb)
     return AVIF_RESULT_OK;
 }
 
-static avifResult avifImageYUVAnyToRGBAnySlow(avifImage * image, avifRGBImage * rgb, avifReformatState * state)
-{
-    const float kr = state->kr;
-    const float kg = state->kg;
-    const float kb = state->kb;
-    const uint32_t rgbPixelBytes = state->rgbPixelBytes;
-    const float * const unormFloatTableY = state->unormFloatTableY;
-    const float * const unormFloatTableUV = state->unormFloatTableUV;
-    const uint32_t maxUVI = ((image->width + state->formatInfo.chromaShiftX) >> state->formatInfo.chromaShiftX) - 1;
-    const uint32_t maxUVJ = ((image->height + state->formatInfo.chromaShiftY) >> state->formatInfo.chromaShiftY) - 1;
-    const avifBool hasColor = (image->yuvPlanes[AVIF_CHAN_U] && image->yuvPlanes[AVIF_CHAN_V]);
+// ---------------------------------------------------------------------------
+// YUV -> RGB
+//
+// Like the RGB -> YUV direction, rows are converted in runs: samples are looked up in the reformat
+// state's float tables (upsampling chroma by repetition), converted with the SIMD kernel, then
+// quantized with avifQuantizeRun() and stored. The float operations and their order match the
+// original per-pixel conversion, so fixed-point math isn't used here: it would not be bit-exact.
 
-    const uint16_t yuvMaxChannel = (uint16_t)((1 << image->depth) - 1);
-    const float rgbMaxChannel = (float)((1 << rgb->depth) - 1);
-    for (uint32_t j = 0; j < image->height; ++j) {
-        const uint32_t uvJ = AVIF_MIN(j >> state->formatInfo.chromaShiftY, maxUVJ);
-        uint8_t * ptrY8 = &image->yuvPlanes[AVIF_CHAN_Y][(j * image->yuvRowBytes[AVIF_CHAN_Y])];
-        uint8_t * ptrU8 = NULL;
-        uint8_t * ptrV8 = NULL;
-        if (hasColor) {
-            ptrU8 = &image->yuvPlanes[AVIF_CHAN_U][(uvJ * image->yuvRowBytes[AVIF_CHAN_U])];
-            ptrV8 = &image->yuvPlanes[AVIF_CHAN_V][(uvJ * image->yuvRowBytes[AVIF_CHAN_V])];
+// Looks up a run of Y, U or V samples in one of the state's float tables, one value per pixel
+static void avifUnpackYUVRow(const avifImage * image, const avifReformatState * state, int chan, uint32_t j, const float * table, float * dst)
+{
+    const uint32_t shiftX = (chan == AVIF_CHAN_Y) ? 0 : state->formatInfo.chromaShiftX;
+    const uint8_t * row = &image->yuvPlanes[chan][j * image->yuvRowBytes[chan]];
+    if (state->yuvChannelBytes > 1) {
+        // clamp incoming data to protect against bad LUT lookups
+        const uint16_t * row16 = (const uint16_t *)row;
+        const uint16_t yuvMaxChannel = (uint16_t)((1 << image->depth) - 1);
+        for (uint32_t i = 0; i < image->width; ++i) {
+            dst[i] = table[AVIF_MIN(row16[i >> shiftX], yuvMaxChannel)];
         }
-        uint16_t * ptrY16 = (uint16_t *)ptrY8;
-        uint16_t * ptrU16 = (uint16_t *)ptrU8;
-        uint16_t * ptrV16 = (uint16_t *)ptrV8;
-        uint8_t * ptrR = &rgb->pixels[state->rgbOffsetBytesR + (j * rgb->rowBytes)];
-        uint8_t * ptrG = &rgb->pixels[state->rgbOffsetBytesG + (j * rgb->rowBytes)];
-        uint8_t * ptrB = &rgb->pixels[state->rgbOffsetBytesB + (j * rgb->rowBytes)];
-
+    } else {
+        // no clamp necessary, the full uint8_t range is a legal lookup
         for (uint32_t i = 0; i < image->width; ++i) {
-            uint32_t uvI = AVIF_MIN(i >> state->formatInfo.chromaShiftX, maxUVI);
-            uint16_t unormY, unormU, unormV;
-
-            // clamp incoming data to protect against bad LUT lookups
-            if (image->depth == 8) {
-                unormY = (uint16_t)AVIF_MIN(ptrY8[i], yuvMaxChannel);
-                if (hasColor) {
-                    unormU = (uint16_t)AVIF_MIN(ptrU8[uvI], yuvMaxChannel);
-                    unormV = (uint16_t)AVIF_MIN(ptrV8[uvI], yuvMaxChannel);
-                } else {
-                    unormU = 0;
-                    unormV = 0;
-                }
-            } else {
-                unormY = AVIF_MIN(ptrY16[i], yuvMaxChannel);
-                if (hasColor) {
-                    unormU = AVIF_MIN(ptrU16[uvI], yuvMaxChannel);
-                    unormV = AVIF_MIN(ptrV16[uvI], yuvMaxChannel);
-                } else {
-                    unormU = 0;
-                    unormV = 0;
-                }
-            }
-
-            // Convert unorm to float
-            const float Y = unormFloatTableY[unormY];
-            const float Cb = unormFloatTableUV[unormU];
-            const float Cr = unormFloatTableUV[unormV];
-
-            float R, G, B;
-            if (state->mode == AVIF_REFORMAT_MODE_IDENTITY) {
-                // Formulas 41,42,43 from https://www.itu.int/rec/T-REC-H.273-201612-I/en
-                if (hasColor) {
-                    G = Y;
-                    B = Cb;
-                    R = Cr;
-                } else {
-                    G = Y;
-                    B = Y;
-                    R = Y;
-                }
-            } else {
-                R = Y + (2 * (1 - kr)) * Cr;
-                B = Y + (2 * (1 - kb)) * Cb;
-                G = Y - ((2 * ((kr * (1 - kr) * Cr) + (kb * (1 - kb) * Cb))) / kg);
-            }
-            const float Rc = AVIF_CLAMP(R, 0.0f, 1.0f);
-            const float Gc = AVIF_CLAMP(G, 0.0f, 1.0f);
-            const float Bc = AVIF_CLAMP(B, 0.0f, 1.0f);
-
-            if (rgb->depth == 8) {
-                *ptrR = (uint8_t)(0.5f + (Rc * rgbMaxChannel));
-                *ptrG = (uint8_t)(0.5f + (Gc * rgbMaxChannel));
-                *ptrB = (uint8_t)(0.5f + (Bc * rgbMaxChannel));
-            } else {
-                *((uint16_t *)ptrR) = (uint16_t)(0.5f + (Rc * rgbMaxChannel));
-                *((uint16_t *)ptrG) = (uint16_t)(0.5f + (Gc * rgbMaxChannel));
-                *((uint16_t *)ptrB) = (uint16_t)(0.5f + (Bc * rgbMaxChannel));
-            }
-            ptrR += rgbPixelBytes;
-            ptrG += rgbPixelBytes;
-            ptrB += rgbPixelBytes;
+            dst[i] = table[row[i >> shiftX]];
         }
     }
-    return AVIF_RESULT_OK;
 }
 
-static avifResult avifImageYUV16ToRGB16Color(avifImage * image, avifRGBImage * rgb, avifReformatState * state)
+static void avifYUVToRGBRun(const avifReformatState * state, const float * y, const float * u, const float * v, float * r, float * g, float * b, uint32_t count)
 {
-    const float kr = state->kr;
     const float kg = state->kg;
-    const float kb = state->kb;
-    const uint32_t rgbPixelBytes = state->rgbPixelBytes;
-    const float * const unormFloatTableY = state->unormFloatTableY;
-    const float * const unormFloatTableUV = state->unormFloatTableUV;
-    const uint32_t maxUVI = ((image->width + state->formatInfo.chromaShiftX) >> state->formatInfo.chromaShiftX) - 1;
-    const uint32_t maxUVJ = ((image->height + state->formatInfo.chromaShiftY) >> state->formatInfo.chromaShiftY) - 1;
-
-    const uint16_t yuvMaxChannel = (uint16_t)((1 << image->depth) - 1);
-    const float rgbMaxChannel = (float)((1 << rgb->depth) - 1);
-    for (uint32_t j = 0; j < image->height; ++j) {
-        const uint32_t uvJ = AVIF_MIN(j >> state->formatInfo.chromaShiftY, maxUVJ);
-        const uint16_t * const ptrY = (uint16_t *)&image->yuvPlanes[AVIF_CHAN_Y][(j * image->yuvRowBytes[AVIF_CHAN_Y])];
-        const uint16_t * const ptrU = (uint16_t *)&image->yuvPlanes[AVIF_CHAN_U][(uvJ * image->yuvRowBytes[AVIF_CHAN_U])];
-        const uint16_t * const ptrV = (uint16_t *)&image->yuvPlanes[AVIF_CHAN_V][(uvJ * image->yuvRowBytes[AVIF_CHAN_V])];
-        uint8_t * ptrR = &rgb->pixels[state->rgbOffsetBytesR + (j * rgb->rowBytes)];
-        uint8_t * ptrG = &rgb->pixels[state->rgbOffsetBytesG + (j * rgb->rowBytes)];
-        uint8_t * ptrB = &rgb->pixels[state->rgbOffsetBytesB + (j * rgb->rowBytes)];
-
-        for (uint32_t i = 0; i < image->width; ++i) {
-            uint32_t uvI = AVIF_MIN(i >> state->formatInfo.chromaShiftX, maxUVI);
-
-            // clamp incoming data to protect against bad LUT lookups
-            const uint16_t unormY = AVIF_MIN(ptrY[i], yuvMaxChannel);
-            const uint16_t unormU = AVIF_MIN(ptrU[uvI], yuvMaxChannel);
-            const uint16_t unormV = AVIF_MIN(ptrV[uvI], yuvMaxChannel);
-
-            // Convert unorm to float
-            const float Y = unormFloatTableY[unormY];
-            const float Cb = unormFloatTableUV[unormU];
-            const float Cr = unormFloatTableUV[unormV];
-
-            const float R = Y + (2 * (1 - kr)) * Cr;
-            const float B = Y + (2 * (1 - kb)) * Cb;
-            const float G = Y - ((2 * ((kr * (1 - kr) * Cr) + (kb * (1 - kb) * Cb))) / kg);
-            const float Rc = AVIF_CLAMP(R, 0.0f, 1.0f);
-            const float Gc = AVIF_CLAMP(G, 0.0f, 1.0f);
-            const float Bc = AVIF_CLAMP(B, 0.0f, 1.0f);
-
-            *((uint16_t *)ptrR) = (uint16_t)(0.5f + (Rc * rgbMaxChannel));
-            *((uint16_t *)ptrG) = (uint16_t)(0.5f + (Gc * rgbMaxChannel));
-            *((uint16_t *)ptrB) = (uint16_t)(0.5f + (Bc * rgbMaxChannel));
-
-            ptrR += rgbPixelBytes;
-            ptrG += rgbPixelBytes;
-            ptrB += rgbPixelBytes;
+    const float rCoeff = 2 * (1 - state->kr);
+    const float bCoeff = 2 * (1 - state->kb);
+    const float gCoeffR = state->kr * (1 - state->kr);
+    const float gCoeffB = state->kb * (1 - state->kb);
+    uint32_t i = 0;
+
+#if defined(AVIF_REFORMAT_AVX2)
+    {
+        const __m256 kgV = _mm256_set1_ps(kg);
+        const __m256 rCoeffV = _mm256_set1_ps(rCoeff);
+        const __m256 bCoeffV = _mm256_set1_ps(bCoeff);
+        const __m256 gCoeffRV = _mm256_set1_ps(gCoeffR);
+        const __m256 gCoeffBV = _mm256_set1_ps(gCoeffB);
+        const __m256 two = _mm256_set1_ps(2.0f);
+        for (; (i + 8) <= count; i += 8) {
+            const __m256 Y = _mm256_loadu_ps(&y[i]);
+            const __m256 Cb = _mm256_loadu_ps(&u[i]);
+            const __m256 Cr = _mm256_loadu_ps(&v[i]);
+            const __m256 gSum = _mm256_add_ps(_mm256_mul_ps(gCoeffRV, Cr), _mm256_mul_ps(gCoeffBV, Cb));
+            _mm256_storeu_ps(&r[i], _mm256_add_ps(Y, _mm256_mul_ps(rCoeffV, Cr)));
+            _mm256_storeu_ps(&g[i], _mm256_sub_ps(Y, _mm256_div_ps(_mm256_mul_ps(two, gSum), kgV)));
+            _mm256_storeu_ps(&b[i], _mm256_add_ps(Y, _mm256_mul_ps(bCoeffV, Cb)));
         }
     }
-    return AVIF_RESULT_OK;
-}
-
-static avifResult avifImageYUV16ToRGB16Mono(avifImage * image, avifRGBImage * rgb, avifReformatState * state)
-{
-    const float kr = state->kr;
-    const float kg = state->kg;
-    const float kb = state->kb;
-    const uint32_t rgbPixelBytes = state->rgbPixelBytes;
-    const float * const unormFloatTableY = state->unormFloatTableY;
-
-    const uint16_t yuvMaxChannel = (uint16_t)((1 << image->depth) - 1);
-    const float rgbMaxChannel = (float)((1 << rgb->depth) - 1);
-    for (uint32_t j = 0; j < image->height; ++j) {
-        const uint16_t * const ptrY = (uint16_t *)&image->yuvPlanes[AVIF_CHAN_Y][(j * image->yuvRowBytes[AVIF_CHAN_Y])];
-        uint8_t * ptrR = &rgb->pixels[state->rgbOffsetBytesR + (j * rgb->rowBytes)];
-        uint8_t * ptrG = &rgb->pixels[state->rgbOffsetBytesG + (j * rgb->rowBytes)];
-        uint8_t * ptrB = &rgb->pixels[state->rgbOffsetBytesB + (j * rgb->rowBytes)];
-
-        for (uint32_t i = 0; i < image->width; ++i) {
-            // clamp incoming data to protect against bad LUT lookups
-            const uint16_t unormY = AVIF_MIN(ptrY[i], yuvMaxChannel);
-
-            // Convert unorm to float
-            const float Y = unormFloatTableY[unormY];
-            const float Cb = 0.0f;
-            const float Cr = 0.0f;
-
-            const float R = Y + (2 * (1 - kr)) * Cr;
-            const float B = Y + (2 * (1 - kb)) * Cb;
-            const float G = Y - ((2 * ((kr * (1 - kr) * Cr) + (kb * (1 - kb) * Cb))) / kg);
-            const float Rc = AVIF_CLAMP(R, 0.0f, 1.0f);
-            const float Gc = AVIF_CLAMP(G, 0.0f, 1.0f);
-            const float Bc = AVIF_CLAMP(B, 0.0f, 1.0f);
-
-            *((uint16_t *)ptrR) = (uint16_t)(0.5f + (Rc * rgbMaxChannel));
-            *((uint16_t *)ptrG) = (uint16_t)(0.5f + (Gc * rgbMaxChannel));
-            *((uint16_t *)ptrB) = (uint16_t)(0.5f + (Bc * rgbMaxChannel));
-
-            ptrR += rgbPixelBytes;
-            ptrG += rgbPixelBytes;
-            ptrB += rgbPixelBytes;
+#endif
+#if defined(AVIF_REFORMAT_SSE2)
+    {
+        const __m128 kgV = _mm_set1_ps(kg);
+        const __m128 rCoeffV = _mm_set1_ps(rCoeff);
+        const __m128 bCoeffV = _mm_set1_ps(bCoeff);
+        const __m128 gCoeffRV = _mm_set1_ps(gCoeffR);
+        const __m128 gCoeffBV = _mm_set1_ps(gCoeffB);
+        const __m128 two = _mm_set1_ps(2.0f);
+        for (; (i + 4) <= count; i += 4) {
+            const __m128 Y = _mm_loadu_ps(&y[i]);
+            const __m128 Cb = _mm_loadu_ps(&u[i]);
+            const __m128 Cr = _mm_loadu_ps(&v[i]);
+            const __m128 gSum = _mm_add_ps(_mm_mul_ps(gCoeffRV, Cr), _mm_mul_ps(gCoeffBV, Cb));
+            _mm_storeu_ps(&r[i], _mm_add_ps(Y, _mm_mul_ps(rCoeffV, Cr)));
+            _mm_storeu_ps(&g[i], _mm_sub_ps(Y, _mm_div_ps(_mm_mul_ps(two, gSum), kgV)));
+            _mm_storeu_ps(&b[i], _mm_add_ps(Y, _mm_mul_ps(bCoeffV, Cb)));
         }
     }
-    return AVIF_RESULT_OK;
+#endif
+
+    for (; i < count; ++i) {
+        const float Y = y[i];
+        const float Cb = u[i];
+        const float Cr = v[i];
+        r[i] = Y + rCoeff * Cr;
+        g[i] = Y - ((2 * ((gCoeffR * Cr) + (gCoeffB * Cb))) / kg);
+        b[i] = Y + bCoeff * Cb;
+    }
 }
-static avifResult avifImageYUV16ToRGB8Color(avifImage * image, avifRGBImage * rgb, avifReformatState * state)
-{
-    const float kr = state->kr;
-    const float kg = state->kg;
-    const float kb = state->kb;
-    const uint32_t rgbPixelBytes = state->rgbPixelBytes;
-    const float * const unormFloatTableY = state->unormFloatTableY;
-    const float * const unormFloatTableUV = state->unormFloatTableUV;
-    const uint32_t maxUVI = ((image->width + state->formatInfo.chromaShiftX) >> state->formatInfo.chromaShiftX) - 1;
-    const uint32_t maxUVJ = ((image->height + state->formatInfo.chromaShiftY) >> state->formatInfo.chromaShiftY) - 1;
-
-    const uint16_t yuvMaxChannel = (uint16_t)((1 << image->depth) - 1);
-    const float rgbMaxChannel = (float)((1 << rgb->depth) - 1);
-    for (uint32_t j = 0; j < image->height; ++j) {
-        const uint32_t uvJ = AVIF_MIN(j >> state->formatInfo.chromaShiftY, maxUVJ);
-        const uint16_t * const ptrY = (uint16_t *)&image->yuvPlanes[AVIF_CHAN_Y][(j * image->yuvRowBytes[AVIF_CHAN_Y])];
-        const uint16_t * const ptrU = (uint16_t *)&image->yuvPlanes[AVIF_CHAN_U][(uvJ * image->yuvRowBytes[AVIF_CHAN_U])];
-        const uint16_t * const ptrV = (uint16_t *)&image->yuvPlanes[AVIF_CHAN_V][(uvJ * image->yuvRowBytes[AVIF_CHAN_V])];
-        uint8_t * ptrR = &rgb->pixels[state->rgbOffsetBytesR + (j * rgb->rowBytes)];
-        uint8_t * ptrG = &rgb->pixels[state->rgbOffsetBytesG + (j * rgb->rowBytes)];
-        uint8_t * ptrB = &rgb->pixels[state->rgbOffsetBytesB + (j * rgb->rowBytes)];
-
-        for (uint32_t i = 0; i < image->width; ++i) {
-            uint32_t uvI = AVIF_MIN(i >> state->formatInfo.chromaShiftX, maxUVI);
-
-            // clamp incoming data to protect against bad LUT lookups
-            const uint16_t unormY = AVIF_MIN(ptrY[i], yuvMaxChannel);
-            const uint16_t unormU = AVIF_MIN(ptrU[uvI], yuvMaxChannel);
-            const uint16_t unormV = AVIF_MIN(ptrV[uvI], yuvMaxChannel);
 
-            // Convert unorm to float
-            const float Y = unormFloatTableY[unormY];
-            const float Cb = unormFloatTableUV[unormU];
-            const float Cr = unormFloatTableUV[unormV];
-
-            const float R = Y + (2 * (1 - kr)) * Cr;
-            const float B = Y + (2 * (1 - kb)) * Cb;
-            const float G = Y - ((2 * ((kr * (1 - kr) * Cr) + (kb * (1 - kb) * Cb))) / kg);
-            const float Rc = AVIF_CLAMP(R, 0.0f, 1.0f);
-            const float Gc = AVIF_CLAMP(G, 0.0f, 1.0f);
-            const float Bc = AVIF_CLAMP(B, 0.0f, 1.0f);
-
-            *ptrR = (uint8_t)(0.5f + (Rc * rgbMaxChannel));
-            *ptrG = (uint8_t)(0.5f + (Gc * rgbMaxChannel));
-            *ptrB = (uint8_t)(0.5f + (Bc * rgbMaxChannel));
-
-            ptrR += rgbPixelBytes;
-            ptrG += rgbPixelBytes;
-            ptrB += rgbPixelBytes;
+// Stores a run of codepoints into one channel of an RGB row
+static void avifStoreRGBChannel(const uint16_t * codepoints, uint32_t count, uint8_t * dst, uint32_t pixelBytes, uint32_t channelBytes)
+{
+    if (channelBytes > 1) {
+        for (uint32_t i = 0; i < count; ++i) {
+            *((uint16_t *)dst) = codepoints[i];
+            dst += pixelBytes;
+        }
+    } else {
+        for (uint32_t i = 0; i < count; ++i) {
+            *dst = (uint8_t)codepoints[i];
+            dst += pixelBytes;
         }
     }
-    return AVIF_RESULT_OK;
 }
 
-static avifResult avifImageYUV16ToRGB8Mono(avifImage * image, avifRGBImage * rgb, avifReformatState * state)
+// Quantizes float runs into the R, G and B channels of row j of rgb. Passing the same run for all
+// three quantizes it only once.
+static void avifStoreRGBRow(avifRGBImage * rgb, const avifReformatState * state, uint32_t j, const float * r, const float * g, const float * b, uint16_t * codepoints)
 {
-    const float kr = state->kr;
-    const float kg = state->kg;
-    const float kb = state->kb;
-    const uint32_t rgbPixelBytes = state->rgbPixelBytes;
-    const float * const unormFloatTableY = state->unormFloatTableY;
-
-    const uint16_t yuvMaxChannel = (uint16_t)((1 << image->depth) - 1);
     const float rgbMaxChannel = (float)((1 << rgb->depth) - 1);
-    for (uint32_t j = 0; j < image->height; ++j) {
-        const uint16_t * const ptrY = (uint16_t *)&image->yuvPlanes[AVIF_CHAN_Y][(j * image->yuvRowBytes[AVIF_CHAN_Y])];
-        uint8_t * ptrR = &rgb->pixels[state->rgbOffsetBytesR + (j * rgb->rowBytes)];
-        uint8_t * ptrG = &rgb->pixels[state->rgbOffsetBytesG + (j * rgb->rowBytes)];
-        uint8_t * ptrB = &rgb->pixels[state->rgbOffsetBytesB + (j * rgb->rowBytes)];
-
-        for (uint32_t i = 0; i < image->width; ++i) {
-            // clamp incoming data to protect against bad LUT lookups
-            const uint16_t unormY = AVIF_MIN(ptrY[i], yuvMaxChannel);
-
-            // Convert unorm to float
-            const float Y = unormFloatTableY[unormY];
-            const float Cb = 0.0f;
-            const float Cr = 0.0f;
-
-            const float R = Y + (2 * (1 - kr)) * Cr;
-            const float B = Y + (2 * (1 - kb)) * Cb;
-            const float G = Y - ((2 * ((kr * (1 - kr) * Cr) + (kb * (1 - kb) * Cb))) / kg);
-            const float Rc = AVIF_CLAMP(R, 0.0f, 1.0f);
-            const float Gc = AVIF_CLAMP(G, 0.0f, 1.0f);
-            const float Bc = AVIF_CLAMP(B, 0.0f, 1.0f);
-
-            *((uint16_t *)ptrR) = (uint16_t)(0.5f + (Rc * rgbMaxChannel));
-            *((uint16_t *)ptrG) = (uint16_t)(0.5f + (Gc * rgbMaxChannel));
-            *((uint16_t *)ptrB) = (uint16_t)(0.5f + (Bc * rgbMaxChannel));
-
-            ptrR += rgbPixelBytes;
-            ptrG += rgbPixelBytes;
-            ptrB += rgbPixelBytes;
+    const uint32_t offsetBytes[3] = { state->rgbOffsetBytesR, state->rgbOffsetBytesG, state->rgbOffsetBytesB };
+    const float * runs[3] = { r, g, b };
+    uint8_t * row = &rgb->pixels[j * rgb->rowBytes];
+    for (int c = 0; c < 3; ++c) {
+        if ((c == 0) || (runs[c] != runs[c - 1])) {
+            avifQuantizeRun(runs[c], rgb->width, 0.0f, rgbMaxChannel, codepoints);
         }
+        avifStoreRGBChannel(codepoints, rgb->width, &row[offsetBytes[c]], state->rgbPixelBytes, state->rgbChannelBytes);
     }
-    return AVIF_RESULT_OK;
 }
 
-static avifResult avifImageYUV8ToRGB16Color(avifImage * image, avifRGBImage * rgb, avifReformatState * state)
+static avifResult avifImageYUVToRGBColor(avifImage * image, avifRGBImage * rgb, avifReformatState * state, uint32_t rowStart, uint32_t rowEnd)
 {
-    const float kr = state->kr;
-    const float kg = state->kg;
-    const float kb = state->kb;
-    const uint32_t rgbPixelBytes = state->rgbPixelBytes;
-    const float * const unormFloatTableY = state->unormFloatTableY;
-    const float * const unormFloatTableUV = state->unormFloatTableUV;
-    const uint32_t maxUVI = ((image->width + state->formatInfo.chromaShiftX) >> state->formatInfo.chromaShiftX) - 1;
+    const uint32_t width = image->width;
     const uint32_t maxUVJ = ((image->height + state->formatInfo.chromaShiftY) >> state->formatInfo.chromaShiftY) - 1;
 
-    const float rgbMaxChannel = (float)((1 << rgb->depth) - 1);
-    for (uint32_t j = 0; j < image->height; ++j) {
+    // 6 float runs + 1 uint16_t run of the image width
+    float * buffer = (float *)avifAlloc(sizeof(float) * 7 * width);
+    float * y = &buffer[0 * width];
+    float * u = &buffer[1 * width];
+    float * v = &buffer[2 * width];
+    float * r = &buffer[3 * width];
+    float * g = &buffer[4 * width];
+    float * b = &buffer[5 * width];
+    uint16_t * codepoints = (uint16_t *)&buffer[6 * width];
+
+    for (uint32_t j = rowStart; j < rowEnd; ++j) {
         const uint32_t uvJ = AVIF_MIN(j >> state->formatInfo.chromaShiftY, maxUVJ);
-        const uint8_t * const ptrY = &image->yuvPlanes[AVIF_CHAN_Y][(j * image->yuvRowBytes[AVIF_CHAN_Y])];
-        const uint8_t * const ptrU = &image->yuvPlanes[AVIF_CHAN_U][(uvJ * image->yuvRowBytes[AVIF_CHAN_U])];
-        const uint8_t * const ptrV = &image->yuvPlanes[AVIF_CHAN_V][(uvJ * image->yuvRowBytes[AVIF_CHAN_V])];
-        uint8_t * ptrR = &rgb->pixels[state->rgbOffsetBytesR + (j * rgb->rowBytes)];
-        uint8_t * ptrG = &rgb->pixels[state->rgbOffsetBytesG + (j * rgb->rowBytes)];
-        uint8_t * ptrB = &rgb->pixels[state->rgbOffsetBytesB + (j * rgb->rowBytes)];
-
-        for (uint32_t i = 0; i < image->width; ++i) {
-            uint32_t uvI = AVIF_MIN(i >> state->formatInfo.chromaShiftX, maxUVI);
-
-            // Convert unorm to float (no clamp necessary, the full uint8_t range is a legal lookup)
-            const float Y = unormFloatTableY[ptrY[i]];
-            const float Cb = unormFloatTableUV[ptrU[uvI]];
-            const float Cr = unormFloatTableUV[ptrV[uvI]];
+        avifUnpackYUVRow(image, state, AVIF_CHAN_Y, j, state->unormFloatTableY, y);
+        avifUnpackYUVRow(image, state, AVIF_CHAN_U, uvJ, state->unormFloatTableUV, u);
+        avifUnpackYUVRow(image, state, AVIF_CHAN_V, uvJ, state->unormFloatTableUV, v);
+        avifYUVToRGBRun(state, y, u, v, r, g, b, width);
+        avifStoreRGBRow(rgb, state, j - rowStart, r, g, b, codepoints);
+    }
+    avifFree(buffer);
+    return AVIF_RESULT_OK;
+}
 
-            const float R = Y + (2 * (1 - kr)) * Cr;
-            const float B = Y + (2 * (1 - kb)) * Cb;
-            const float G = Y - ((2 * ((kr * (1 - kr) * Cr) + (kb * (1 - kb) * Cb))) / kg);
-            const float Rc = AVIF_CLAMP(R, 0.0f, 1.0f);
-            const float Gc = AVIF_CLAMP(G, 0.0f, 1.0f);
-            const float Bc = AVIF_CLAMP(B, 0.0f, 1.0f);
+// Without chroma every pixel is gray: R, G and B all equal Y (Cb and Cr are 0)
+static avifResult avifImageYUVToRGBMono(avifImage * image, avifRGBImage * rgb, avifReformatState * state, uint32_t rowStart, uint32_t rowEnd)
+{
+    const uint32_t width = image->width;
 
-            *((uint16_t *)ptrR) = (uint16_t)(0.5f + (Rc * rgbMaxChannel));
-            *((uint16_t *)ptrG) = (uint16_t)(0.5f + (Gc * rgbMaxChannel));
-            *((uint16_t *)ptrB) = (uint16_t)(0.5f + (Bc * rgbMaxChannel));
+    // 1 float run + 1 uint16_t run of the image width
+    float * buffer = (float *)avifAlloc(sizeof(float) * 2 * width);
+    float * y = &buffer[0];
+    uint16_t * codepoints = (uint16_t *)&buffer[width];
 
-            ptrR += rgbPixelBytes;
-            ptrG += rgbPixelBytes;
-            ptrB += rgbPixelBytes;
-        }
+    for (uint32_t j = rowStart; j < rowEnd; ++j) {
+        avifUnpackYUVRow(image, state, AVIF_CHAN_Y, j, state->unormFloatTableY, y);
+        avifStoreRGBRow(rgb, state, j - rowStart, y, y, y, codepoints);
     }
+    avifFree(buffer);
     return AVIF_RESULT_OK;
 }
 
-static avifResult avifImageYUV8ToRGB16Mono(avifImage * image, avifRGBImage * rgb, avifReformatState * state)
+// Any depth and range: in identity mode the tables already hold the normalized G, B and R values
+static avifResult avifImageIdentityToRGB(avifImage * image, avifRGBImage * rgb, avifReformatState * state, uint32_t rowStart, uint32_t rowEnd)
 {
-    const float kr = state->kr;
-    const float kg = state->kg;
-    const float kb = state->kb;
-    const uint32_t rgbPixelBytes = state->rgbPixelBytes;
-    const float * const unormFloatTableY = state->unormFloatTableY;
-
-    const float rgbMaxChannel = (float)((1 << rgb->depth) - 1);
-    for (uint32_t j = 0; j < image->height; ++j) {
-        const uint8_t * const ptrY = &image->yuvPlanes[AVIF_CHAN_Y][(j * image->yuvRowBytes[AVIF_CHAN_Y])];
-        uint8_t * ptrR = &rgb->pixels[state->rgbOffsetBytesR + (j * rgb->rowBytes)];
-        uint8_t * ptrG = &rgb->pixels[state->rgbOffsetBytesG + (j * rgb->rowBytes)];
-        uint8_t * ptrB = &rgb->pixels[state->rgbOffsetBytesB + (j * rgb->rowBytes)];
+    const uint32_t width = image->width;
+    const avifBool hasColor = (image->yuvPlanes[AVIF_CHAN_U] && image->yuvPlanes[AVIF_CHAN_V]);
+    const uint32_t maxUVJ = ((image->height + state->formatInfo.chromaShiftY) >> state->formatInfo.chromaShiftY) - 1;
 
-        for (uint32_t i = 0; i < image->width; ++i) {
-            // Convert unorm to float (no clamp necessary, the full uint8_t range is a legal lookup)
-            const float Y = unormFloatTableY[ptrY[i]];
-            const float Cb = 0.0f;
-            const float Cr = 0.0f;
-
-            const float R = Y + (2 * (1 - kr)) * Cr;
-            const float B = Y + (2 * (1 - kb)) * Cb;
-            const float G = Y - ((2 * ((kr * (1 - kr) * Cr) + (kb * (1 - kb) * Cb))) / kg);
-            const float Rc = AVIF_CLAMP(R, 0.0f, 1.0f);
-            const float Gc = AVIF_CLAMP(G, 0.0f, 1.0f);
-            const float Bc = AVIF_CLAMP(B, 0.0f, 1.0f);
-
-            *ptrR = (uint8_t)(0.5f + (Rc * rgbMaxChannel));
-            *ptrG = (uint8_t)(0.5f + (Gc * rgbMaxChannel));
-            *ptrB = (uint8_t)(0.5f + (Bc * rgbMaxChannel));
+    // 3 float runs + 1 uint16_t run of the image width
+    float * buffer = (float *)avifAlloc(sizeof(float) * 4 * width);
+    float * y = &buffer[0 * width];
+    float * u = &buffer[1 * width];
+    float * v = &buffer[2 * width];
+    uint16_t * codepoints = (uint16_t *)&buffer[3 * width];
 
-            ptrR += rgbPixelBytes;
-            ptrG += rgbPixelBytes;
-            ptrB += rgbPixelBytes;
+    for (uint32_t j = rowStart; j < rowEnd; ++j) {
+        avifUnpackYUVRow(image, state, AVIF_CHAN_Y, j, state->unormFloatTableY, y);
+        if (hasColor) {
+            // Formulas 41,42,43 from https://www.itu.int/rec/T-REC-H.273-201612-I/en
+            const uint32_t uvJ = AVIF_MIN(j >> state->formatInfo.chromaShiftY, maxUVJ);
+            avifUnpackYUVRow(image, state, AVIF_CHAN_U, uvJ, state->unormFloatTableUV, u);
+            avifUnpackYUVRow(image, state, AVIF_CHAN_V, uvJ, state->unormFloatTableUV, v);
+            avifStoreRGBRow(rgb, state, j - rowStart, v, y, u, codepoints);
+        } else {
+            avifStoreRGBRow(rgb, state, j - rowStart, y, y, y, codepoints);
         }
     }
+    avifFree(buffer);
     return AVIF_RESULT_OK;
 }
 
-static avifResult avifImageIdentity8ToRGB8ColorFullRange(avifImage * image, avifRGBImage * rgb, avifReformatState * state)
+static avifResult avifImageIdentity8ToRGB8ColorFullRange(avifImage * image, avifRGBImage * rgb, avifReformatState * state, uint32_t rowStart, uint32_t rowEnd)
 {
     const uint32_t rgbPixelBytes = state->rgbPixelBytes;
-    for (uint32_t j = 0; j < image->height; ++j) {
+    for (uint32_t j = rowStart; j < rowEnd; ++j) {
         const uint8_t * const ptrY = &image->yuvPlanes[AVIF_CHAN_Y][(j * image->yuvRowBytes[AVIF_CHAN_Y])];
         const uint8_t * const ptrU = &image->yuvPlanes[AVIF_CHAN_U][(j * image->yuvRowBytes[AVIF_CHAN_U])];
         const uint8_t * const ptrV = &image->yuvPlanes[AVIF_CHAN_V][(j * image->yuvRowBytes[AVIF_CHAN_V])];
-        uint8_t * ptrR = &rgb->pixels[state->rgbOffsetBytesR + (j * rgb->rowBytes)];
-        uint8_t * ptrG = &rgb->pixels[state->rgbOffsetBytesG + (j * rgb->rowBytes)];
-        uint8_t * ptrB = &rgb->pixels[state->rgbOffsetBytesB + (j * rgb->rowBytes)];
+        uint8_t * ptrR = &rgb->pixels[state->rgbOffsetBytesR + ((j - rowStart) * rgb->rowBytes)];
+        uint8_t * ptrG = &rgb->pixels[state->rgbOffsetBytesG + ((j - rowStart) * rgb->rowBytes)];
+        uint8_t * ptrB = &rgb->pixels[state->rgbOffsetBytesB + ((j - rowStart) * rgb->rowBytes)];
 
         for (uint32_t i = 0; i < image->width; ++i) {
             *ptrR = ptrV[i];
@@ -717,180 +822,339 @@ static avifResult avifImageIdentity8ToRGB8ColorFullRange(avifImage * image, avif
     return AVIF_RESULT_OK;
 }
 
-static avifResult avifImageYUV8ToRGB8Color(avifImage * image, avifRGBImage * rgb, avifReformatState * state)
-{
-    const float kr = state->kr;
-    const float kg = state->kg;
-    const float kb = state->kb;
-    const uint32_t rgbPixelBytes = state->rgbPixelBytes;
-    const float * const unormFloatTableY = state->unormFloatTableY;
-    const float * const unormFloatTableUV = state->unormFloatTableUV;
-    const uint32_t maxUVI = ((image->width + state->formatInfo.chromaShiftX) >> state->formatInfo.chromaShiftX) - 1;
-    const uint32_t maxUVJ = ((image->height + state->formatInfo.chromaShiftY) >> state->formatInfo.chromaShiftY) - 1;
-
-    const float rgbMaxChannel = (float)((1 << rgb->depth) - 1);
-    for (uint32_t j = 0; j < image->height; ++j) {
-        const uint32_t uvJ = AVIF_MIN(j >> state->formatInfo.chromaShiftY, maxUVJ);
-        const uint8_t * const ptrY = &image->yuvPlanes[AVIF_CHAN_Y][(j * image->yuvRowBytes[AVIF_CHAN_Y])];
-        const uint8_t * const ptrU = &image->yuvPlanes[AVIF_CHAN_U][(uvJ * image->yuvRowBytes[AVIF_CHAN_U])];
-        const uint8_t * const ptrV = &image->yuvPlanes[AVIF_CHAN_V][(uvJ * image->yuvRowBytes[AVIF_CHAN_V])];
-        uint8_t * ptrR = &rgb->pixels[state->rgbOffsetBytesR + (j * rgb->rowBytes)];
-        uint8_t * ptrG = &rgb->pixels[state->rgbOffsetBytesG + (j * rgb->rowBytes)];
-        uint8_t * ptrB = &rgb->pixels[state->rgbOffsetBytesB + (j * rgb->rowBytes)];
+typedef avifResult (*avifYUVToRGBRowsFunc)(avifImage * image, avifRGBImage * rgb, avifReformatState * state, uint32_t rowStart, uint32_t rowEnd);
 
-        for (uint32_t i = 0; i < image->width; ++i) {
-            uint32_t uvI = AVIF_MIN(i >> state->formatInfo.chromaShiftX, maxUVI);
-
-            // Convert unorm to float (no clamp necessary, the full uint8_t range is a legal lookup)
-            const float Y = unormFloatTableY[ptrY[i]];
-            const float Cb = unormFloatTableUV[ptrU[uvI]];
-            const float Cr = unormFloatTableUV[ptrV[uvI]];
-
-            const float R = Y + (2 * (1 - kr)) * Cr;
-            const float B = Y + (2 * (1 - kb)) * Cb;
-            const float G = Y - ((2 * ((kr * (1 - kr) * Cr) + (kb * (1 - kb) * Cb))) / kg);
-            const float Rc = AVIF_CLAMP(R, 0.0f, 1.0f);
-            const float Gc = AVIF_CLAMP(G, 0.0f, 1.0f);
-            const float Bc = AVIF_CLAMP(B, 0.0f, 1.0f);
-
-            *ptrR = (uint8_t)(0.5f + (Rc * rgbMaxChannel));
-            *ptrG = (uint8_t)(0.5f + (Gc * rgbMaxChannel));
-            *ptrB = (uint8_t)(0.5f + (Bc * rgbMaxChannel));
+typedef struct avifYUVToRGBJob
+{
+    avifImage * image;
+    avifRGBImage * rgb;
+    avifReformatState * state;
+    avifYUVToRGBRowsFunc convertRows;
+    uint32_t firstRow; // image row held by the first row of rgb->pixels
+    uint32_t endRow;
+    avifMutex * mutex;
+    uint32_t nextRow;
+    avifResult result;
+} avifYUVToRGBJob;
+
+static void avifYUVToRGBWorker(void * userData)
+{
+    avifYUVToRGBJob * job = (avifYUVToRGBJob *)userData;
+    avifImage * image = job->image;
+    const avifReformatState * state = job->state;
+
+    for (;;) {
+        avifMutexLock(job->mutex);
+        const uint32_t rowStart = job->nextRow;
+        if (rowStart < job->endRow) {
+            job->nextRow = AVIF_MIN(rowStart + AVIF_REFORMAT_BAND_ROWS, job->endRow);
+        }
+        avifMutexUnlock(job->mutex);
+        if (rowStart >= job->endRow) {
+            break;
+        }
+        const uint32_t rowEnd = AVIF_MIN(rowStart + AVIF_REFORMAT_BAND_ROWS, job->endRow);
+
+        // A view of rgb starting at rowStart, which is where the row functions begin writing
+        avifRGBImage bandRGB = *job->rgb;
+        bandRGB.pixels = &job->rgb->pixels[(rowStart - job->firstRow) * job->rgb->rowBytes];
+        bandRGB.height = rowEnd - rowStart;
+
+        // Color first: libyuv kernels write opaque alpha into four-channel formats
+        avifResult result = job->convertRows(image, &bandRGB, job->state, rowStart, rowEnd);
+        if (result != AVIF_RESULT_OK) {
+            avifMutexLock(job->mutex);
+            job->result = result;
+            avifMutexUnlock(job->mutex);
+        }
 
-            ptrR += rgbPixelBytes;
-            ptrG += rgbPixelBytes;
-            ptrB += rgbPixelBytes;
+        if (avifRGBFormatHasAlpha(bandRGB.format)) {
+            avifAlphaParams params;
+
+            params.width = bandRGB.width;
+            params.height = bandRGB.height;
+            params.dstDepth = bandRGB.depth;
+            params.dstRange = AVIF_RANGE_FULL;
+            params.dstPlane = bandRGB.pixels;
+            params.dstRowBytes = bandRGB.rowBytes;
+            params.dstOffsetBytes = state->rgbOffsetBytesA;
+            params.dstPixelBytes = state->rgbPixelBytes;
+
+            if (image->alphaPlane && image->alphaRowBytes) {
+                params.srcDepth = image->depth;
+                params.srcRange = image->alphaRange;
+                params.srcPlane = &image->alphaPlane[rowStart * image->alphaRowBytes];
+                params.srcRowBytes = image->alphaRowBytes;
+                params.srcOffsetBytes = 0;
+                params.srcPixelBytes = state->yuvChannelBytes;
+
+                avifReformatAlpha(&params);
+            } else {
+                avifFillAlpha(&params);
+            }
         }
     }
-    return AVIF_RESULT_OK;
 }
 
-static avifResult avifImageYUV8ToRGB8Mono(avifImage * image, avifRGBImage * rgb, avifReformatState * state)
+avifResult avifImageYUVToRGB(avifImage * image, avifRGBImage * rgb)
 {
-    const float kr = state->kr;
-    const float kg = state->kg;
-    const float kb = state->kb;
-    const uint32_t rgbPixelBytes = state->rgbPixelBytes;
-    const float * const unormFloatTableY = state->unormFloatTableY;
-
-    const float rgbMaxChannel = (float)((1 << rgb->depth) - 1);
-    for (uint32_t j = 0; j < image->height; ++j) {
-        const uint8_t * const ptrY = &image->yuvPlanes[AVIF_CHAN_Y][(j * image->yuvRowBytes[AVIF_CHAN_Y])];
-        uint8_t * ptrR = &rgb->pixels[state->rgbOffsetBytesR + (j * rgb->rowBytes)];
-        uint8_t * ptrG = &rgb->pixels[state->rgbOffsetBytesG + (j * rgb->rowBytes)];
-        uint8_t * ptrB = &rgb->pixels[state->rgbOffsetBytesB + (j * rgb->rowBytes)];
-
-        for (uint32_t i = 0; i < image->width; ++i) {
-            // Convert unorm to float (no clamp necessary, the full uint8_t range is a legal lookup)
-            const float Y = unormFloatTableY[ptrY[i]];
-            const float Cb = 0.0f;
-            const float Cr = 0.0f;
-
-            const float R = Y + (2 * (1 - kr)) * Cr;
-            const float B = Y + (2 * (1 - kb)) * Cb;
-            const float G = Y - ((2 * ((kr * (1 - kr) * Cr) + (kb * (1 - kb) * Cb))) / kg);
-            const float Rc = AVIF_CLAMP(R, 0.0f, 1.0f);
-            const float Gc = AVIF_CLAMP(G, 0.0f, 1.0f);
-            const float Bc = AVIF_CLAMP(B, 0.0f, 1.0f);
-
-            *ptrR = (uint8_t)(0.5f + (Rc * rgbMaxChannel));
-            *ptrG = (uint8_t)(0.5f + (Gc * rgbMaxChannel));
-            *ptrB = (uint8_t)(0.5f + (Bc * rgbMaxChannel));
-
-            ptrR += rgbPixelBytes;
-            ptrG += rgbPixelBytes;
-            ptrB += rgbPixelBytes;
-        }
-    }
-    return AVIF_RESULT_OK;
+    return avifImageYUVToRGBRows(image, rgb, 0, image->height);
 }
 
-avifResult avifImageYUVToRGB(avifImage * image, avifRGBImage * rgb)
+avifResult avifImageYUVToRGBRows(avifImage * image, avifRGBImage * rgb, uint32_t firstRow, uint32_t rowCount)
 {
     if (!image->yuvPlanes[AVIF_CHAN_Y]) {
         return AVIF_RESULT_REFORMAT_FAILED;
     }
+    if ((firstRow > image->height) || (rowCount > (image->height - firstRow))) {
+        return AVIF_RESULT_REFORMAT_FAILED;
+    }
 
     avifReformatState state;
     if (!avifPrepareReformatState(image, rgb, &state)) {
         return AVIF_RESULT_REFORMAT_FAILED;
     }
 
-    if (avifRGBFormatHasAlpha(rgb->format)) {
-        avifAlphaParams params;
-
-        params.width = rgb->width;
-        params.height = rgb->height;
-        params.dstDepth = rgb->depth;
-        params.dstRange = AVIF_RANGE_FULL;
-        params.dstPlane = rgb->pixels;
-        params.dstRowBytes = rgb->rowBytes;
-        params.dstOffsetBytes = state.rgbOffsetBytesA;
-        params.dstPixelBytes = state.rgbPixelBytes;
-
-        if (image->alphaPlane && image->alphaRowBytes) {
-            params.srcDepth = image->depth;
-            params.srcRange = image->alphaRange;
-            params.srcPlane = image->alphaPlane;
-            params.srcRowBytes = image->alphaRowBytes;
-            params.srcOffsetBytes = 0;
-            params.srcPixelBytes = state.yuvChannelBytes;
-
-            avifReformatAlpha(&params);
+    const avifBool hasColor = (image->yuvRowBytes[AVIF_CHAN_U] && image->yuvRowBytes[AVIF_CHAN_V]);
+    avifYUVToRGBRowsFunc convertRows;
+    if (state.mode == AVIF_REFORMAT_MODE_IDENTITY) {
+        if ((image->depth == 8) && (rgb->depth == 8) && hasColor && (image->yuvRange == AVIF_RANGE_FULL) &&
+            !state.formatInfo.chromaShiftX && !state.formatInfo.chromaShiftY) {
+            convertRows = avifImageIdentity8ToRGB8ColorFullRange;
         } else {
-            avifFillAlpha(&params);
+            convertRows = avifImageIdentityToRGB;
         }
+    } else if (hasColor && avifLibYUVSupportsReformat(image, rgb, &state) && (!state.formatInfo.chromaShiftY || !(firstRow & 1))) {
+        // Bands start at firstRow plus multiples of AVIF_REFORMAT_BAND_ROWS, so all start on a 4:2:0 block
+        convertRows = avifImageYUVToRGBLibYUV;
+    } else if (hasColor) {
+        convertRows = avifImageYUVToRGBColor;
+    } else {
+        convertRows = avifImageYUVToRGBMono;
     }
 
-    if (state.mode == AVIF_REFORMAT_MODE_IDENTITY) {
-        if ((image->depth == 8) && (rgb->depth == 8) && image->yuvRowBytes[AVIF_CHAN_U] && image->yuvRowBytes[AVIF_CHAN_V] &&
-            (image->yuvRange == AVIF_RANGE_FULL)) {
-            return avifImageIdentity8ToRGB8ColorFullRange(image, rgb, &state);
-        }
+    avifYUVToRGBJob job;
+    memset(&job, 0, sizeof(job));
+    job.image = image;
+    job.rgb = rgb;
+    job.state = &state;
+    job.convertRows = convertRows;
+    job.firstRow = firstRow;
+    job.endRow = firstRow + rowCount;
+    job.mutex = avifMutexCreate();
+    job.nextRow = firstRow;
+    job.result = AVIF_RESULT_OK;
+    const int bandCount = (int)((rowCount + AVIF_REFORMAT_BAND_ROWS - 1) / AVIF_REFORMAT_BAND_ROWS);
+    const int maxThreads = (rgb->maxThreads > 1) ? rgb->maxThreads : 1;
+    avifRunWorkers(avifYUVToRGBWorker, &job, AVIF_MIN(maxThreads, bandCount));
+    avifMutexDestroy(job.mutex);
+    return job.result;
+}
 
-        // TODO: Add more fast paths for identity
-    } else {
-        if (image->depth > 8) {
-            // yuv:u16
+// ---------------------------------------------------------------------------
+// YUV -> RGB, downscaled
+//
+// Meant for thumbnails: every output pixel is the average of the box of source pixels it covers.
+// Y, U and V are averaged as normalized floats (after the table lookups), so only the output pixels
+// go through the conversion, and no full size RGB image is ever made.
 
-            if (rgb->depth > 8) {
-                // yuv:u16, rgb:u16
+typedef struct avifYUVToRGBScaledJob
+{
+    avifImage * image;
+    avifRGBImage * rgb;
+    const avifReformatState * state;
+    const uint32_t * colStarts; // output column i averages source columns [colStarts[i], colStarts[i + 1])
+    uint32_t bandRows;
+    avifMutex * mutex;
+    uint32_t nextRow;
+} avifYUVToRGBScaledJob;
+
+// Stores averaged alpha samples (in the image's depth and alpha range) into row j of rgb
+static void avifStoreScaledAlphaRow(const avifImage * image, avifRGBImage * rgb, const avifReformatState * state, uint32_t j, const float * sumA, const float * scale)
+{
+    const float srcMaxChannelF = (float)((1 << image->depth) - 1);
+    const float dstMaxChannelF = (float)((1 << rgb->depth) - 1);
+    const int dstMaxChannel = (1 << rgb->depth) - 1;
+    uint8_t * dst = &rgb->pixels[(j * rgb->rowBytes) + state->rgbOffsetBytesA];
+    for (uint32_t i = 0; i < rgb->width; ++i) {
+        int a = (int)(sumA[i] * scale[i] + 0.5f);
+        if (image->alphaRange == AVIF_RANGE_LIMITED) {
+            a = avifLimitedToFullY(image->depth, a);
+        }
+        if (image->depth != rgb->depth) {
+            // Same rounding as avifReformatAlpha()
+            a = (int)(0.5f + (((float)a / srcMaxChannelF) * dstMaxChannelF));
+        }
+        const int value = AVIF_CLAMP(a, 0, dstMaxChannel);
+        if (state->rgbChannelBytes > 1) {
+            *((uint16_t *)dst) = (uint16_t)value;
+        } else {
+            *dst = (uint8_t)value;
+        }
+        dst += state->rgbPixelBytes;
+    }
+}
 
-                if (image->yuvRowBytes[AVIF_CHAN_U] && image->yuvRowBytes[AVIF_CHAN_V]) {
-                    return avifImageYUV16ToRGB16Color(image, rgb, &state);
-                }
-                return avifImageYUV16ToRGB16Mono(image, rgb, &state);
-            } else {
-                // yuv:u16, rgb:u8
+static void avifYUVToRGBScaledRows(const avifYUVToRGBScaledJob * job, uint32_t rowStart, uint32_t rowEnd, float * buffer)
+{
+    const avifImage * image = job->image;
+    avifRGBImage * rgb = job->rgb;
+    const avifReformatState * state = job->state;
+    const uint32_t * colStarts = job->colStarts;
+    const uint32_t srcWidth = image->width;
+    const uint32_t dstWidth = rgb->width;
+    const avifBool hasColor = (image->yuvPlanes[AVIF_CHAN_U] && image->yuvPlanes[AVIF_CHAN_V]);
+    const avifBool hasAlpha = (image->alphaPlane && image->alphaRowBytes);
+    const uint32_t maxUVJ = ((image->height + state->formatInfo.chromaShiftY) >> state->formatInfo.chromaShiftY) - 1;
 
-                if (image->yuvRowBytes[AVIF_CHAN_U] && image->yuvRowBytes[AVIF_CHAN_V]) {
-                    return avifImageYUV16ToRGB8Color(image, rgb, &state);
+    // 3 float runs of the source width, 8 float runs + 1 uint16_t run of the output width
+    float * y = &buffer[0 * srcWidth];
+    float * u = &buffer[1 * srcWidth];
+    float * v = &buffer[2 * srcWidth];
+    float * sums = &buffer[3 * srcWidth];
+    float * sumY = &sums[0 * dstWidth];
+    float * sumU = &sums[1 * dstWidth];
+    float * sumV = &sums[2 * dstWidth];
+    float * sumA = &sums[3 * dstWidth];
+    float * scale = &sums[4 * dstWidth];
+    float * r = &sums[5 * dstWidth];
+    float * g = &sums[6 * dstWidth];
+    float * b = &sums[7 * dstWidth];
+    uint16_t * codepoints = (uint16_t *)&sums[8 * dstWidth];
+
+    for (uint32_t j = rowStart; j < rowEnd; ++j) {
+        const uint32_t srcRowStart = (uint32_t)(((uint64_t)j * image->height) / rgb->height);
+        const uint32_t srcRowEnd = (uint32_t)(((uint64_t)(j + 1) * image->height) / rgb->height);
+        memset(sums, 0, sizeof(float) * 4 * dstWidth);
+
+        for (uint32_t srcJ = srcRowStart; srcJ < srcRowEnd; ++srcJ) {
+            avifUnpackYUVRow(image, state, AVIF_CHAN_Y, srcJ, state->unormFloatTableY, y);
+            if (hasColor) {
+                const uint32_t uvJ = AVIF_MIN(srcJ >> state->formatInfo.chromaShiftY, maxUVJ);
+                avifUnpackYUVRow(image, state, AVIF_CHAN_U, uvJ, state->unormFloatTableUV, u);
+                avifUnpackYUVRow(image, state, AVIF_CHAN_V, uvJ, state->unormFloatTableUV, v);
+            }
+            for (uint32_t i = 0; i < dstWidth; ++i) {
+                for (uint32_t x = colStarts[i]; x < colStarts[i + 1]; ++x) {
+                    sumY[i] += y[x];
                 }
-                return avifImageYUV16ToRGB8Mono(image, rgb, &state);
             }
-        } else {
-            // yuv:u8
+            if (hasColor) {
+                for (uint32_t i = 0; i < dstWidth; ++i) {
+                    for (uint32_t x = colStarts[i]; x < colStarts[i + 1]; ++x) {
+                        sumU[i] += u[x];
+                        sumV[i] += v[x];
+                    }
+                }
+            }
+            if (hasAlpha && avifRGBFormatHasAlpha(rgb->format)) {
+                const uint8_t * alphaRow = &image->alphaPlane[srcJ * image->alphaRowBytes];
+                for (uint32_t i = 0; i < dstWidth; ++i) {
+                    for (uint32_t x = colStarts[i]; x < colStarts[i + 1]; ++x) {
+                        sumA[i] += (state->yuvChannelBytes > 1) ? (float)((const uint16_t *)alphaRow)[x] : (float)alphaRow[x];
+                    }
+                }
+            }
+        }
 
-            if (rgb->depth > 8) {
-                // yuv:u8, rgb:u16
+        const float rowCount = (float)(srcRowEnd - srcRowStart);
+        for (uint32_t i = 0; i < dstWidth; ++i) {
+            scale[i] = 1.0f / (rowCount * (float)(colStarts[i + 1] - colStarts[i]));
+            sumY[i] *= scale[i];
+            sumU[i] *= scale[i];
+            sumV[i] *= scale[i];
+        }
 
-                if (image->yuvRowBytes[AVIF_CHAN_U] && image->yuvRowBytes[AVIF_CHAN_V]) {
-                    return avifImageYUV8ToRGB16Color(image, rgb, &state);
-                }
-                return avifImageYUV8ToRGB16Mono(image, rgb, &state);
+        if (state->mode == AVIF_REFORMAT_MODE_IDENTITY) {
+            if (hasColor) {
+                avifStoreRGBRow(rgb, state, j, sumV, sumY, sumU, codepoints);
             } else {
-                // yuv:u8, rgb:u8
+                avifStoreRGBRow(rgb, state, j, sumY, sumY, sumY, codepoints);
+            }
+        } else if (hasColor) {
+            avifYUVToRGBRun(state, sumY, sumU, sumV, r, g, b, dstWidth);
+            avifStoreRGBRow(rgb, state, j, r, g, b, codepoints);
+        } else {
+            avifStoreRGBRow(rgb, state, j, sumY, sumY, sumY, codepoints);
+        }
 
-                if (image->yuvRowBytes[AVIF_CHAN_U] && image->yuvRowBytes[AVIF_CHAN_V]) {
-                    return avifImageYUV8ToRGB8Color(image, rgb, &state);
-                }
-                return avifImageYUV8ToRGB8Mono(image, rgb, &state);
+        if (avifRGBFormatHasAlpha(rgb->format)) {
+            if (hasAlpha) {
+                avifStoreScaledAlphaRow(image, rgb, state, j, sumA, scale);
+            } else {
+                avifAlphaParams params;
+                memset(&params, 0, sizeof(params));
+                params.width = rgb->width;
+                params.height = 1;
+                params.dstDepth = rgb->depth;
+                params.dstRange = AVIF_RANGE_FULL;
+                params.dstPlane = &rgb->pixels[j * rgb->rowBytes];
+                params.dstRowBytes = rgb->rowBytes;
+                params.dstOffsetBytes = state->rgbOffsetBytesA;
+                params.dstPixelBytes = state->rgbPixelBytes;
+                avifFillAlpha(&params);
             }
         }
     }
+}
+
+static void avifYUVToRGBScaledWorker(void * userData)
+{
+    avifYUVToRGBScaledJob * job = (avifYUVToRGBScaledJob *)userData;
+    float * buffer = (float *)avifAlloc(sizeof(float) * ((3 * job->image->width) + (9 * job->rgb->width)));
+
+    for (;;) {
+        avifMutexLock(job->mutex);
+        const uint32_t rowStart = job->nextRow;
+        if (rowStart < job->rgb->height) {
+            job->nextRow = AVIF_MIN(rowStart + job->bandRows, job->rgb->height);
+        }
+        avifMutexUnlock(job->mutex);
+        if (rowStart >= job->rgb->height) {
+            break;
+        }
+        avifYUVToRGBScaledRows(job, rowStart, AVIF_MIN(rowStart + job->bandRows, job->rgb->height), buffer);
+    }
+    avifFree(buffer);
+}
 
-    // If we get here, there is no fast path for this combination. Time to be slow!
-    return avifImageYUVAnyToRGBAnySlow(image, rgb, &state);
+avifResult avifImageYUVToRGBScaled(avifImage * image, avifRGBImage * rgb)
+{
+    if (!image->yuvPlanes[AVIF_CHAN_Y]) {
+        return AVIF_RESULT_REFORMAT_FAILED;
+    }
+    if (!rgb->width || !rgb->height || (rgb->width > image->width) || (rgb->height > image->height)) {
+        return AVIF_RESULT_REFORMAT_FAILED;
+    }
+
+    avifReformatState state;
+    if (!avifPrepareReformatState(image, rgb, &state)) {
+        return AVIF_RESULT_REFORMAT_FAILED;
+    }
+
+    uint32_t * colStarts = (uint32_t *)avifAlloc(sizeof(uint32_t) * (rgb->width + 1));
+    for (uint32_t i = 0; i <= rgb->width; ++i) {
+        colStarts[i] = (uint32_t)(((uint64_t)i * image->width) / rgb->width);
+    }
+
+    avifYUVToRGBScaledJob job;
+    memset(&job, 0, sizeof(job));
+    job.image = image;
+    job.rgb = rgb;
+    job.state = &state;
+    job.colStarts = colStarts;
+    // Bands cover about AVIF_REFORMAT_BAND_ROWS source rows
+    job.bandRows = (uint32_t)(((uint64_t)AVIF_REFORMAT_BAND_ROWS * rgb->height) / image->height);
+    if (job.bandRows < 1) {
+        job.bandRows = 1;
+    }
+    job.mutex = avifMutexCreate();
+    const int bandCount = (int)((rgb->height + job.bandRows - 1) / job.bandRows);
+    const int maxThreads = (rgb->maxThreads > 1) ? rgb->maxThreads : 1;
+    avifRunWorkers(avifYUVToRGBScaledWorker, &job, AVIF_MIN(maxThreads, bandCount));
+    avifMutexDestroy(job.mutex);
+    avifFree(colStarts);
+    return AVIF_RESULT_OK;
 }
 
 // Limited -> Full
@@ -0,0 +1,199 @@
+// Copyright 2020 Joe Drago. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "avif/internal.h"
+
+#if !defined(AVIF_LIBYUV_ENABLED)
+
+// No libyuv: the generic conversions in reformat.c handle everything
+
+avifBool avifLibYUVSupportsReformat(const avifImage * image, const avifRGBImage * rgb, const avifReformatState * state)
+{
+    (void)image;
+    (void)rgb;
+    (void)state;
+    return AVIF_FALSE;
+}
+
+avifResult avifImageRGBToYUVLibYUV(avifImage * image, avifRGBImage * rgb, uint32_t rowStart, uint32_t rowEnd)
+{
+    (void)image;
+    (void)rgb;
+    (void)rowStart;
+    (void)rowEnd;
+    return AVIF_RESULT_REFORMAT_FAILED;
+}
+
+avifResult avifImageYUVToRGBLibYUV(avifImage * image, avifRGBImage * rgb, avifReformatState * state, uint32_t rowStart, uint32_t rowEnd)
+{
+    (void)image;
+    (void)rgb;
+    (void)state;
+    (void)rowStart;
+    (void)rowEnd;
+    return AVIF_RESULT_REFORMAT_FAILED;
+}
+
+unsigned int avifLibYUVVersion(void)
+{
+    return 0;
+}
+
+#else
+
+#include "libyuv/convert.h"
+#include "libyuv/convert_argb.h"
+#include "libyuv/convert_from.h"
+#include "libyuv/convert_from_argb.h"
+#include "libyuv/version.h"
+
+#include <limits.h>
+#include <math.h>
+
+// libyuv names formats after a little-endian 32-bit word, so its names are the reverse of the
+// memory order avifRGBFormat uses: libyuv's ARGB is BGRA in memory, its RAW is RGB, and so on.
+// Every kernel reaches every avifRGBFormat, directly or through an ARGB (memory BGRA) band.
+
+typedef int (*avifRGBToI420Func)(const uint8_t * src, int srcStride,
+                                 uint8_t * dstY, int dstStrideY,
+                                 uint8_t * dstU, int dstStrideU,
+                                 uint8_t * dstV, int dstStrideV,
+                                 int width, int height);
+typedef int (*avifI420ToRGBFunc)(const uint8_t * srcY, int srcStrideY,
+                                 const uint8_t * srcU, int srcStrideU,
+                                 const uint8_t * srcV, int srcStrideV,
+                                 uint8_t * dst, int dstStride,
+                                 int width, int height);
+typedef int (*avifPackedToPackedFunc)(const uint8_t * src, int srcStride, uint8_t * dst, int dstStride, int width, int height);
+
+// The following tables are indexed by avifRGBFormat: RGB, RGBA, ARGB, BGR, BGRA, ABGR
+
+// Limited range 4:2:0 straight from each packed format
+static const avifRGBToI420Func rgbToI420[6] = { RAWToI420, ABGRToI420, BGRAToI420, RGB24ToI420, ARGBToI420, RGBAToI420 };
+static const avifI420ToRGBFunc i420ToRGB[6] = { I420ToRAW, I420ToABGR, I420ToBGRA, I420ToRGB24, I420ToARGB, I420ToRGBA };
+// Limited range 4:2:2 only exists for four-channel formats
+static const avifI420ToRGBFunc i422ToRGB[6] = { NULL, I422ToABGR, I422ToBGRA, NULL, I422ToARGB, I422ToRGBA };
+// To and from the intermediate ARGB band; NULL for ARGB itself, which needs no band
+static const avifPackedToPackedFunc rgbToARGB[6] = { RAWToARGB, ABGRToARGB, BGRAToARGB, RGB24ToARGB, NULL, RGBAToARGB };
+static const avifPackedToPackedFunc argbToRGB[6] = { ARGBToRAW, ARGBToABGR, ARGBToBGRA, ARGBToRGB24, NULL, ARGBToRGBA };
+
+avifBool avifLibYUVSupportsReformat(const avifImage * image, const avifRGBImage * rgb, const avifReformatState * state)
+{
+    if (rgb->avoidLibYUV || (state->mode != AVIF_REFORMAT_MODE_YUV_COEFFICIENTS)) {
+        return AVIF_FALSE;
+    }
+    if ((image->depth != 8) || (rgb->depth != 8) || ((uint32_t)rgb->format > AVIF_RGB_FORMAT_ABGR)) {
+        return AVIF_FALSE;
+    }
+    if ((image->yuvFormat != AVIF_PIXEL_FORMAT_YUV420) && (image->yuvFormat != AVIF_PIXEL_FORMAT_YUV422)) {
+        return AVIF_FALSE;
+    }
+    if ((image->width > (INT_MAX / 4)) || (image->height > INT_MAX) || (rgb->rowBytes > INT_MAX)) {
+        return AVIF_FALSE;
+    }
+    // libyuv only ships BT.601 coefficients ("I" for limited range, "J" for full range JPEG)
+    return (fabsf(state->kr - 0.299f) < 0.001f) && (fabsf(state->kb - 0.114f) < 0.001f);
+}
+
+avifResult avifImageRGBToYUVLibYUV(avifImage * image, avifRGBImage * rgb, uint32_t rowStart, uint32_t rowEnd)
+{
+    const avifBool is420 = (image->yuvFormat == AVIF_PIXEL_FORMAT_YUV420);
+    const uint32_t uvRow = is420 ? (rowStart >> 1) : rowStart;
+    const int width = (int)image->width;
+    const int height = (int)(rowEnd - rowStart);
+
+    const uint8_t * src = rgb->pixels;
+    uint8_t * dstY = &image->yuvPlanes[AVIF_CHAN_Y][rowStart * image->yuvRowBytes[AVIF_CHAN_Y]];
+    uint8_t * dstU = &image->yuvPlanes[AVIF_CHAN_U][uvRow * image->yuvRowBytes[AVIF_CHAN_U]];
+    uint8_t * dstV = &image->yuvPlanes[AVIF_CHAN_V][uvRow * image->yuvRowBytes[AVIF_CHAN_V]];
+    const int strideY = (int)image->yuvRowBytes[AVIF_CHAN_Y];
+    const int strideU = (int)image->yuvRowBytes[AVIF_CHAN_U];
+    const int strideV = (int)image->yuvRowBytes[AVIF_CHAN_V];
+
+    if (is420 && (image->yuvRange == AVIF_RANGE_LIMITED)) {
+        if (rgbToI420[rgb->format](src, (int)rgb->rowBytes, dstY, strideY, dstU, strideU, dstV, strideV, width, height) != 0) {
+            return AVIF_RESULT_REFORMAT_FAILED;
+        }
+        return AVIF_RESULT_OK;
+    }
+
+    // The remaining kernels only read ARGB. Limited range only gets here for 4:2:2.
+    uint8_t * argb = NULL;
+    const uint8_t * argbSrc = src;
+    int argbStride = (int)rgb->rowBytes;
+    if (rgbToARGB[rgb->format]) {
+        argbStride = width * 4;
+        argb = (uint8_t *)avifAlloc((size_t)argbStride * height);
+        rgbToARGB[rgb->format](src, (int)rgb->rowBytes, argb, argbStride, width, height);
+        argbSrc = argb;
+    }
+
+    int err;
+    if (image->yuvRange == AVIF_RANGE_LIMITED) {
+        err = ARGBToI422(argbSrc, argbStride, dstY, strideY, dstU, strideU, dstV, strideV, width, height);
+    } else if (is420) {
+        err = ARGBToJ420(argbSrc, argbStride, dstY, strideY, dstU, strideU, dstV, strideV, width, height);
+    } else {
+        err = ARGBToJ422(argbSrc, argbStride, dstY, strideY, dstU, strideU, dstV, strideV, width, height);
+    }
+    avifFree(argb);
+    return (err == 0) ? AVIF_RESULT_OK : AVIF_RESULT_REFORMAT_FAILED;
+}
+
+avifResult avifImageYUVToRGBLibYUV(avifImage * image, avifRGBImage * rgb, avifReformatState * state, uint32_t rowStart, uint32_t rowEnd)
+{
+    (void)state;
+
+    const avifBool is420 = (image->yuvFormat == AVIF_PIXEL_FORMAT_YUV420);
+    const uint32_t uvRow = is420 ? (rowStart >> 1) : rowStart;
+    const int width = (int)image->width;
+    const int height = (int)(rowEnd - rowStart);
+
+    const uint8_t * srcY = &image->yuvPlanes[AVIF_CHAN_Y][rowStart * image->yuvRowBytes[AVIF_CHAN_Y]];
+    const uint8_t * srcU = &image->yuvPlanes[AVIF_CHAN_U][uvRow * image->yuvRowBytes[AVIF_CHAN_U]];
+    const uint8_t * srcV = &image->yuvPlanes[AVIF_CHAN_V][uvRow * image->yuvRowBytes[AVIF_CHAN_V]];
+    const int strideY = (int)image->yuvRowBytes[AVIF_CHAN_Y];
+    const int strideU = (int)image->yuvRowBytes[AVIF_CHAN_U];
+    const int strideV = (int)image->yuvRowBytes[AVIF_CHAN_V];
+
+    if (image->yuvRange == AVIF_RANGE_LIMITED) {
+        const avifI420ToRGBFunc direct = is420 ? i420ToRGB[rgb->format] : i422ToRGB[rgb->format];
+        if (direct) {
+            if (direct(srcY, strideY, srcU, strideU, srcV, strideV, rgb->pixels, (int)rgb->rowBytes, width, height) != 0) {
+                return AVIF_RESULT_REFORMAT_FAILED;
+            }
+            return AVIF_RESULT_OK;
+        }
+    }
+
+    // The remaining kernels only write ARGB. Limited range only gets here for 4:2:2 RGB and BGR.
+    uint8_t * argb = NULL;
+    uint8_t * argbDst = rgb->pixels;
+    int argbStride = (int)rgb->rowBytes;
+    if (argbToRGB[rgb->format]) {
+        argbStride = width * 4;
+        argb = (uint8_t *)avifAlloc((size_t)argbStride * height);
+        argbDst = argb;
+    }
+
+    int err;
+    if (image->yuvRange == AVIF_RANGE_LIMITED) {
+        err = I422ToARGB(srcY, strideY, srcU, strideU, srcV, strideV, argbDst, argbStride, width, height);
+    } else if (is420) {
+        err = J420ToARGB(srcY, strideY, srcU, strideU, srcV, strideV, argbDst, argbStride, width, height);
+    } else {
+        err = J422ToARGB(srcY, strideY, srcU, strideU, srcV, strideV, argbDst, argbStride, width, height);
+    }
+    if ((err == 0) && argb) {
+        err = argbToRGB[rgb->format](argb, argbStride, rgb->pixels, (int)rgb->rowBytes, width, height);
+    }
+    avifFree(argb);
+    return (err == 0) ? AVIF_RESULT_OK : AVIF_RESULT_REFORMAT_FAILED;
+}
+
+unsigned int avifLibYUVVersion(void)
+{
+    return (unsigned int)LIBYUV_VERSION;
+}
+
+#endif
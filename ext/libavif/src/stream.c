@@ -191,16 +191,21 @@ avifBool avifROStreamReadAndEnforceVersion(avifROStream * stream, uint8_t enforc
 // ---------------------------------------------------------------------------
 // avifRWStream
 
-#define AVIF_STREAM_BUFFER_INCREMENT (1024 * 1024)
+#define AVIF_STREAM_BUFFER_MIN_CAPACITY (4 * 1024)
 static void makeRoom(avifRWStream * stream, size_t size)
 {
     size_t neededSize = stream->offset + size;
-    size_t newSize = stream->raw->size;
-    while (newSize < neededSize) {
-        newSize += AVIF_STREAM_BUFFER_INCREMENT;
+    if (neededSize > stream->raw->capacity) {
+        // Double the capacity, so writing n bytes moves O(n) bytes in total across reallocations
+        size_t newCapacity = (stream->raw->capacity > AVIF_STREAM_BUFFER_MIN_CAPACITY) ? stream->raw->capacity
+                                                                                        : AVIF_STREAM_BUFFER_MIN_CAPACITY;
+        while (newCapacity < neededSize) {
+            newCapacity *= 2;
+        }
+        avifRWDataReserve(stream->raw, newCapacity);
     }
-    if (stream->raw->size != newSize) {
-        avifRWDataRealloc(stream->raw, newSize);
+    if (stream->raw->size < neededSize) {
+        stream->raw->size = neededSize;
     }
 }
 
@@ -251,6 +256,11 @@ void avifRWStreamWriteChars(avifRWStream * stream, const char * chars, size_t si
 }
 
 avifBoxMarker avifRWStreamWriteBox(avifRWStream * stream, const char * type, int version, size_t contentSize)
+{
+    return avifRWStreamWriteFullBox(stream, type, version, 0, contentSize);
+}
+
+avifBoxMarker avifRWStreamWriteFullBox(avifRWStream * stream, const char * type, int version, uint32_t flags, size_t contentSize)
 {
     avifBoxMarker marker = stream->offset;
     size_t headerSize = sizeof(uint32_t) + 4 /* size of type */;
@@ -262,6 +272,9 @@ avifBoxMarker avifRWStreamWriteBox(avifRWStream * stream, const char * type, int
     memset(stream->raw->data + stream->offset, 0, headerSize);
     if (version != -1) {
         stream->raw->data[stream->offset + 8] = (uint8_t)version;
+        stream->raw->data[stream->offset + 9] = (uint8_t)((flags >> 16) & 0xff);
+        stream->raw->data[stream->offset + 10] = (uint8_t)((flags >> 8) & 0xff);
+        stream->raw->data[stream->offset + 11] = (uint8_t)(flags & 0xff);
     }
     uint32_t noSize = avifNTOHL((uint32_t)(headerSize + contentSize));
     memcpy(stream->raw->data + stream->offset, &noSize, sizeof(uint32_t));
@@ -303,6 +316,15 @@ void avifRWStreamWriteU32(avifRWStream * stream, uint32_t v)
     stream->offset += size;
 }
 
+void avifRWStreamWriteU64(avifRWStream * stream, uint64_t v)
+{
+    size_t size = sizeof(uint64_t);
+    v = avifHTON64(v);
+    makeRoom(stream, size);
+    memcpy(stream->raw->data + stream->offset, &v, size);
+    stream->offset += size;
+}
+
 void avifRWStreamWriteZeros(avifRWStream * stream, size_t byteCount)
 {
     makeRoom(stream, byteCount);
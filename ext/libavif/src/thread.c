@@ -0,0 +1,222 @@
+// Copyright 2020 Joe Drago. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "avif/internal.h"
+
+#include <string.h>
+
+#if defined(AVIF_THREADS_DISABLED)
+// No threading support: every avifThreadCreate() fails, and locks are no-ops.
+#elif defined(_WIN32)
+#define AVIF_THREADS_WIN32
+#include <windows.h>
+#else
+#define AVIF_THREADS_PTHREADS
+#include <pthread.h>
+#endif
+
+struct avifThread
+{
+    avifThreadFunc func;
+    void * userData;
+#if defined(AVIF_THREADS_WIN32)
+    HANDLE handle;
+#elif defined(AVIF_THREADS_PTHREADS)
+    pthread_t handle;
+#endif
+};
+
+struct avifMutex
+{
+#if defined(AVIF_THREADS_WIN32)
+    CRITICAL_SECTION cs;
+#elif defined(AVIF_THREADS_PTHREADS)
+    pthread_mutex_t mutex;
+#else
+    int unused;
+#endif
+};
+
+struct avifCond
+{
+#if defined(AVIF_THREADS_WIN32)
+    CONDITION_VARIABLE cv;
+#elif defined(AVIF_THREADS_PTHREADS)
+    pthread_cond_t cond;
+#else
+    int unused;
+#endif
+};
+
+// ---------------------------------------------------------------------------
+// avifThread
+
+#if defined(AVIF_THREADS_WIN32)
+static DWORD WINAPI avifThreadTrampoline(LPVOID param)
+{
+    avifThread * thread = (avifThread *)param;
+    thread->func(thread->userData);
+    return 0;
+}
+#elif defined(AVIF_THREADS_PTHREADS)
+static void * avifThreadTrampoline(void * param)
+{
+    avifThread * thread = (avifThread *)param;
+    thread->func(thread->userData);
+    return NULL;
+}
+#endif
+
+avifThread * avifThreadCreate(avifThreadFunc func, void * userData)
+{
+#if defined(AVIF_THREADS_WIN32) || defined(AVIF_THREADS_PTHREADS)
+    avifThread * thread = (avifThread *)avifAlloc(sizeof(avifThread));
+    memset(thread, 0, sizeof(avifThread));
+    thread->func = func;
+    thread->userData = userData;
+#if defined(AVIF_THREADS_WIN32)
+    thread->handle = CreateThread(NULL, 0, avifThreadTrampoline, thread, 0, NULL);
+    if (thread->handle == NULL) {
+        avifFree(thread);
+        return NULL;
+    }
+#else
+    if (pthread_create(&thread->handle, NULL, avifThreadTrampoline, thread) != 0) {
+        avifFree(thread);
+        return NULL;
+    }
+#endif
+    return thread;
+#else
+    (void)func;
+    (void)userData;
+    return NULL;
+#endif
+}
+
+void avifThreadJoin(avifThread * thread)
+{
+#if defined(AVIF_THREADS_WIN32)
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#elif defined(AVIF_THREADS_PTHREADS)
+    pthread_join(thread->handle, NULL);
+#endif
+    avifFree(thread);
+}
+
+void avifRunWorkers(avifThreadFunc func, void * userData, int workerCount)
+{
+    avifThread * threads[AVIF_MAX_WORKERS];
+    int threadCount = 0;
+    if (workerCount > AVIF_MAX_WORKERS) {
+        workerCount = AVIF_MAX_WORKERS;
+    }
+    for (int i = 1; i < workerCount; ++i) {
+        avifThread * thread = avifThreadCreate(func, userData);
+        if (!thread) {
+            // Out of threads; the workers we have (including this one) will pick up the slack
+            break;
+        }
+        threads[threadCount++] = thread;
+    }
+
+    func(userData);
+
+    for (int i = 0; i < threadCount; ++i) {
+        avifThreadJoin(threads[i]);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// avifMutex
+
+avifMutex * avifMutexCreate(void)
+{
+    avifMutex * mutex = (avifMutex *)avifAlloc(sizeof(avifMutex));
+    memset(mutex, 0, sizeof(avifMutex));
+#if defined(AVIF_THREADS_WIN32)
+    InitializeCriticalSection(&mutex->cs);
+#elif defined(AVIF_THREADS_PTHREADS)
+    pthread_mutex_init(&mutex->mutex, NULL);
+#endif
+    return mutex;
+}
+
+void avifMutexDestroy(avifMutex * mutex)
+{
+#if defined(AVIF_THREADS_WIN32)
+    DeleteCriticalSection(&mutex->cs);
+#elif defined(AVIF_THREADS_PTHREADS)
+    pthread_mutex_destroy(&mutex->mutex);
+#endif
+    avifFree(mutex);
+}
+
+void avifMutexLock(avifMutex * mutex)
+{
+#if defined(AVIF_THREADS_WIN32)
+    EnterCriticalSection(&mutex->cs);
+#elif defined(AVIF_THREADS_PTHREADS)
+    pthread_mutex_lock(&mutex->mutex);
+#else
+    (void)mutex;
+#endif
+}
+
+void avifMutexUnlock(avifMutex * mutex)
+{
+#if defined(AVIF_THREADS_WIN32)
+    LeaveCriticalSection(&mutex->cs);
+#elif defined(AVIF_THREADS_PTHREADS)
+    pthread_mutex_unlock(&mutex->mutex);
+#else
+    (void)mutex;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// avifCond
+
+avifCond * avifCondCreate(void)
+{
+    avifCond * cond = (avifCond *)avifAlloc(sizeof(avifCond));
+    memset(cond, 0, sizeof(avifCond));
+#if defined(AVIF_THREADS_WIN32)
+    InitializeConditionVariable(&cond->cv);
+#elif defined(AVIF_THREADS_PTHREADS)
+    pthread_cond_init(&cond->cond, NULL);
+#endif
+    return cond;
+}
+
+void avifCondDestroy(avifCond * cond)
+{
+#if defined(AVIF_THREADS_PTHREADS)
+    pthread_cond_destroy(&cond->cond);
+#endif
+    avifFree(cond);
+}
+
+void avifCondWait(avifCond * cond, avifMutex * mutex)
+{
+#if defined(AVIF_THREADS_WIN32)
+    SleepConditionVariableCS(&cond->cv, &mutex->cs, INFINITE);
+#elif defined(AVIF_THREADS_PTHREADS)
+    pthread_cond_wait(&cond->cond, &mutex->mutex);
+#else
+    (void)cond;
+    (void)mutex;
+#endif
+}
+
+void avifCondBroadcast(avifCond * cond)
+{
+#if defined(AVIF_THREADS_WIN32)
+    WakeAllConditionVariable(&cond->cv);
+#elif defined(AVIF_THREADS_PTHREADS)
+    pthread_cond_broadcast(&cond->cond);
+#else
+    (void)cond;
+#endif
+}
@@ -26,8 +26,13 @@ static const char xmpContentType[] = CONTENT_TYPE_XMP;
 static const size_t xmpContentTypeSize = sizeof(xmpContentType);
 
 static avifBool avifImageIsOpaque(avifImage * image);
+static avifImage * avifImageCreateGridCell(avifImage * image, uint32_t cellX, uint32_t cellY, uint32_t cellWidth, uint32_t cellHeight);
+static void writeImageGridPayload(avifRWData * payload, uint32_t gridCols, uint32_t gridRows, avifImage * image);
 static void fillConfigBox(avifCodec * codec, avifImage * image, avifBool alpha);
 static void writeConfigBox(avifRWStream * s, avifCodecConfigurationBox * cfg);
+static avifResult avifEncoderWriteInternal(avifEncoder * encoder, avifImage * image, avifRWData * output, avifIOWriter * io);
+static avifResult avifEncoderWriteFile(avifEncoder * encoder, avifImage * image, avifRWData * output, avifIOWriter * io);
+static void avifEncoderWriteMoov(avifEncoder * encoder, avifRWStream * s);
 
 // ---------------------------------------------------------------------------
 // avifEncoderItem
@@ -39,8 +44,12 @@ typedef struct avifEncoderItem
     uint8_t type[4];
     avifImage * image;  // avifImage* to use when encoding or populating ipma for this item (unowned)
     avifCodec * codec;  // only present on type==av01
-    avifRWData content; // OBU data on av01, metadata payload for Exif/XMP
+    avifRWData content; // OBU data on av01, ImageGrid payload on grid, metadata payload for Exif/XMP
     avifBool alpha;
+    avifBool searched; // encoder->target: content comes from the quantizer search, not the encode scheduler
+
+    avifEncodeSampleArray samples; // sequences only: every sample of this av01 item's track, instead of content
+    size_t stcoOffsetOffset;       // Stream offset where the track's chunk offset was written, set after mdat like infeOffsetOffset
 
     const char * infeName;
     size_t infeNameSize;
@@ -50,6 +59,7 @@ typedef struct avifEncoderItem
 
     uint16_t irefToID; // if non-zero, make an iref from this id -> irefToID
     const char * irefType;
+    uint16_t dimgFromID; // if non-zero, this item is a cell of the grid item dimgFromID (listed in its iref dimg)
 
     struct ipmaArray ipma;
 } avifEncoderItem;
@@ -58,11 +68,30 @@ AVIF_ARRAY_DECLARE(avifEncoderItemArray, avifEncoderItem, item);
 // ---------------------------------------------------------------------------
 // avifEncoderData
 
+typedef struct avifEncodeFrame
+{
+    uint64_t durationInTimescales;
+} avifEncodeFrame;
+AVIF_ARRAY_DECLARE(avifEncodeFrameArray, avifEncodeFrame, frame);
+
+typedef avifCodec * avifCodecPtr;
+AVIF_ARRAY_DECLARE(avifCodecPtrArray, avifCodecPtr, codec);
+
 typedef struct avifEncoderData
 {
     avifEncoderItemArray items;
     uint16_t lastItemID;
     uint16_t primaryItemID;
+
+    // Sequences: the first frame's properties (without planes) which describe every frame, and the
+    // frames added so far
+    avifImage * sequenceImage;
+    avifEncodeFrameArray frames;
+
+    // encoder->keepCodecs: the codecs of the previous still image, handed out again (in the same
+    // item order) to the next one
+    avifCodecPtrArray codecPool;
+    avifCodecChoice codecPoolChoice;
 } avifEncoderData;
 
 static avifEncoderData * avifEncoderDataCreate()
@@ -70,9 +99,28 @@ static avifEncoderData * avifEncoderDataCreate()
     avifEncoderData * data = (avifEncoderData *)avifAlloc(sizeof(avifEncoderData));
     memset(data, 0, sizeof(avifEncoderData));
     avifArrayCreate(&data->items, sizeof(avifEncoderItem), 8);
+    avifArrayCreate(&data->frames, sizeof(avifEncodeFrame), 16);
+    avifArrayCreate(&data->codecPool, sizeof(avifCodecPtr), 2);
     return data;
 }
 
+static avifCodec * avifEncoderDataCreateCodec(avifEncoderData * data, avifBool keepCodecs, avifCodecChoice codecChoice)
+{
+    if (keepCodecs && (data->codecPool.count > 0) && (data->codecPoolChoice == codecChoice)) {
+        --data->codecPool.count;
+        return data->codecPool.codec[data->codecPool.count];
+    }
+    return avifCodecCreate(codecChoice, AVIF_CODEC_FLAG_CAN_ENCODE);
+}
+
+static void avifEncoderDataDestroyCodecPool(avifEncoderData * data)
+{
+    for (uint32_t i = 0; i < data->codecPool.count; ++i) {
+        avifCodecDestroy(data->codecPool.codec[i]);
+    }
+    data->codecPool.count = 0;
+}
+
 static avifEncoderItem * avifEncoderDataCreateItem(avifEncoderData * data, const char * type, const char * infeName, size_t infeNameSize)
 {
     avifEncoderItem * item = (avifEncoderItem *)avifArrayPushPtr(&data->items);
@@ -84,76 +132,57 @@ static avifEncoderItem * avifEncoderDataCreateItem(avifEncoderData * data, const
     return item;
 }
 
-static void avifEncoderDataDestroy(avifEncoderData * data)
+// Creates a grid item followed by one av01 item per cell (in raster order), and returns the grid
+// item's ID, or 0 if no codec is available. The cell images remain owned by the caller.
+static uint16_t avifEncoderDataCreateGridItems(avifEncoderData * data,
+                                               avifBool keepCodecs,
+                                               avifCodecChoice codecChoice,
+                                               avifImage * image,
+                                               avifImage ** cells,
+                                               uint32_t gridCols,
+                                               uint32_t gridRows,
+                                               avifBool alpha)
 {
-    for (uint32_t i = 0; i < data->items.count; ++i) {
-        avifEncoderItem * item = &data->items.item[i];
-        if (item->codec) {
-            avifCodecDestroy(item->codec);
+    const char * infeName = alpha ? "Alpha" : "Color";
+    avifEncoderItem * gridItem = avifEncoderDataCreateItem(data, "grid", infeName, 6);
+    gridItem->image = image;
+    gridItem->alpha = alpha;
+    writeImageGridPayload(&gridItem->content, gridCols, gridRows, image);
+    uint16_t gridItemID = gridItem->id; // gridItem is invalidated by the pushes below
+
+    for (uint32_t cellIndex = 0; cellIndex < gridCols * gridRows; ++cellIndex) {
+        avifEncoderItem * cellItem = avifEncoderDataCreateItem(data, "av01", infeName, 6);
+        cellItem->image = cells[cellIndex];
+        cellItem->codec = avifEncoderDataCreateCodec(data, keepCodecs, codecChoice);
+        if (!cellItem->codec) {
+            return 0;
         }
-        avifRWDataFree(&item->content);
+        cellItem->alpha = alpha;
+        cellItem->dimgFromID = gridItemID;
     }
-    avifArrayDestroy(&data->items);
-    avifFree(data);
+    return gridItemID;
 }
 
-// ---------------------------------------------------------------------------
-
-avifEncoder * avifEncoderCreate(void)
-{
-    avifEncoder * encoder = (avifEncoder *)avifAlloc(sizeof(avifEncoder));
-    memset(encoder, 0, sizeof(avifEncoder));
-    encoder->maxThreads = 1;
-    encoder->minQuantizer = AVIF_QUANTIZER_LOSSLESS;
-    encoder->maxQuantizer = AVIF_QUANTIZER_LOSSLESS;
-    encoder->minQuantizerAlpha = AVIF_QUANTIZER_LOSSLESS;
-    encoder->maxQuantizerAlpha = AVIF_QUANTIZER_LOSSLESS;
-    encoder->tileRowsLog2 = 0;
-    encoder->tileColsLog2 = 0;
-    encoder->speed = AVIF_SPEED_DEFAULT;
-    encoder->data = avifEncoderDataCreate();
-    return encoder;
-}
-
-void avifEncoderDestroy(avifEncoder * encoder)
-{
-    avifEncoderDataDestroy(encoder->data);
-    avifFree(encoder);
-}
-
-avifResult avifEncoderWrite(avifEncoder * encoder, avifImage * image, avifRWData * output)
+// Checks what every encoded image (and every frame of a sequence) needs
+static avifResult avifEncoderValidateImage(avifImage * image)
 {
     if ((image->depth != 8) && (image->depth != 10) && (image->depth != 12)) {
         return AVIF_RESULT_UNSUPPORTED_DEPTH;
     }
 
-    avifResult result = AVIF_RESULT_UNKNOWN_ERROR;
-
-    avifEncoderItem * colorItem = avifEncoderDataCreateItem(encoder->data, "av01", "Color", 6);
-    colorItem->image = image;
-    colorItem->codec = avifCodecCreate(encoder->codecChoice, AVIF_CODEC_FLAG_CAN_ENCODE);
-    if (!colorItem->codec) {
-        // Just bail out early, we're not surviving this function without an encoder compiled in
-        return AVIF_RESULT_NO_CODEC_AVAILABLE;
+    if (!image->width || !image->height || !image->yuvPlanes[AVIF_CHAN_Y]) {
+        return AVIF_RESULT_NO_CONTENT;
     }
-    encoder->data->primaryItemID = colorItem->id;
 
-    avifBool imageIsOpaque = avifImageIsOpaque(image);
-    if (!imageIsOpaque) {
-        avifEncoderItem * alphaItem = avifEncoderDataCreateItem(encoder->data, "av01", "Alpha", 6);
-        alphaItem->image = image;
-        alphaItem->codec = avifCodecCreate(encoder->codecChoice, AVIF_CODEC_FLAG_CAN_ENCODE);
-        if (!alphaItem->codec) {
-            return AVIF_RESULT_NO_CODEC_AVAILABLE;
-        }
-        alphaItem->alpha = AVIF_TRUE;
-        alphaItem->irefToID = encoder->data->primaryItemID;
-        alphaItem->irefType = "auxl";
+    if (image->yuvFormat == AVIF_PIXEL_FORMAT_NONE) {
+        return AVIF_RESULT_NO_YUV_FORMAT_SELECTED;
     }
+    return AVIF_RESULT_OK;
+}
 
-    // -----------------------------------------------------------------------
-    // Create metadata items (Exif, XMP)
-
+// Creates the Exif and XMP items describing the primary item
+static avifResult avifEncoderDataCreateMetadataItems(avifEncoderData * data, avifImage * image)
+{
     if (image->exif.size > 0) {
         // Validate Exif payload (if any) and find TIFF header offset
         uint32_t exifTiffHeaderOffset = 0;
@@ -180,8 +209,8 @@ avifResult avifEncoderWrite(avifEncoder * encoder, avifImage * image, avifRWData
             }
         }
 
-        avifEncoderItem * exifItem = avifEncoderDataCreateItem(encoder->data, "Exif", "Exif", 5);
-        exifItem->irefToID = encoder->data->primaryItemID;
+        avifEncoderItem * exifItem = avifEncoderDataCreateItem(data, "Exif", "Exif", 5);
+        exifItem->irefToID = data->primaryItemID;
         exifItem->irefType = "cdsc";
 
         avifRWDataRealloc(&exifItem->content, sizeof(uint32_t) + image->exif.size);
@@ -191,14 +220,794 @@ avifResult avifEncoderWrite(avifEncoder * encoder, avifImage * image, avifRWData
     }
 
     if (image->xmp.size > 0) {
-        avifEncoderItem * xmpItem = avifEncoderDataCreateItem(encoder->data, "mime", "XMP", 4);
-        xmpItem->irefToID = encoder->data->primaryItemID;
+        avifEncoderItem * xmpItem = avifEncoderDataCreateItem(data, "mime", "XMP", 4);
+        xmpItem->irefToID = data->primaryItemID;
         xmpItem->irefType = "cdsc";
 
         xmpItem->infeContentType = xmpContentType;
         xmpItem->infeContentTypeSize = xmpContentTypeSize;
         avifRWDataSet(&xmpItem->content, image->xmp.data, image->xmp.size);
     }
+    return AVIF_RESULT_OK;
+}
+
+// Forgets every item, so the next image starts from scratch. With keepCodecs, the codecs of a still
+// image go to the pool; sequence codecs are never reused, their streams can't be continued. Without
+// it, the pool left from when it was set is emptied too.
+static void avifEncoderDataReset(avifEncoderData * data, avifBool keepCodecs, avifCodecChoice codecChoice)
+{
+    if (!keepCodecs) {
+        avifEncoderDataDestroyCodecPool(data);
+    }
+    keepCodecs = keepCodecs && !data->sequenceImage;
+    if (keepCodecs && (data->codecPoolChoice != codecChoice)) {
+        avifEncoderDataDestroyCodecPool(data);
+        data->codecPoolChoice = codecChoice;
+    }
+
+    // Pushed last item first, so avifEncoderDataCreateCodec() hands them out in item order
+    for (uint32_t i = data->items.count; i-- > 0;) {
+        avifEncoderItem * item = &data->items.item[i];
+        if (item->codec) {
+            if (keepCodecs) {
+                avifCodecPtr * pooledCodec = (avifCodecPtr *)avifArrayPushPtr(&data->codecPool);
+                *pooledCodec = item->codec;
+            } else {
+                avifCodecDestroy(item->codec);
+            }
+        }
+        avifRWDataFree(&item->content);
+        for (uint32_t sampleIndex = 0; sampleIndex < item->samples.count; ++sampleIndex) {
+            avifRWDataFree(&item->samples.sample[sampleIndex].data);
+        }
+        avifArrayDestroy(&item->samples);
+        memset(item, 0, sizeof(avifEncoderItem)); // avifArrayPushPtr() only zeroes fresh capacity
+    }
+    data->items.count = 0;
+    data->lastItemID = 0;
+    data->primaryItemID = 0;
+
+    data->frames.count = 0;
+    if (data->sequenceImage) {
+        avifImageDestroy(data->sequenceImage);
+        data->sequenceImage = NULL;
+    }
+}
+
+static void avifEncoderDataDestroy(avifEncoderData * data)
+{
+    avifEncoderDataReset(data, AVIF_FALSE, data->codecPoolChoice);
+    avifArrayDestroy(&data->codecPool);
+    avifArrayDestroy(&data->items);
+    avifArrayDestroy(&data->frames);
+    avifFree(data);
+}
+
+// ---------------------------------------------------------------------------
+// Encode scheduler
+//
+// Every av01 item (color, alpha, grid cells) is encoded independently into its own content
+// buffer, so items can be handed out to a pool of workers. Each item's codec gets a share of
+// maxThreads proportional to its pixel count, and since the boxes are only written once all items
+// are done, the output does not depend on the order in which items finish. Sequences go through the
+// same scheduler once per frame (color and alpha tracks in parallel), and once more to flush.
+
+typedef enum avifEncodeStep
+{
+    AVIF_ENCODE_STEP_IMAGE = 0, // still image: item->content
+    AVIF_ENCODE_STEP_FRAME,     // next frame of a sequence: appended to item->samples
+    AVIF_ENCODE_STEP_FINISH     // end of a sequence: the codec's remaining samples
+} avifEncodeStep;
+
+typedef struct avifEncodeJob
+{
+    avifEncoder * encoder;
+    avifEncodeStep step;
+    uint64_t durationInTimescales; // AVIF_ENCODE_STEP_FRAME
+    avifMutex * mutex;
+    uint32_t nextItemIndex;
+    uint32_t failedItemIndex; // lowest failing item index, so the reported error doesn't depend on timing
+    avifResult result;
+} avifEncodeJob;
+
+static avifBool avifEncoderItemEncode(avifEncodeJob * job, avifEncoderItem * item)
+{
+    avifCodec * codec = item->codec;
+    switch (job->step) {
+        case AVIF_ENCODE_STEP_FRAME:
+            if (codec->encodeFrame) {
+                return codec->encodeFrame(codec, item->image, job->encoder, job->durationInTimescales, &item->samples, item->alpha);
+            } else {
+                // No inter prediction available, each frame becomes a key frame of its own
+                avifEncodeSample * sample = (avifEncodeSample *)avifArrayPushPtr(&item->samples);
+                sample->sync = AVIF_TRUE;
+                return codec->encodeImage(codec, item->image, job->encoder, &sample->data, item->alpha);
+            }
+        case AVIF_ENCODE_STEP_FINISH:
+            return !codec->encodeFinish || codec->encodeFinish(codec, &item->samples);
+        case AVIF_ENCODE_STEP_IMAGE:
+        default:
+            return codec->encodeImage(codec, item->image, job->encoder, &item->content, item->alpha);
+    }
+}
+
+static void avifEncodeWorker(void * userData)
+{
+    avifEncodeJob * job = (avifEncodeJob *)userData;
+    avifEncoderItemArray * items = &job->encoder->data->items;
+
+    for (;;) {
+        uint32_t itemIndex = items->count;
+        avifMutexLock(job->mutex);
+        while ((job->result == AVIF_RESULT_OK) && (job->nextItemIndex < items->count)) {
+            avifEncoderItem * candidate = &items->item[job->nextItemIndex++];
+            if (candidate->codec && candidate->image && !candidate->searched) {
+                itemIndex = (uint32_t)(candidate - items->item);
+                break;
+            }
+        }
+        avifMutexUnlock(job->mutex);
+        if (itemIndex == items->count) {
+            return;
+        }
+
+        avifEncoderItem * item = &items->item[itemIndex];
+        const double startSeconds = avifTimeSeconds();
+        const avifBool encoded = avifEncoderItemEncode(job, item);
+        const double seconds = avifTimeSeconds() - startSeconds;
+
+        avifMutexLock(job->mutex);
+        if (item->alpha) {
+            job->encoder->ioStats.alphaCodecSeconds += seconds;
+        } else {
+            job->encoder->ioStats.colorCodecSeconds += seconds;
+        }
+        if (!encoded && ((job->result == AVIF_RESULT_OK) || (itemIndex < job->failedItemIndex))) {
+            job->result = item->alpha ? AVIF_RESULT_ENCODE_ALPHA_FAILED : AVIF_RESULT_ENCODE_COLOR_FAILED;
+            job->failedItemIndex = itemIndex;
+        }
+        avifMutexUnlock(job->mutex);
+    }
+}
+
+static avifResult avifEncoderEncodeItems(avifEncoder * encoder, avifEncodeStep step, uint64_t durationInTimescales)
+{
+    avifEncoderItemArray * items = &encoder->data->items;
+
+    uint64_t totalPixels = 0;
+    int encodeCount = 0;
+    for (uint32_t itemIndex = 0; itemIndex < items->count; ++itemIndex) {
+        avifEncoderItem * item = &items->item[itemIndex];
+        if (item->codec && item->image && !item->searched) {
+            totalPixels += (uint64_t)item->image->width * item->image->height;
+            ++encodeCount;
+        }
+    }
+    if (encodeCount == 0) {
+        return AVIF_RESULT_OK;
+    }
+
+    // libaom switches to row-based multithreading (and slightly different speed features) as soon as
+    // it is allowed more than one thread, but its output doesn't depend on the exact count. So an item
+    // never drops to a single thread when the whole encode may use several, which keeps the output
+    // identical to encoding the items one after another with all of maxThreads.
+    int maxThreads = (encoder->maxThreads > 1) ? encoder->maxThreads : 1;
+    int minThreads = (maxThreads > 1) ? 2 : 1;
+    for (uint32_t itemIndex = 0; itemIndex < items->count; ++itemIndex) {
+        avifEncoderItem * item = &items->item[itemIndex];
+        if (item->codec && item->image && !item->searched) {
+            uint64_t pixels = (uint64_t)item->image->width * item->image->height;
+            int threads = (int)((maxThreads * pixels + totalPixels / 2) / totalPixels);
+            item->codec->maxThreads = AVIF_CLAMP(threads, minThreads, maxThreads);
+        }
+    }
+
+    avifEncodeJob job;
+    memset(&job, 0, sizeof(job));
+    job.encoder = encoder;
+    job.step = step;
+    job.durationInTimescales = durationInTimescales;
+    job.mutex = avifMutexCreate();
+    job.result = AVIF_RESULT_OK;
+    avifRunWorkers(avifEncodeWorker, &job, AVIF_MIN(maxThreads, encodeCount));
+    avifMutexDestroy(job.mutex);
+    return job.result;
+}
+
+// ---------------------------------------------------------------------------
+// Quantizer search (encoder->target)
+//
+// The color items are encoded at single quantizers ("candidates") until the one that best meets the
+// target is found. Quantizers are laid out on a search axis along which candidates go from missing
+// the target to meeting it: rising quantizers for a size target, falling ones for a quality target.
+// The search narrows down the first position on that axis that meets the target, encoding up to
+// searchWidth untested positions per round, concurrently, each with its own codecs. Only the best
+// candidate meeting the target and the closest one missing it are kept, so the winner can be
+// written as it is.
+
+typedef struct avifSearchCandidate
+{
+    int position; // on the search axis
+    int quantizer;
+    int speed;
+    avifRWData * contents; // one per color item
+    size_t size;           // of the whole file
+    double quality;        // PSNR or SSIM, quality targets only
+    avifBool fits;
+    avifResult result;
+} avifSearchCandidate;
+
+typedef struct avifSearch
+{
+    avifEncoder * encoder;
+    avifEncoderItem ** colorItems;
+    uint32_t colorItemCount;
+    size_t baseSize; // the file without the color payloads, which doesn't depend on them
+    int minQuantizer;
+    int axisLength;
+    int searchWidth;
+    int codecThreads;
+
+    avifSearchCandidate * round;
+    int roundCount;
+    int nextCandidate;
+    avifMutex * mutex;
+} avifSearch;
+
+static void avifSearchCandidateFree(avifSearch * search, avifSearchCandidate * candidate)
+{
+    if (candidate->contents) {
+        for (uint32_t i = 0; i < search->colorItemCount; ++i) {
+            avifRWDataFree(&candidate->contents[i]);
+        }
+        avifFree(candidate->contents);
+    }
+    memset(candidate, 0, sizeof(avifSearchCandidate));
+}
+
+// Decodes content and adds it to quality, measured against source
+static avifBool avifSearchMeasure(avifSearch * search, const avifRWData * content, avifImage * source, avifQuality * quality)
+{
+    avifCodecDecodeInput * decodeInput = avifCodecDecodeInputCreate();
+    avifSample * sample = (avifSample *)avifArrayPushPtr(&decodeInput->samples);
+    sample->data.data = content->data;
+    sample->data.size = content->size;
+    sample->sync = AVIF_TRUE;
+
+    avifBool measured = AVIF_FALSE;
+    avifCodec * codec = avifCodecCreate(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_DECODE);
+    if (codec) {
+        codec->decodeInput = decodeInput;
+        codec->maxThreads = search->codecThreads;
+        avifImage * decoded = avifImageCreateEmpty();
+        if (codec->open(codec, 0) && codec->getNextImage(codec, decoded)) {
+            avifQualityAdd(quality, source, decoded, search->encoder->target == AVIF_ENCODER_TARGET_SSIM);
+            measured = AVIF_TRUE;
+        }
+        avifImageDestroy(decoded);
+        avifCodecDestroy(codec);
+    }
+    avifCodecDecodeInputDestroy(decodeInput);
+    return measured;
+}
+
+static void avifSearchCandidateEncode(avifSearch * search, avifSearchCandidate * candidate)
+{
+    // The candidate's own copy of the settings, with a single quantizer
+    avifEncoder settings = *search->encoder;
+    settings.minQuantizer = candidate->quantizer;
+    settings.maxQuantizer = candidate->quantizer;
+    settings.speed = candidate->speed;
+    settings.keepCodecs = AVIF_FALSE;
+
+    candidate->contents = (avifRWData *)avifAlloc(search->colorItemCount * sizeof(avifRWData));
+    memset(candidate->contents, 0, search->colorItemCount * sizeof(avifRWData));
+    candidate->size = search->baseSize;
+    candidate->result = AVIF_RESULT_OK;
+
+    avifQuality quality;
+    memset(&quality, 0, sizeof(quality));
+    for (uint32_t i = 0; (i < search->colorItemCount) && (candidate->result == AVIF_RESULT_OK); ++i) {
+        avifEncoderItem * item = search->colorItems[i];
+        avifCodec * codec = avifCodecCreate(search->encoder->codecChoice, AVIF_CODEC_FLAG_CAN_ENCODE);
+        if (!codec) {
+            candidate->result = AVIF_RESULT_NO_CODEC_AVAILABLE;
+            break;
+        }
+        codec->configBox = item->codec->configBox;
+        codec->maxThreads = search->codecThreads;
+        if (!codec->encodeImage(codec, item->image, &settings, &candidate->contents[i], AVIF_FALSE)) {
+            candidate->result = AVIF_RESULT_ENCODE_COLOR_FAILED;
+        }
+        avifCodecDestroy(codec);
+        candidate->size += candidate->contents[i].size;
+
+        if ((candidate->result == AVIF_RESULT_OK) && (search->encoder->target != AVIF_ENCODER_TARGET_SIZE) &&
+            !avifSearchMeasure(search, &candidate->contents[i], item->image, &quality)) {
+            candidate->result = AVIF_RESULT_DECODE_COLOR_FAILED;
+        }
+    }
+
+    switch (search->encoder->target) {
+        case AVIF_ENCODER_TARGET_PSNR:
+            candidate->quality = avifQualityPSNR(&quality);
+            candidate->fits = candidate->quality >= search->encoder->targetQuality;
+            break;
+        case AVIF_ENCODER_TARGET_SSIM:
+            candidate->quality = avifQualitySSIM(&quality);
+            candidate->fits = candidate->quality >= search->encoder->targetQuality;
+            break;
+        case AVIF_ENCODER_TARGET_SIZE:
+        default:
+            candidate->fits = candidate->size <= search->encoder->targetSize;
+            break;
+    }
+}
+
+static void avifSearchWorker(void * userData)
+{
+    avifSearch * search = (avifSearch *)userData;
+    for (;;) {
+        avifMutexLock(search->mutex);
+        int candidateIndex = search->nextCandidate++;
+        avifMutexUnlock(search->mutex);
+        if (candidateIndex >= search->roundCount) {
+            return;
+        }
+
+        const double startSeconds = avifTimeSeconds();
+        avifSearchCandidateEncode(search, &search->round[candidateIndex]);
+        const double seconds = avifTimeSeconds() - startSeconds;
+
+        avifMutexLock(search->mutex);
+        search->encoder->ioStats.colorCodecSeconds += seconds;
+        avifMutexUnlock(search->mutex);
+    }
+}
+
+// Searches the axis at speed, starting with the positions in [windowFirst, windowLast] and widening
+// the window around them for as long as the first fit isn't found in there. Every candidate fitting at fit->position
+// or missing at miss->position has been encoded. fit and miss start out empty, and fit stays empty
+// if nothing fits.
+static avifResult avifSearchRun(avifSearch * search, int speed, int windowFirst, int windowLast, avifSearchCandidate * fit, avifSearchCandidate * miss)
+{
+    int first = 0;                 // every position before this misses the target
+    int last = search->axisLength; // this position fits, or nothing is known to fit yet
+    while (first < last) {
+        int roundFirst = AVIF_MAX(first, windowFirst);
+        int roundLast = AVIF_MIN(last - 1, windowLast);
+        if (roundFirst > roundLast) {
+            // The first fit lies outside the window, double it
+            const int windowSize = windowLast - windowFirst + 1;
+            windowFirst -= windowSize;
+            windowLast += windowSize;
+            continue;
+        }
+
+        // Spread the round evenly over what is left of the window
+        const int span = roundLast - roundFirst + 1;
+        search->roundCount = AVIF_MIN(span, search->searchWidth);
+        for (int i = 0; i < search->roundCount; ++i) {
+            avifSearchCandidate * candidate = &search->round[i];
+            memset(candidate, 0, sizeof(avifSearchCandidate));
+            if (search->roundCount == span) {
+                candidate->position = roundFirst + i;
+            } else {
+                candidate->position = roundFirst + (span * (i + 1)) / (search->roundCount + 1);
+            }
+            if (search->encoder->target == AVIF_ENCODER_TARGET_SIZE) {
+                candidate->quantizer = search->minQuantizer + candidate->position;
+            } else {
+                candidate->quantizer = search->minQuantizer + (search->axisLength - 1 - candidate->position);
+            }
+            candidate->speed = speed;
+        }
+        search->nextCandidate = 0;
+        avifRunWorkers(avifSearchWorker, search, search->roundCount);
+        search->encoder->ioStats.targetCandidates += search->roundCount;
+
+        avifResult result = AVIF_RESULT_OK;
+        for (int i = 0; i < search->roundCount; ++i) {
+            avifSearchCandidate * candidate = &search->round[i];
+            if ((result == AVIF_RESULT_OK) && (candidate->result != AVIF_RESULT_OK)) {
+                result = candidate->result;
+            }
+            if ((result == AVIF_RESULT_OK) && candidate->fits && (candidate->position < last)) {
+                last = candidate->position;
+                avifSearchCandidateFree(search, fit);
+                *fit = *candidate;
+            } else if ((result == AVIF_RESULT_OK) && !candidate->fits && (candidate->position >= first)) {
+                first = candidate->position + 1;
+                avifSearchCandidateFree(search, miss);
+                *miss = *candidate;
+            } else {
+                avifSearchCandidateFree(search, candidate);
+            }
+        }
+        if (result != AVIF_RESULT_OK) {
+            return result;
+        }
+    }
+    return AVIF_RESULT_OK;
+}
+
+// Encodes the alpha items as usual, then searches for the color quantizer and hands the winner's
+// payloads to the color items
+static avifResult avifEncoderSearchItems(avifEncoder * encoder, avifImage * image)
+{
+    avifEncoderItemArray * items = &encoder->data->items;
+
+    avifSearch search;
+    memset(&search, 0, sizeof(search));
+    search.encoder = encoder;
+    search.colorItems = (avifEncoderItem **)avifAlloc(items->count * sizeof(avifEncoderItem *));
+    for (uint32_t itemIndex = 0; itemIndex < items->count; ++itemIndex) {
+        avifEncoderItem * item = &items->item[itemIndex];
+        if (item->codec && item->image && !item->alpha) {
+            item->searched = AVIF_TRUE;
+            search.colorItems[search.colorItemCount++] = item;
+        }
+    }
+
+    avifResult result = avifEncoderEncodeItems(encoder, AVIF_ENCODE_STEP_IMAGE, 0);
+    if (result != AVIF_RESULT_OK) {
+        avifFree(search.colorItems);
+        return result;
+    }
+
+    // Everything but the color payloads is in place now, and the header doesn't depend on their sizes
+    avifRWData withoutColor = AVIF_DATA_EMPTY;
+    result = avifEncoderWriteFile(encoder, image, &withoutColor, NULL);
+    search.baseSize = withoutColor.size;
+    avifRWDataFree(&withoutColor);
+    if (result != AVIF_RESULT_OK) {
+        avifFree(search.colorItems);
+        return result;
+    }
+
+    // Candidates never drop to a single thread when maxThreads allows several, for the same reason
+    // as in avifEncoderEncodeItems()
+    const int maxThreads = (encoder->maxThreads > 1) ? encoder->maxThreads : 1;
+    const int minQuantizer = AVIF_CLAMP(AVIF_MIN(encoder->minQuantizer, encoder->maxQuantizer), 0, 63);
+    const int maxQuantizer = AVIF_CLAMP(AVIF_MAX(encoder->minQuantizer, encoder->maxQuantizer), 0, 63);
+    search.minQuantizer = minQuantizer;
+    search.axisLength = maxQuantizer - minQuantizer + 1;
+    search.searchWidth = (maxThreads > 1) ? AVIF_CLAMP(maxThreads / 2, 1, 4) : 1;
+    search.codecThreads = (maxThreads > 1) ? AVIF_MAX(maxThreads / search.searchWidth, 2) : 1;
+    search.round = (avifSearchCandidate *)avifAlloc(search.searchWidth * sizeof(avifSearchCandidate));
+    search.mutex = avifMutexCreate();
+
+    avifSearchCandidate fit, miss;
+    memset(&fit, 0, sizeof(fit));
+    memset(&miss, 0, sizeof(miss));
+
+    // The probe only decides where to look first, its candidates are never written
+    int windowFirst = 0;
+    int windowLast = search.axisLength - 1;
+    if ((encoder->speed != AVIF_SPEED_FASTEST) && (search.axisLength > search.searchWidth)) {
+        result = avifSearchRun(&search, AVIF_SPEED_FASTEST, windowFirst, windowLast, &fit, &miss);
+        const int probePosition = fit.contents ? fit.position : (search.axisLength - 1);
+        windowFirst = probePosition - search.searchWidth;
+        windowLast = probePosition + search.searchWidth;
+        avifSearchCandidateFree(&search, &fit);
+        avifSearchCandidateFree(&search, &miss);
+    }
+    if (result == AVIF_RESULT_OK) {
+        result = avifSearchRun(&search, encoder->speed, windowFirst, windowLast, &fit, &miss);
+    }
+
+    if (result == AVIF_RESULT_OK) {
+        // Nothing fits: miss is the candidate at the end of the axis, the closest one to the target
+        avifSearchCandidate * winner = fit.contents ? &fit : &miss;
+        for (uint32_t i = 0; i < search.colorItemCount; ++i) {
+            search.colorItems[i]->content = winner->contents[i];
+            memset(&winner->contents[i], 0, sizeof(avifRWData));
+        }
+        encoder->ioStats.targetQuantizer = winner->quantizer;
+        encoder->ioStats.targetQuality = winner->quality;
+        encoder->ioStats.targetMet = winner->fits;
+    }
+
+    avifSearchCandidateFree(&search, &fit);
+    avifSearchCandidateFree(&search, &miss);
+    avifMutexDestroy(search.mutex);
+    avifFree(search.round);
+    avifFree(search.colorItems);
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+
+avifEncoder * avifEncoderCreate(void)
+{
+    avifEncoder * encoder = (avifEncoder *)avifAlloc(sizeof(avifEncoder));
+    memset(encoder, 0, sizeof(avifEncoder));
+    encoder->maxThreads = 1;
+    encoder->minQuantizer = AVIF_QUANTIZER_LOSSLESS;
+    encoder->maxQuantizer = AVIF_QUANTIZER_LOSSLESS;
+    encoder->minQuantizerAlpha = AVIF_QUANTIZER_LOSSLESS;
+    encoder->maxQuantizerAlpha = AVIF_QUANTIZER_LOSSLESS;
+    encoder->tileRowsLog2 = 0;
+    encoder->tileColsLog2 = 0;
+    encoder->speed = AVIF_SPEED_DEFAULT;
+    encoder->timescale = 1;
+    encoder->data = avifEncoderDataCreate();
+    return encoder;
+}
+
+void avifEncoderDestroy(avifEncoder * encoder)
+{
+    avifEncoderDataDestroy(encoder->data);
+    avifFree(encoder);
+}
+
+avifResult avifEncoderWrite(avifEncoder * encoder, avifImage * image, avifRWData * output)
+{
+    return avifEncoderWriteInternal(encoder, image, output, NULL);
+}
+
+avifResult avifEncoderWriteToIO(avifEncoder * encoder, avifImage * image, avifIOWriter * io)
+{
+    avifRWData header = AVIF_DATA_EMPTY;
+    avifResult result = avifEncoderWriteInternal(encoder, image, &header, io);
+    avifRWDataFree(&header);
+    return result;
+}
+
+// A copy of image's properties (without planes or metadata), describing every frame of a sequence
+static avifImage * avifImageCreateSequenceImage(avifImage * image)
+{
+    avifImage * sequenceImage = avifImageCreate(image->width, image->height, image->depth, image->yuvFormat);
+    sequenceImage->yuvRange = image->yuvRange;
+    sequenceImage->alphaRange = image->alphaRange;
+    if (image->profileFormat == AVIF_PROFILE_FORMAT_ICC) {
+        avifImageSetProfileICC(sequenceImage, image->icc.data, image->icc.size);
+    } else if (image->profileFormat == AVIF_PROFILE_FORMAT_NCLX) {
+        avifImageSetProfileNCLX(sequenceImage, &image->nclx);
+    }
+    sequenceImage->transformFlags = image->transformFlags;
+    memcpy(&sequenceImage->pasp, &image->pasp, sizeof(sequenceImage->pasp));
+    memcpy(&sequenceImage->clap, &image->clap, sizeof(sequenceImage->clap));
+    memcpy(&sequenceImage->irot, &image->irot, sizeof(sequenceImage->irot));
+    memcpy(&sequenceImage->imir, &image->imir, sizeof(sequenceImage->imir));
+    return sequenceImage;
+}
+
+// Creates the color (and alpha) track items from the first frame of a sequence
+static avifResult avifEncoderCreateSequenceItems(avifEncoder * encoder, avifImage * image)
+{
+    avifEncoderData * data = encoder->data;
+    if ((encoder->gridCellWidth > 0) && (encoder->gridCellHeight > 0) &&
+        ((encoder->gridCellWidth < image->width) || (encoder->gridCellHeight < image->height))) {
+        return AVIF_RESULT_INVALID_IMAGE_GRID;
+    }
+
+    avifEncoderDataReset(data, encoder->keepCodecs, encoder->codecChoice);
+    memset(&encoder->ioStats, 0, sizeof(encoder->ioStats));
+    data->sequenceImage = avifImageCreateSequenceImage(image);
+    for (int alpha = 0; alpha < (image->alphaPlane ? 2 : 1); ++alpha) {
+        avifEncoderItem * item = avifEncoderDataCreateItem(data, "av01", alpha ? "Alpha" : "Color", 6);
+        item->image = data->sequenceImage;
+        item->codec = avifEncoderDataCreateCodec(data, encoder->keepCodecs, encoder->codecChoice);
+        if (!item->codec) {
+            return AVIF_RESULT_NO_CODEC_AVAILABLE;
+        }
+        avifArrayCreate(&item->samples, sizeof(avifEncodeSample), 16);
+        if (alpha) {
+            item->alpha = AVIF_TRUE;
+            item->irefToID = data->primaryItemID;
+            item->irefType = "auxl";
+        } else {
+            data->primaryItemID = item->id;
+        }
+        fillConfigBox(item->codec, item->image, item->alpha);
+    }
+    return avifEncoderDataCreateMetadataItems(data, image);
+}
+
+avifResult avifEncoderAddImage(avifEncoder * encoder, avifImage * image, uint64_t durationInTimescales)
+{
+    avifResult result = avifEncoderValidateImage(image);
+    if (result != AVIF_RESULT_OK) {
+        return result;
+    }
+
+    avifEncoderData * data = encoder->data;
+    if (!data->sequenceImage) {
+        result = avifEncoderCreateSequenceItems(encoder, image);
+        if (result != AVIF_RESULT_OK) {
+            return result;
+        }
+    } else {
+        avifBool sequenceHasAlpha = (data->items.count > 1) && data->items.item[1].alpha;
+        if ((image->width != data->sequenceImage->width) || (image->height != data->sequenceImage->height) ||
+            (image->depth != data->sequenceImage->depth) || (image->yuvFormat != data->sequenceImage->yuvFormat) ||
+            (!image->alphaPlane && sequenceHasAlpha)) {
+            return AVIF_RESULT_INCOMPATIBLE_IMAGE;
+        }
+    }
+    if (durationInTimescales == 0) {
+        durationInTimescales = 1;
+    }
+
+    // The track items point at this frame only while it is being encoded
+    for (uint32_t itemIndex = 0; itemIndex < data->items.count; ++itemIndex) {
+        if (data->items.item[itemIndex].codec) {
+            data->items.item[itemIndex].image = image;
+        }
+    }
+    result = avifEncoderEncodeItems(encoder, AVIF_ENCODE_STEP_FRAME, durationInTimescales);
+    for (uint32_t itemIndex = 0; itemIndex < data->items.count; ++itemIndex) {
+        if (data->items.item[itemIndex].codec) {
+            data->items.item[itemIndex].image = data->sequenceImage;
+        }
+    }
+    if (result != AVIF_RESULT_OK) {
+        return result;
+    }
+
+    avifEncodeFrame * frame = (avifEncodeFrame *)avifArrayPushPtr(&data->frames);
+    frame->durationInTimescales = durationInTimescales;
+    return AVIF_RESULT_OK;
+}
+
+static avifResult avifEncoderFinishInternal(avifEncoder * encoder, avifRWData * output, avifIOWriter * io)
+{
+    avifEncoderData * data = encoder->data;
+    if (!data->sequenceImage || (data->frames.count == 0)) {
+        return AVIF_RESULT_NO_CONTENT;
+    }
+
+    avifResult result = avifEncoderEncodeItems(encoder, AVIF_ENCODE_STEP_FINISH, 0);
+
+    // Every frame must have come out as exactly one sample, starting with a key frame
+    for (uint32_t itemIndex = 0; (itemIndex < data->items.count) && (result == AVIF_RESULT_OK); ++itemIndex) {
+        avifEncoderItem * item = &data->items.item[itemIndex];
+        if (item->codec && ((item->samples.count != data->frames.count) || !item->samples.sample[0].sync)) {
+            result = item->alpha ? AVIF_RESULT_ENCODE_ALPHA_FAILED : AVIF_RESULT_ENCODE_COLOR_FAILED;
+        }
+    }
+    if (result == AVIF_RESULT_OK) {
+        const double writeStartSeconds = avifTimeSeconds();
+        result = avifEncoderWriteFile(encoder, data->sequenceImage, output, io);
+        encoder->ioStats.writeSeconds = avifTimeSeconds() - writeStartSeconds;
+    }
+
+    // Either way the sequence is over, the next avifEncoderAddImage() starts a new one
+    avifEncoderDataReset(data, encoder->keepCodecs, encoder->codecChoice);
+    return result;
+}
+
+avifResult avifEncoderFinish(avifEncoder * encoder, avifRWData * output)
+{
+    return avifEncoderFinishInternal(encoder, output, NULL);
+}
+
+avifResult avifEncoderFinishToIO(avifEncoder * encoder, avifIOWriter * io)
+{
+    avifRWData header = AVIF_DATA_EMPTY;
+    avifResult result = avifEncoderFinishInternal(encoder, &header, io);
+    avifRWDataFree(&header);
+    return result;
+}
+
+// Without io, the whole file is assembled in output. With io, output only receives the header boxes
+// (up to and including the mdat box header), which are handed to io followed by each item payload.
+static avifResult avifEncoderWriteInternal(avifEncoder * encoder, avifImage * image, avifRWData * output, avifIOWriter * io)
+{
+    avifResult result = avifEncoderValidateImage(image);
+    if (result != AVIF_RESULT_OK) {
+        return result;
+    }
+
+    // -----------------------------------------------------------------------
+    // Validate grid layout (if any)
+
+    uint32_t gridCols = 1;
+    uint32_t gridRows = 1;
+    if ((encoder->gridCellWidth > 0) && (encoder->gridCellHeight > 0)) {
+        gridCols = (image->width + encoder->gridCellWidth - 1) / encoder->gridCellWidth;
+        gridRows = (image->height + encoder->gridCellHeight - 1) / encoder->gridCellHeight;
+        if ((gridCols > 256) || (gridRows > 256)) {
+            // rows_minus_one and columns_minus_one are only 8 bits
+            return AVIF_RESULT_INVALID_IMAGE_GRID;
+        }
+    }
+    const uint32_t cellCount = gridCols * gridRows;
+    if (cellCount > 1) {
+        if ((cellCount * 2 + 4) > UINT16_MAX) {
+            // Every color and alpha cell needs its own 16 bit item ID
+            return AVIF_RESULT_INVALID_IMAGE_GRID;
+        }
+
+        if ((encoder->gridCellWidth < 64) || (encoder->gridCellHeight < 64)) {
+            // MIAF (ISO/IEC 23000-22:2019, 7.3.11.4.2) forbids cells smaller than 64x64
+            return AVIF_RESULT_INVALID_IMAGE_GRID;
+        }
+
+        avifPixelFormatInfo formatInfo;
+        avifGetPixelFormatInfo(image->yuvFormat, &formatInfo);
+        if ((encoder->gridCellWidth & formatInfo.chromaShiftX) || (encoder->gridCellHeight & formatInfo.chromaShiftY)) {
+            // Cells must start on a chroma sample
+            return AVIF_RESULT_INVALID_IMAGE_GRID;
+        }
+    }
+
+    avifEncoderDataReset(encoder->data, encoder->keepCodecs, encoder->codecChoice);
+    memset(&encoder->ioStats, 0, sizeof(encoder->ioStats));
+    result = AVIF_RESULT_UNKNOWN_ERROR;
+    avifImage ** gridCells = NULL;
+
+    // -----------------------------------------------------------------------
+    // Create color/alpha items (a grid item and its cells, or a single av01 item each)
+
+    avifBool imageIsOpaque = avifImageIsOpaque(image);
+    if (cellCount > 1) {
+        const double gridStartSeconds = avifTimeSeconds();
+        gridCells = (avifImage **)avifAlloc(cellCount * sizeof(avifImage *));
+        for (uint32_t cellIndex = 0; cellIndex < cellCount; ++cellIndex) {
+            uint32_t cellX = (cellIndex % gridCols) * encoder->gridCellWidth;
+            uint32_t cellY = (cellIndex / gridCols) * encoder->gridCellHeight;
+            gridCells[cellIndex] = avifImageCreateGridCell(image, cellX, cellY, encoder->gridCellWidth, encoder->gridCellHeight);
+            if (((cellX + encoder->gridCellWidth) > image->width) || ((cellY + encoder->gridCellHeight) > image->height)) {
+                // Only the cells overhanging the image have planes of their own
+                encoder->ioStats.planeBytes += avifImagePlaneBytes(gridCells[cellIndex], AVIF_PLANES_ALL);
+            }
+        }
+        encoder->ioStats.gridSeconds = avifTimeSeconds() - gridStartSeconds;
+
+        encoder->data->primaryItemID =
+            avifEncoderDataCreateGridItems(encoder->data, encoder->keepCodecs, encoder->codecChoice,
+                                           image, gridCells, gridCols, gridRows, AVIF_FALSE);
+        if (!encoder->data->primaryItemID) {
+            result = AVIF_RESULT_NO_CODEC_AVAILABLE;
+            goto writeCleanup;
+        }
+
+        if (!imageIsOpaque) {
+            uint16_t alphaGridItemID =
+                avifEncoderDataCreateGridItems(encoder->data, encoder->keepCodecs, encoder->codecChoice,
+                                               image, gridCells, gridCols, gridRows, AVIF_TRUE);
+            if (!alphaGridItemID) {
+                result = AVIF_RESULT_NO_CODEC_AVAILABLE;
+                goto writeCleanup;
+            }
+            avifEncoderItem * alphaGridItem = &encoder->data->items.item[encoder->data->items.count - cellCount - 1];
+            alphaGridItem->irefToID = encoder->data->primaryItemID;
+            alphaGridItem->irefType = "auxl";
+        }
+    } else {
+        avifEncoderItem * colorItem = avifEncoderDataCreateItem(encoder->data, "av01", "Color", 6);
+        colorItem->image = image;
+        colorItem->codec = avifEncoderDataCreateCodec(encoder->data, encoder->keepCodecs, encoder->codecChoice);
+        if (!colorItem->codec) {
+            // We're not surviving this function without an encoder compiled in
+            result = AVIF_RESULT_NO_CODEC_AVAILABLE;
+            goto writeCleanup;
+        }
+        encoder->data->primaryItemID = colorItem->id;
+
+        if (!imageIsOpaque) {
+            avifEncoderItem * alphaItem = avifEncoderDataCreateItem(encoder->data, "av01", "Alpha", 6);
+            alphaItem->image = image;
+            alphaItem->codec = avifEncoderDataCreateCodec(encoder->data, encoder->keepCodecs, encoder->codecChoice);
+            if (!alphaItem->codec) {
+                result = AVIF_RESULT_NO_CODEC_AVAILABLE;
+                goto writeCleanup;
+            }
+            alphaItem->alpha = AVIF_TRUE;
+            alphaItem->irefToID = encoder->data->primaryItemID;
+            alphaItem->irefType = "auxl";
+        }
+    }
+
+    // -----------------------------------------------------------------------
+    // Create metadata items (Exif, XMP)
+
+    result = avifEncoderDataCreateMetadataItems(encoder->data, image);
+    if (result != AVIF_RESULT_OK) {
+        goto writeCleanup;
+    }
 
     // -----------------------------------------------------------------------
     // Pre-fill config boxes based on image (codec can query/update later)
@@ -211,40 +1020,63 @@ avifResult avifEncoderWrite(avifEncoder * encoder, avifImage * image, avifRWData
     }
 
     // -----------------------------------------------------------------------
-    // Begin write stream
+    // Encode AV1 OBUs
 
-    avifRWStream s;
-    avifRWStreamStart(&s, output);
+    if (encoder->target != AVIF_ENCODER_TARGET_NONE) {
+        result = avifEncoderSearchItems(encoder, image);
+    } else {
+        result = avifEncoderEncodeItems(encoder, AVIF_ENCODE_STEP_IMAGE, 0);
+    }
+    if (result != AVIF_RESULT_OK) {
+        goto writeCleanup;
+    }
 
-    // -----------------------------------------------------------------------
-    // Validate image
+    const double writeStartSeconds = avifTimeSeconds();
+    result = avifEncoderWriteFile(encoder, image, output, io);
+    encoder->ioStats.writeSeconds = avifTimeSeconds() - writeStartSeconds;
 
-    if (!image->width || !image->height || !image->yuvPlanes[AVIF_CHAN_Y]) {
-        result = AVIF_RESULT_NO_CONTENT;
-        goto writeCleanup;
+writeCleanup:
+    // The items refer to image and its cells, which the caller may free right after this
+    avifEncoderDataReset(encoder->data, encoder->keepCodecs, encoder->codecChoice);
+    if (gridCells) {
+        for (uint32_t cellIndex = 0; cellIndex < cellCount; ++cellIndex) {
+            avifImageDestroy(gridCells[cellIndex]);
+        }
+        avifFree(gridCells);
     }
+    return result;
+}
 
-    if (image->yuvFormat == AVIF_PIXEL_FORMAT_NONE) {
-        result = AVIF_RESULT_NO_YUV_FORMAT_SELECTED;
-        goto writeCleanup;
+static size_t avifEncoderItemPayloadSize(const avifEncoderItem * item)
+{
+    size_t size = item->content.size;
+    for (uint32_t sampleIndex = 0; sampleIndex < item->samples.count; ++sampleIndex) {
+        size += item->samples.sample[sampleIndex].data.size;
     }
+    return size;
+}
 
+// Writes the file for the encoded items, describing image. Without io, the whole file is assembled
+// in output. With io, output only receives the header boxes, and the payloads are streamed after it.
+static avifResult avifEncoderWriteFile(avifEncoder * encoder, avifImage * image, avifRWData * output, avifIOWriter * io)
+{
     // -----------------------------------------------------------------------
-    // Encode AV1 OBUs
+    // Begin write stream
 
+    avifRWStream s;
+    avifRWStreamStart(&s, output);
+    const avifBool sequence = (encoder->data->sequenceImage != NULL);
+
+    // Grid cells and sequence samples are summed up into the total for their plane
+    encoder->ioStats.colorOBUSize = 0;
+    encoder->ioStats.alphaOBUSize = 0;
     for (uint32_t itemIndex = 0; itemIndex < encoder->data->items.count; ++itemIndex) {
         avifEncoderItem * item = &encoder->data->items.item[itemIndex];
         if (item->codec && item->image) {
-            if (!item->codec->encodeImage(item->codec, item->image, encoder, &item->content, item->alpha)) {
-                result = item->alpha ? AVIF_RESULT_ENCODE_ALPHA_FAILED : AVIF_RESULT_ENCODE_COLOR_FAILED;
-                goto writeCleanup;
-            }
-
-            // TODO: rethink this if/when image grid encoding support is added
             if (item->alpha) {
-                encoder->ioStats.alphaOBUSize = item->content.size;
+                encoder->ioStats.alphaOBUSize += avifEncoderItemPayloadSize(item);
             } else {
-                encoder->ioStats.colorOBUSize = item->content.size;
+                encoder->ioStats.colorOBUSize += avifEncoderItemPayloadSize(item);
             }
         }
     }
@@ -253,13 +1085,19 @@ avifResult avifEncoderWrite(avifEncoder * encoder, avifImage * image, avifRWData
     // Write ftyp
 
     avifBoxMarker ftyp = avifRWStreamWriteBox(&s, "ftyp", -1, 0);
-    avifRWStreamWriteChars(&s, "avif", 4);                         // unsigned int(32) major_brand;
+    avifRWStreamWriteChars(&s, sequence ? "avis" : "avif", 4);     // unsigned int(32) major_brand;
     avifRWStreamWriteU32(&s, 0);                                   // unsigned int(32) minor_version;
     avifRWStreamWriteChars(&s, "avif", 4);                         // unsigned int(32) compatible_brands[];
+    if (sequence) {                                                //
+        avifRWStreamWriteChars(&s, "avis", 4);                     // ... compatible_brands[]
+        avifRWStreamWriteChars(&s, "msf1", 4);                     // ... compatible_brands[]
+        avifRWStreamWriteChars(&s, "iso8", 4);                     // ... compatible_brands[]
+    }                                                              //
     avifRWStreamWriteChars(&s, "mif1", 4);                         // ... compatible_brands[]
     avifRWStreamWriteChars(&s, "miaf", 4);                         // ... compatible_brands[]
     if ((image->depth == 8) || (image->depth == 10)) {             //
-        if (image->yuvFormat == AVIF_PIXEL_FORMAT_YUV420) {        //
+        if ((image->yuvFormat == AVIF_PIXEL_FORMAT_YUV420) ||      //
+            (image->yuvFormat == AVIF_PIXEL_FORMAT_YUV400)) {      //
             avifRWStreamWriteChars(&s, "MA1B", 4);                 // ... compatible_brands[]
         } else if (image->yuvFormat == AVIF_PIXEL_FORMAT_YUV444) { //
             avifRWStreamWriteChars(&s, "MA1A", 4);                 // ... compatible_brands[]
@@ -304,12 +1142,14 @@ avifResult avifEncoderWrite(avifEncoder * encoder, avifImage * image, avifRWData
 
     for (uint32_t itemIndex = 0; itemIndex < encoder->data->items.count; ++itemIndex) {
         avifEncoderItem * item = &encoder->data->items.item[itemIndex];
-        avifRWStreamWriteU16(&s, item->id);                     // unsigned int(16) item_ID;
-        avifRWStreamWriteU16(&s, 0);                            // unsigned int(16) data_reference_index;
-        avifRWStreamWriteU16(&s, 1);                            // unsigned int(16) extent_count;
-        item->infeOffsetOffset = avifRWStreamOffset(&s);        //
-        avifRWStreamWriteU32(&s, 0 /* set later */);            // unsigned int(offset_size*8) extent_offset;
-        avifRWStreamWriteU32(&s, (uint32_t)item->content.size); // unsigned int(length_size*8) extent_length;
+        // A sequence's first frame doubles as the still image, so its item points at the first sample
+        size_t itemSize = (item->samples.count > 0) ? item->samples.sample[0].data.size : item->content.size;
+        avifRWStreamWriteU16(&s, item->id);              // unsigned int(16) item_ID;
+        avifRWStreamWriteU16(&s, 0);                     // unsigned int(16) data_reference_index;
+        avifRWStreamWriteU16(&s, 1);                     // unsigned int(16) extent_count;
+        item->infeOffsetOffset = avifRWStreamOffset(&s); //
+        avifRWStreamWriteU32(&s, 0 /* set later */);     // unsigned int(offset_size*8) extent_offset;
+        avifRWStreamWriteU32(&s, (uint32_t)itemSize);    // unsigned int(length_size*8) extent_length;
     }
 
     avifRWStreamFinishBox(&s, iloc);
@@ -337,37 +1177,81 @@ avifResult avifEncoderWrite(avifEncoder * encoder, avifImage * image, avifRWData
     avifRWStreamFinishBox(&s, iinf);
 
     // -----------------------------------------------------------------------
-    // Write iref boxes
+    // Write iref
 
+    avifBool hasIref = AVIF_FALSE;
     for (uint32_t itemIndex = 0; itemIndex < encoder->data->items.count; ++itemIndex) {
         avifEncoderItem * item = &encoder->data->items.item[itemIndex];
-        if (item->irefToID != 0) {
-            avifBoxMarker iref = avifRWStreamWriteBox(&s, "iref", 0, 0);
-            avifBoxMarker refType = avifRWStreamWriteBox(&s, item->irefType, -1, 0);
-            avifRWStreamWriteU16(&s, item->id);       // unsigned int(16) from_item_ID;
-            avifRWStreamWriteU16(&s, 1);              // unsigned int(16) reference_count;
-            avifRWStreamWriteU16(&s, item->irefToID); // unsigned int(16) to_item_ID;
-            avifRWStreamFinishBox(&s, refType);
-            avifRWStreamFinishBox(&s, iref);
+        if ((item->irefToID != 0) || (item->dimgFromID != 0)) {
+            hasIref = AVIF_TRUE;
+            break;
         }
     }
 
+    if (hasIref) {
+        avifBoxMarker iref = avifRWStreamWriteBox(&s, "iref", 0, 0);
+        for (uint32_t itemIndex = 0; itemIndex < encoder->data->items.count; ++itemIndex) {
+            avifEncoderItem * item = &encoder->data->items.item[itemIndex];
+            if (!memcmp(item->type, "grid", 4)) {
+                uint16_t cellCount = 0;
+                for (uint32_t cellIndex = itemIndex + 1; cellIndex < encoder->data->items.count; ++cellIndex) {
+                    if (encoder->data->items.item[cellIndex].dimgFromID == item->id) {
+                        ++cellCount;
+                    }
+                }
+
+                avifBoxMarker dimg = avifRWStreamWriteBox(&s, "dimg", -1, 0);
+                avifRWStreamWriteU16(&s, item->id);  // unsigned int(16) from_item_ID;
+                avifRWStreamWriteU16(&s, cellCount); // unsigned int(16) reference_count;
+                for (uint32_t cellIndex = itemIndex + 1; cellIndex < encoder->data->items.count; ++cellIndex) {
+                    avifEncoderItem * cellItem = &encoder->data->items.item[cellIndex];
+                    if (cellItem->dimgFromID == item->id) {
+                        avifRWStreamWriteU16(&s, cellItem->id); // unsigned int(16) to_item_ID;
+                    }
+                }
+                avifRWStreamFinishBox(&s, dimg);
+            }
+            if (item->irefToID != 0) {
+                avifBoxMarker refType = avifRWStreamWriteBox(&s, item->irefType, -1, 0);
+                avifRWStreamWriteU16(&s, item->id);       // unsigned int(16) from_item_ID;
+                avifRWStreamWriteU16(&s, 1);              // unsigned int(16) reference_count;
+                avifRWStreamWriteU16(&s, item->irefToID); // unsigned int(16) to_item_ID;
+                avifRWStreamFinishBox(&s, refType);
+            }
+        }
+        avifRWStreamFinishBox(&s, iref);
+    }
+
     // -----------------------------------------------------------------------
     // Write iprp -> ipco/ipma
 
     avifBoxMarker iprp = avifRWStreamWriteBox(&s, "iprp", -1, 0);
 
+    // Every cell of a grid shares the same ispe/pixi/av1C, so each grid's properties are written
+    // once (by its first cell) and the remaining cells reuse its associations.
+    uint16_t sharedCellIpmaGridID = 0;
+    struct ipmaArray sharedCellIpma;
+    avifCodecConfigurationBox sharedCellConfigBox;
+
     uint8_t itemPropertyIndex = 0;
     avifBoxMarker ipco = avifRWStreamWriteBox(&s, "ipco", -1, 0);
     for (uint32_t itemIndex = 0; itemIndex < encoder->data->items.count; ++itemIndex) {
         avifEncoderItem * item = &encoder->data->items.item[itemIndex];
         memset(&item->ipma, 0, sizeof(item->ipma));
-        if (!item->image || !item->codec) {
+        if (!item->image) {
             // No ipma to write for this item
             continue;
         }
 
-        // Properties all av01 items need
+        if (item->dimgFromID != 0) {
+            if ((item->dimgFromID == sharedCellIpmaGridID) &&
+                !memcmp(&item->codec->configBox, &sharedCellConfigBox, sizeof(avifCodecConfigurationBox))) {
+                memcpy(&item->ipma, &sharedCellIpma, sizeof(struct ipmaArray));
+                continue;
+            }
+        }
+
+        // Properties all av01 and grid items need
 
         avifBoxMarker ispe = avifRWStreamWriteBox(&s, "ispe", 0, 0);
         avifRWStreamWriteU32(&s, item->image->width);  // unsigned int(32) image_width;
@@ -375,7 +1259,7 @@ avifResult avifEncoderWrite(avifEncoder * encoder, avifImage * image, avifRWData
         avifRWStreamFinishBox(&s, ispe);
         ipmaPush(&item->ipma, ++itemPropertyIndex, AVIF_FALSE); // ipma is 1-indexed, doing this afterwards is correct
 
-        uint8_t channelCount = item->alpha ? 1 : 3; // TODO: write the correct value here when adding monochrome support
+        uint8_t channelCount = (item->alpha || (item->image->yuvFormat == AVIF_PIXEL_FORMAT_YUV400)) ? 1 : 3;
         avifBoxMarker pixi = avifRWStreamWriteBox(&s, "pixi", 0, 0);
         avifRWStreamWriteU8(&s, channelCount); // unsigned int (8) num_channels;
         for (uint8_t chan = 0; chan < channelCount; ++chan) {
@@ -384,8 +1268,18 @@ avifResult avifEncoderWrite(avifEncoder * encoder, avifImage * image, avifRWData
         avifRWStreamFinishBox(&s, pixi);
         ipmaPush(&item->ipma, ++itemPropertyIndex, AVIF_FALSE);
 
-        writeConfigBox(&s, &item->codec->configBox);
-        ipmaPush(&item->ipma, ++itemPropertyIndex, AVIF_TRUE);
+        if (item->codec) {
+            writeConfigBox(&s, &item->codec->configBox);
+            ipmaPush(&item->ipma, ++itemPropertyIndex, AVIF_TRUE);
+        }
+
+        if (item->dimgFromID != 0) {
+            // Grid cells only carry what is needed to decode them; everything else lives on the grid item
+            sharedCellIpmaGridID = item->dimgFromID;
+            memcpy(&sharedCellIpma, &item->ipma, sizeof(struct ipmaArray));
+            memcpy(&sharedCellConfigBox, &item->codec->configBox, sizeof(avifCodecConfigurationBox));
+            continue;
+        }
 
         if (item->alpha) {
             // Alpha specific properties
@@ -491,40 +1385,407 @@ avifResult avifEncoderWrite(avifEncoder * encoder, avifImage * image, avifRWData
 
     avifRWStreamFinishBox(&s, meta);
 
+    // -----------------------------------------------------------------------
+    // Write moov (sequences only)
+
+    if (sequence) {
+        avifEncoderWriteMoov(encoder, &s);
+    }
+
     // -----------------------------------------------------------------------
     // Write mdat
 
-    avifBoxMarker mdat = avifRWStreamWriteBox(&s, "mdat", -1, 0);
+    // Everything after the header is known exactly by now, so the payloads' file offsets are
+    // patched into iloc (and stco) before the mdat box is emitted, and its size is written up front.
+    // Each track's samples are stored back to back, as a single chunk.
+    const size_t mdatHeaderSize = 8;
+    size_t mdatContentSize = 0;
+    size_t payloadOffset = avifRWStreamOffset(&s) + mdatHeaderSize;
     for (uint32_t itemIndex = 0; itemIndex < encoder->data->items.count; ++itemIndex) {
         avifEncoderItem * item = &encoder->data->items.item[itemIndex];
-        if (item->content.size == 0) {
+        size_t payloadSize = avifEncoderItemPayloadSize(item);
+        if (payloadSize == 0) {
             continue;
         }
 
-        uint32_t infeOffset = (uint32_t)s.offset;
-        avifRWStreamWrite(&s, item->content.data, item->content.size);
+        size_t offsetOffsets[2] = { item->infeOffsetOffset, item->stcoOffsetOffset };
+        for (int i = 0; i < 2; ++i) {
+            if (offsetOffsets[i] != 0) {
+                size_t prevOffset = avifRWStreamOffset(&s);
+                avifRWStreamSetOffset(&s, offsetOffsets[i]);
+                avifRWStreamWriteU32(&s, (uint32_t)payloadOffset);
+                avifRWStreamSetOffset(&s, prevOffset);
+            }
+        }
+        payloadOffset += payloadSize;
+        mdatContentSize += payloadSize;
+    }
 
-        if (item->infeOffsetOffset != 0) {
-            size_t prevOffset = avifRWStreamOffset(&s);
-            avifRWStreamSetOffset(&s, item->infeOffsetOffset);
-            avifRWStreamWriteU32(&s, infeOffset);
-            avifRWStreamSetOffset(&s, prevOffset);
+    if (!io) {
+        // Size the output once, so each payload is copied straight to its final place and the
+        // output's capacity matches its final size.
+        avifRWDataReserve(output, avifRWStreamOffset(&s) + mdatHeaderSize + mdatContentSize);
+    }
+    avifRWStreamWriteBox(&s, "mdat", -1, mdatContentSize);
+    if (!io) {
+        for (uint32_t itemIndex = 0; itemIndex < encoder->data->items.count; ++itemIndex) {
+            avifEncoderItem * item = &encoder->data->items.item[itemIndex];
+            avifRWStreamWrite(&s, item->content.data, item->content.size);
+            for (uint32_t sampleIndex = 0; sampleIndex < item->samples.count; ++sampleIndex) {
+                avifRWData * sample = &item->samples.sample[sampleIndex].data;
+                avifRWStreamWrite(&s, sample->data, sample->size);
+            }
         }
     }
-    avifRWStreamFinishBox(&s, mdat);
 
     // -----------------------------------------------------------------------
     // Finish up stream
 
     avifRWStreamFinishWrite(&s);
 
-    // -----------------------------------------------------------------------
-    // Set result and cleanup
+    if (io) {
+        // Hand the header to io, then stream each payload from the buffer it was encoded into
+        avifResult result = io->write(io->userData, output->data, output->size);
+        for (uint32_t itemIndex = 0; (itemIndex < encoder->data->items.count) && (result == AVIF_RESULT_OK); ++itemIndex) {
+            avifEncoderItem * item = &encoder->data->items.item[itemIndex];
+            if (item->content.size > 0) {
+                result = io->write(io->userData, item->content.data, item->content.size);
+            }
+            for (uint32_t sampleIndex = 0; (sampleIndex < item->samples.count) && (result == AVIF_RESULT_OK); ++sampleIndex) {
+                avifRWData * sample = &item->samples.sample[sampleIndex].data;
+                result = io->write(io->userData, sample->data, sample->size);
+            }
+        }
+        if (result != AVIF_RESULT_OK) {
+            return result;
+        }
+    }
 
-    result = AVIF_RESULT_OK;
+    return AVIF_RESULT_OK;
+}
 
-writeCleanup:
-    return result;
+// Writes a track per av01 item of a sequence, alpha tracks refer to the color track as auxiliary.
+// Every track is a single chunk whose offset (stco) is set along with the iloc offsets.
+static void avifEncoderWriteMoov(avifEncoder * encoder, avifRWStream * s)
+{
+    avifEncoderData * data = encoder->data;
+    const uint32_t timescale = (uint32_t)encoder->timescale;
+    uint64_t durationInTimescales = 0;
+    for (uint32_t frameIndex = 0; frameIndex < data->frames.count; ++frameIndex) {
+        durationInTimescales += data->frames.frame[frameIndex].durationInTimescales;
+    }
+
+    const uint32_t unityMatrix[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+    uint32_t trackCount = 0;
+    for (uint32_t itemIndex = 0; itemIndex < data->items.count; ++itemIndex) {
+        if (data->items.item[itemIndex].samples.count > 0) {
+            ++trackCount;
+        }
+    }
+
+    avifBoxMarker moov = avifRWStreamWriteBox(s, "moov", -1, 0);
+
+    avifBoxMarker mvhd = avifRWStreamWriteBox(s, "mvhd", 1, 0);
+    avifRWStreamWriteU64(s, 0);                    // unsigned int(64) creation_time;
+    avifRWStreamWriteU64(s, 0);                    // unsigned int(64) modification_time;
+    avifRWStreamWriteU32(s, timescale);            // unsigned int(32) timescale;
+    avifRWStreamWriteU64(s, durationInTimescales); // unsigned int(64) duration;
+    avifRWStreamWriteU32(s, 0x00010000);           // template int(32) rate = 0x00010000; // typically 1.0
+    avifRWStreamWriteU16(s, 0x0100);               // template int(16) volume = 0x0100; // typically, full volume
+    avifRWStreamWriteZeros(s, 2);                  // const bit(16) reserved = 0;
+    avifRWStreamWriteZeros(s, 8);                  // const unsigned int(32)[2] reserved = 0;
+    for (int i = 0; i < 9; ++i) {                  //
+        avifRWStreamWriteU32(s, unityMatrix[i]);   // template int(32)[9] matrix;
+    }                                              //
+    avifRWStreamWriteZeros(s, 24);                 // bit(32)[6] pre_defined = 0;
+    avifRWStreamWriteU32(s, trackCount + 1);       // unsigned int(32) next_track_ID;
+    avifRWStreamFinishBox(s, mvhd);
+
+    uint32_t trackID = 0;
+    uint32_t colorTrackID = 0;
+    for (uint32_t itemIndex = 0; itemIndex < data->items.count; ++itemIndex) {
+        avifEncoderItem * item = &data->items.item[itemIndex];
+        if (item->samples.count == 0) {
+            continue;
+        }
+        ++trackID;
+        if (!item->alpha) {
+            colorTrackID = trackID;
+        }
+
+        avifBoxMarker trak = avifRWStreamWriteBox(s, "trak", -1, 0);
+
+        avifBoxMarker tkhd = avifRWStreamWriteFullBox(s, "tkhd", 1, 3, 0); // track_enabled | track_in_movie
+        avifRWStreamWriteU64(s, 0);                                // unsigned int(64) creation_time;
+        avifRWStreamWriteU64(s, 0);                                // unsigned int(64) modification_time;
+        avifRWStreamWriteU32(s, trackID);                          // unsigned int(32) track_ID;
+        avifRWStreamWriteZeros(s, 4);                              // const unsigned int(32) reserved = 0;
+        avifRWStreamWriteU64(s, durationInTimescales);             // unsigned int(64) duration;
+        avifRWStreamWriteZeros(s, 8);                              // const unsigned int(32)[2] reserved = 0;
+        avifRWStreamWriteU16(s, 0);                                // template int(16) layer = 0;
+        avifRWStreamWriteU16(s, 0);                                // template int(16) alternate_group = 0;
+        avifRWStreamWriteU16(s, 0);                                // template int(16) volume = 0;
+        avifRWStreamWriteZeros(s, 2);                              // const unsigned int(16) reserved = 0;
+        for (int i = 0; i < 9; ++i) {                              //
+            avifRWStreamWriteU32(s, unityMatrix[i]);               // template int(32)[9] matrix;
+        }                                                          //
+        avifRWStreamWriteU32(s, item->image->width << 16);         // unsigned int(32) width;
+        avifRWStreamWriteU32(s, item->image->height << 16);        // unsigned int(32) height;
+        avifRWStreamFinishBox(s, tkhd);
+
+        if (item->alpha && (colorTrackID != 0)) {
+            avifBoxMarker tref = avifRWStreamWriteBox(s, "tref", -1, 0);
+            avifBoxMarker auxl = avifRWStreamWriteBox(s, "auxl", -1, 0);
+            avifRWStreamWriteU32(s, colorTrackID); // unsigned int(32) track_IDs[];
+            avifRWStreamFinishBox(s, auxl);
+            avifRWStreamFinishBox(s, tref);
+        }
+
+        avifBoxMarker mdia = avifRWStreamWriteBox(s, "mdia", -1, 0);
+
+        avifBoxMarker mdhd = avifRWStreamWriteBox(s, "mdhd", 1, 0);
+        avifRWStreamWriteU64(s, 0);                    // unsigned int(64) creation_time;
+        avifRWStreamWriteU64(s, 0);                    // unsigned int(64) modification_time;
+        avifRWStreamWriteU32(s, timescale);            // unsigned int(32) timescale;
+        avifRWStreamWriteU64(s, durationInTimescales); // unsigned int(64) duration;
+        avifRWStreamWriteU16(s, 0x55C4);               // bit(1) pad = 0; unsigned int(5)[3] language; // "und"
+        avifRWStreamWriteU16(s, 0);                    // unsigned int(16) pre_defined = 0;
+        avifRWStreamFinishBox(s, mdhd);
+
+        avifBoxMarker hdlr = avifRWStreamWriteBox(s, "hdlr", 0, 0);
+        avifRWStreamWriteU32(s, 0);                               // unsigned int(32) pre_defined = 0;
+        avifRWStreamWriteChars(s, item->alpha ? "auxv" : "pict", 4); // unsigned int(32) handler_type;
+        avifRWStreamWriteZeros(s, 12);                            // const unsigned int(32)[3] reserved = 0;
+        avifRWStreamWriteChars(s, "libavif", 8);                  // string name; (writing null terminator)
+        avifRWStreamFinishBox(s, hdlr);
+
+        avifBoxMarker minf = avifRWStreamWriteBox(s, "minf", -1, 0);
+
+        avifBoxMarker vmhd = avifRWStreamWriteFullBox(s, "vmhd", 0, 1, 0);
+        avifRWStreamWriteU16(s, 0);   // template unsigned int(16) graphicsmode = 0; // copy
+        avifRWStreamWriteZeros(s, 6); // template unsigned int(16)[3] opcolor = {0, 0, 0};
+        avifRWStreamFinishBox(s, vmhd);
+
+        avifBoxMarker dinf = avifRWStreamWriteBox(s, "dinf", -1, 0);
+        avifBoxMarker dref = avifRWStreamWriteBox(s, "dref", 0, 0);
+        avifRWStreamWriteU32(s, 1);                     // unsigned int(32) entry_count;
+        avifRWStreamWriteFullBox(s, "url ", 0, 1, 0); // flags:1 means data is in this file
+        avifRWStreamFinishBox(s, dref);
+        avifRWStreamFinishBox(s, dinf);
+
+        avifBoxMarker stbl = avifRWStreamWriteBox(s, "stbl", -1, 0);
+
+        avifBoxMarker stsd = avifRWStreamWriteBox(s, "stsd", 0, 0);
+        avifRWStreamWriteU32(s, 1);                                   // unsigned int(32) entry_count;
+        avifBoxMarker av01 = avifRWStreamWriteBox(s, "av01", -1, 0);  // VisualSampleEntry
+        avifRWStreamWriteZeros(s, 6);                                 // const unsigned int(8)[6] reserved = 0;
+        avifRWStreamWriteU16(s, 1);                                   // unsigned int(16) data_reference_index;
+        avifRWStreamWriteU16(s, 0);                                   // unsigned int(16) pre_defined = 0;
+        avifRWStreamWriteZeros(s, 2);                                 // const unsigned int(16) reserved = 0;
+        avifRWStreamWriteZeros(s, 12);                                // unsigned int(32)[3] pre_defined = 0;
+        avifRWStreamWriteU16(s, (uint16_t)item->image->width);        // unsigned int(16) width;
+        avifRWStreamWriteU16(s, (uint16_t)item->image->height);       // unsigned int(16) height;
+        avifRWStreamWriteU32(s, 0x00480000);                          // template unsigned int(32) horizresolution = 72 dpi;
+        avifRWStreamWriteU32(s, 0x00480000);                          // template unsigned int(32) vertresolution = 72 dpi;
+        avifRWStreamWriteZeros(s, 4);                                 // const unsigned int(32) reserved = 0;
+        avifRWStreamWriteU16(s, 1);                                   // template unsigned int(16) frame_count = 1;
+        avifRWStreamWriteZeros(s, 32);                                // string[32] compressorname;
+        avifRWStreamWriteU16(s, 0x0018);                              // template unsigned int(16) depth = 0x0018;
+        avifRWStreamWriteU16(s, 0xffff);                              // int(16) pre_defined = -1;
+        writeConfigBox(s, &item->codec->configBox);
+        if (item->alpha) {
+            avifBoxMarker auxi = avifRWStreamWriteBox(s, "auxi", 0, 0);
+            avifRWStreamWriteChars(s, alphaURN, alphaURNSize); // string aux_track_type;
+            avifRWStreamFinishBox(s, auxi);
+        }
+        avifRWStreamFinishBox(s, av01);
+        avifRWStreamFinishBox(s, stsd);
+
+        // Runs of equal durations share an entry
+        avifBoxMarker stts = avifRWStreamWriteBox(s, "stts", 0, 0);
+        size_t sttsEntryCountOffset = avifRWStreamOffset(s);
+        uint32_t sttsEntryCount = 0;
+        avifRWStreamWriteU32(s, 0); // unsigned int(32) entry_count; (set below)
+        for (uint32_t frameIndex = 0; frameIndex < data->frames.count;) {
+            uint64_t delta = data->frames.frame[frameIndex].durationInTimescales;
+            uint32_t sampleCount = 1;
+            while (((frameIndex + sampleCount) < data->frames.count) &&
+                   (data->frames.frame[frameIndex + sampleCount].durationInTimescales == delta)) {
+                ++sampleCount;
+            }
+            avifRWStreamWriteU32(s, sampleCount);     // unsigned int(32) sample_count;
+            avifRWStreamWriteU32(s, (uint32_t)delta); // unsigned int(32) sample_delta;
+            ++sttsEntryCount;
+            frameIndex += sampleCount;
+        }
+        size_t sttsEndOffset = avifRWStreamOffset(s);
+        avifRWStreamSetOffset(s, sttsEntryCountOffset);
+        avifRWStreamWriteU32(s, sttsEntryCount);
+        avifRWStreamSetOffset(s, sttsEndOffset);
+        avifRWStreamFinishBox(s, stts);
+
+        avifBoxMarker stsc = avifRWStreamWriteBox(s, "stsc", 0, 0);
+        avifRWStreamWriteU32(s, 1);                  // unsigned int(32) entry_count;
+        avifRWStreamWriteU32(s, 1);                  // unsigned int(32) first_chunk;
+        avifRWStreamWriteU32(s, item->samples.count); // unsigned int(32) samples_per_chunk;
+        avifRWStreamWriteU32(s, 1);                  // unsigned int(32) sample_description_index;
+        avifRWStreamFinishBox(s, stsc);
+
+        avifBoxMarker stsz = avifRWStreamWriteBox(s, "stsz", 0, 0);
+        avifRWStreamWriteU32(s, 0);                   // unsigned int(32) sample_size;
+        avifRWStreamWriteU32(s, item->samples.count); // unsigned int(32) sample_count;
+        for (uint32_t sampleIndex = 0; sampleIndex < item->samples.count; ++sampleIndex) {
+            avifRWStreamWriteU32(s, (uint32_t)item->samples.sample[sampleIndex].data.size); // unsigned int(32) entry_size;
+        }
+        avifRWStreamFinishBox(s, stsz);
+
+        avifBoxMarker stco = avifRWStreamWriteBox(s, "stco", 0, 0);
+        avifRWStreamWriteU32(s, 1);                     // unsigned int(32) entry_count;
+        item->stcoOffsetOffset = avifRWStreamOffset(s); //
+        avifRWStreamWriteU32(s, 0 /* set later */);     // unsigned int(32) chunk_offset;
+        avifRWStreamFinishBox(s, stco);
+
+        // Without stss every sample is a sync sample
+        uint32_t syncCount = 0;
+        for (uint32_t sampleIndex = 0; sampleIndex < item->samples.count; ++sampleIndex) {
+            if (item->samples.sample[sampleIndex].sync) {
+                ++syncCount;
+            }
+        }
+        if (syncCount < item->samples.count) {
+            avifBoxMarker stss = avifRWStreamWriteBox(s, "stss", 0, 0);
+            avifRWStreamWriteU32(s, syncCount); // unsigned int(32) entry_count;
+            for (uint32_t sampleIndex = 0; sampleIndex < item->samples.count; ++sampleIndex) {
+                if (item->samples.sample[sampleIndex].sync) {
+                    avifRWStreamWriteU32(s, sampleIndex + 1); // unsigned int(32) sample_number;
+                }
+            }
+            avifRWStreamFinishBox(s, stss);
+        }
+
+        avifRWStreamFinishBox(s, stbl);
+        avifRWStreamFinishBox(s, minf);
+        avifRWStreamFinishBox(s, mdia);
+        avifRWStreamFinishBox(s, trak);
+    }
+
+    avifRWStreamFinishBox(s, moov);
+}
+
+// Copies a srcWidth x srcHeight region into a dstWidth x dstHeight plane, replicating the last
+// column and row of the region into any remaining space.
+static void avifCopyPaddedPlane(uint8_t * dst,
+                                uint32_t dstRowBytes,
+                                uint32_t dstWidth,
+                                uint32_t dstHeight,
+                                const uint8_t * src,
+                                uint32_t srcRowBytes,
+                                uint32_t srcWidth,
+                                uint32_t srcHeight,
+                                uint32_t channelSize)
+{
+    for (uint32_t j = 0; j < dstHeight; ++j) {
+        const uint8_t * srcRow = &src[AVIF_MIN(j, srcHeight - 1) * srcRowBytes];
+        uint8_t * dstRow = &dst[j * dstRowBytes];
+        memcpy(dstRow, srcRow, srcWidth * channelSize);
+        for (uint32_t i = srcWidth; i < dstWidth; ++i) {
+            memcpy(&dstRow[i * channelSize], &srcRow[(srcWidth - 1) * channelSize], channelSize);
+        }
+    }
+}
+
+// Returns a cellWidth x cellHeight image showing the region of image starting at (cellX, cellY).
+// Cells lying entirely inside image point directly at its planes; cells overhanging its right or
+// bottom edge get their own copy, padded out to the full cell size.
+static avifImage * avifImageCreateGridCell(avifImage * image, uint32_t cellX, uint32_t cellY, uint32_t cellWidth, uint32_t cellHeight)
+{
+    avifImage * cell = avifImageCreate(cellWidth, cellHeight, image->depth, image->yuvFormat);
+    cell->yuvRange = image->yuvRange;
+    cell->alphaRange = image->alphaRange;
+    if (image->profileFormat == AVIF_PROFILE_FORMAT_NCLX) {
+        avifImageSetProfileNCLX(cell, &image->nclx);
+    }
+
+    avifPixelFormatInfo formatInfo;
+    avifGetPixelFormatInfo(image->yuvFormat, &formatInfo);
+    uint32_t channelSize = avifImageUsesU16(image) ? 2 : 1;
+    avifBool overhangs = ((cellX + cellWidth) > image->width) || ((cellY + cellHeight) > image->height);
+    if (overhangs) {
+        avifImageAllocatePlanes(cell, image->alphaPlane ? AVIF_PLANES_ALL : AVIF_PLANES_YUV);
+    }
+
+    for (int yuvPlane = 0; yuvPlane < AVIF_PLANE_COUNT_YUV; ++yuvPlane) {
+        if (!image->yuvPlanes[yuvPlane]) {
+            continue;
+        }
+        uint32_t shiftX = (yuvPlane == AVIF_CHAN_Y) ? 0 : formatInfo.chromaShiftX;
+        uint32_t shiftY = (yuvPlane == AVIF_CHAN_Y) ? 0 : formatInfo.chromaShiftY;
+        uint8_t * src = &image->yuvPlanes[yuvPlane][(cellY >> shiftY) * image->yuvRowBytes[yuvPlane] + (cellX >> shiftX) * channelSize];
+        if (overhangs) {
+            uint32_t srcWidth = ((image->width + shiftX) >> shiftX) - (cellX >> shiftX);
+            uint32_t srcHeight = ((image->height + shiftY) >> shiftY) - (cellY >> shiftY);
+            uint32_t dstWidth = (cellWidth + shiftX) >> shiftX;
+            uint32_t dstHeight = (cellHeight + shiftY) >> shiftY;
+            avifCopyPaddedPlane(cell->yuvPlanes[yuvPlane],
+                                cell->yuvRowBytes[yuvPlane],
+                                dstWidth,
+                                dstHeight,
+                                src,
+                                image->yuvRowBytes[yuvPlane],
+                                AVIF_MIN(srcWidth, dstWidth),
+                                AVIF_MIN(srcHeight, dstHeight),
+                                channelSize);
+        } else {
+            cell->yuvPlanes[yuvPlane] = src;
+            cell->yuvRowBytes[yuvPlane] = image->yuvRowBytes[yuvPlane];
+        }
+    }
+
+    if (image->alphaPlane) {
+        uint8_t * src = &image->alphaPlane[cellY * image->alphaRowBytes + cellX * channelSize];
+        if (overhangs) {
+            avifCopyPaddedPlane(cell->alphaPlane,
+                                cell->alphaRowBytes,
+                                cellWidth,
+                                cellHeight,
+                                src,
+                                image->alphaRowBytes,
+                                AVIF_MIN(image->width - cellX, cellWidth),
+                                AVIF_MIN(image->height - cellY, cellHeight),
+                                channelSize);
+        } else {
+            cell->alphaPlane = src;
+            cell->alphaRowBytes = image->alphaRowBytes;
+        }
+    }
+
+    if (!overhangs) {
+        // The planes still belong to image
+        cell->decoderOwnsYUVPlanes = AVIF_TRUE;
+        cell->decoderOwnsAlphaPlane = AVIF_TRUE;
+    }
+    return cell;
+}
+
+static void writeImageGridPayload(avifRWData * payload, uint32_t gridCols, uint32_t gridRows, avifImage * image)
+{
+    // ImageGrid from ISO/IEC 23008-12:2017 6.6.2.3.2; FieldLength is 32 bits only if 16 won't do
+    uint8_t flags = ((image->width > 65535) || (image->height > 65535)) ? 1 : 0;
+
+    avifRWStream s;
+    avifRWStreamStart(&s, payload);
+    avifRWStreamWriteU8(&s, 0);                            // unsigned int(8) version = 0;
+    avifRWStreamWriteU8(&s, flags);                        // unsigned int(8) flags;
+    avifRWStreamWriteU8(&s, (uint8_t)(gridRows - 1));      // unsigned int(8) rows_minus_one;
+    avifRWStreamWriteU8(&s, (uint8_t)(gridCols - 1));      // unsigned int(8) columns_minus_one;
+    if (flags & 1) {                                       //
+        avifRWStreamWriteU32(&s, image->width);            // unsigned int(FieldLength) output_width;
+        avifRWStreamWriteU32(&s, image->height);           // unsigned int(FieldLength) output_height;
+    } else {                                               //
+        avifRWStreamWriteU16(&s, (uint16_t)image->width);  // unsigned int(FieldLength) output_width;
+        avifRWStreamWriteU16(&s, (uint16_t)image->height); // unsigned int(FieldLength) output_height;
+    }
+    avifRWStreamFinishWrite(&s);
 }
 
 static avifBool avifImageIsOpaque(avifImage * image)
@@ -559,6 +1820,8 @@ static void fillConfigBox(avifCodec * codec, avifImage * image, avifBool alpha)
 {
     avifPixelFormatInfo formatInfo;
     avifGetPixelFormatInfo(image->yuvFormat, &formatInfo);
+    // Alpha is always coded as a monochrome stream, which AV1 lays out as 4:2:0
+    const avifBool monochrome = alpha || formatInfo.monochrome;
 
     // Profile 0.  8-bit and 10-bit 4:2:0 and 4:0:0 only.
     // Profile 1.  8-bit and 10-bit 4:4:4
@@ -571,7 +1834,7 @@ static void fillConfigBox(avifCodec * codec, avifImage * image, avifBool alpha)
     } else {
         // 8-bit or 10-bit
 
-        if (alpha) {
+        if (monochrome) {
             seqProfile = 0;
         } else {
             switch (image->yuvFormat) {
@@ -587,6 +1850,7 @@ static void fillConfigBox(avifCodec * codec, avifImage * image, avifBool alpha)
                 case AVIF_PIXEL_FORMAT_YV12:
                     seqProfile = 0;
                     break;
+                case AVIF_PIXEL_FORMAT_YUV400:
                 case AVIF_PIXEL_FORMAT_NONE:
                 default:
                     break;
@@ -607,9 +1871,9 @@ static void fillConfigBox(avifCodec * codec, avifImage * image, avifBool alpha)
     codec->configBox.seqTier0 = 0;
     codec->configBox.highBitdepth = (image->depth > 8) ? 1 : 0;
     codec->configBox.twelveBit = (image->depth == 12) ? 1 : 0;
-    codec->configBox.monochrome = alpha ? 1 : 0;
-    codec->configBox.chromaSubsamplingX = (uint8_t)formatInfo.chromaShiftX;
-    codec->configBox.chromaSubsamplingY = (uint8_t)formatInfo.chromaShiftY;
+    codec->configBox.monochrome = monochrome ? 1 : 0;
+    codec->configBox.chromaSubsamplingX = monochrome ? 1 : (uint8_t)formatInfo.chromaShiftX;
+    codec->configBox.chromaSubsamplingY = monochrome ? 1 : (uint8_t)formatInfo.chromaShiftY;
 
     // TODO: choose the correct one from below:
     //   * 0 - CSP_UNKNOWN   Unknown (in this case the source video transfer function must be signaled outside the AV1 bitstream)
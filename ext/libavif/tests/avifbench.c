@@ -0,0 +1,608 @@
+// Copyright 2020 Joe Drago. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "avif/avif.h"
+
+#include "cJSON.h"
+#include "y4m.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+#define NEXTARG()                                                     \
+    if (((argIndex + 1) == argc) || (argv[argIndex + 1][0] == '-')) { \
+        fprintf(stderr, "%s requires an argument.", arg);             \
+        return 1;                                                     \
+    }                                                                 \
+    arg = argv[++argIndex]
+
+// avifbench:
+// Runs every input (y4m files given on the command line and synthetic images of the requested sizes)
+// through RGB->YUV, encode, parse, decode and YUV->RGB, for each combination of depth, YUV format,
+// codec, speed and thread count. Each combination is run --warmup times untimed, then --repeat times
+// timed, and the median time of each stage is reported in megapixels per second, as JSON.
+//
+// Inputs are converted from one 16-bit RGB source, so every depth and YUV format starts out from the
+// same pixels. Peak RSS is the process high-water mark once a combination is done; as it never goes
+// down, it is only meaningful for the largest input run so far.
+
+#define AVIF_BENCH_MAX_LIST 16
+
+typedef struct avifBenchList
+{
+    int count;
+    int values[AVIF_BENCH_MAX_LIST];
+} avifBenchList;
+
+typedef enum avifBenchStage
+{
+    AVIF_BENCH_STAGE_RGB_TO_YUV = 0,
+    AVIF_BENCH_STAGE_ENCODE,
+    AVIF_BENCH_STAGE_PARSE,
+    AVIF_BENCH_STAGE_DECODE,
+    AVIF_BENCH_STAGE_YUV_TO_RGB,
+
+    AVIF_BENCH_STAGE_COUNT
+} avifBenchStage;
+
+static const char * stageNames[AVIF_BENCH_STAGE_COUNT] = { "rgbToYUV", "encode", "parse", "decode", "yuvToRGB" };
+
+typedef struct avifBenchSource
+{
+    char name[256];
+    avifRGBImage rgb; // 16-bit RGBA
+} avifBenchSource;
+
+typedef struct avifBenchCase
+{
+    const avifBenchSource * source;
+    uint32_t depth;
+    avifPixelFormat yuvFormat;
+    avifCodecChoice codecChoice;
+    int speed;
+    int threads;
+    int quantizer;
+    avifBool alpha;
+    int warmup;
+    int repeat;
+} avifBenchCase;
+
+static double benchSeconds(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+#endif
+}
+
+static double benchPeakRSSKB(void)
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return (double)counters.PeakWorkingSetSize / 1024.0;
+    }
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+        return (double)usage.ru_maxrss / 1024.0; // bytes on macOS
+#else
+        return (double)usage.ru_maxrss;
+#endif
+    }
+#endif
+    return 0.0;
+}
+
+static const char * yuvFormatToString(avifPixelFormat format)
+{
+    switch (format) {
+        case AVIF_PIXEL_FORMAT_YUV444:
+            return "444";
+        case AVIF_PIXEL_FORMAT_YUV422:
+            return "422";
+        case AVIF_PIXEL_FORMAT_YUV420:
+            return "420";
+        case AVIF_PIXEL_FORMAT_YUV400:
+            return "400";
+        case AVIF_PIXEL_FORMAT_NONE:
+        default:
+            break;
+    }
+    return "none";
+}
+
+// Parses a comma separated list of integers into list. Returns AVIF_FALSE if it doesn't fit or isn't a list.
+static avifBool parseIntList(const char * arg, avifBenchList * list)
+{
+    list->count = 0;
+    while (*arg) {
+        char * end;
+        long value = strtol(arg, &end, 10);
+        if ((end == arg) || (list->count == AVIF_BENCH_MAX_LIST)) {
+            return AVIF_FALSE;
+        }
+        list->values[list->count++] = (int)value;
+        arg = (*end == ',') ? (end + 1) : end;
+        if (*end && (*end != ',')) {
+            return AVIF_FALSE;
+        }
+    }
+    return list->count > 0;
+}
+
+// Accepts "444", "422", "420" and "400" (a comma separated list of them)
+static avifBool parseYUVFormatList(const char * arg, avifBenchList * list)
+{
+    if (!parseIntList(arg, list)) {
+        return AVIF_FALSE;
+    }
+    for (int i = 0; i < list->count; ++i) {
+        switch (list->values[i]) {
+            case 444:
+                list->values[i] = AVIF_PIXEL_FORMAT_YUV444;
+                break;
+            case 422:
+                list->values[i] = AVIF_PIXEL_FORMAT_YUV422;
+                break;
+            case 420:
+                list->values[i] = AVIF_PIXEL_FORMAT_YUV420;
+                break;
+            case 400:
+                list->values[i] = AVIF_PIXEL_FORMAT_YUV400;
+                break;
+            default:
+                return AVIF_FALSE;
+        }
+    }
+    return AVIF_TRUE;
+}
+
+// Accepts a comma separated list of codec names, as listed by avifCodecName()
+static avifBool parseCodecList(const char * arg, avifBenchList * list)
+{
+    char names[256];
+    snprintf(names, sizeof(names), "%s", arg);
+    list->count = 0;
+    for (char * name = strtok(names, ","); name; name = strtok(NULL, ",")) {
+        avifCodecChoice choice = avifCodecChoiceFromName(name);
+        if (((choice == AVIF_CODEC_CHOICE_AUTO) && strcmp(name, "auto")) || (list->count == AVIF_BENCH_MAX_LIST)) {
+            fprintf(stderr, "Unknown codec: %s\n", name);
+            return AVIF_FALSE;
+        }
+        list->values[list->count++] = choice;
+    }
+    return list->count > 0;
+}
+
+static void sourceAllocate(avifBenchSource * source, const char * name, uint32_t width, uint32_t height)
+{
+    snprintf(source->name, sizeof(source->name), "%s", name);
+    avifImage * image = avifImageCreate(width, height, 8, AVIF_PIXEL_FORMAT_YUV444);
+    avifRGBImageSetDefaults(&source->rgb, image);
+    avifImageDestroy(image);
+    source->rgb.depth = 16;
+    source->rgb.format = AVIF_RGB_FORMAT_RGBA;
+    avifRGBImageAllocatePixels(&source->rgb);
+}
+
+// Smooth gradients with a little noise and a few hard edges, somewhere between a photo and a screenshot
+static void sourceCreateSynthetic(avifBenchSource * source, uint32_t width, uint32_t height)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "synthetic_%ux%u", width, height);
+    sourceAllocate(source, name, width, height);
+
+    uint32_t noise = 0x12345678;
+    for (uint32_t j = 0; j < height; ++j) {
+        uint16_t * row = (uint16_t *)&source->rgb.pixels[j * source->rgb.rowBytes];
+        for (uint32_t i = 0; i < width; ++i) {
+            noise = noise * 1664525 + 1013904223;
+            uint32_t grain = (noise >> 24) * 16;
+            uint32_t edge = (((i / 64) + (j / 64)) & 1) ? 8192 : 0;
+            row[i * 4 + 0] = (uint16_t)((i * 50000 / width + grain + edge) & 0xffff);
+            row[i * 4 + 1] = (uint16_t)((j * 50000 / height + grain) & 0xffff);
+            row[i * 4 + 2] = (uint16_t)(((i + j) * 30000 / (width + height) + grain + edge) & 0xffff);
+            row[i * 4 + 3] = (uint16_t)(65535 - (j * 32768 / height));
+        }
+    }
+}
+
+static avifBool sourceCreateFromY4M(avifBenchSource * source, const char * filename)
+{
+    avifImage * image = avifImageCreateEmpty();
+    if (!y4mRead(image, filename)) {
+        avifImageDestroy(image);
+        return AVIF_FALSE;
+    }
+
+    const char * basename = strrchr(filename, '/');
+    sourceAllocate(source, basename ? (basename + 1) : filename, image->width, image->height);
+    avifResult result = avifImageYUVToRGB(image, &source->rgb);
+    avifImageDestroy(image);
+    if (result != AVIF_RESULT_OK) {
+        avifRGBImageFreePixels(&source->rgb);
+        return AVIF_FALSE;
+    }
+
+    // y4m has no alpha, give it the same ramp as the synthetic inputs in case alpha is benchmarked
+    for (uint32_t j = 0; j < source->rgb.height; ++j) {
+        uint16_t * row = (uint16_t *)&source->rgb.pixels[j * source->rgb.rowBytes];
+        for (uint32_t i = 0; i < source->rgb.width; ++i) {
+            row[i * 4 + 3] = (uint16_t)(65535 - (j * 32768 / source->rgb.height));
+        }
+    }
+    return AVIF_TRUE;
+}
+
+// The RGB image a caller at this depth would hand over: 8-bit for 8-bit AVIFs, 16-bit otherwise
+static void benchRGBFromSource(avifRGBImage * rgb, const avifBenchSource * source, avifImage * image, avifBool alpha, int threads)
+{
+    avifRGBImageSetDefaults(rgb, image);
+    rgb->depth = (image->depth > 8) ? 16 : 8;
+    rgb->format = alpha ? AVIF_RGB_FORMAT_RGBA : AVIF_RGB_FORMAT_RGB;
+    rgb->maxThreads = threads;
+    avifRGBImageAllocatePixels(rgb);
+
+    const uint32_t channels = avifRGBFormatChannelCount(rgb->format);
+    for (uint32_t j = 0; j < rgb->height; ++j) {
+        const uint16_t * src = (const uint16_t *)&source->rgb.pixels[j * source->rgb.rowBytes];
+        uint8_t * dst = &rgb->pixels[j * rgb->rowBytes];
+        for (uint32_t i = 0; i < rgb->width; ++i) {
+            for (uint32_t c = 0; c < channels; ++c) {
+                if (rgb->depth == 8) {
+                    dst[i * channels + c] = (uint8_t)(src[i * 4 + c] >> 8);
+                } else {
+                    ((uint16_t *)dst)[i * channels + c] = src[i * 4 + c];
+                }
+            }
+        }
+    }
+}
+
+static int compareDoubles(const void * a, const void * b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return (da < db) ? -1 : ((da > db) ? 1 : 0);
+}
+
+// Runs one combination and returns its JSON report (with an "error" member if a stage failed)
+static cJSON * benchRun(const avifBenchCase * bc)
+{
+    const avifRGBImage * sourceRGB = &bc->source->rgb;
+    const double megapixels = (double)sourceRGB->width * sourceRGB->height / 1000000.0;
+
+    cJSON * json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "input", bc->source->name);
+    cJSON_AddNumberToObject(json, "width", sourceRGB->width);
+    cJSON_AddNumberToObject(json, "height", sourceRGB->height);
+    cJSON_AddNumberToObject(json, "depth", bc->depth);
+    cJSON_AddStringToObject(json, "yuvFormat", yuvFormatToString(bc->yuvFormat));
+    cJSON_AddBoolToObject(json, "alpha", bc->alpha);
+    cJSON_AddNumberToObject(json, "speed", bc->speed);
+    cJSON_AddNumberToObject(json, "threads", bc->threads);
+    cJSON_AddNumberToObject(json, "quantizer", bc->quantizer);
+
+    // A codec that can only encode (or decode) is paired with the default one for the other direction
+    avifCodecChoice encodeChoice = avifCodecName(bc->codecChoice, AVIF_CODEC_FLAG_CAN_ENCODE) ? bc->codecChoice : AVIF_CODEC_CHOICE_AUTO;
+    avifCodecChoice decodeChoice = avifCodecName(bc->codecChoice, AVIF_CODEC_FLAG_CAN_DECODE) ? bc->codecChoice : AVIF_CODEC_CHOICE_AUTO;
+    const char * encoderName = avifCodecName(encodeChoice, AVIF_CODEC_FLAG_CAN_ENCODE);
+    const char * decoderName = avifCodecName(decodeChoice, AVIF_CODEC_FLAG_CAN_DECODE);
+    cJSON_AddStringToObject(json, "encoder", encoderName ? encoderName : "none");
+    cJSON_AddStringToObject(json, "decoder", decoderName ? decoderName : "none");
+    if (!encoderName || !decoderName) {
+        cJSON_AddStringToObject(json, "error", avifResultToString(AVIF_RESULT_NO_CODEC_AVAILABLE));
+        return json;
+    }
+
+    avifImage * image = avifImageCreate(sourceRGB->width, sourceRGB->height, bc->depth, bc->yuvFormat);
+    avifRGBImage rgb;
+    benchRGBFromSource(&rgb, bc->source, image, bc->alpha, bc->threads);
+    avifRGBImage decodedRGB = rgb;
+    decodedRGB.pixels = NULL;
+    avifRGBImageAllocatePixels(&decodedRGB);
+    if (bc->alpha) {
+        avifImageAllocatePlanes(image, AVIF_PLANES_A);
+    }
+
+    avifEncoder * encoder = avifEncoderCreate();
+    encoder->codecChoice = encodeChoice;
+    encoder->maxThreads = bc->threads;
+    encoder->speed = bc->speed;
+    encoder->minQuantizer = bc->quantizer;
+    encoder->maxQuantizer = bc->quantizer;
+    encoder->minQuantizerAlpha = bc->quantizer;
+    encoder->maxQuantizerAlpha = bc->quantizer;
+
+    double * times = malloc(sizeof(double) * AVIF_BENCH_STAGE_COUNT * bc->repeat);
+    size_t encodedSize = 0;
+    avifResult result = AVIF_RESULT_OK;
+    const char * failedStage = NULL;
+    for (int run = -bc->warmup; (run < bc->repeat) && !failedStage; ++run) {
+        double stageTimes[AVIF_BENCH_STAGE_COUNT] = { 0 };
+        avifRWData encoded = AVIF_DATA_EMPTY;
+        avifDecoder * decoder = avifDecoderCreate();
+        decoder->codecChoice = decodeChoice;
+        decoder->maxThreads = bc->threads;
+
+        for (int stage = 0; (stage < AVIF_BENCH_STAGE_COUNT) && (result == AVIF_RESULT_OK); ++stage) {
+            const double startSeconds = benchSeconds();
+            switch (stage) {
+                case AVIF_BENCH_STAGE_RGB_TO_YUV:
+                    result = avifImageRGBToYUV(image, &rgb);
+                    break;
+                case AVIF_BENCH_STAGE_ENCODE:
+                    result = avifEncoderWrite(encoder, image, &encoded);
+                    break;
+                case AVIF_BENCH_STAGE_PARSE: {
+                    avifROData input = { encoded.data, encoded.size };
+                    result = avifDecoderParse(decoder, &input);
+                    break;
+                }
+                case AVIF_BENCH_STAGE_DECODE:
+                    result = avifDecoderNextImage(decoder);
+                    break;
+                case AVIF_BENCH_STAGE_YUV_TO_RGB:
+                    result = avifImageYUVToRGB(decoder->image, &decodedRGB);
+                    break;
+            }
+            stageTimes[stage] = benchSeconds() - startSeconds;
+            if (result != AVIF_RESULT_OK) {
+                failedStage = stageNames[stage];
+            }
+        }
+
+        encodedSize = encoded.size;
+        avifDecoderDestroy(decoder);
+        avifRWDataFree(&encoded);
+        if ((run >= 0) && !failedStage) {
+            for (int stage = 0; stage < AVIF_BENCH_STAGE_COUNT; ++stage) {
+                times[stage * bc->repeat + run] = stageTimes[stage];
+            }
+        }
+    }
+
+    if (failedStage) {
+        char error[256];
+        snprintf(error, sizeof(error), "%s: %s", failedStage, avifResultToString(result));
+        cJSON_AddStringToObject(json, "error", error);
+    } else {
+        cJSON_AddNumberToObject(json, "encodedBytes", (double)encodedSize);
+        cJSON_AddNumberToObject(json, "bitsPerPixel", (double)encodedSize * 8.0 / (megapixels * 1000000.0));
+
+        cJSON * stages = cJSON_CreateObject();
+        for (int stage = 0; stage < AVIF_BENCH_STAGE_COUNT; ++stage) {
+            double * stageTimes = &times[stage * bc->repeat];
+            qsort(stageTimes, bc->repeat, sizeof(double), compareDoubles);
+            double median = (bc->repeat & 1) ? stageTimes[bc->repeat / 2]
+                                             : (stageTimes[bc->repeat / 2 - 1] + stageTimes[bc->repeat / 2]) / 2.0;
+
+            cJSON * stageJSON = cJSON_CreateObject();
+            cJSON_AddNumberToObject(stageJSON, "medianSeconds", median);
+            cJSON_AddNumberToObject(stageJSON, "minSeconds", stageTimes[0]);
+            cJSON_AddNumberToObject(stageJSON, "maxSeconds", stageTimes[bc->repeat - 1]);
+            cJSON_AddNumberToObject(stageJSON, "megapixelsPerSecond", (median > 0.0) ? (megapixels / median) : 0.0);
+            cJSON_AddItemToObject(stages, stageNames[stage], stageJSON);
+        }
+        cJSON_AddItemToObject(json, "stages", stages);
+    }
+    cJSON_AddNumberToObject(json, "peakRSSKB", benchPeakRSSKB());
+
+    free(times);
+    avifEncoderDestroy(encoder);
+    avifRGBImageFreePixels(&decodedRGB);
+    avifRGBImageFreePixels(&rgb);
+    avifImageDestroy(image);
+    return json;
+}
+
+static void syntax(void)
+{
+    printf("Syntax: avifbench [options] [input.y4m ...]\n");
+    printf("Options (lists are comma separated, every combination is run):\n");
+    printf("    -h,--help             : Show syntax help\n");
+    printf("    -s,--size WxH         : Add a synthetic input of that size (default: 512x512 if no y4m input is given)\n");
+    printf("    -d,--depth LIST       : Depths (default: 8,10)\n");
+    printf("    -y,--yuv LIST         : YUV formats, any of 444,422,420,400 (default: 444,420)\n");
+    printf("    -c,--codec LIST       : Codecs, used for encoding and decoding where they can (default: auto)\n");
+    printf("    --speed LIST          : Encoder speeds (default: 8)\n");
+    printf("    -j,--jobs LIST        : Thread counts (default: 1)\n");
+    printf("    -q,--quantizer Q      : Quantizer for color and alpha (default: 30)\n");
+    printf("    -a,--alpha            : Include an alpha channel\n");
+    printf("    -r,--repeat N         : Timed runs per combination, the median is reported (default: 3)\n");
+    printf("    -w,--warmup N         : Untimed runs per combination before those (default: 1)\n");
+    printf("    -o,--output FILE      : Write the JSON report to FILE instead of stdout\n");
+    printf("\n");
+}
+
+int main(int argc, char * argv[])
+{
+    avifBenchList depths = { 2, { 8, 10 } };
+    avifBenchList yuvFormats = { 2, { AVIF_PIXEL_FORMAT_YUV444, AVIF_PIXEL_FORMAT_YUV420 } };
+    avifBenchList codecs = { 1, { AVIF_CODEC_CHOICE_AUTO } };
+    avifBenchList speeds = { 1, { 8 } };
+    avifBenchList threadCounts = { 1, { 1 } };
+    avifBenchList widths = { 0, { 0 } };
+    avifBenchList heights = { 0, { 0 } };
+    int quantizer = 30;
+    avifBool alpha = AVIF_FALSE;
+    int repeat = 3;
+    int warmup = 1;
+    const char * outputFilename = NULL;
+    const char * inputFilenames[AVIF_BENCH_MAX_LIST];
+    int inputCount = 0;
+
+    int argIndex = 1;
+    while (argIndex < argc) {
+        const char * arg = argv[argIndex];
+        avifBool valid = AVIF_TRUE;
+
+        if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+            syntax();
+            return 0;
+        } else if (!strcmp(arg, "-s") || !strcmp(arg, "--size")) {
+            NEXTARG();
+            unsigned int width, height;
+            valid = (sscanf(arg, "%ux%u", &width, &height) == 2) && width && height && (widths.count < AVIF_BENCH_MAX_LIST);
+            if (valid) {
+                widths.values[widths.count++] = (int)width;
+                heights.values[heights.count++] = (int)height;
+            }
+        } else if (!strcmp(arg, "-d") || !strcmp(arg, "--depth")) {
+            NEXTARG();
+            valid = parseIntList(arg, &depths);
+        } else if (!strcmp(arg, "-y") || !strcmp(arg, "--yuv")) {
+            NEXTARG();
+            valid = parseYUVFormatList(arg, &yuvFormats);
+        } else if (!strcmp(arg, "-c") || !strcmp(arg, "--codec")) {
+            NEXTARG();
+            valid = parseCodecList(arg, &codecs);
+        } else if (!strcmp(arg, "--speed")) {
+            NEXTARG();
+            valid = parseIntList(arg, &speeds);
+        } else if (!strcmp(arg, "-j") || !strcmp(arg, "--jobs")) {
+            NEXTARG();
+            valid = parseIntList(arg, &threadCounts);
+        } else if (!strcmp(arg, "-q") || !strcmp(arg, "--quantizer")) {
+            NEXTARG();
+            quantizer = atoi(arg);
+            valid = (quantizer >= AVIF_QUANTIZER_BEST_QUALITY) && (quantizer <= AVIF_QUANTIZER_WORST_QUALITY);
+        } else if (!strcmp(arg, "-a") || !strcmp(arg, "--alpha")) {
+            alpha = AVIF_TRUE;
+        } else if (!strcmp(arg, "-r") || !strcmp(arg, "--repeat")) {
+            NEXTARG();
+            repeat = atoi(arg);
+            valid = repeat > 0;
+        } else if (!strcmp(arg, "-w") || !strcmp(arg, "--warmup")) {
+            NEXTARG();
+            warmup = atoi(arg);
+            valid = warmup >= 0;
+        } else if (!strcmp(arg, "-o") || !strcmp(arg, "--output")) {
+            NEXTARG();
+            outputFilename = arg;
+        } else if (arg[0] != '-') {
+            valid = inputCount < AVIF_BENCH_MAX_LIST;
+            if (valid) {
+                inputFilenames[inputCount++] = arg;
+            }
+        } else {
+            valid = AVIF_FALSE;
+        }
+
+        if (!valid) {
+            fprintf(stderr, "Invalid argument: %s\n", arg);
+            syntax();
+            return 1;
+        }
+        ++argIndex;
+    }
+
+    if ((inputCount == 0) && (widths.count == 0)) {
+        widths.values[widths.count++] = 512;
+        heights.values[heights.count++] = 512;
+    }
+
+    avifBenchSource sources[AVIF_BENCH_MAX_LIST * 2];
+    int sourceCount = 0;
+    for (int i = 0; i < inputCount; ++i) {
+        if (!sourceCreateFromY4M(&sources[sourceCount], inputFilenames[i])) {
+            fprintf(stderr, "Failed to read: %s\n", inputFilenames[i]);
+            continue;
+        }
+        ++sourceCount;
+    }
+    for (int i = 0; i < widths.count; ++i) {
+        sourceCreateSynthetic(&sources[sourceCount++], (uint32_t)widths.values[i], (uint32_t)heights.values[i]);
+    }
+
+    char codecVersions[256];
+    avifCodecVersions(codecVersions);
+    cJSON * report = cJSON_CreateObject();
+    cJSON_AddStringToObject(report, "version", avifVersion());
+    cJSON_AddStringToObject(report, "codecs", codecVersions);
+    cJSON_AddNumberToObject(report, "repeat", repeat);
+    cJSON_AddNumberToObject(report, "warmup", warmup);
+    cJSON * results = cJSON_CreateArray();
+    cJSON_AddItemToObject(report, "results", results);
+
+    int failures = 0;
+    for (int sourceIndex = 0; sourceIndex < sourceCount; ++sourceIndex) {
+        for (int depthIndex = 0; depthIndex < depths.count; ++depthIndex) {
+            for (int yuvIndex = 0; yuvIndex < yuvFormats.count; ++yuvIndex) {
+                for (int codecIndex = 0; codecIndex < codecs.count; ++codecIndex) {
+                    for (int speedIndex = 0; speedIndex < speeds.count; ++speedIndex) {
+                        for (int threadIndex = 0; threadIndex < threadCounts.count; ++threadIndex) {
+                            avifBenchCase bc;
+                            bc.source = &sources[sourceIndex];
+                            bc.depth = (uint32_t)depths.values[depthIndex];
+                            bc.yuvFormat = (avifPixelFormat)yuvFormats.values[yuvIndex];
+                            bc.codecChoice = (avifCodecChoice)codecs.values[codecIndex];
+                            bc.speed = speeds.values[speedIndex];
+                            bc.threads = threadCounts.values[threadIndex];
+                            bc.quantizer = quantizer;
+                            bc.alpha = alpha;
+                            bc.warmup = warmup;
+                            bc.repeat = repeat;
+
+                            fprintf(stderr,
+                                    "avifbench: %s %ubpc %s codec:%s speed:%d threads:%d\n",
+                                    bc.source->name,
+                                    bc.depth,
+                                    yuvFormatToString(bc.yuvFormat),
+                                    (bc.codecChoice == AVIF_CODEC_CHOICE_AUTO) ? "auto" : avifCodecName(bc.codecChoice, 0),
+                                    bc.speed,
+                                    bc.threads);
+                            cJSON * result = benchRun(&bc);
+                            if (cJSON_GetObjectItem(result, "error")) {
+                                fprintf(stderr, "avifbench: ERROR: %s\n", cJSON_GetStringValue(cJSON_GetObjectItem(result, "error")));
+                                ++failures;
+                            }
+                            cJSON_AddItemToArray(results, result);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    cJSON_AddNumberToObject(report, "peakRSSKB", benchPeakRSSKB());
+
+    int retCode = failures ? 1 : 0;
+    char * jsonString = cJSON_Print(report);
+    if (outputFilename) {
+        FILE * f = fopen(outputFilename, "wb");
+        if (f) {
+            fprintf(f, "%s\n", jsonString);
+            fclose(f);
+        } else {
+            fprintf(stderr, "Failed to write: %s\n", outputFilename);
+            retCode = 1;
+        }
+    } else {
+        printf("%s\n", jsonString);
+    }
+    free(jsonString);
+    cJSON_Delete(report);
+
+    for (int i = 0; i < sourceCount; ++i) {
+        avifRGBImageFreePixels(&sources[i].rgb);
+    }
+    return retCode;
+}
@@ -0,0 +1,867 @@
+// Copyright 2020 Joe Drago. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include "avif/avif.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NEXTARG()                                                     \
+    if (((argIndex + 1) == argc) || (argv[argIndex + 1][0] == '-')) { \
+        fprintf(stderr, "%s requires an argument.", arg);             \
+        return 1;                                                     \
+    }                                                                 \
+    arg = argv[++argIndex]
+
+// avifroundtrip:
+// Encodes synthetic images with one of the encoder's features, decodes them again and checks what
+// comes back. Wherever samples are compared, the images are encoded losslessly (quantizer 0), so any
+// difference is a bug rather than coding noise.
+
+// Fills every plane of image with a smooth gradient plus a little noise, different for each seed
+static void fillImage(avifImage * image, uint32_t seed)
+{
+    avifPixelFormatInfo formatInfo;
+    avifGetPixelFormatInfo(image->yuvFormat, &formatInfo);
+    const uint32_t maxChannel = (1 << image->depth) - 1;
+    for (int plane = 0; plane < 4; ++plane) {
+        uint8_t * pixels = (plane < 3) ? image->yuvPlanes[plane] : image->alphaPlane;
+        const uint32_t rowBytes = (plane < 3) ? image->yuvRowBytes[plane] : image->alphaRowBytes;
+        if (!pixels) {
+            continue;
+        }
+        const avifBool chroma = (plane == AVIF_CHAN_U) || (plane == AVIF_CHAN_V);
+        const uint32_t planeWidth = chroma ? ((image->width + formatInfo.chromaShiftX) >> formatInfo.chromaShiftX) : image->width;
+        const uint32_t planeHeight = chroma ? ((image->height + formatInfo.chromaShiftY) >> formatInfo.chromaShiftY) : image->height;
+        for (uint32_t j = 0; j < planeHeight; ++j) {
+            for (uint32_t i = 0; i < planeWidth; ++i) {
+                seed = (seed * 1103515245) + 12345;
+                const uint32_t value = ((((i + plane * 17) * maxChannel) / (planeWidth + 40)) + ((j * maxChannel) / (planeHeight * 4)) +
+                                        ((seed >> 16) & 7)) &
+                                       maxChannel;
+                if (image->depth > 8) {
+                    ((uint16_t *)&pixels[j * rowBytes])[i] = (uint16_t)value;
+                } else {
+                    pixels[j * rowBytes + i] = (uint8_t)value;
+                }
+            }
+        }
+    }
+}
+
+static avifImage * createImage(uint32_t width, uint32_t height, uint32_t depth, avifPixelFormat yuvFormat, avifBool alpha, uint32_t seed)
+{
+    avifImage * image = avifImageCreate(width, height, depth, yuvFormat);
+    avifImageAllocatePlanes(image, alpha ? AVIF_PLANES_ALL : AVIF_PLANES_YUV);
+    fillImage(image, seed);
+    return image;
+}
+
+// Returns the number of samples which differ between the visible planes of image and refImage
+static uint64_t countDiffSamples(const avifImage * image, const avifImage * refImage)
+{
+    if ((image->width != refImage->width) || (image->height != refImage->height) || (image->depth != refImage->depth) ||
+        (image->yuvFormat != refImage->yuvFormat) || (!image->alphaPlane != !refImage->alphaPlane)) {
+        return UINT64_MAX;
+    }
+
+    avifPixelFormatInfo formatInfo;
+    avifGetPixelFormatInfo(image->yuvFormat, &formatInfo);
+    const uint32_t bytesPerSample = (image->depth > 8) ? 2 : 1;
+    uint64_t diffSampleCount = 0;
+    for (int plane = 0; plane < 4; ++plane) {
+        const uint8_t * pixels = (plane < 3) ? image->yuvPlanes[plane] : image->alphaPlane;
+        const uint8_t * refPixels = (plane < 3) ? refImage->yuvPlanes[plane] : refImage->alphaPlane;
+        const uint32_t rowBytes = (plane < 3) ? image->yuvRowBytes[plane] : image->alphaRowBytes;
+        const uint32_t refRowBytes = (plane < 3) ? refImage->yuvRowBytes[plane] : refImage->alphaRowBytes;
+        if (!pixels || !refPixels) {
+            continue;
+        }
+        const avifBool chroma = (plane == AVIF_CHAN_U) || (plane == AVIF_CHAN_V);
+        const uint32_t planeWidth = chroma ? ((image->width + formatInfo.chromaShiftX) >> formatInfo.chromaShiftX) : image->width;
+        const uint32_t planeHeight = chroma ? ((image->height + formatInfo.chromaShiftY) >> formatInfo.chromaShiftY) : image->height;
+        for (uint32_t j = 0; j < planeHeight; ++j) {
+            for (uint32_t i = 0; i < planeWidth * bytesPerSample; i += bytesPerSample) {
+                if (memcmp(&pixels[j * rowBytes + i], &refPixels[j * refRowBytes + i], bytesPerSample)) {
+                    ++diffSampleCount;
+                }
+            }
+        }
+    }
+    return diffSampleCount;
+}
+
+static void setQuantizer(avifEncoder * encoder, int quantizer)
+{
+    encoder->minQuantizer = quantizer;
+    encoder->maxQuantizer = quantizer;
+    encoder->minQuantizerAlpha = quantizer;
+    encoder->maxQuantizerAlpha = quantizer;
+}
+
+// -----------------------------------------------------------------------
+// Grids
+
+static int testGrid(void)
+{
+    // Sizes which aren't a multiple of the cell size, so the right and bottom cells are padded
+    const struct
+    {
+        uint32_t width, height, depth;
+        avifPixelFormat yuvFormat;
+        avifBool alpha;
+        uint32_t cellWidth, cellHeight;
+    } configs[] = {
+        { 150, 130, 8, AVIF_PIXEL_FORMAT_YUV444, AVIF_TRUE, 64, 64 },
+        { 200, 70, 10, AVIF_PIXEL_FORMAT_YUV420, AVIF_FALSE, 96, 64 },
+        { 64, 200, 8, AVIF_PIXEL_FORMAT_YUV422, AVIF_TRUE, 64, 66 },
+        { 130, 90, 12, AVIF_PIXEL_FORMAT_YUV400, AVIF_FALSE, 64, 80 },
+    };
+    const int configCount = (int)(sizeof(configs) / sizeof(configs[0]));
+
+    int failedCount = 0;
+    for (int configIndex = 0; configIndex < configCount; ++configIndex) {
+        avifImage * image = createImage(configs[configIndex].width,
+                                        configs[configIndex].height,
+                                        configs[configIndex].depth,
+                                        configs[configIndex].yuvFormat,
+                                        configs[configIndex].alpha,
+                                        configIndex + 1);
+        const uint32_t gridCols = (image->width + configs[configIndex].cellWidth - 1) / configs[configIndex].cellWidth;
+        const uint32_t gridRows = (image->height + configs[configIndex].cellHeight - 1) / configs[configIndex].cellHeight;
+
+        avifEncoder * encoder = avifEncoderCreate();
+        encoder->speed = AVIF_SPEED_FASTEST;
+        encoder->maxThreads = 4;
+        encoder->gridCellWidth = configs[configIndex].cellWidth;
+        encoder->gridCellHeight = configs[configIndex].cellHeight;
+        setQuantizer(encoder, AVIF_QUANTIZER_LOSSLESS);
+        avifRWData encoded = AVIF_DATA_EMPTY;
+        avifResult result = avifEncoderWrite(encoder, image, &encoded);
+
+        avifImage * decoded = avifImageCreateEmpty();
+        avifDecoder * decoder = avifDecoderCreate();
+        if (result == AVIF_RESULT_OK) {
+            avifROData raw = { encoded.data, encoded.size };
+            result = avifDecoderRead(decoder, decoded, &raw);
+        }
+        const uint32_t expectedTileCount = gridCols * gridRows * (image->alphaPlane ? 2 : 1);
+        const uint64_t diffSampleCount = (result == AVIF_RESULT_OK) ? countDiffSamples(decoded, image) : UINT64_MAX;
+        printf(" * Grid %ux%u depth %u %s alpha %d, %ux%u cells: %s, %u tiles decoded, %" PRIu64 " samples differ\n",
+               image->width,
+               image->height,
+               image->depth,
+               avifPixelFormatToString(image->yuvFormat),
+               image->alphaPlane != NULL,
+               gridCols,
+               gridRows,
+               avifResultToString(result),
+               decoder->ioStats.tileCount,
+               diffSampleCount);
+        if ((result != AVIF_RESULT_OK) || (decoder->ioStats.tileCount != expectedTileCount) || diffSampleCount) {
+            ++failedCount;
+        }
+
+        // Cells below 64x64 are not allowed by MIAF
+        encoder->gridCellWidth = 32;
+        encoder->gridCellHeight = 64;
+        avifRWDataFree(&encoded);
+        result = avifEncoderWrite(encoder, image, &encoded);
+        if (result != AVIF_RESULT_INVALID_IMAGE_GRID) {
+            printf("   32x64 cells: %s, expected %s\n", avifResultToString(result), avifResultToString(AVIF_RESULT_INVALID_IMAGE_GRID));
+            ++failedCount;
+        }
+
+        avifDecoderDestroy(decoder);
+        avifImageDestroy(decoded);
+        avifRWDataFree(&encoded);
+        avifEncoderDestroy(encoder);
+        avifImageDestroy(image);
+    }
+    return failedCount;
+}
+
+// -----------------------------------------------------------------------
+// Image sequences
+
+static int testSequence(void)
+{
+    const struct
+    {
+        uint32_t width, height, depth;
+        avifPixelFormat yuvFormat;
+        int maxThreads;
+    } configs[] = {
+        { 97, 61, 8, AVIF_PIXEL_FORMAT_YUV420, 4 },
+        { 64, 48, 10, AVIF_PIXEL_FORMAT_YUV444, 1 },
+    };
+    const int configCount = (int)(sizeof(configs) / sizeof(configs[0]));
+    const uint64_t durations[] = { 100, 40, 40, 250, 1, 60 };
+    const int frameCount = (int)(sizeof(durations) / sizeof(durations[0]));
+
+    int failedCount = 0;
+    for (int configIndex = 0; configIndex < configCount; ++configIndex) {
+        avifImage * frames[sizeof(durations) / sizeof(durations[0])];
+        avifEncoder * encoder = avifEncoderCreate();
+        encoder->speed = AVIF_SPEED_FASTEST;
+        encoder->maxThreads = configs[configIndex].maxThreads;
+        encoder->timescale = 1000;
+        setQuantizer(encoder, AVIF_QUANTIZER_LOSSLESS);
+        avifResult result = AVIF_RESULT_OK;
+        for (int frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
+            frames[frameIndex] = createImage(configs[configIndex].width,
+                                             configs[configIndex].height,
+                                             configs[configIndex].depth,
+                                             configs[configIndex].yuvFormat,
+                                             AVIF_TRUE,
+                                             100 * configIndex + frameIndex);
+            if (result == AVIF_RESULT_OK) {
+                result = avifEncoderAddImage(encoder, frames[frameIndex], durations[frameIndex]);
+            }
+        }
+        avifRWData encoded = AVIF_DATA_EMPTY;
+        if (result == AVIF_RESULT_OK) {
+            result = avifEncoderFinish(encoder, &encoded);
+        }
+        printf(" * Sequence %ux%u depth %u %s, %d frames, %d threads: %s\n",
+               configs[configIndex].width,
+               configs[configIndex].height,
+               configs[configIndex].depth,
+               avifPixelFormatToString(configs[configIndex].yuvFormat),
+               frameCount,
+               configs[configIndex].maxThreads,
+               avifResultToString(result));
+        if (result != AVIF_RESULT_OK) {
+            ++failedCount;
+        }
+
+        // The track, frame by frame
+        avifDecoder * decoder = avifDecoderCreate();
+        avifROData raw = { encoded.data, encoded.size };
+        if (result == AVIF_RESULT_OK) {
+            result = avifDecoderParse(decoder, &raw);
+            if ((result != AVIF_RESULT_OK) || (decoder->imageCount != frameCount) || (decoder->timescale != 1000)) {
+                printf("   parse: %s, %d frames, timescale %" PRIu64 "\n", avifResultToString(result), decoder->imageCount, decoder->timescale);
+                ++failedCount;
+                result = AVIF_RESULT_UNKNOWN_ERROR;
+            }
+        }
+        uint64_t ptsInTimescales = 0;
+        for (int frameIndex = 0; (result == AVIF_RESULT_OK) && (frameIndex < frameCount); ++frameIndex) {
+            result = avifDecoderNextImage(decoder);
+            const uint64_t diffSampleCount = (result == AVIF_RESULT_OK) ? countDiffSamples(decoder->image, frames[frameIndex]) : UINT64_MAX;
+            if ((result != AVIF_RESULT_OK) || diffSampleCount ||
+                (decoder->imageTiming.durationInTimescales != durations[frameIndex]) ||
+                (decoder->imageTiming.ptsInTimescales != ptsInTimescales)) {
+                printf("   frame %d: %s, %" PRIu64 " samples differ, pts %" PRIu64 " duration %" PRIu64 ", expected pts %" PRIu64
+                       " duration %" PRIu64 "\n",
+                       frameIndex,
+                       avifResultToString(result),
+                       diffSampleCount,
+                       decoder->imageTiming.ptsInTimescales,
+                       decoder->imageTiming.durationInTimescales,
+                       ptsInTimescales,
+                       durations[frameIndex]);
+                ++failedCount;
+            }
+            ptsInTimescales += durations[frameIndex];
+        }
+        if ((result == AVIF_RESULT_OK) && (decoder->durationInTimescales != ptsInTimescales)) {
+            printf("   duration %" PRIu64 ", expected %" PRIu64 "\n", decoder->durationInTimescales, ptsInTimescales);
+            ++failedCount;
+        }
+        if ((result == AVIF_RESULT_OK) && (avifDecoderNextImage(decoder) != AVIF_RESULT_NO_IMAGES_REMAINING)) {
+            printf("   more frames than were encoded\n");
+            ++failedCount;
+        }
+        avifDecoderDestroy(decoder);
+
+        // The primary item, for still image readers
+        if (result == AVIF_RESULT_OK) {
+            decoder = avifDecoderCreate();
+            decoder->requestedSource = AVIF_DECODER_SOURCE_PRIMARY_ITEM;
+            avifImage * decoded = avifImageCreateEmpty();
+            result = avifDecoderRead(decoder, decoded, &raw);
+            const uint64_t diffSampleCount = (result == AVIF_RESULT_OK) ? countDiffSamples(decoded, frames[0]) : UINT64_MAX;
+            if (diffSampleCount) {
+                printf("   primary item: %s, %" PRIu64 " samples differ from the first frame\n", avifResultToString(result), diffSampleCount);
+                ++failedCount;
+            }
+            avifImageDestroy(decoded);
+            avifDecoderDestroy(decoder);
+        }
+
+        for (int frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
+            avifImageDestroy(frames[frameIndex]);
+        }
+        avifRWDataFree(&encoded);
+        avifEncoderDestroy(encoder);
+    }
+    return failedCount;
+}
+
+// -----------------------------------------------------------------------
+// Codec contexts kept between writes (avifEncoder.keepCodecs)
+
+static int testReuse(void)
+{
+    // Runs of images with the same settings, where the contexts are reused, broken up by changes
+    // in size, format, alpha and quantizer, which must set them up again
+    const struct
+    {
+        uint32_t width, height, depth;
+        avifPixelFormat yuvFormat;
+        avifBool alpha;
+        int quantizer;
+    } images[] = {
+        { 97, 61, 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_TRUE, AVIF_QUANTIZER_LOSSLESS },
+        { 97, 61, 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_TRUE, AVIF_QUANTIZER_LOSSLESS },
+        { 97, 61, 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_TRUE, AVIF_QUANTIZER_LOSSLESS },
+        { 97, 61, 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_FALSE, AVIF_QUANTIZER_LOSSLESS },
+        { 64, 64, 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_TRUE, AVIF_QUANTIZER_LOSSLESS },
+        { 64, 64, 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_TRUE, 30 },
+        { 64, 64, 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_TRUE, 30 },
+        { 64, 64, 10, AVIF_PIXEL_FORMAT_YUV444, AVIF_TRUE, AVIF_QUANTIZER_LOSSLESS },
+        { 64, 64, 10, AVIF_PIXEL_FORMAT_YUV444, AVIF_TRUE, AVIF_QUANTIZER_LOSSLESS },
+    };
+    const int imageCount = (int)(sizeof(images) / sizeof(images[0]));
+    const int speeds[] = { 6, AVIF_SPEED_FASTEST };
+
+    int failedCount = 0;
+    for (int speedIndex = 0; speedIndex < 2; ++speedIndex) {
+        avifEncoder * encoder = avifEncoderCreate();
+        encoder->keepCodecs = AVIF_TRUE;
+        encoder->speed = speeds[speedIndex];
+        encoder->maxThreads = 2;
+        for (int imageIndex = 0; imageIndex < imageCount; ++imageIndex) {
+            avifImage * image = createImage(images[imageIndex].width,
+                                            images[imageIndex].height,
+                                            images[imageIndex].depth,
+                                            images[imageIndex].yuvFormat,
+                                            images[imageIndex].alpha,
+                                            imageIndex + 1);
+            setQuantizer(encoder, images[imageIndex].quantizer);
+            avifRWData encoded = AVIF_DATA_EMPTY;
+            avifResult result = avifEncoderWrite(encoder, image, &encoded);
+
+            // The same image from an encoder of its own
+            avifEncoder * freshEncoder = avifEncoderCreate();
+            freshEncoder->speed = encoder->speed;
+            freshEncoder->maxThreads = encoder->maxThreads;
+            setQuantizer(freshEncoder, images[imageIndex].quantizer);
+            avifRWData freshEncoded = AVIF_DATA_EMPTY;
+            avifResult freshResult = avifEncoderWrite(freshEncoder, image, &freshEncoded);
+            avifEncoderDestroy(freshEncoder);
+
+            avifImage * decoded = avifImageCreateEmpty();
+            avifImage * freshDecoded = avifImageCreateEmpty();
+            if ((result == AVIF_RESULT_OK) && (freshResult == AVIF_RESULT_OK)) {
+                avifDecoder * decoder = avifDecoderCreate();
+                avifROData raw = { encoded.data, encoded.size };
+                result = avifDecoderRead(decoder, decoded, &raw);
+                avifDecoderDestroy(decoder);
+                decoder = avifDecoderCreate();
+                avifROData freshRaw = { freshEncoded.data, freshEncoded.size };
+                freshResult = avifDecoderRead(decoder, freshDecoded, &freshRaw);
+                avifDecoderDestroy(decoder);
+            }
+
+            // Lossless images must come out whole. Lossy ones may differ from the fresh encode (see
+            // keepCodecs in avif.h), but never in size, depth, format or alpha.
+            const avifBool lossless = (images[imageIndex].quantizer == AVIF_QUANTIZER_LOSSLESS);
+            uint64_t diffSampleCount = UINT64_MAX;
+            if ((result == AVIF_RESULT_OK) && (freshResult == AVIF_RESULT_OK)) {
+                diffSampleCount = countDiffSamples(decoded, lossless ? image : freshDecoded);
+            }
+            const avifBool failed = lossless ? (diffSampleCount != 0) : (diffSampleCount == UINT64_MAX);
+            printf(" * Reuse speed %d, image %d (%ux%u depth %u %s alpha %d quantizer %d): %s, %zu bytes (fresh: %zu), %" PRIu64
+                   " samples differ from the %s\n",
+                   encoder->speed,
+                   imageIndex,
+                   image->width,
+                   image->height,
+                   image->depth,
+                   avifPixelFormatToString(image->yuvFormat),
+                   image->alphaPlane != NULL,
+                   images[imageIndex].quantizer,
+                   avifResultToString(result),
+                   encoded.size,
+                   freshEncoded.size,
+                   diffSampleCount,
+                   lossless ? "source" : "fresh encode");
+            if (failed) {
+                ++failedCount;
+            }
+
+            avifImageDestroy(freshDecoded);
+            avifImageDestroy(decoded);
+            avifRWDataFree(&freshEncoded);
+            avifRWDataFree(&encoded);
+            avifImageDestroy(image);
+        }
+
+        // A sequence in between never takes over the kept contexts, and the still images after it
+        // still come out whole
+        avifImage * frame = createImage(64, 64, 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_TRUE, 1000);
+        setQuantizer(encoder, AVIF_QUANTIZER_LOSSLESS);
+        avifRWData encoded = AVIF_DATA_EMPTY;
+        avifResult result = avifEncoderAddImage(encoder, frame, 1);
+        if (result == AVIF_RESULT_OK) {
+            result = avifEncoderAddImage(encoder, frame, 1);
+        }
+        if (result == AVIF_RESULT_OK) {
+            result = avifEncoderFinish(encoder, &encoded);
+        }
+        avifRWDataFree(&encoded);
+        if (result == AVIF_RESULT_OK) {
+            result = avifEncoderWrite(encoder, frame, &encoded);
+        }
+        avifImage * decoded = avifImageCreateEmpty();
+        if (result == AVIF_RESULT_OK) {
+            avifDecoder * decoder = avifDecoderCreate();
+            avifROData raw = { encoded.data, encoded.size };
+            result = avifDecoderRead(decoder, decoded, &raw);
+            avifDecoderDestroy(decoder);
+        }
+        const uint64_t diffSampleCount = (result == AVIF_RESULT_OK) ? countDiffSamples(decoded, frame) : UINT64_MAX;
+        printf(" * Reuse speed %d, still image after a sequence: %s, %" PRIu64 " samples differ\n",
+               encoder->speed,
+               avifResultToString(result),
+               diffSampleCount);
+        if (diffSampleCount) {
+            ++failedCount;
+        }
+        avifImageDestroy(decoded);
+        avifRWDataFree(&encoded);
+        avifImageDestroy(frame);
+
+        // Once keepCodecs is turned off, the contexts kept so far are dropped, and a lossy image
+        // comes out exactly as from a fresh encoder
+        encoder->minQuantizer = encoder->minQuantizerAlpha = 10;
+        encoder->maxQuantizer = encoder->maxQuantizerAlpha = 50;
+        for (int writeIndex = 0; (writeIndex < 2) && (result == AVIF_RESULT_OK); ++writeIndex) {
+            avifImage * image = createImage(128, 128, 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_TRUE, 2000 + writeIndex);
+            result = avifEncoderWrite(encoder, image, &encoded);
+            avifRWDataFree(&encoded);
+            avifImageDestroy(image);
+        }
+        avifImage * image = createImage(128, 128, 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_TRUE, 2002);
+        encoder->keepCodecs = AVIF_FALSE;
+        if (result == AVIF_RESULT_OK) {
+            result = avifEncoderWrite(encoder, image, &encoded);
+        }
+        avifEncoder * freshEncoder = avifEncoderCreate();
+        freshEncoder->speed = encoder->speed;
+        freshEncoder->maxThreads = encoder->maxThreads;
+        freshEncoder->minQuantizer = freshEncoder->minQuantizerAlpha = encoder->minQuantizer;
+        freshEncoder->maxQuantizer = freshEncoder->maxQuantizerAlpha = encoder->maxQuantizer;
+        avifRWData freshEncoded = AVIF_DATA_EMPTY;
+        avifResult freshResult = avifEncoderWrite(freshEncoder, image, &freshEncoded);
+        avifEncoderDestroy(freshEncoder);
+        const avifBool same = (result == AVIF_RESULT_OK) && (freshResult == AVIF_RESULT_OK) && (encoded.size == freshEncoded.size) &&
+                              !memcmp(encoded.data, freshEncoded.data, encoded.size);
+        printf(" * Reuse speed %d, lossy image after turning keepCodecs off: %s, %zu bytes (fresh: %zu), %s\n",
+               encoder->speed,
+               avifResultToString(result),
+               encoded.size,
+               freshEncoded.size,
+               same ? "same as the fresh encode" : "differs from the fresh encode");
+        if (!same) {
+            ++failedCount;
+        }
+        avifRWDataFree(&freshEncoded);
+        avifRWDataFree(&encoded);
+        avifImageDestroy(image);
+        avifEncoderDestroy(encoder);
+    }
+    return failedCount;
+}
+
+// -----------------------------------------------------------------------
+// Size and quality targets
+
+// Encodes image with encoder's target at the single quantizer q, which measures q the same way the
+// search measures its candidates
+static avifResult encodeAtQuantizer(avifEncoder * encoder, avifImage * image, int quantizer, size_t * size, double * quality)
+{
+    const int minQuantizer = encoder->minQuantizer;
+    const int maxQuantizer = encoder->maxQuantizer;
+    encoder->minQuantizer = quantizer;
+    encoder->maxQuantizer = quantizer;
+    avifRWData encoded = AVIF_DATA_EMPTY;
+    avifResult result = avifEncoderWrite(encoder, image, &encoded);
+    *size = encoded.size;
+    *quality = encoder->ioStats.targetQuality;
+    avifRWDataFree(&encoded);
+    encoder->minQuantizer = minQuantizer;
+    encoder->maxQuantizer = maxQuantizer;
+    return result;
+}
+
+static int testTarget(void)
+{
+    const struct
+    {
+        const char * name;
+        avifEncoderTarget target;
+        avifBool alpha;
+        double fraction; // of the way from the worst to the best size or quality in the sweep
+        int maxThreads;
+    } configs[] = {
+        { "size", AVIF_ENCODER_TARGET_SIZE, AVIF_FALSE, 0.3, 1 },
+        { "size", AVIF_ENCODER_TARGET_SIZE, AVIF_TRUE, 0.6, 8 },
+        { "PSNR", AVIF_ENCODER_TARGET_PSNR, AVIF_FALSE, 0.5, 4 },
+        { "PSNR", AVIF_ENCODER_TARGET_PSNR, AVIF_TRUE, 0.8, 1 },
+        { "SSIM", AVIF_ENCODER_TARGET_SSIM, AVIF_FALSE, 0.4, 8 },
+    };
+    const int configCount = (int)(sizeof(configs) / sizeof(configs[0]));
+    const int minQuantizer = 8;
+    const int maxQuantizer = 56;
+
+    int failedCount = 0;
+    for (int configIndex = 0; configIndex < configCount; ++configIndex) {
+        avifImage * image = createImage(128, 96, 8, AVIF_PIXEL_FORMAT_YUV420, configs[configIndex].alpha, configIndex + 1);
+        avifEncoder * encoder = avifEncoderCreate();
+        encoder->speed = 8;
+        encoder->maxThreads = configs[configIndex].maxThreads;
+        encoder->minQuantizer = minQuantizer;
+        encoder->maxQuantizer = maxQuantizer;
+        encoder->minQuantizerAlpha = 20;
+        encoder->maxQuantizerAlpha = 20;
+        encoder->target = configs[configIndex].target;
+
+        // Brute force: every quantizer on its own
+        size_t sizes[64];
+        double qualities[64];
+        int sweepFailedCount = 0;
+        for (int quantizer = minQuantizer; quantizer <= maxQuantizer; ++quantizer) {
+            if (encodeAtQuantizer(encoder, image, quantizer, &sizes[quantizer], &qualities[quantizer]) != AVIF_RESULT_OK) {
+                ++sweepFailedCount;
+            }
+        }
+        if (sweepFailedCount) {
+            printf(" * Target %s: %d quantizers of the sweep failed to encode\n", configs[configIndex].name, sweepFailedCount);
+            ++failedCount;
+            avifEncoderDestroy(encoder);
+            avifImageDestroy(image);
+            continue;
+        }
+
+        // A target between the extremes, and the quantizer a search has to find for it: the best
+        // quality whose file fits, or the largest quantizer (smallest file) which is good enough
+        const avifBool sizeTarget = (configs[configIndex].target == AVIF_ENCODER_TARGET_SIZE);
+        const double fraction = configs[configIndex].fraction;
+        int expectedQuantizer = -1;
+        if (sizeTarget) {
+            encoder->targetSize = (size_t)(sizes[maxQuantizer] + fraction * (double)(sizes[minQuantizer] - sizes[maxQuantizer]));
+            for (int quantizer = maxQuantizer; quantizer >= minQuantizer; --quantizer) {
+                if (sizes[quantizer] <= encoder->targetSize) {
+                    expectedQuantizer = quantizer;
+                }
+            }
+        } else {
+            encoder->targetQuality = qualities[maxQuantizer] + fraction * (qualities[minQuantizer] - qualities[maxQuantizer]);
+            for (int quantizer = minQuantizer; quantizer <= maxQuantizer; ++quantizer) {
+                if (qualities[quantizer] >= encoder->targetQuality) {
+                    expectedQuantizer = quantizer;
+                }
+            }
+        }
+
+        avifRWData encoded = AVIF_DATA_EMPTY;
+        avifResult result = avifEncoderWrite(encoder, image, &encoded);
+        const avifIOStats * ioStats = &encoder->ioStats;
+        printf(" * Target %s %.4g (alpha %d, %d threads): %s, quantizer %d (sweep: %d) after %u candidates, %zu bytes, quality %.4f, met %d\n",
+               configs[configIndex].name,
+               sizeTarget ? (double)encoder->targetSize : encoder->targetQuality,
+               configs[configIndex].alpha,
+               encoder->maxThreads,
+               avifResultToString(result),
+               ioStats->targetQuantizer,
+               expectedQuantizer,
+               ioStats->targetCandidates,
+               encoded.size,
+               ioStats->targetQuality,
+               ioStats->targetMet);
+        if ((result != AVIF_RESULT_OK) || !ioStats->targetMet || (ioStats->targetQuantizer != expectedQuantizer) ||
+            (encoded.size != sizes[expectedQuantizer]) || (ioStats->targetCandidates >= (uint32_t)(maxQuantizer - minQuantizer + 1))) {
+            ++failedCount;
+        }
+        avifRWDataFree(&encoded);
+
+        // Out of reach: the closest quantizer is written, and the target is reported as missed
+        if (sizeTarget) {
+            encoder->targetSize = 10;
+            expectedQuantizer = maxQuantizer;
+        } else {
+            encoder->targetQuality = (configs[configIndex].target == AVIF_ENCODER_TARGET_SSIM) ? 1.01 : 1000.0;
+            expectedQuantizer = minQuantizer;
+        }
+        result = avifEncoderWrite(encoder, image, &encoded);
+        printf("   unreachable target: %s, quantizer %d, %zu bytes, met %d\n",
+               avifResultToString(result),
+               ioStats->targetQuantizer,
+               encoded.size,
+               ioStats->targetMet);
+        if ((result != AVIF_RESULT_OK) || ioStats->targetMet || (ioStats->targetQuantizer != expectedQuantizer) ||
+            (encoded.size != sizes[expectedQuantizer])) {
+            ++failedCount;
+        }
+        avifRWDataFree(&encoded);
+
+        avifEncoderDestroy(encoder);
+        avifImageDestroy(image);
+    }
+    return failedCount;
+}
+
+// -----------------------------------------------------------------------
+// Regions of interest
+
+// Returns the number of samples of region which differ from the area at (x, y) of image
+static uint64_t countRegionDiffSamples(const avifImage * region, const avifImage * image, uint32_t x, uint32_t y)
+{
+    if ((region->depth != image->depth) || (region->yuvFormat != image->yuvFormat) || (!region->alphaPlane != !image->alphaPlane) ||
+        ((x + region->width) > image->width) || ((y + region->height) > image->height)) {
+        return UINT64_MAX;
+    }
+
+    avifPixelFormatInfo formatInfo;
+    avifGetPixelFormatInfo(image->yuvFormat, &formatInfo);
+    const uint32_t bytesPerSample = (image->depth > 8) ? 2 : 1;
+    uint64_t diffSampleCount = 0;
+    for (int plane = 0; plane < 4; ++plane) {
+        const uint8_t * pixels = (plane < 3) ? region->yuvPlanes[plane] : region->alphaPlane;
+        const uint8_t * refPixels = (plane < 3) ? image->yuvPlanes[plane] : image->alphaPlane;
+        const uint32_t rowBytes = (plane < 3) ? region->yuvRowBytes[plane] : region->alphaRowBytes;
+        const uint32_t refRowBytes = (plane < 3) ? image->yuvRowBytes[plane] : image->alphaRowBytes;
+        if (!pixels || !refPixels) {
+            continue;
+        }
+        const avifBool chroma = (plane == AVIF_CHAN_U) || (plane == AVIF_CHAN_V);
+        const uint32_t shiftX = chroma ? formatInfo.chromaShiftX : 0;
+        const uint32_t shiftY = chroma ? formatInfo.chromaShiftY : 0;
+        const uint32_t planeWidth = (region->width + shiftX) >> shiftX;
+        const uint32_t planeHeight = (region->height + shiftY) >> shiftY;
+        for (uint32_t j = 0; j < planeHeight; ++j) {
+            const uint8_t * row = &pixels[j * rowBytes];
+            const uint8_t * refRow = &refPixels[((y >> shiftY) + j) * refRowBytes + (x >> shiftX) * bytesPerSample];
+            for (uint32_t i = 0; i < planeWidth * bytesPerSample; i += bytesPerSample) {
+                if (memcmp(&row[i], &refRow[i], bytesPerSample)) {
+                    ++diffSampleCount;
+                }
+            }
+        }
+    }
+    return diffSampleCount;
+}
+
+static int testRegion(void)
+{
+    // Grids (with the cache big enough for every cell, a few cells or none) and single items, which
+    // are decoded whole and cropped
+    const struct
+    {
+        uint32_t depth;
+        avifPixelFormat yuvFormat;
+        avifBool alpha;
+        uint32_t cellSize;
+        size_t regionCacheBytes;
+        int maxThreads;
+    } configs[] = {
+        { 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_TRUE, 64, 128 << 20, 4 },
+        { 10, AVIF_PIXEL_FORMAT_YUV444, AVIF_TRUE, 96, 20000, 1 },
+        { 8, AVIF_PIXEL_FORMAT_YUV422, AVIF_FALSE, 64, 0, 2 },
+        { 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_TRUE, 0, 128 << 20, 4 },
+        { 12, AVIF_PIXEL_FORMAT_YUV422, AVIF_FALSE, 0, 0, 1 },
+    };
+    const int configCount = (int)(sizeof(configs) / sizeof(configs[0]));
+    const uint32_t width = 301;
+    const uint32_t height = 203;
+
+    int failedCount = 0;
+    for (int configIndex = 0; configIndex < configCount; ++configIndex) {
+        avifImage * image = createImage(width, height, configs[configIndex].depth, configs[configIndex].yuvFormat, configs[configIndex].alpha, configIndex + 1);
+        avifEncoder * encoder = avifEncoderCreate();
+        encoder->speed = AVIF_SPEED_FASTEST;
+        encoder->maxThreads = configs[configIndex].maxThreads;
+        encoder->gridCellWidth = configs[configIndex].cellSize;
+        encoder->gridCellHeight = configs[configIndex].cellSize;
+        setQuantizer(encoder, 30);
+        avifRWData encoded = AVIF_DATA_EMPTY;
+        avifResult result = avifEncoderWrite(encoder, image, &encoded);
+        avifEncoderDestroy(encoder);
+        avifImageDestroy(image);
+
+        // The full decode every region is cut from
+        avifDecoder * decoder = avifDecoderCreate();
+        decoder->maxThreads = configs[configIndex].maxThreads;
+        decoder->regionCacheBytes = configs[configIndex].regionCacheBytes;
+        avifROData raw = { encoded.data, encoded.size };
+        if (result == AVIF_RESULT_OK) {
+            result = avifDecoderParse(decoder, &raw);
+        }
+        if (result == AVIF_RESULT_OK) {
+            result = avifDecoderNextImage(decoder);
+        }
+        if (result != AVIF_RESULT_OK) {
+            printf(" * Region %s depth %u, %u cells: %s\n",
+                   avifPixelFormatToString(configs[configIndex].yuvFormat),
+                   configs[configIndex].depth,
+                   configs[configIndex].cellSize,
+                   avifResultToString(result));
+            ++failedCount;
+            avifDecoderDestroy(decoder);
+            avifRWDataFree(&encoded);
+            continue;
+        }
+        avifImage * full = avifImageCreateEmpty();
+        avifImageCopy(full, decoder->image);
+
+        // The whole image right after avifDecoderNextImage(), whose planes may belong to the codec
+        // (and have the same size), then a region inside, then random ones, always starting on a
+        // chroma sample
+        avifPixelFormatInfo formatInfo;
+        avifGetPixelFormatInfo(full->yuvFormat, &formatInfo);
+        const int regionCount = 24;
+        int regionFailedCount = 0;
+        uint32_t seed = configIndex + 1;
+        for (int regionIndex = 0; regionIndex < regionCount; ++regionIndex) {
+            uint32_t x = 0, y = 0, regionWidth = width, regionHeight = height;
+            if (regionIndex == 1) {
+                x = 2;
+                y = 2;
+                regionWidth = 100;
+                regionHeight = 70;
+            } else if (regionIndex > 1) {
+                seed = (seed * 1103515245) + 12345;
+                x = ((seed >> 8) % width) & ~formatInfo.chromaShiftX;
+                seed = (seed * 1103515245) + 12345;
+                y = ((seed >> 8) % height) & ~formatInfo.chromaShiftY;
+                seed = (seed * 1103515245) + 12345;
+                regionWidth = 1 + (seed >> 8) % (width - x);
+                seed = (seed * 1103515245) + 12345;
+                regionHeight = 1 + (seed >> 8) % (height - y);
+            }
+            result = avifDecoderDecodeRegion(decoder, x, y, regionWidth, regionHeight);
+            uint64_t diffSampleCount = UINT64_MAX;
+            if ((result == AVIF_RESULT_OK) && (decoder->image->width == regionWidth) && (decoder->image->height == regionHeight)) {
+                diffSampleCount = countRegionDiffSamples(decoder->image, full, x, y);
+            }
+            if (diffSampleCount) {
+                printf("   region %ux%u at (%u, %u): %s, %" PRIu64 " samples differ\n",
+                       regionWidth,
+                       regionHeight,
+                       x,
+                       y,
+                       avifResultToString(result),
+                       diffSampleCount);
+                ++regionFailedCount;
+            }
+        }
+
+        // Regions which can't be decoded
+        const struct
+        {
+            uint32_t x, y, width, height;
+        } invalidRegions[] = {
+            { 1, 1, 8, 8 },         // starts between chroma samples (or a valid 4:4:4 region)
+            { width - 1, 0, 2, 2 }, // reaches past the right edge
+            { 0, height, 2, 2 },    // starts below the image
+            { 0, 0, 0, 4 },         // empty
+        };
+        for (int invalidIndex = 0; invalidIndex < 4; ++invalidIndex) {
+            const avifBool oddOffset = (invalidIndex == 0);
+            if (oddOffset && !formatInfo.chromaShiftX && !formatInfo.chromaShiftY) {
+                continue;
+            }
+            result = avifDecoderDecodeRegion(decoder,
+                                             invalidRegions[invalidIndex].x,
+                                             invalidRegions[invalidIndex].y,
+                                             invalidRegions[invalidIndex].width,
+                                             invalidRegions[invalidIndex].height);
+            if (result != AVIF_RESULT_INVALID_REGION) {
+                printf("   region %ux%u at (%u, %u): %s, expected %s\n",
+                       invalidRegions[invalidIndex].width,
+                       invalidRegions[invalidIndex].height,
+                       invalidRegions[invalidIndex].x,
+                       invalidRegions[invalidIndex].y,
+                       avifResultToString(result),
+                       avifResultToString(AVIF_RESULT_INVALID_REGION));
+                ++regionFailedCount;
+            }
+        }
+
+        printf(" * Region %s depth %u alpha %d, %u cells, cache %zu bytes, %d threads: %d regions, %u cells from the cache, %d failed\n",
+               avifPixelFormatToString(full->yuvFormat),
+               full->depth,
+               full->alphaPlane != NULL,
+               configs[configIndex].cellSize,
+               configs[configIndex].regionCacheBytes,
+               configs[configIndex].maxThreads,
+               regionCount,
+               decoder->ioStats.cellCacheHits,
+               regionFailedCount);
+        failedCount += regionFailedCount;
+
+        avifImageDestroy(full);
+        avifDecoderDestroy(decoder);
+        avifRWDataFree(&encoded);
+    }
+    return failedCount;
+}
+
+int main(int argc, char * argv[])
+{
+    printf("avif version: %s\n", avifVersion());
+
+    const char * mode = NULL;
+
+    int argIndex = 1;
+    while (argIndex < argc) {
+        const char * arg = argv[argIndex];
+
+        if (!strcmp(arg, "-m") || !strcmp(arg, "--mode")) {
+            NEXTARG();
+            mode = arg;
+        }
+
+        ++argIndex;
+    }
+
+    // Without -m, every test is run
+    const struct
+    {
+        const char * name;
+        int (*run)(void);
+    } tests[] = {
+        { "grid", testGrid },
+        { "sequence", testSequence },
+        { "reuse", testReuse },
+        { "target", testTarget },
+        { "region", testRegion },
+    };
+    const int testCount = (int)(sizeof(tests) / sizeof(tests[0]));
+
+    int failedCount = 0;
+    avifBool found = AVIF_FALSE;
+    for (int testIndex = 0; testIndex < testCount; ++testIndex) {
+        if (mode && strcmp(mode, tests[testIndex].name)) {
+            continue;
+        }
+        found = AVIF_TRUE;
+        const int testFailedCount = tests[testIndex].run();
+        if (testFailedCount) {
+            printf("ERROR: %d %s checks failed\n", testFailedCount, tests[testIndex].name);
+        }
+        failedCount += testFailedCount;
+    }
+    if (!found) {
+        fprintf(stderr, "Unknown mode: %s\n", mode);
+        return 1;
+    }
+    return failedCount ? 1 : 0;
+}
@@ -4,6 +4,7 @@
 #include "avif/avif.h"
 
 #include <inttypes.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,6 +12,15 @@
 
 #define MAX_DRIFT 10
 
+// avifImageRGBToYUV() must match referenceRGBToYUV() exactly, except that a compiler fusing
+// multiply-adds (-ffp-contract=fast with FMA enabled) may move a sample by one codepoint.
+#define MAX_RGB_TO_YUV_DIFF 1
+
+// libyuv's fixed-point BT.601 kernels (used for 8-bit 4:2:0 and 4:2:2 when libavif is built with
+// AVIF_LOCAL_LIBYUV) must stay within these bounds of the float conversions.
+#define MAX_LIBYUV_RGB_TO_YUV_DIFF 2
+#define MAX_LIBYUV_YUV_TO_RGB_DIFF 3
+
 #define NEXTARG()                                                     \
     if (((argIndex + 1) == argc) || (argv[argIndex + 1][0] == '-')) { \
         fprintf(stderr, "%s requires an argument.", arg);             \
@@ -43,6 +53,173 @@ static const char * rgbFormatToString(avifRGBFormat format)
     return "Unknown";
 }
 
+static void referenceStore(avifImage * image, int chan, uint32_t i, uint32_t j, float v, avifReformatMode mode)
+{
+    if ((chan != AVIF_CHAN_Y) && (mode != AVIF_REFORMAT_MODE_IDENTITY)) {
+        v += 0.5f;
+    }
+    v = (v < 0.0f) ? 0.0f : ((v > 1.0f) ? 1.0f : v);
+    int unorm = (int)floorf((v * (float)((1 << image->depth) - 1)) + 0.5f);
+    if (image->yuvRange == AVIF_RANGE_LIMITED) {
+        if ((chan == AVIF_CHAN_Y) || (mode == AVIF_REFORMAT_MODE_IDENTITY)) {
+            unorm = avifFullToLimitedY(image->depth, unorm);
+        } else {
+            unorm = avifFullToLimitedUV(image->depth, unorm);
+        }
+    }
+
+    uint8_t * row = &image->yuvPlanes[chan][j * image->yuvRowBytes[chan]];
+    if (image->depth > 8) {
+        ((uint16_t *)row)[i] = (uint16_t)unorm;
+    } else {
+        row[i] = (uint8_t)unorm;
+    }
+}
+
+// The original per-pixel RGB -> YUV conversion (2x2 blocks, averaging subsampled chroma in float),
+// kept here as the reference for the run-based kernels in reformat.c.
+static void referenceRGBToYUV(avifImage * image, avifRGBImage * rgb)
+{
+    avifReformatState state;
+    avifPrepareReformatState(image, rgb, &state);
+    avifImageAllocatePlanes(image, AVIF_PLANES_YUV);
+
+    const float rgbMaxChannel = (float)((1 << rgb->depth) - 1);
+    const uint32_t shiftX = state.formatInfo.chromaShiftX;
+    const uint32_t shiftY = state.formatInfo.chromaShiftY;
+    float u[2][2], v[2][2];
+    for (uint32_t outerJ = 0; outerJ < image->height; outerJ += 2) {
+        for (uint32_t outerI = 0; outerI < image->width; outerI += 2) {
+            const int blockW = ((outerI + 1) >= image->width) ? 1 : 2;
+            const int blockH = ((outerJ + 1) >= image->height) ? 1 : 2;
+            for (int bJ = 0; bJ < blockH; ++bJ) {
+                for (int bI = 0; bI < blockW; ++bI) {
+                    const uint32_t i = outerI + bI;
+                    const uint32_t j = outerJ + bJ;
+                    const uint8_t * pixel = &rgb->pixels[(i * state.rgbPixelBytes) + (j * rgb->rowBytes)];
+                    float rgbPixel[3];
+                    if (state.rgbChannelBytes > 1) {
+                        rgbPixel[0] = *((const uint16_t *)&pixel[state.rgbOffsetBytesR]) / rgbMaxChannel;
+                        rgbPixel[1] = *((const uint16_t *)&pixel[state.rgbOffsetBytesG]) / rgbMaxChannel;
+                        rgbPixel[2] = *((const uint16_t *)&pixel[state.rgbOffsetBytesB]) / rgbMaxChannel;
+                    } else {
+                        rgbPixel[0] = pixel[state.rgbOffsetBytesR] / rgbMaxChannel;
+                        rgbPixel[1] = pixel[state.rgbOffsetBytesG] / rgbMaxChannel;
+                        rgbPixel[2] = pixel[state.rgbOffsetBytesB] / rgbMaxChannel;
+                    }
+
+                    float y;
+                    if (state.mode == AVIF_REFORMAT_MODE_IDENTITY) {
+                        y = rgbPixel[1];
+                        u[bI][bJ] = rgbPixel[2];
+                        v[bI][bJ] = rgbPixel[0];
+                    } else {
+                        y = (state.kr * rgbPixel[0]) + (state.kg * rgbPixel[1]) + (state.kb * rgbPixel[2]);
+                        u[bI][bJ] = (rgbPixel[2] - y) / (2 * (1 - state.kb));
+                        v[bI][bJ] = (rgbPixel[0] - y) / (2 * (1 - state.kr));
+                    }
+                    referenceStore(image, AVIF_CHAN_Y, i, j, y, state.mode);
+                }
+            }
+
+            if (state.formatInfo.monochrome) {
+                continue;
+            }
+
+            // Average each block of subsampled chroma (a single sample for 4:4:4)
+            const int uvBlockW = shiftX ? blockW : 1;
+            const int uvBlockH = shiftY ? blockH : 1;
+            for (int bJ = 0; bJ < blockH; bJ += uvBlockH) {
+                for (int bI = 0; bI < blockW; bI += uvBlockW) {
+                    float sumU = 0.0f;
+                    float sumV = 0.0f;
+                    for (int sJ = 0; sJ < uvBlockH; ++sJ) {
+                        for (int sI = 0; sI < uvBlockW; ++sI) {
+                            sumU += u[bI + sI][bJ + sJ];
+                            sumV += v[bI + sI][bJ + sJ];
+                        }
+                    }
+                    const float totalSamples = (float)(uvBlockW * uvBlockH);
+                    const uint32_t uvI = (outerI + bI) >> shiftX;
+                    const uint32_t uvJ = (outerJ + bJ) >> shiftY;
+                    referenceStore(image, AVIF_CHAN_U, uvI, uvJ, sumU / totalSamples, state.mode);
+                    referenceStore(image, AVIF_CHAN_V, uvI, uvJ, sumV / totalSamples, state.mode);
+                }
+            }
+        }
+    }
+}
+
+// Returns the largest difference between the YUV planes of image and refImage
+static int comparePlanes(const avifImage * image, const avifImage * refImage, avifBool verbose, uint64_t * diffSampleCount, uint64_t * totalSampleCount)
+{
+    avifPixelFormatInfo formatInfo;
+    avifGetPixelFormatInfo(image->yuvFormat, &formatInfo);
+
+    int maxDiff = 0;
+    const int lastChan = formatInfo.monochrome ? AVIF_CHAN_Y : AVIF_CHAN_V;
+    for (int chan = AVIF_CHAN_Y; chan <= lastChan; ++chan) {
+        const uint32_t shiftX = (chan == AVIF_CHAN_Y) ? 0 : formatInfo.chromaShiftX;
+        const uint32_t shiftY = (chan == AVIF_CHAN_Y) ? 0 : formatInfo.chromaShiftY;
+        const uint32_t planeWidth = (image->width + shiftX) >> shiftX;
+        const uint32_t planeHeight = (image->height + shiftY) >> shiftY;
+        for (uint32_t j = 0; j < planeHeight; ++j) {
+            const uint8_t * row = &image->yuvPlanes[chan][j * image->yuvRowBytes[chan]];
+            const uint8_t * refRow = &refImage->yuvPlanes[chan][j * refImage->yuvRowBytes[chan]];
+            for (uint32_t i = 0; i < planeWidth; ++i) {
+                int diff;
+                if (image->depth > 8) {
+                    diff = abs((int)((const uint16_t *)row)[i] - (int)((const uint16_t *)refRow)[i]);
+                } else {
+                    diff = abs((int)row[i] - (int)refRow[i]);
+                }
+                if (diff > 0) {
+                    ++(*diffSampleCount);
+                    if (maxDiff < diff) {
+                        maxDiff = diff;
+                    }
+                    if (verbose) {
+                        printf("depth:%2d yuvFormat:%d matrixCoeffs:%d %ux%u chan:%d (%u,%u) diff:%d\n",
+                               image->depth,
+                               image->yuvFormat,
+                               image->nclx.matrixCoefficients,
+                               image->width,
+                               image->height,
+                               chan,
+                               i,
+                               j,
+                               diff);
+                    }
+                }
+                ++(*totalSampleCount);
+            }
+        }
+    }
+    return maxDiff;
+}
+
+// Returns the largest difference between two 8-bit RGB images of the same format
+static int compareRGB8(const avifRGBImage * rgb, const avifRGBImage * refRGB, uint64_t * diffSampleCount, uint64_t * totalSampleCount)
+{
+    const uint32_t rowSamples = rgb->width * avifRGBFormatChannelCount(rgb->format);
+    int maxDiff = 0;
+    for (uint32_t j = 0; j < rgb->height; ++j) {
+        const uint8_t * row = &rgb->pixels[j * rgb->rowBytes];
+        const uint8_t * refRow = &refRGB->pixels[j * refRGB->rowBytes];
+        for (uint32_t i = 0; i < rowSamples; ++i) {
+            const int diff = abs((int)row[i] - (int)refRow[i]);
+            if (diff > 0) {
+                ++(*diffSampleCount);
+                if (maxDiff < diff) {
+                    maxDiff = diff;
+                }
+            }
+            ++(*totalSampleCount);
+        }
+    }
+    return maxDiff;
+}
+
 int main(int argc, char * argv[])
 {
     (void)argc;
@@ -65,6 +242,12 @@ int main(int argc, char * argv[])
                 mode = 1;
             } else if (!strcmp(arg, "rgb")) {
                 mode = 2;
+            } else if (!strcmp(arg, "rgbtoyuv")) {
+                mode = 3;
+            } else if (!strcmp(arg, "libyuv")) {
+                mode = 4;
+            } else if (!strcmp(arg, "scaled")) {
+                mode = 5;
             } else {
                 mode = atoi(arg);
             }
@@ -378,6 +561,322 @@ int main(int argc, char * argv[])
             avifRGBImageFreePixels(&srcRGB);
         }
         avifImageDestroy(image);
+    } else if (mode == 3) {
+        // Compare the run-based, multithreaded avifImageRGBToYUV() against the per-pixel reference
+
+        const uint32_t rgbDepths[] = { 8, 10, 12, 16 };
+        const avifPixelFormat yuvFormats[] = { AVIF_PIXEL_FORMAT_YUV444,
+                                               AVIF_PIXEL_FORMAT_YUV422,
+                                               AVIF_PIXEL_FORMAT_YUV420,
+                                               AVIF_PIXEL_FORMAT_YUV400 };
+        const avifNclxMatrixCoefficients matrixCoeffsList[] = { AVIF_NCLX_MATRIX_COEFFICIENTS_BT601,
+                                                                AVIF_NCLX_MATRIX_COEFFICIENTS_BT709,
+                                                                AVIF_NCLX_MATRIX_COEFFICIENTS_IDENTITY };
+        const avifRange ranges[] = { AVIF_RANGE_FULL, AVIF_RANGE_LIMITED };
+        const uint32_t sizes[][2] = { { 1, 1 }, { 3, 5 }, { 17, 9 }, { 71, 67 }, { 33, 130 } };
+        const int maxThreadsList[] = { 1, 3, 8 };
+
+        int maxDiff = 0;
+        uint64_t diffSampleCount = 0;
+        uint64_t totalSampleCount = 0;
+        uint32_t seed = 1;
+        for (int yuvDepthIndex = 0; yuvDepthIndex < yuvDepthsCount; ++yuvDepthIndex) {
+            for (int rgbDepthIndex = 0; rgbDepthIndex < 4; ++rgbDepthIndex) {
+                for (int yuvFormatIndex = 0; yuvFormatIndex < 4; ++yuvFormatIndex) {
+                    for (int matrixCoeffsIndex = 0; matrixCoeffsIndex < 3; ++matrixCoeffsIndex) {
+                        for (int rangeIndex = 0; rangeIndex < 2; ++rangeIndex) {
+                            for (int rgbFormat = AVIF_RGB_FORMAT_RGB; rgbFormat <= AVIF_RGB_FORMAT_ABGR; ++rgbFormat) {
+                                for (int sizeIndex = 0; sizeIndex < 5; ++sizeIndex) {
+                                    const uint32_t width = sizes[sizeIndex][0];
+                                    const uint32_t height = sizes[sizeIndex][1];
+                                    const uint32_t yuvDepth = yuvDepths[yuvDepthIndex];
+
+                                    avifNclxColorProfile nclx;
+                                    nclx.colourPrimaries = AVIF_NCLX_COLOUR_PRIMARIES_BT709;
+                                    nclx.transferCharacteristics = AVIF_NCLX_TRANSFER_CHARACTERISTICS_SRGB;
+                                    nclx.matrixCoefficients = matrixCoeffsList[matrixCoeffsIndex];
+                                    nclx.range = ranges[rangeIndex];
+
+                                    avifImage * image = avifImageCreate(width, height, yuvDepth, yuvFormats[yuvFormatIndex]);
+                                    avifImageSetProfileNCLX(image, &nclx);
+                                    image->yuvRange = nclx.range;
+                                    avifImage * refImage = avifImageCreate(width, height, yuvDepth, yuvFormats[yuvFormatIndex]);
+                                    avifImageSetProfileNCLX(refImage, &nclx);
+                                    refImage->yuvRange = nclx.range;
+
+                                    avifRGBImage rgb;
+                                    avifRGBImageSetDefaults(&rgb, image);
+                                    rgb.depth = rgbDepths[rgbDepthIndex];
+                                    rgb.format = (avifRGBFormat)rgbFormat;
+                                    rgb.maxThreads = maxThreadsList[sizeIndex % 3];
+                                    rgb.avoidLibYUV = AVIF_TRUE;
+                                    avifRGBImageAllocatePixels(&rgb);
+                                    const uint32_t rgbMaxChannel = (1 << rgb.depth) - 1;
+                                    const uint32_t channelCount = avifRGBFormatChannelCount(rgb.format);
+                                    for (uint32_t j = 0; j < height; ++j) {
+                                        for (uint32_t i = 0; i < width * channelCount; ++i) {
+                                            seed = (seed * 1103515245) + 12345;
+                                            const uint32_t value = (seed >> 8) & rgbMaxChannel;
+                                            if (rgb.depth > 8) {
+                                                ((uint16_t *)&rgb.pixels[j * rgb.rowBytes])[i] = (uint16_t)value;
+                                            } else {
+                                                rgb.pixels[(j * rgb.rowBytes) + i] = (uint8_t)value;
+                                            }
+                                        }
+                                    }
+
+                                    if (sizeIndex & 1) {
+                                        // Also cover avifImageRGBToYUVRows(): feed the same pixels in small bands
+                                        const uint32_t bandRows = 6;
+                                        for (uint32_t firstRow = 0; firstRow < height; firstRow += bandRows) {
+                                            avifRGBImage bandRGB = rgb;
+                                            bandRGB.pixels = &rgb.pixels[firstRow * rgb.rowBytes];
+                                            const uint32_t rowCount = ((height - firstRow) < bandRows) ? (height - firstRow) : bandRows;
+                                            avifImageRGBToYUVRows(image, &bandRGB, firstRow, rowCount);
+                                        }
+                                    } else {
+                                        avifImageRGBToYUV(image, &rgb);
+                                    }
+                                    referenceRGBToYUV(refImage, &rgb);
+
+                                    const int diff = comparePlanes(image, refImage, verbose, &diffSampleCount, &totalSampleCount);
+                                    if (maxDiff < diff) {
+                                        maxDiff = diff;
+                                    }
+
+                                    avifRGBImageFreePixels(&rgb);
+                                    avifImageDestroy(image);
+                                    avifImageDestroy(refImage);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        printf(" * RGB -> YUV: %" PRIu64 " / %" PRIu64 " samples differ from the reference, maxDiff: %d\n",
+               diffSampleCount,
+               totalSampleCount,
+               maxDiff);
+        if (maxDiff > MAX_RGB_TO_YUV_DIFF) {
+            printf("ERROR: Encountered a difference greater than MAX_RGB_TO_YUV_DIFF(%d): %d\n", MAX_RGB_TO_YUV_DIFF, maxDiff);
+            return 1;
+        }
+    } else if (mode == 4) {
+        // Bound the error of the libyuv kernels against the float conversions, in both directions.
+        // Without libyuv this compares the generic path against itself and the reference.
+
+        printf(" * libyuv version: %u\n", avifLibYUVVersion());
+
+        const avifPixelFormat yuvFormats[] = { AVIF_PIXEL_FORMAT_YUV422, AVIF_PIXEL_FORMAT_YUV420 };
+        const avifRange ranges[] = { AVIF_RANGE_FULL, AVIF_RANGE_LIMITED };
+        const uint32_t sizes[][2] = { { 1, 1 }, { 3, 5 }, { 17, 9 }, { 71, 67 }, { 33, 130 } };
+        const int maxThreadsList[] = { 1, 3, 8 };
+
+        int maxRGBToYUVDiff = 0;
+        int maxYUVToRGBDiff = 0;
+        uint64_t rgbToYUVDiffCount = 0;
+        uint64_t rgbToYUVTotalCount = 0;
+        uint64_t yuvToRGBDiffCount = 0;
+        uint64_t yuvToRGBTotalCount = 0;
+        uint32_t seed = 1;
+        for (int yuvFormatIndex = 0; yuvFormatIndex < 2; ++yuvFormatIndex) {
+            for (int rangeIndex = 0; rangeIndex < 2; ++rangeIndex) {
+                for (int rgbFormat = AVIF_RGB_FORMAT_RGB; rgbFormat <= AVIF_RGB_FORMAT_ABGR; ++rgbFormat) {
+                    for (int sizeIndex = 0; sizeIndex < 5; ++sizeIndex) {
+                        const uint32_t width = sizes[sizeIndex][0];
+                        const uint32_t height = sizes[sizeIndex][1];
+
+                        avifNclxColorProfile nclx;
+                        nclx.colourPrimaries = AVIF_NCLX_COLOUR_PRIMARIES_BT709;
+                        nclx.transferCharacteristics = AVIF_NCLX_TRANSFER_CHARACTERISTICS_SRGB;
+                        nclx.matrixCoefficients = AVIF_NCLX_MATRIX_COEFFICIENTS_BT601;
+                        nclx.range = ranges[rangeIndex];
+
+                        avifImage * image = avifImageCreate(width, height, 8, yuvFormats[yuvFormatIndex]);
+                        avifImageSetProfileNCLX(image, &nclx);
+                        image->yuvRange = nclx.range;
+                        avifImage * refImage = avifImageCreate(width, height, 8, yuvFormats[yuvFormatIndex]);
+                        avifImageSetProfileNCLX(refImage, &nclx);
+                        refImage->yuvRange = nclx.range;
+
+                        avifRGBImage rgb;
+                        avifRGBImageSetDefaults(&rgb, image);
+                        rgb.format = (avifRGBFormat)rgbFormat;
+                        rgb.maxThreads = maxThreadsList[sizeIndex % 3];
+                        avifRGBImageAllocatePixels(&rgb);
+                        avifRGBImage refRGB;
+                        avifRGBImageSetDefaults(&refRGB, image);
+                        refRGB.format = rgb.format;
+                        refRGB.avoidLibYUV = AVIF_TRUE;
+                        avifRGBImageAllocatePixels(&refRGB);
+
+                        // RGB -> YUV, against the per-pixel reference
+                        for (uint32_t j = 0; j < height; ++j) {
+                            for (uint32_t i = 0; i < width * avifRGBFormatChannelCount(rgb.format); ++i) {
+                                seed = (seed * 1103515245) + 12345;
+                                rgb.pixels[(j * rgb.rowBytes) + i] = (uint8_t)(seed >> 8);
+                            }
+                        }
+                        avifImageRGBToYUV(image, &rgb);
+                        referenceRGBToYUV(refImage, &rgb);
+                        int diff = comparePlanes(image, refImage, verbose, &rgbToYUVDiffCount, &rgbToYUVTotalCount);
+                        if (maxRGBToYUVDiff < diff) {
+                            maxRGBToYUVDiff = diff;
+                        }
+
+                        // YUV -> RGB from random planes (alpha included, which must survive the color
+                        // kernels untouched), against the generic path. Limited range samples stay within
+                        // [16, 235] (Y) and [16, 240] (UV): the generic path clamps codepoints outside of
+                        // those before converting, libyuv doesn't.
+                        avifImageAllocatePlanes(image, AVIF_PLANES_A);
+                        const uint32_t uvHeight = (yuvFormats[yuvFormatIndex] == AVIF_PIXEL_FORMAT_YUV420) ? ((height + 1) >> 1) : height;
+                        for (int chan = AVIF_CHAN_Y; chan <= AVIF_CHAN_V; ++chan) {
+                            const uint32_t planeHeight = (chan == AVIF_CHAN_Y) ? height : uvHeight;
+                            const uint32_t minValue = (image->yuvRange == AVIF_RANGE_LIMITED) ? 16 : 0;
+                            const uint32_t valueCount = (image->yuvRange == AVIF_RANGE_LIMITED) ? ((chan == AVIF_CHAN_Y) ? 220 : 225) : 256;
+                            for (uint32_t k = 0; k < image->yuvRowBytes[chan] * planeHeight; ++k) {
+                                seed = (seed * 1103515245) + 12345;
+                                image->yuvPlanes[chan][k] = (uint8_t)(minValue + ((seed >> 8) % valueCount));
+                            }
+                        }
+                        for (uint32_t k = 0; k < image->alphaRowBytes * height; ++k) {
+                            seed = (seed * 1103515245) + 12345;
+                            image->alphaPlane[k] = (uint8_t)(seed >> 8);
+                        }
+                        avifImageYUVToRGB(image, &rgb);
+                        avifImageYUVToRGB(image, &refRGB);
+                        diff = compareRGB8(&rgb, &refRGB, &yuvToRGBDiffCount, &yuvToRGBTotalCount);
+                        if (maxYUVToRGBDiff < diff) {
+                            maxYUVToRGBDiff = diff;
+                        }
+
+                        avifRGBImageFreePixels(&rgb);
+                        avifRGBImageFreePixels(&refRGB);
+                        avifImageDestroy(image);
+                        avifImageDestroy(refImage);
+                    }
+                }
+            }
+        }
+
+        printf(" * RGB -> YUV: %" PRIu64 " / %" PRIu64 " samples differ from the reference, maxDiff: %d\n",
+               rgbToYUVDiffCount,
+               rgbToYUVTotalCount,
+               maxRGBToYUVDiff);
+        printf(" * YUV -> RGB: %" PRIu64 " / %" PRIu64 " samples differ from the generic path, maxDiff: %d\n",
+               yuvToRGBDiffCount,
+               yuvToRGBTotalCount,
+               maxYUVToRGBDiff);
+        if (maxRGBToYUVDiff > MAX_LIBYUV_RGB_TO_YUV_DIFF) {
+            printf("ERROR: Encountered a difference greater than MAX_LIBYUV_RGB_TO_YUV_DIFF(%d): %d\n",
+                   MAX_LIBYUV_RGB_TO_YUV_DIFF,
+                   maxRGBToYUVDiff);
+            return 1;
+        }
+        if (maxYUVToRGBDiff > MAX_LIBYUV_YUV_TO_RGB_DIFF) {
+            printf("ERROR: Encountered a difference greater than MAX_LIBYUV_YUV_TO_RGB_DIFF(%d): %d\n",
+                   MAX_LIBYUV_YUV_TO_RGB_DIFF,
+                   maxYUVToRGBDiff);
+            return 1;
+        }
+    } else if (mode == 5) {
+        // avifImageYUVToRGBScaled() at the image's own size averages boxes of a single pixel, so it
+        // must match avifImageYUVToRGB() exactly. Also shrink each image to exercise uneven boxes.
+
+        const avifPixelFormat yuvFormats[] = { AVIF_PIXEL_FORMAT_YUV444, AVIF_PIXEL_FORMAT_YUV420, AVIF_PIXEL_FORMAT_YUV400 };
+        const uint32_t rgbDepths[] = { 8, 16 };
+        const avifRange ranges[] = { AVIF_RANGE_FULL, AVIF_RANGE_LIMITED };
+        const uint32_t sizes[][2] = { { 1, 1 }, { 3, 5 }, { 17, 9 }, { 71, 67 }, { 33, 130 } };
+        const int maxThreadsList[] = { 1, 3, 8 };
+
+        uint64_t diffRowCount = 0;
+        uint64_t totalRowCount = 0;
+        int failedCount = 0;
+        uint32_t seed = 1;
+        for (int yuvDepthIndex = 0; yuvDepthIndex < yuvDepthsCount; ++yuvDepthIndex) {
+            for (int yuvFormatIndex = 0; yuvFormatIndex < 3; ++yuvFormatIndex) {
+                for (int rgbDepthIndex = 0; rgbDepthIndex < 2; ++rgbDepthIndex) {
+                    for (int rangeIndex = 0; rangeIndex < 2; ++rangeIndex) {
+                        for (int sizeIndex = 0; sizeIndex < 5; ++sizeIndex) {
+                            const uint32_t width = sizes[sizeIndex][0];
+                            const uint32_t height = sizes[sizeIndex][1];
+                            const uint32_t yuvDepth = yuvDepths[yuvDepthIndex];
+
+                            avifImage * image = avifImageCreate(width, height, yuvDepth, yuvFormats[yuvFormatIndex]);
+                            image->yuvRange = ranges[rangeIndex];
+                            image->alphaRange = ranges[rangeIndex];
+                            avifImageAllocatePlanes(image, AVIF_PLANES_YUV);
+                            if (sizeIndex & 1) {
+                                avifImageAllocatePlanes(image, AVIF_PLANES_A);
+                            }
+                            const uint32_t yuvMaxChannel = (1 << yuvDepth) - 1;
+                            uint8_t * planes[4] = { image->yuvPlanes[AVIF_CHAN_Y], image->yuvPlanes[AVIF_CHAN_U], image->yuvPlanes[AVIF_CHAN_V], image->alphaPlane };
+                            const uint32_t planeRowBytes[4] = { image->yuvRowBytes[AVIF_CHAN_Y], image->yuvRowBytes[AVIF_CHAN_U], image->yuvRowBytes[AVIF_CHAN_V], image->alphaRowBytes };
+                            const uint32_t uvHeight = (yuvFormats[yuvFormatIndex] == AVIF_PIXEL_FORMAT_YUV420) ? ((height + 1) >> 1) : height;
+                            for (int plane = 0; plane < 4; ++plane) {
+                                if (!planes[plane]) {
+                                    continue;
+                                }
+                                const uint32_t planeHeight = ((plane == 1) || (plane == 2)) ? uvHeight : height;
+                                for (uint32_t k = 0; k < (planeRowBytes[plane] * planeHeight) / ((yuvDepth > 8) ? 2 : 1); ++k) {
+                                    seed = (seed * 1103515245) + 12345;
+                                    const uint32_t value = (seed >> 8) & yuvMaxChannel;
+                                    if (yuvDepth > 8) {
+                                        ((uint16_t *)planes[plane])[k] = (uint16_t)value;
+                                    } else {
+                                        planes[plane][k] = (uint8_t)value;
+                                    }
+                                }
+                            }
+
+                            avifRGBImage rgb;
+                            avifRGBImageSetDefaults(&rgb, image);
+                            rgb.depth = rgbDepths[rgbDepthIndex];
+                            rgb.avoidLibYUV = AVIF_TRUE;
+                            avifRGBImageAllocatePixels(&rgb);
+                            avifRGBImage scaledRGB = rgb;
+                            scaledRGB.pixels = NULL;
+                            scaledRGB.maxThreads = maxThreadsList[sizeIndex % 3];
+                            avifRGBImageAllocatePixels(&scaledRGB);
+
+                            avifImageYUVToRGB(image, &rgb);
+                            if (avifImageYUVToRGBScaled(image, &scaledRGB) != AVIF_RESULT_OK) {
+                                ++failedCount;
+                            }
+                            for (uint32_t j = 0; j < height; ++j) {
+                                if (memcmp(&rgb.pixels[j * rgb.rowBytes], &scaledRGB.pixels[j * scaledRGB.rowBytes], rgb.rowBytes)) {
+                                    ++diffRowCount;
+                                }
+                                ++totalRowCount;
+                            }
+                            avifRGBImageFreePixels(&scaledRGB);
+
+                            scaledRGB.width = (width + 2) / 3;
+                            scaledRGB.height = (height + 1) / 2;
+                            avifRGBImageAllocatePixels(&scaledRGB);
+                            if (avifImageYUVToRGBScaled(image, &scaledRGB) != AVIF_RESULT_OK) {
+                                ++failedCount;
+                            }
+
+                            avifRGBImageFreePixels(&scaledRGB);
+                            avifRGBImageFreePixels(&rgb);
+                            avifImageDestroy(image);
+                        }
+                    }
+                }
+            }
+        }
+
+        printf(" * Scaled YUV -> RGB: %" PRIu64 " / %" PRIu64 " full size rows differ from avifImageYUVToRGB(), %d conversions failed\n",
+               diffRowCount,
+               totalRowCount,
+               failedCount);
+        if (diffRowCount || failedCount) {
+            printf("ERROR: avifImageYUVToRGBScaled() is not consistent with avifImageYUVToRGB()\n");
+            return 1;
+        }
     }
     return 0;
 }
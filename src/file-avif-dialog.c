@@ -52,6 +52,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <avif/avif.h>
 
 #include "file-avif-dialog.h"
+#include "file-avif-preview.h"
 
 static void
 save_dialog_min_quantizer_changed ( GObject          *config,
@@ -86,6 +87,41 @@ save_dialog_max_quantizer_changed ( GObject          *config,
     }
 }
 
+/* scale entries which only make sense with or without a quality target */
+typedef struct
+{
+  GtkAdjustment *min_quantizer;
+  GtkAdjustment *max_quantizer;
+  GtkAdjustment *target_size;
+  GtkAdjustment *target_psnr;
+  GtkAdjustment *target_ssim;
+} AvifPluginTargetWidgets;
+
+static void
+save_dialog_target_mode_changed ( GObject          *config,
+                                  const GParamSpec *pspec,
+                                  gpointer          user_data )
+{
+  AvifPluginTargetWidgets *widgets = user_data;
+  gint                     target_mode = AVIF_ENCODER_TARGET_NONE;
+  gboolean                 animation = FALSE;
+
+  g_object_get ( config, "target-mode", &target_mode,
+                 "animation", &animation,
+                 NULL );
+
+  if ( animation ) //animations ignore the target and keep the quantizers
+    {
+      target_mode = AVIF_ENCODER_TARGET_NONE;
+    }
+
+  gimp_scale_entry_set_sensitive ( widgets->min_quantizer, target_mode == AVIF_ENCODER_TARGET_NONE );
+  gimp_scale_entry_set_sensitive ( widgets->max_quantizer, target_mode == AVIF_ENCODER_TARGET_NONE );
+  gimp_scale_entry_set_sensitive ( widgets->target_size, target_mode == AVIF_ENCODER_TARGET_SIZE );
+  gimp_scale_entry_set_sensitive ( widgets->target_psnr, target_mode == AVIF_ENCODER_TARGET_PSNR );
+  gimp_scale_entry_set_sensitive ( widgets->target_ssim, target_mode == AVIF_ENCODER_TARGET_SSIM );
+}
+
 static GtkListStore*
 avifplugin_create_codec_store ( GObject       *config )
 {
@@ -131,6 +167,7 @@ avifplugin_create_codec_store ( GObject       *config )
 }
 
 gboolean   save_dialog ( GimpImage     *image,
+                         GimpDrawable  *drawable,
                          GimpProcedure *procedure,
                          GObject       *config )
 {
@@ -140,8 +177,12 @@ gboolean   save_dialog ( GimpImage     *image,
   GtkWidget     *toggle;
   GtkListStore  *store;
   GtkWidget     *combo;
+  GtkWidget     *label;
+  AvifPluginTargetWidgets target_widgets;
+  AvifPluginPreview      *preview;
 
   gboolean       bitdepth12_supported = FALSE;
+  gboolean       animation = FALSE;
   gboolean       run;
   gint           row = 0;
 
@@ -191,7 +232,44 @@ gboolean   save_dialog ( GimpImage     *image,
   gtk_box_pack_start ( GTK_BOX ( vbox ), grid, FALSE, FALSE, 0 );
   gtk_widget_show ( grid );
 
-  /* GtkAdjustment *min_quantizer_scale = */
+  /* Create the combobox choosing between the quantizers and a quality target */
+  store = gimp_int_store_new ( "None (use the quantizers)", AVIF_ENCODER_TARGET_NONE,
+                               "File size",                 AVIF_ENCODER_TARGET_SIZE,
+                               "PSNR",                      AVIF_ENCODER_TARGET_PSNR,
+                               "SSIM",                      AVIF_ENCODER_TARGET_SSIM,
+                               NULL );
+  combo = gimp_prop_int_combo_box_new ( config, "target-mode",
+                                        GIMP_INT_STORE ( store ) );
+  g_object_unref ( store );
+  g_object_get ( config, "animation", &animation, NULL );
+  gtk_widget_set_sensitive ( combo, ! animation );
+
+  gimp_grid_attach_aligned ( GTK_GRID ( grid ), 0, row++,
+                             "Quality target:", 0.0, 0.5,
+                             combo, 2 );
+
+  target_widgets.target_size =
+    gimp_prop_scale_entry_new ( config, "target-size",
+                                GTK_GRID ( grid ), 0, row++,
+                                "Target size (KiB):",
+                                1.0, 10.0, 0,
+                                TRUE, 1, 10000 );
+
+  target_widgets.target_psnr =
+    gimp_prop_scale_entry_new ( config, "target-psnr",
+                                GTK_GRID ( grid ), 0, row++,
+                                "Target PSNR (dB):",
+                                0.5, 5.0, 1,
+                                FALSE, 0, 0 );
+
+  target_widgets.target_ssim =
+    gimp_prop_scale_entry_new ( config, "target-ssim",
+                                GTK_GRID ( grid ), 0, row++,
+                                "Target SSIM:",
+                                0.005, 0.05, 3,
+                                FALSE, 0, 0 );
+
+  target_widgets.min_quantizer =
   gimp_prop_scale_entry_new ( config, "min-quantizer",
                               GTK_GRID ( grid ), 0, row++,
                               "Quantizer (Min):",
@@ -201,7 +279,7 @@ gboolean   save_dialog ( GimpImage     *image,
                      G_CALLBACK ( save_dialog_min_quantizer_changed ),
                      NULL );
 
-  /* GtkAdjustment *max_quantizer_scale = */
+  target_widgets.max_quantizer =
   gimp_prop_scale_entry_new ( config, "max-quantizer",
                               GTK_GRID ( grid ), 0, row++,
                               "Quantizer (Max):",
@@ -211,6 +289,11 @@ gboolean   save_dialog ( GimpImage     *image,
                      G_CALLBACK ( save_dialog_max_quantizer_changed ),
                      NULL );
 
+  g_signal_connect ( config, "notify::target-mode",
+                     G_CALLBACK ( save_dialog_target_mode_changed ),
+                     &target_widgets );
+  save_dialog_target_mode_changed ( config, NULL, &target_widgets );
+
   if ( alpha_supported )
     {
       gimp_prop_scale_entry_new ( config, "alpha-quantizer",
@@ -289,12 +372,26 @@ gboolean   save_dialog ( GimpImage     *image,
                                         "Save ICC color profile" );
   gtk_box_pack_start ( GTK_BOX ( vbox ), toggle, FALSE, FALSE, 0 );
 
+  /* Estimated size, quality and export time, updated in the background as settings change */
+  label = gtk_label_new ( NULL );
+  gtk_label_set_xalign ( GTK_LABEL ( label ), 0.0 );
+  gtk_label_set_line_wrap ( GTK_LABEL ( label ), TRUE );
+  gimp_help_set_help_data ( label,
+                            "Extrapolated from encoding a few crops of the active layer, without metadata",
+                            NULL );
+  gtk_box_pack_start ( GTK_BOX ( vbox ), label, FALSE, FALSE, 0 );
+  gtk_widget_show ( label );
+
+  preview = avifplugin_preview_new ( image, drawable, config, GTK_LABEL ( label ) );
 
 
   gtk_widget_show ( dialog );
 
   run = gimp_procedure_dialog_run ( GIMP_PROCEDURE_DIALOG ( dialog ) );
 
+  avifplugin_preview_free ( preview );
+  g_signal_handlers_disconnect_by_func ( config, save_dialog_target_mode_changed, &target_widgets );
+
   gtk_widget_destroy ( dialog );
 
   return run;
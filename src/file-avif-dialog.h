@@ -4,6 +4,7 @@
 
 
 gboolean   save_dialog (GimpImage     *image,
+                        GimpDrawable  *drawable,
                         GimpProcedure *procedure,
                         GObject       *config);
 
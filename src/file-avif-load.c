@@ -84,6 +84,7 @@ DEALINGS IN THE SOFTWARE.
 #include <glib/gstdio.h>
 
 #include "file-avif-load.h"
+#include "file-avif-stats.h"
 
 #include "hlgCurveBinary.h"
 #include "pqCurveBinary.h"
@@ -216,6 +217,214 @@ static cmsHPROFILE _create_lcms_profile_from_NCLX ( const char *description_suff
   return profile;
 }
 
+/* Fallback for inputs that cannot be mapped (pipes, FIFOs, ...):
+   read until EOF, growing the buffer geometrically as we have no size up front. */
+static gboolean avifplugin_read_file_buffered ( const gchar *filename, avifRWData *raw )
+{
+  FILE * inputFile = g_fopen ( filename, "rb" );
+  if ( !inputFile )
+    {
+      g_message ( "Cannot open file for read: %s\n", filename );
+      return FALSE;
+    }
+
+  size_t used = 0;
+  avifRWDataRealloc ( raw, 64 * 1024 );
+
+  for ( ;; )
+    {
+      if ( used == raw->size )
+        {
+          avifRWDataRealloc ( raw, raw->size * 2 );
+        }
+
+      size_t bytes_read = fread ( raw->data + used, 1, raw->size - used, inputFile );
+      used += bytes_read;
+
+      if ( bytes_read == 0 )
+        {
+          break;
+        }
+    }
+
+  if ( ferror ( inputFile ) )
+    {
+      g_message ( "Failed to read %zu bytes: %s\n", used, filename );
+      fclose ( inputFile );
+      return FALSE;
+    }
+
+  fclose ( inputFile );
+
+  raw->size = used;
+  return TRUE;
+}
+
+static void avifplugin_input_free ( GMappedFile *mapped, avifRWData *raw )
+{
+  if ( mapped )
+    {
+      g_mapped_file_unref ( mapped );
+    }
+  avifRWDataFree ( raw );
+}
+
+/* Converts a decoded frame into layer, in bands of band_height rows held in rgb->pixels */
+static gboolean avifplugin_frame_to_layer ( avifImage *avif, avifRGBImage *rgb, uint32_t band_height, GimpLayer *layer,
+                                            AvifPluginStats *stats )
+{
+  GeglBuffer *buffer = gimp_drawable_get_buffer ( GIMP_DRAWABLE ( layer ) );
+  gboolean    success = TRUE;
+
+  for ( uint32_t band_y = 0; band_y < rgb->height; band_y += band_height )
+    {
+      uint32_t rows = MIN ( band_height, rgb->height - band_y );
+      gint64   start_time = g_get_monotonic_time ();
+
+      avifResult convertResult = avifImageYUVToRGBRows ( avif, rgb, band_y, rows );
+      stats->convert_time += g_get_monotonic_time () - start_time;
+      if ( convertResult != AVIF_RESULT_OK )
+        {
+          g_printerr ( "%s: Failed to convert rows %u-%u: %s\n", G_STRFUNC,
+                       band_y, band_y + rows - 1, avifResultToString ( convertResult ) );
+          success = FALSE;
+          break;
+        }
+
+      start_time = g_get_monotonic_time ();
+      gegl_buffer_set ( buffer, GEGL_RECTANGLE ( 0, band_y, rgb->width, rows ), 0,
+                        NULL, rgb->pixels, GEGL_AUTO_ROWSTRIDE );
+      stats->buffer_time += g_get_monotonic_time () - start_time;
+    }
+
+  g_object_unref ( buffer );
+  return success;
+}
+
+/* GIMP's animation playback picks the frame duration up from "(NNms)" in the layer name */
+static gchar * avifplugin_frame_layer_name ( gint index, const avifImageTiming *timing )
+{
+  return g_strdup_printf ( "Frame %d (%.0fms)", index + 1, timing->duration * 1000.0 );
+}
+
+/* Frames of an image sequence travel from the decoding thread to the main thread
+   through a small ring of reusable images, so decoding frame N+1 overlaps with
+   converting and uploading frame N. All GIMP calls stay on the main thread. */
+#define AVIFPLUGIN_FRAME_QUEUE_DEPTH 2
+
+typedef struct
+{
+  avifImage      *image;     /* deep copy, decoder->image is reused by the next frame */
+  avifImageTiming timing;
+  guint32         index;
+} AvifPluginFrame;
+
+typedef struct
+{
+  avifDecoder    *decoder;
+  GAsyncQueue    *free_frames;
+  GAsyncQueue    *ready_frames;
+  AvifPluginFrame end_of_stream;
+  gint            abort;     /* atomic, set by the main thread */
+  avifResult      result;    /* written by the decoding thread before end_of_stream */
+} AvifPluginFrameQueue;
+
+static gpointer avifplugin_decode_frames ( gpointer data )
+{
+  AvifPluginFrameQueue *queue = ( AvifPluginFrameQueue * ) data;
+  avifDecoder          *decoder = queue->decoder;
+
+  while ( ! g_atomic_int_get ( &queue->abort ) )
+    {
+      avifResult decodeResult = avifDecoderNextImage ( decoder );
+      if ( decodeResult == AVIF_RESULT_NO_IMAGES_REMAINING )
+        {
+          break;
+        }
+      if ( decodeResult != AVIF_RESULT_OK )
+        {
+          queue->result = decodeResult;
+          break;
+        }
+
+      /* blocks while the main thread still holds every frame */
+      AvifPluginFrame *frame = g_async_queue_pop ( queue->free_frames );
+      avifImageCopy ( frame->image, decoder->image );
+      frame->index = decoder->imageIndex;
+      avifDecoderNthImageTiming ( decoder, decoder->imageIndex, &frame->timing );
+      g_async_queue_push ( queue->ready_frames, frame );
+    }
+
+  g_async_queue_push ( queue->ready_frames, &queue->end_of_stream );
+  return NULL;
+}
+
+/* Applies the irot/imir transforms of the decoded image to the loaded GIMP image */
+static void avifplugin_apply_orientation ( GimpImage *image, const avifImage *avif )
+{
+  if ( avif->transformFlags & AVIF_TRANSFORM_IROT )
+    {
+      switch ( avif->irot.angle )
+        {
+        case 1:
+          gimp_image_rotate ( image, GIMP_ROTATE_270 );
+          break;
+        case 2:
+          gimp_image_rotate ( image, GIMP_ROTATE_180 );
+          break;
+        case 3:
+          gimp_image_rotate ( image, GIMP_ROTATE_90 );
+          break;
+        }
+    }
+
+  if ( avif->transformFlags & AVIF_TRANSFORM_IMIR )
+    {
+      switch ( avif->imir.axis )
+        {
+        case 0:
+          gimp_image_flip ( image, GIMP_ORIENTATION_VERTICAL );
+          break;
+        case 1:
+          gimp_image_flip ( image, GIMP_ORIENTATION_HORIZONTAL );
+          break;
+        }
+    }
+}
+
+/* Reads straight from a seekable GIO stream, so a parse only touches the bytes
+   libavif asks for instead of the whole file. */
+typedef struct
+{
+  GInputStream *stream;
+  avifRWData    buffer;
+} AvifPluginStreamReader;
+
+static avifResult avifplugin_read_stream ( void *userData, uint64_t offset, size_t size, avifROData *out )
+{
+  AvifPluginStreamReader *reader = ( AvifPluginStreamReader * ) userData;
+  gsize                   bytes_read = 0;
+
+  if ( ! g_seekable_seek ( G_SEEKABLE ( reader->stream ), ( goffset ) offset, G_SEEK_SET, NULL, NULL ) )
+    {
+      return AVIF_RESULT_IO_ERROR;
+    }
+
+  if ( reader->buffer.size < size )
+    {
+      avifRWDataRealloc ( &reader->buffer, size );
+    }
+
+  if ( ! g_input_stream_read_all ( reader->stream, reader->buffer.data, size, &bytes_read, NULL, NULL ) )
+    {
+      return AVIF_RESULT_IO_ERROR;
+    }
+
+  out->data = reader->buffer.data;
+  out->size = bytes_read;
+  return AVIF_RESULT_OK;
+}
+
 GimpImage * load_image ( GFile       *file,
                          gboolean     interactive,
                          GError     **error )
@@ -231,58 +440,78 @@ GimpImage * load_image ( GFile       *file,
 
   filename = g_file_get_path ( file );
 
-  FILE * inputFile = g_fopen ( filename, "rb" );
-  if ( !inputFile )
+  AvifPluginStats stats;
+  avifplugin_stats_begin ( &stats );
+
+  avifROData   input = AVIF_DATA_EMPTY;
+  avifRWData   raw = AVIF_DATA_EMPTY;
+  GMappedFile *mapped = NULL;
+
+  if ( g_file_test ( filename, G_FILE_TEST_IS_REGULAR ) )
     {
-      g_message ( "Cannot open file for read: %s\n", filename );
-      g_free ( filename );
-      return NULL;
+      GError *map_error = NULL;
+
+      /* regular files are mapped read-only and handed to libavif without a copy,
+         the mapping has to outlive the decoder */
+      mapped = g_mapped_file_new ( filename, FALSE, &map_error );
+      if ( mapped )
+        {
+          input.data = ( const uint8_t * ) g_mapped_file_get_contents ( mapped );
+          input.size = g_mapped_file_get_length ( mapped );
+        }
+      else
+        {
+          g_printerr ( "%s: Failed to map %s, falling back to buffered read: %s\n", G_STRFUNC, filename, map_error->message );
+          g_clear_error ( &map_error );
+        }
     }
-  fseek ( inputFile, 0, SEEK_END );
-  size_t inputFileSize = ftell ( inputFile );
-  fseek ( inputFile, 0, SEEK_SET );
 
-  if ( inputFileSize < 1 )
+  if ( !mapped )
     {
-      g_message ( "File too small: %s\n", filename );
-      fclose ( inputFile );
-      g_free ( filename );
-      return NULL;
+      if ( !avifplugin_read_file_buffered ( filename, &raw ) )
+        {
+          avifRWDataFree ( &raw );
+          g_free ( filename );
+          return NULL;
+        }
+      input.data = raw.data;
+      input.size = raw.size;
     }
 
-  avifRWData raw = AVIF_DATA_EMPTY;
-  avifRWDataRealloc ( &raw, inputFileSize );
-  if ( fread ( raw.data, 1, inputFileSize, inputFile ) != inputFileSize )
+  if ( input.size < 1 )
     {
-      g_message ( "Failed to read %zu bytes: %s\n", inputFileSize, filename );
-      fclose ( inputFile );
-      avifRWDataFree ( &raw );
-
+      g_message ( "File too small: %s\n", filename );
+      avifplugin_input_free ( mapped, &raw );
       g_free ( filename );
       return NULL;
     }
 
-  fclose ( inputFile );
-  inputFile = NULL;
-
-  if ( avifPeekCompatibleFileType ( ( avifROData * ) &raw ) == AVIF_FALSE )
+  if ( avifPeekCompatibleFileType ( &input ) == AVIF_FALSE )
     {
       g_message ( "File %s is probably not in AVIF format!\n", filename );
-      avifRWDataFree ( &raw );
+      avifplugin_input_free ( mapped, &raw );
       g_free ( filename );
       return NULL;
     }
 
+  gint num_threads = 1;
+  g_object_get ( gegl_config(), "threads", &num_threads, NULL );
+  if ( num_threads < 1 )
+    {
+      num_threads = 1;
+    }
+
   avifDecoder * decoder = avifDecoderCreate();
+  decoder->maxThreads = num_threads;
   avifResult decodeResult;
 
-  decodeResult = avifDecoderParse ( decoder, ( avifROData * ) &raw );
+  decodeResult = avifDecoderParse ( decoder, &input );
   if ( decodeResult != AVIF_RESULT_OK )
     {
       g_message ( "ERROR: Failed to parse input: %s\n", avifResultToString ( decodeResult ) );
 
       avifDecoderDestroy ( decoder );
-      avifRWDataFree ( &raw );
+      avifplugin_input_free ( mapped, &raw );
       g_free ( filename );
       return NULL;
     }
@@ -293,7 +522,7 @@ GimpImage * load_image ( GFile       *file,
       g_message ( "ERROR: Failed to decode image: %s\n", avifResultToString ( decodeResult ) );
 
       avifDecoderDestroy ( decoder );
-      avifRWDataFree ( &raw );
+      avifplugin_input_free ( mapped, &raw );
       g_free ( filename );
       return NULL;
     }
@@ -396,8 +625,7 @@ GimpImage * load_image ( GFile       *file,
     }
 
   avifRGBImage rgb;
-  rgb.width = avif->width;
-  rgb.height = avif->height;
+  avifRGBImageSetDefaults ( &rgb, avif );
 
   if ( avif->alphaPlane )
     {
@@ -412,118 +640,167 @@ GimpImage * load_image ( GFile       *file,
 
 
 
+  GimpPrecision precision;
+
   if ( avifImageUsesU16 ( avif ) ) //10 and 12 bit depth import
     {
-      if ( profile )
+      rgb.depth = 16;
+      precision = GIMP_PRECISION_U16_NON_LINEAR;
+      if ( profile && gimp_color_profile_is_linear ( profile ) )
         {
-          if ( gimp_color_profile_is_linear ( profile ) )
-            {
-              image = gimp_image_new_with_precision ( rgb.width, rgb.height, GIMP_RGB, GIMP_PRECISION_U16_LINEAR );
-            }
-          else
-            {
-              image = gimp_image_new_with_precision ( rgb.width, rgb.height, GIMP_RGB, GIMP_PRECISION_U16_NON_LINEAR );
-            }
-
-          if ( gimp_color_profile_is_rgb ( profile ) )
-            {
-              gimp_image_set_color_profile ( image, profile );
-            }
-
+          precision = GIMP_PRECISION_U16_LINEAR;
         }
-      else
+    }
+  else //8 bit depth import
+    {
+      rgb.depth = 8;
+      precision = GIMP_PRECISION_U8_NON_LINEAR;
+      if ( profile && gimp_color_profile_is_linear ( profile ) )
         {
-          image = gimp_image_new_with_precision ( rgb.width, rgb.height, GIMP_RGB, GIMP_PRECISION_U16_NON_LINEAR );
+          precision = GIMP_PRECISION_U8_LINEAR;
         }
+    }
 
-      rgb.depth = 16;
-      if ( loadalpha ) //RGBA
-        {
-          rgb.rowBytes = rgb.width * 8;
-          rgb.pixels = g_malloc_n ( rgb.height, rgb.rowBytes );
+  image = gimp_image_new_with_precision ( rgb.width, rgb.height, GIMP_RGB, precision );
 
-          decodeResult = avifImageYUVToRGB ( avif, &rgb );
+  if ( profile && gimp_color_profile_is_rgb ( profile ) )
+    {
+      gimp_image_set_color_profile ( image, profile );
+    }
 
-          layer = gimp_layer_new ( image, "Background",
-                                   rgb.width, rgb.height,
-                                   GIMP_RGBA_IMAGE, 100,
-                                   gimp_image_get_default_new_layer_mode ( image ) );
-        }
-      else //RGB
-        {
-          rgb.rowBytes = rgb.width * 6;
-          rgb.pixels = g_malloc_n ( rgb.height, rgb.rowBytes );
+  rgb.rowBytes = rgb.width * avifRGBImagePixelSize ( &rgb );
 
-          decodeResult = avifImageYUVToRGB ( avif, &rgb );
+  GimpImageType layer_type = loadalpha ? GIMP_RGBA_IMAGE : GIMP_RGB_IMAGE;
+  gboolean      sequence = decoder->imageCount > 1;
+  gchar        *layer_name;
 
-          layer = gimp_layer_new ( image, "Background",
-                                   rgb.width, rgb.height,
-                                   GIMP_RGB_IMAGE, 100,
-                                   gimp_image_get_default_new_layer_mode ( image ) );
-        }
+  if ( sequence )
+    {
+      gimp_progress_init_printf ( "Opening '%s'", gimp_file_get_utf8_name ( file ) );
+      layer_name = avifplugin_frame_layer_name ( decoder->imageIndex, &decoder->imageTiming );
     }
-  else //8 bit depth import
+  else
     {
-      if ( profile )
-        {
-          if ( gimp_color_profile_is_linear ( profile ) )
-            {
-              image = gimp_image_new_with_precision ( rgb.width, rgb.height, GIMP_RGB, GIMP_PRECISION_U8_LINEAR );
-            }
-          else
-            {
-              image = gimp_image_new_with_precision ( rgb.width, rgb.height, GIMP_RGB, GIMP_PRECISION_U8_NON_LINEAR );
-            }
+      layer_name = g_strdup ( "Background" );
+    }
 
-          if ( gimp_color_profile_is_rgb ( profile ) )
-            {
-              gimp_image_set_color_profile ( image, profile );
-            }
+  layer = gimp_layer_new ( image, layer_name,
+                           rgb.width, rgb.height,
+                           layer_type, 100,
+                           gimp_image_get_default_new_layer_mode ( image ) );
+  g_free ( layer_name );
 
-        }
-      else
+  gimp_image_insert_layer ( image, layer, NULL, 0 );
+
+  buffer = gimp_drawable_get_buffer ( GIMP_DRAWABLE ( layer ) );
+
+  /* Convert and upload in bands of whole GEGL tile rows, so only a band-sized
+     RGB scratch buffer is needed instead of a full-frame copy. */
+  gint tile_height = 64;
+  g_object_get ( buffer, "tile-height", &tile_height, NULL );
+  if ( tile_height < 1 )
+    {
+      tile_height = 64;
+    }
+  g_object_unref ( buffer );
+
+  /* One tile row per thread, so libavif can convert a band on all of them at once */
+  rgb.maxThreads = num_threads;
+  uint32_t band_height = MIN ( ( uint32_t ) tile_height * num_threads, rgb.height );
+  rgb.pixels = g_malloc_n ( band_height, rgb.rowBytes );
+
+  /* the first frame of a sequence is still in decoder->image, so it is converted before
+     the decoding thread starts reusing it */
+  gboolean converted = avifplugin_frame_to_layer ( avif, &rgb, band_height, layer, &stats );
+
+  if ( converted && sequence )
+    {
+      AvifPluginFrameQueue queue;
+      AvifPluginFrame      frames[AVIFPLUGIN_FRAME_QUEUE_DEPTH];
+      AvifPluginFrame     *frame;
+      GThread             *decode_thread;
+
+      queue.decoder = decoder;
+      queue.free_frames = g_async_queue_new ();
+      queue.ready_frames = g_async_queue_new ();
+      queue.abort = 0;
+      queue.result = AVIF_RESULT_OK;
+      queue.end_of_stream.image = NULL;
+
+      for ( gint i = 0; i < AVIFPLUGIN_FRAME_QUEUE_DEPTH; i++ )
         {
-          image = gimp_image_new_with_precision ( rgb.width, rgb.height, GIMP_RGB, GIMP_PRECISION_U8_NON_LINEAR );
+          frames[i].image = avifImageCreateEmpty ();
+          g_async_queue_push ( queue.free_frames, &frames[i] );
         }
 
+      gimp_progress_update ( 1.0 / decoder->imageCount );
 
-      rgb.depth = 8;
-      if ( loadalpha ) //RGBA
-        {
-          rgb.rowBytes = rgb.width * 4;
-          rgb.pixels = g_malloc_n ( rgb.height, rgb.rowBytes );
+      decode_thread = g_thread_new ( "avif-decode", avifplugin_decode_frames, &queue );
 
-          decodeResult = avifImageYUVToRGB ( avif, &rgb );
+      while ( ( frame = g_async_queue_pop ( queue.ready_frames ) ) != &queue.end_of_stream )
+        {
+          if ( ! g_atomic_int_get ( &queue.abort ) )
+            {
+              if ( frame->image->width != rgb.width || frame->image->height != rgb.height )
+                {
+                  g_printerr ( "%s: Skipping frame %u, its size %ux%u differs from %ux%u\n", G_STRFUNC,
+                               frame->index + 1, frame->image->width, frame->image->height, rgb.width, rgb.height );
+                }
+              else
+                {
+                  layer_name = avifplugin_frame_layer_name ( frame->index, &frame->timing );
+                  layer = gimp_layer_new ( image, layer_name,
+                                           rgb.width, rgb.height,
+                                           layer_type, 100,
+                                           gimp_image_get_default_new_layer_mode ( image ) );
+                  g_free ( layer_name );
+
+                  gimp_image_insert_layer ( image, layer, NULL, 0 );
+
+                  if ( ! avifplugin_frame_to_layer ( frame->image, &rgb, band_height, layer, &stats ) )
+                    {
+                      g_atomic_int_set ( &queue.abort, 1 );
+                      converted = FALSE;
+                    }
+                }
+              gimp_progress_update ( ( gdouble ) ( frame->index + 1 ) / decoder->imageCount );
+            }
 
-          layer = gimp_layer_new ( image, "Background",
-                                   rgb.width, rgb.height,
-                                   GIMP_RGBA_IMAGE, 100,
-                                   gimp_image_get_default_new_layer_mode ( image ) );
+          g_async_queue_push ( queue.free_frames, frame );
         }
-      else //RGB
-        {
-          rgb.rowBytes = rgb.width * 3;
-          rgb.pixels = g_malloc_n ( rgb.height, rgb.rowBytes );
 
-          decodeResult = avifImageYUVToRGB ( avif, &rgb );
+      g_thread_join ( decode_thread );
 
-          layer = gimp_layer_new ( image, "Background",
-                                   rgb.width, rgb.height,
-                                   GIMP_RGB_IMAGE, 100,
-                                   gimp_image_get_default_new_layer_mode ( image ) );
+      if ( queue.result != AVIF_RESULT_OK )
+        {
+          g_message ( "ERROR: Failed to decode frame: %s\n", avifResultToString ( queue.result ) );
         }
-    }
 
-  gimp_image_insert_layer ( image, layer, NULL, 0 );
-
-  buffer = gimp_drawable_get_buffer ( GIMP_DRAWABLE ( layer ) );
+      for ( gint i = 0; i < AVIFPLUGIN_FRAME_QUEUE_DEPTH; i++ )
+        {
+          avifImageDestroy ( frames[i].image );
+        }
+      g_async_queue_unref ( queue.free_frames );
+      g_async_queue_unref ( queue.ready_frames );
 
-  gegl_buffer_set ( buffer, GEGL_RECTANGLE ( 0, 0, rgb.width, rgb.height ), 0,
-                    NULL, rgb.pixels, GEGL_AUTO_ROWSTRIDE );
+      gimp_progress_update ( 1.0 );
+    }
 
-  g_object_unref ( buffer );
   g_free ( rgb.pixels );
 
+  if ( ! converted )
+    {
+      g_set_error ( error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                    "Failed to convert the decoded image of '%s'", gimp_file_get_utf8_name ( file ) );
+      gimp_image_delete ( image );
+      g_clear_object ( &metadata );
+      g_clear_object ( &profile );
+      avifDecoderDestroy ( decoder );
+      avifplugin_input_free ( mapped, &raw );
+      g_free ( filename );
+      return NULL;
+    }
+
   gimp_image_undo_disable ( image );
   gimp_image_set_file ( image, file );
 
@@ -581,34 +858,7 @@ GimpImage * load_image ( GFile       *file,
         }
     }
 
-  if ( avif->transformFlags & AVIF_TRANSFORM_IROT )
-    {
-      switch ( avif->irot.angle )
-        {
-        case 1:
-          gimp_image_rotate ( image, GIMP_ROTATE_270 );
-          break;
-        case 2:
-          gimp_image_rotate ( image, GIMP_ROTATE_180 );
-          break;
-        case 3:
-          gimp_image_rotate ( image, GIMP_ROTATE_90 );
-          break;
-        }
-    }
-
-  if ( avif->transformFlags & AVIF_TRANSFORM_IMIR )
-    {
-      switch ( avif->imir.axis )
-        {
-        case 0:
-          gimp_image_flip ( image, GIMP_ORIENTATION_VERTICAL );
-          break;
-        case 1:
-          gimp_image_flip ( image, GIMP_ORIENTATION_HORIZONTAL );
-          break;
-        }
-    }
+  avifplugin_apply_orientation ( image, avif );
 
   if ( profile )
     {
@@ -628,9 +878,181 @@ GimpImage * load_image ( GFile       *file,
       gimp_image_metadata_load_finish ( image, "image/avif", metadata, flags, interactive );
     }
 
+  avifplugin_stats_log ( &stats, "load", filename, &decoder->ioStats, decoder );
 
   avifDecoderDestroy ( decoder );
-  avifRWDataFree ( &raw );
+  avifplugin_input_free ( mapped, &raw );
+
+  g_debug ( "%s: %s loaded from %s input, peak RSS grew by %ld kB",
+            G_STRFUNC, filename, mapped ? "mapped" : "buffered",
+            avifplugin_peak_rss_kb () - stats.peak_rss_kb );
+
   g_free ( filename );
   return image;
 }
+
+/* Preview for the file dialog: prefers the embedded thmb item and otherwise decodes the
+   primary image once, converting straight to the thumbnail size. The returned width and
+   height are those of the full image. Color profile and metadata are not applied. */
+GimpImage * load_thumbnail_image ( GFile         *file,
+                                   gint           thumb_size,
+                                   gint          *width,
+                                   gint          *height,
+                                   GimpImageType *type,
+                                   GError       **error )
+{
+  GimpImage        *image;
+  GimpLayer        *layer;
+  GeglBuffer       *buffer;
+  GFileInputStream *stream;
+  GFileInfo        *info;
+
+  stream = g_file_read ( file, NULL, error );
+  if ( ! stream )
+    {
+      return NULL;
+    }
+
+  AvifPluginStreamReader reader = { G_INPUT_STREAM ( stream ), AVIF_DATA_EMPTY };
+  avifIOReader io;
+  io.read = avifplugin_read_stream;
+  io.userData = &reader;
+  io.sizeHint = 0;
+  io.persistent = AVIF_FALSE;
+
+  info = g_file_query_info ( file, G_FILE_ATTRIBUTE_STANDARD_SIZE, G_FILE_QUERY_INFO_NONE, NULL, NULL );
+  if ( info )
+    {
+      io.sizeHint = ( uint64_t ) g_file_info_get_size ( info );
+      g_object_unref ( info );
+    }
+
+  gint num_threads = 1;
+  g_object_get ( gegl_config(), "threads", &num_threads, NULL );
+  if ( num_threads < 1 )
+    {
+      num_threads = 1;
+    }
+
+  avifDecoder * decoder = avifDecoderCreate();
+  decoder->maxThreads = num_threads;
+  avifResult decodeResult;
+
+  decodeResult = avifDecoderParseIO ( decoder, &io );
+  if ( decodeResult != AVIF_RESULT_OK )
+    {
+      g_set_error ( error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                    "Failed to parse input: %s", avifResultToString ( decodeResult ) );
+      avifDecoderDestroy ( decoder );
+      avifRWDataFree ( &reader.buffer );
+      g_object_unref ( stream );
+      return NULL;
+    }
+
+  /* Parse reports the primary item (or track), remember its size and orientation
+     before switching to the thumbnail */
+  gint     full_width = decoder->containerWidth;
+  gint     full_height = decoder->containerHeight;
+  gboolean full_rotated = ( decoder->image->transformFlags & AVIF_TRANSFORM_IROT ) &&
+                          ( decoder->image->irot.angle & 1 );
+
+  if ( avifDecoderSetSource ( decoder, AVIF_DECODER_SOURCE_THUMBNAIL_ITEM ) != AVIF_RESULT_OK ||
+       avifDecoderNextImage ( decoder ) != AVIF_RESULT_OK )
+    {
+      decodeResult = avifDecoderSetSource ( decoder, AVIF_DECODER_SOURCE_AUTO );
+      if ( decodeResult == AVIF_RESULT_OK )
+        {
+          decodeResult = avifDecoderNextImage ( decoder );
+        }
+      if ( decodeResult != AVIF_RESULT_OK )
+        {
+          g_set_error ( error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                        "Failed to decode image: %s", avifResultToString ( decodeResult ) );
+          avifDecoderDestroy ( decoder );
+          avifRWDataFree ( &reader.buffer );
+          g_object_unref ( stream );
+          return NULL;
+        }
+    }
+
+  avifImage * avif = decoder->image;
+
+  if ( full_width < 1 || full_height < 1 )
+    {
+      full_width = avif->width;
+      full_height = avif->height;
+    }
+
+  if ( full_rotated )
+    {
+      *width = full_height;
+      *height = full_width;
+    }
+  else
+    {
+      *width = full_width;
+      *height = full_height;
+    }
+
+  /* Fit the longer side into thumb_size, the library averages each output pixel
+     over the source pixels it covers */
+  avifRGBImage rgb;
+  avifRGBImageSetDefaults ( &rgb, avif );
+  if ( thumb_size > 0 && ( rgb.width > ( uint32_t ) thumb_size || rgb.height > ( uint32_t ) thumb_size ) )
+    {
+      if ( rgb.width >= rgb.height )
+        {
+          rgb.height = MAX ( 1, ( guint64 ) rgb.height * thumb_size / rgb.width );
+          rgb.width = thumb_size;
+        }
+      else
+        {
+          rgb.width = MAX ( 1, ( guint64 ) rgb.width * thumb_size / rgb.height );
+          rgb.height = thumb_size;
+        }
+    }
+
+  rgb.depth = 8;
+  rgb.format = avif->alphaPlane ? AVIF_RGB_FORMAT_RGBA : AVIF_RGB_FORMAT_RGB;
+  rgb.maxThreads = num_threads;
+  rgb.rowBytes = rgb.width * avifRGBImagePixelSize ( &rgb );
+  rgb.pixels = g_malloc_n ( rgb.height, rgb.rowBytes );
+
+  decodeResult = avifImageYUVToRGBScaled ( avif, &rgb );
+  if ( decodeResult != AVIF_RESULT_OK )
+    {
+      g_set_error ( error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                    "Failed to convert image: %s", avifResultToString ( decodeResult ) );
+      g_free ( rgb.pixels );
+      avifDecoderDestroy ( decoder );
+      avifRWDataFree ( &reader.buffer );
+      g_object_unref ( stream );
+      return NULL;
+    }
+
+  *type = avif->alphaPlane ? GIMP_RGBA_IMAGE : GIMP_RGB_IMAGE;
+
+  image = gimp_image_new ( rgb.width, rgb.height, GIMP_RGB );
+
+  layer = gimp_layer_new ( image, "Background",
+                           rgb.width, rgb.height,
+                           *type, 100,
+                           gimp_image_get_default_new_layer_mode ( image ) );
+
+  gimp_image_insert_layer ( image, layer, NULL, 0 );
+
+  buffer = gimp_drawable_get_buffer ( GIMP_DRAWABLE ( layer ) );
+  gegl_buffer_set ( buffer, GEGL_RECTANGLE ( 0, 0, rgb.width, rgb.height ), 0,
+                    NULL, rgb.pixels, GEGL_AUTO_ROWSTRIDE );
+  g_object_unref ( buffer );
+  g_free ( rgb.pixels );
+
+  gimp_image_undo_disable ( image );
+  avifplugin_apply_orientation ( image, avif );
+
+  avifDecoderDestroy ( decoder );
+  avifRWDataFree ( &reader.buffer );
+  g_object_unref ( stream );
+
+  return image;
+}
@@ -8,5 +8,12 @@ GimpImage * load_image (GFile       *file,
                         gboolean     interactive,
                         GError     **error);
 
+GimpImage * load_thumbnail_image (GFile         *file,
+                                  gint           thumb_size,
+                                  gint          *width,
+                                  gint          *height,
+                                  GimpImageType *type,
+                                  GError       **error);
+
 
 #endif /* __AVIF_LOAD_H__ */
@@ -0,0 +1,490 @@
+/*
+ * GIMP plug-in to allow import/export in AVIF image format.
+ * Author: Daniel Novomesky
+ */
+
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+This software uses libavif
+URL: https://github.com/AOMediaCodec/libavif/
+
+Copyright 2019 Joe Drago. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <libgimp/gimp.h>
+#include <libgimp/gimpui.h>
+
+#include <avif/avif.h>
+
+#include "file-avif-preview.h"
+#include "file-avif-save.h"
+
+#define PREVIEW_TILE_SIZE      128  /* the sample is a 3x3 grid of 128x128 crops */
+#define PREVIEW_TILES_PER_SIDE 3
+#define PREVIEW_DELAY          250  /* milliseconds without changes before a sample is encoded */
+#define PREVIEW_HEADER_BYTES   512  /* roughly what the boxes take, not counting the ICC profile */
+
+/* One encode of the sample, and what it says about the whole export once it finished.
+   Finished jobs are cached by key, so going back to earlier settings shows them at once. */
+typedef struct
+{
+  AvifPluginPreview *preview;   /* reference while queued or running, NULL once finished */
+  gchar             *key;
+  avifImage         *sample;
+  avifEncoder       *encoder;
+  gdouble            scale;     /* drawable pixels per sample pixel */
+
+  gboolean           success;
+  gsize              size;      /* estimated file size in bytes */
+  gdouble            psnr;      /* of the YUV planes of the sample */
+  gdouble            seconds;   /* estimated encode time of the export */
+  gint               quantizer; /* picked by a quality target, -1 without one */
+} AvifPluginPreviewJob;
+
+struct _AvifPluginPreview
+{
+  gint                  ref_count;   /* held by the dialog, the worker and each finished job on its way back */
+  GimpImage            *image;
+  GimpDrawable         *drawable;
+  GObject              *config;
+  GtkLabel             *label;       /* NULL once the dialog is gone */
+  gulong                notify_id;
+  guint                 update_id;
+  gchar                *current_key; /* settings the label is meant to show */
+  GHashTable           *cache;       /* key -> finished AvifPluginPreviewJob, main thread only */
+
+  GThread              *thread;
+  GMutex                mutex;
+  GCond                 cond;
+  AvifPluginPreviewJob *pending;     /* newest job the worker hasn't started, under mutex */
+  gboolean              quit;        /* under mutex */
+};
+
+static void
+avifplugin_preview_unref ( AvifPluginPreview *preview )
+{
+  if ( g_atomic_int_dec_and_test ( &preview->ref_count ) )
+    {
+      g_hash_table_destroy ( preview->cache );
+      g_free ( preview->current_key );
+      g_mutex_clear ( &preview->mutex );
+      g_cond_clear ( &preview->cond );
+      g_free ( preview );
+    }
+}
+
+static void
+avifplugin_preview_job_free ( gpointer data )
+{
+  AvifPluginPreviewJob *job = data;
+
+  if ( job->sample )
+    {
+      avifImageDestroy ( job->sample );
+    }
+  if ( job->encoder )
+    {
+      avifEncoderDestroy ( job->encoder );
+    }
+  if ( job->preview )
+    {
+      avifplugin_preview_unref ( job->preview );
+    }
+  g_free ( job->key );
+  g_free ( job );
+}
+
+/* Everything of config the encoded sample depends on */
+static gchar *
+avifplugin_preview_key ( GObject *config )
+{
+  avifPixelFormat pixel_format = AVIF_PIXEL_FORMAT_YUV420;
+  avifCodecChoice codec_choice = AVIF_CODEC_CHOICE_AUTO;
+  gint            target_mode = AVIF_ENCODER_TARGET_NONE;
+  gboolean        save_12bit_depth = FALSE;
+  gboolean        save_icc_profile = TRUE;
+  gboolean        save_alpha_channel = TRUE;
+  double          min_quantizer = 0, max_quantizer = 0, alpha_quantizer = 0, encoder_speed = 0;
+  double          target_size = 0, target_psnr = 0, target_ssim = 0;
+  double          target = 0;
+
+  g_object_get ( config, "pixel-format", &pixel_format,
+                 "av1-encoder", &codec_choice,
+                 "target-mode", &target_mode,
+                 "save-12bit-depth", &save_12bit_depth,
+                 "save-color-profile", &save_icc_profile,
+                 "save-alpha-channel", &save_alpha_channel,
+                 "min-quantizer", &min_quantizer,
+                 "max-quantizer", &max_quantizer,
+                 "alpha-quantizer", &alpha_quantizer,
+                 "encoder-speed", &encoder_speed,
+                 "target-size", &target_size,
+                 "target-psnr", &target_psnr,
+                 "target-ssim", &target_ssim,
+                 NULL );
+
+  switch ( target_mode )
+    {
+    case AVIF_ENCODER_TARGET_SIZE:
+      target = target_size;
+      break;
+    case AVIF_ENCODER_TARGET_PSNR:
+      target = target_psnr;
+      break;
+    case AVIF_ENCODER_TARGET_SSIM:
+      target = target_ssim;
+      break;
+    default:
+      target_mode = AVIF_ENCODER_TARGET_NONE;
+      break;
+    }
+
+  return g_strdup_printf ( "%d %d %d %d %d %.0f %.0f %.0f %.0f %d %g",
+                           pixel_format, codec_choice, save_12bit_depth, save_icc_profile,
+                           save_alpha_channel, min_quantizer, max_quantizer, alpha_quantizer,
+                           encoder_speed, target_mode, target );
+}
+
+/* Worker thread: encodes and decodes the sample of job, extrapolates to the whole drawable */
+static void
+avifplugin_preview_run ( AvifPluginPreviewJob *job )
+{
+  avifRWData raw = AVIF_DATA_EMPTY;
+  avifResult res;
+  gint64     start_time = g_get_monotonic_time ();
+
+  res = avifEncoderWrite ( job->encoder, job->sample, &raw );
+  job->seconds = ( g_get_monotonic_time () - start_time ) / 1000000.0 * job->scale;
+
+  if ( res == AVIF_RESULT_OK )
+    {
+      /* the payloads grow with the pixel count, the boxes around them hardly change */
+      gsize payload = job->encoder->ioStats.colorOBUSize + job->encoder->ioStats.alphaOBUSize;
+      gsize header = ( raw.size > payload ) ? raw.size - payload : 0;
+      job->size = header + ( gsize ) ( payload * job->scale + 0.5 );
+
+      if ( job->encoder->target != AVIF_ENCODER_TARGET_NONE )
+        {
+          job->quantizer = job->encoder->ioStats.targetQuantizer;
+        }
+
+      avifROData   input = { raw.data, raw.size };
+      avifDecoder *decoder = avifDecoderCreate ();
+      avifImage   *decoded = avifImageCreateEmpty ();
+
+      res = avifDecoderRead ( decoder, decoded, &input );
+      if ( res == AVIF_RESULT_OK )
+        {
+          job->psnr = avifImagePSNR ( decoded, job->sample );
+          job->success = TRUE;
+        }
+      avifImageDestroy ( decoded );
+      avifDecoderDestroy ( decoder );
+    }
+
+  if ( res != AVIF_RESULT_OK )
+    {
+      g_printerr ( "%s: %s\n", G_STRFUNC, avifResultToString ( res ) );
+    }
+
+  avifRWDataFree ( &raw );
+  avifImageDestroy ( job->sample );
+  job->sample = NULL;
+  avifEncoderDestroy ( job->encoder );
+  job->encoder = NULL;
+}
+
+static void
+avifplugin_preview_show ( AvifPluginPreview          *preview,
+                          const AvifPluginPreviewJob *job )
+{
+  gchar *size;
+  gchar *quality;
+  gchar *duration;
+  gchar *text;
+
+  if ( ! job->success )
+    {
+      gtk_label_set_text ( preview->label, "Estimate: the sample could not be encoded" );
+      return;
+    }
+
+  size = g_format_size ( job->size );
+
+  if ( job->psnr >= 100.0 )
+    {
+      quality = g_strdup ( "lossless" );
+    }
+  else if ( job->quantizer >= 0 )
+    {
+      quality = g_strdup_printf ( "PSNR %.1f dB at quantizer %d", job->psnr, job->quantizer );
+    }
+  else
+    {
+      quality = g_strdup_printf ( "PSNR %.1f dB", job->psnr );
+    }
+
+  if ( job->seconds < 1.0 )
+    {
+      duration = g_strdup ( "under a second" );
+    }
+  else if ( job->seconds < 60.0 )
+    {
+      duration = g_strdup_printf ( "about %.0f s", job->seconds );
+    }
+  else
+    {
+      gint seconds = ( gint ) ( job->seconds + 0.5 );
+      duration = g_strdup_printf ( "about %d min %02d s", seconds / 60, seconds % 60 );
+    }
+
+  text = g_strdup_printf ( "Estimate: %s, %s, %s to export", size, quality, duration );
+  gtk_label_set_text ( preview->label, text );
+
+  g_free ( text );
+  g_free ( duration );
+  g_free ( quality );
+  g_free ( size );
+}
+
+/* Main thread: takes a finished job over from the worker */
+static gboolean
+avifplugin_preview_done ( gpointer user_data )
+{
+  AvifPluginPreviewJob *job = user_data;
+  AvifPluginPreview    *preview = job->preview;
+
+  job->preview = NULL;
+  if ( preview->label )
+    {
+      g_hash_table_replace ( preview->cache, job->key, job );
+      if ( g_strcmp0 ( job->key, preview->current_key ) == 0 )
+        {
+          avifplugin_preview_show ( preview, job );
+        }
+    }
+  else
+    {
+      avifplugin_preview_job_free ( job );
+    }
+
+  avifplugin_preview_unref ( preview );
+  return G_SOURCE_REMOVE;
+}
+
+/* Runs the newest job until the dialog is gone. A job the worker already started can't be
+   cancelled; its estimate still ends up in the cache. */
+static gpointer
+avifplugin_preview_worker ( gpointer data )
+{
+  AvifPluginPreview    *preview = data;
+  AvifPluginPreviewJob *job;
+
+  g_mutex_lock ( &preview->mutex );
+  while ( TRUE )
+    {
+      while ( ! preview->pending && ! preview->quit )
+        {
+          g_cond_wait ( &preview->cond, &preview->mutex );
+        }
+      if ( preview->quit )
+        {
+          break;
+        }
+
+      job = preview->pending;
+      preview->pending = NULL;
+      g_mutex_unlock ( &preview->mutex );
+
+      avifplugin_preview_run ( job );
+      g_idle_add ( avifplugin_preview_done, job );
+
+      g_mutex_lock ( &preview->mutex );
+    }
+  g_mutex_unlock ( &preview->mutex );
+
+  avifplugin_preview_unref ( preview );
+  return NULL;
+}
+
+/* Replaces the job waiting for the worker, which is stale by now, with job (or with none) */
+static void
+avifplugin_preview_queue ( AvifPluginPreview    *preview,
+                           AvifPluginPreviewJob *job )
+{
+  AvifPluginPreviewJob *stale;
+
+  g_mutex_lock ( &preview->mutex );
+  stale = preview->pending;
+  preview->pending = job;
+  g_cond_signal ( &preview->cond );
+  g_mutex_unlock ( &preview->mutex );
+
+  if ( stale )
+    {
+      avifplugin_preview_job_free ( stale );
+    }
+}
+
+static gboolean
+avifplugin_preview_update ( gpointer user_data )
+{
+  AvifPluginPreview    *preview = user_data;
+  AvifPluginPreviewJob *job;
+  avifImage            *sample;
+  gint                  num_threads = 1;
+  gchar                *key;
+
+  preview->update_id = 0;
+
+  key = avifplugin_preview_key ( preview->config );
+  if ( g_strcmp0 ( key, preview->current_key ) == 0 )
+    {
+      g_free ( key );
+      return G_SOURCE_REMOVE;
+    }
+  g_free ( preview->current_key );
+  preview->current_key = key;
+
+  job = g_hash_table_lookup ( preview->cache, key );
+  if ( job )
+    {
+      avifplugin_preview_queue ( preview, NULL );
+      avifplugin_preview_show ( preview, job );
+      return G_SOURCE_REMOVE;
+    }
+
+  /* GIMP's API is only used here on the main thread, the worker only sees libavif */
+  sample = save_preview_sample ( preview->image, preview->drawable, preview->config,
+                                 PREVIEW_TILE_SIZE, PREVIEW_TILES_PER_SIDE, &num_threads );
+  if ( ! sample )
+    {
+      avifplugin_preview_queue ( preview, NULL );
+      gtk_label_set_text ( preview->label, "Estimate: not available for this layer" );
+      return G_SOURCE_REMOVE;
+    }
+
+  job = g_new0 ( AvifPluginPreviewJob, 1 );
+  job->key = g_strdup ( key );
+  job->sample = sample;
+  job->encoder = save_preview_encoder ( preview->config, num_threads, sample->alphaPlane != NULL );
+  job->scale = ( gdouble ) gimp_drawable_width ( preview->drawable ) * gimp_drawable_height ( preview->drawable ) /
+               ( ( gdouble ) sample->width * sample->height );
+  job->quantizer = -1;
+
+  /* a size target applies to the whole file, so the sample gets its share of the payload */
+  if ( job->encoder->target == AVIF_ENCODER_TARGET_SIZE )
+    {
+      gsize header = sample->icc.size + PREVIEW_HEADER_BYTES;
+      if ( job->encoder->targetSize > header )
+        {
+          job->encoder->targetSize = header + ( gsize ) ( ( job->encoder->targetSize - header ) / job->scale );
+        }
+    }
+
+  g_atomic_int_inc ( &preview->ref_count );
+  job->preview = preview;
+
+  gtk_label_set_text ( preview->label, "Estimate: encoding a sample..." );
+  avifplugin_preview_queue ( preview, job );
+  return G_SOURCE_REMOVE;
+}
+
+/* Any change of config restarts the delay, so dragging a slider only encodes where it stops */
+static void
+avifplugin_preview_changed ( GObject          *config,
+                             const GParamSpec *pspec,
+                             gpointer          user_data )
+{
+  AvifPluginPreview *preview = user_data;
+
+  if ( preview->update_id )
+    {
+      g_source_remove ( preview->update_id );
+    }
+  preview->update_id = g_timeout_add ( PREVIEW_DELAY, avifplugin_preview_update, preview );
+}
+
+AvifPluginPreview *
+avifplugin_preview_new ( GimpImage    *image,
+                         GimpDrawable *drawable,
+                         GObject      *config,
+                         GtkLabel     *label )
+{
+  AvifPluginPreview *preview = g_new0 ( AvifPluginPreview, 1 );
+
+  preview->ref_count = 2; //the dialog and the worker
+  preview->image = image;
+  preview->drawable = drawable;
+  preview->config = config;
+  preview->label = label;
+  preview->cache = g_hash_table_new_full ( g_str_hash, g_str_equal,
+                                           NULL, avifplugin_preview_job_free );
+  g_mutex_init ( &preview->mutex );
+  g_cond_init ( &preview->cond );
+
+  preview->thread = g_thread_new ( "avif-preview", avifplugin_preview_worker, preview );
+  preview->notify_id = g_signal_connect ( config, "notify",
+                                          G_CALLBACK ( avifplugin_preview_changed ),
+                                          preview );
+  avifplugin_preview_changed ( config, NULL, preview );
+  return preview;
+}
+
+/* Stops the estimate before the dialog goes away. An encode which is still running isn't
+   waited for: the worker drops its result and quits once it is done. */
+void
+avifplugin_preview_free ( AvifPluginPreview *preview )
+{
+  g_signal_handler_disconnect ( preview->config, preview->notify_id );
+  if ( preview->update_id )
+    {
+      g_source_remove ( preview->update_id );
+    }
+  preview->label = NULL;
+
+  avifplugin_preview_queue ( preview, NULL );
+  g_mutex_lock ( &preview->mutex );
+  preview->quit = TRUE;
+  g_cond_signal ( &preview->cond );
+  g_mutex_unlock ( &preview->mutex );
+
+  g_thread_unref ( preview->thread );
+  avifplugin_preview_unref ( preview );
+}
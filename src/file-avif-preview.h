@@ -0,0 +1,18 @@
+
+#ifndef __AVIF_PREVIEW_H__
+#define __AVIF_PREVIEW_H__
+
+
+/* Estimates the size, PSNR and export time of the current settings of the export dialog by
+   encoding a sample of the drawable on a worker thread, and shows the outcome in label. */
+typedef struct _AvifPluginPreview AvifPluginPreview;
+
+AvifPluginPreview * avifplugin_preview_new  (GimpImage         *image,
+                                             GimpDrawable      *drawable,
+                                             GObject           *config,
+                                             GtkLabel          *label);
+
+void                avifplugin_preview_free (AvifPluginPreview *preview);
+
+
+#endif /* __AVIF_PREVIEW_H__ */
@@ -53,21 +53,49 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <gexiv2/gexiv2.h>
 #include <glib/gstdio.h>
 #include <sys/time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
 
 #include "file-avif-save.h"
 #include "file-avif-exif.h"
+#include "file-avif-stats.h"
 
 #define MAX_TILE_WIDTH  4096
 #define MAX_TILE_AREA  (4096 * 2304)
 #define MAX_TILE_ROWS 64
 #define MAX_TILE_COLS 64
 
+/* AV1 level 5.1 frame limits, larger images are saved as an image grid */
+#define MAX_FRAME_WIDTH  8192
+#define MAX_FRAME_HEIGHT 4352
+#define MAX_FRAME_AREA  8912896
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
 typedef struct
 {
   gchar *tag;
   gint  type;
 } XmpStructs;
 
+/* avifIOWriter sink: libavif hands over the header boxes, then each encoded payload */
+static avifResult
+avifplugin_write_file ( void          *user_data,
+                        const uint8_t *data,
+                        size_t         size )
+{
+  FILE *outfile = ( FILE * ) user_data;
+
+  if ( fwrite ( data, 1, size, outfile ) != size )
+    {
+      return AVIF_RESULT_IO_ERROR;
+    }
+  return AVIF_RESULT_OK;
+}
+
 //identical as gimp_image_metadata_copy_tag
 static void
 avifplugin_image_metadata_copy_tag ( GExiv2Metadata *src,
@@ -182,79 +210,79 @@ avifplugin_set_tiles ( unsigned int FrameWidth,
     }
 }
 
-gboolean   save_layer ( GFile         *file,
-                        GimpImage     *image,
-                        GimpDrawable  *drawable,
-                        GObject       *config,
-                        GimpMetadata  *metadata,
-                        GError       **error )
+//procedure to split images too large for a single AV1 frame into grid cells
+static void
+avifplugin_set_grid ( unsigned int FrameWidth,
+                      unsigned int FrameHeight,
+                      avifEncoder *encoder )
 {
-  gchar          *filename;
-  FILE           *outfile;
-  GeglBuffer     *buffer;
-  GimpImageType   drawable_type;
-  const Babl     *file_format = NULL;
-  const Babl     *space;
-  gint            drawable_width;
-  gint            drawable_height;
-  gint            savedepth;
-  gboolean        out_linear, save_alpha, is_gray;
-  guchar         *pixels;
-  
-  GimpColorProfile *profile = NULL;
-  int             min_quantizer = AVIF_QUANTIZER_BEST_QUALITY;
-  int             max_quantizer = 40;
-  int             alpha_quantizer = AVIF_QUANTIZER_BEST_QUALITY;
-  double          retval_double = max_quantizer;
-  double          retval_double2 = min_quantizer;
-  double          retval_double3;
-  double          retval_double4 = alpha_quantizer;
-  avifPixelFormat pixel_format = AVIF_PIXEL_FORMAT_YUV420;
-  avifCodecChoice codec_choice = AVIF_CODEC_CHOICE_AUTO;
-  gboolean        save_icc_profile = TRUE;
-  gboolean        save_exif = FALSE;
-  gboolean        save_xmp = FALSE;
-  gboolean        save_12bit_depth = FALSE;
-  gint            num_threads = 1;
-  gint            encoder_speed;
-  gint            i,j;
-  avifResult      res;
+  unsigned int gridCols, gridRows;
 
+  encoder->gridCellWidth = 0;
+  encoder->gridCellHeight = 0;
 
-  filename = g_file_get_path ( file );
-  gimp_progress_init_printf ( "Exporting '%s'. Wait, it is slow.", filename );
+  if ( FrameWidth <= MAX_FRAME_WIDTH && FrameHeight <= MAX_FRAME_HEIGHT &&
+       ( FrameWidth * FrameHeight ) <= MAX_FRAME_AREA )
+    {
+      return;
+    }
 
-  g_object_get ( config, "max-quantizer", &retval_double,
-                 "min-quantizer", &retval_double2,
-                 "alpha-quantizer", &retval_double4,
-                 "pixel-format", &pixel_format,
-                 "av1-encoder", &codec_choice,
-                 "encoder-speed", &retval_double3,
-                 "save-color-profile", &save_icc_profile,
-                 "save-exif", &save_exif,
-                 "save-xmp", &save_xmp,
+  //spread the image evenly over cells no larger than a single tile, keeping sizes even for chroma subsampling
+  //and at least 64x64 as MIAF requires (edge cells are padded)
+  gridCols = ( FrameWidth + MAX_TILE_WIDTH - 1 ) / MAX_TILE_WIDTH;
+  gridRows = ( FrameHeight + ( MAX_TILE_AREA / MAX_TILE_WIDTH ) - 1 ) / ( MAX_TILE_AREA / MAX_TILE_WIDTH );
+  encoder->gridCellWidth = MAX ( 64, ( ( ( FrameWidth + gridCols - 1 ) / gridCols ) + 1 ) & ~1u );
+  encoder->gridCellHeight = MAX ( 64, ( ( ( FrameHeight + gridRows - 1 ) / gridRows ) + 1 ) & ~1u );
+}
+
+typedef struct
+{
+  GimpColorProfile *profile;
+  const Babl       *file_format;
+  const Babl       *alpha_format;
+  gint              savedepth;
+  gboolean          save_alpha;
+  gboolean          is_gray;
+  avifPixelFormat   pixel_format;
+  gboolean          save_icc_profile;
+  gint              num_threads;
+} AvifPluginExportSettings;
+
+/* Picks the bit depth and the babl formats the drawable pixels are read in, shared by every
+   exported frame. drawable is only used as a fallback space if the profile has none. */
+static void
+avifplugin_export_settings_init ( AvifPluginExportSettings *settings,
+                                  GimpImage                *image,
+                                  GimpDrawable             *drawable,
+                                  GimpImageType             drawable_type,
+                                  GObject                  *config,
+                                  GError                  **error )
+{
+  const Babl *space;
+  gboolean    out_linear;
+  gboolean    save_12bit_depth = FALSE;
+  gint        savedepth;
+  avifCodecChoice codec_choice = AVIF_CODEC_CHOICE_AUTO;
+
+  settings->pixel_format = AVIF_PIXEL_FORMAT_YUV420;
+  settings->save_icc_profile = TRUE;
+  settings->alpha_format = NULL;
+
+  g_object_get ( config, "pixel-format", &settings->pixel_format,
+                 "save-color-profile", &settings->save_icc_profile,
                  "save-12bit-depth", &save_12bit_depth,
+                 "av1-encoder", &codec_choice,
                  NULL );
-  max_quantizer = ( int ) ( retval_double + 0.5 );
-  min_quantizer = ( int ) ( retval_double2 + 0.5 );
-  encoder_speed = ( int ) ( retval_double3 + 0.5 );
-  alpha_quantizer = ( int ) ( retval_double4 + 0.5 );
 
-  g_object_get ( gegl_config(), "threads", &num_threads, NULL );
-  if ( num_threads < 1 )
+  settings->num_threads = 1;
+  g_object_get ( gegl_config(), "threads", &settings->num_threads, NULL );
+  if ( settings->num_threads < 1 )
     {
-      num_threads = 1;
+      settings->num_threads = 1;
     }
 
-  buffer = gimp_drawable_get_buffer ( drawable );
-
-  drawable_type   = gimp_drawable_type ( drawable );
-  drawable_width  = gimp_drawable_width ( drawable );
-  drawable_height = gimp_drawable_height ( drawable );
-
-
-  profile = gimp_image_get_effective_color_profile ( image );
-  space = gimp_color_profile_get_space ( profile,
+  settings->profile = gimp_image_get_effective_color_profile ( image );
+  space = gimp_color_profile_get_space ( settings->profile,
                                          GIMP_COLOR_RENDERING_INTENT_RELATIVE_COLORIMETRIC,
                                          error );
 
@@ -296,7 +324,7 @@ gboolean   save_layer ( GFile         *file,
 
     default:
       savedepth = save_12bit_depth ? 12 : 10;
-      if ( gimp_color_profile_is_linear ( profile ) )
+      if ( gimp_color_profile_is_linear ( settings->profile ) )
         {
           out_linear = TRUE;
         }
@@ -305,122 +333,118 @@ gboolean   save_layer ( GFile         *file,
           out_linear = FALSE;
         }
     }
+  settings->savedepth = savedepth;
 
   switch ( drawable_type )
     {
     case GIMP_RGBA_IMAGE:
-      save_alpha = TRUE;
-      is_gray = FALSE;
+      settings->save_alpha = TRUE;
+      settings->is_gray = FALSE;
 
       if ( savedepth == 8 )
         {
-          pixels = g_new ( guchar, drawable_width * drawable_height * 4 );
           if ( out_linear )
             {
-              file_format = babl_format_with_space ( "RGBA u8", space );
+              settings->file_format = babl_format_with_space ( "RGBA u8", space );
             }
           else
             {
-              file_format = babl_format_with_space ( "R'G'B'A u8", space );
+              settings->file_format = babl_format_with_space ( "R'G'B'A u8", space );
             }
         }
       else
         {
-          pixels = g_new ( guchar, drawable_width * drawable_height * 8 );
           if ( out_linear )
             {
-              file_format = babl_format_with_space ( "RGBA u16", space );
+              settings->file_format = babl_format_with_space ( "RGBA u16", space );
             }
           else
             {
-              file_format = babl_format_with_space ( "R'G'B'A u16", space );
+              settings->file_format = babl_format_with_space ( "R'G'B'A u16", space );
             }
         }
       break;
     case GIMP_RGB_IMAGE:
-      save_alpha = FALSE;
-      is_gray = FALSE;
+      settings->save_alpha = FALSE;
+      settings->is_gray = FALSE;
 
       if ( savedepth == 8 )
         {
-          pixels = g_new ( guchar, drawable_width * drawable_height * 3 );
           if ( out_linear )
             {
-              file_format = babl_format_with_space ( "RGB u8", space );
+              settings->file_format = babl_format_with_space ( "RGB u8", space );
             }
           else
             {
-              file_format = babl_format_with_space ( "R'G'B' u8", space );
+              settings->file_format = babl_format_with_space ( "R'G'B' u8", space );
             }
         }
       else
         {
-          pixels = g_new ( guchar, drawable_width * drawable_height * 6 );
           if ( out_linear )
             {
-              file_format = babl_format_with_space ( "RGB u16", space );
+              settings->file_format = babl_format_with_space ( "RGB u16", space );
             }
           else
             {
-              file_format = babl_format_with_space ( "R'G'B' u16", space );
+              settings->file_format = babl_format_with_space ( "R'G'B' u16", space );
             }
         }
       break;
     case GIMP_GRAYA_IMAGE:
-      save_alpha = TRUE;
-      is_gray = TRUE;
+      settings->save_alpha = TRUE;
+      settings->is_gray = TRUE;
 
+      //luma and alpha go straight into the avif planes, see avifplugin_buffer_to_avif
       if ( savedepth == 8 )
         {
-          pixels = g_new ( guchar, drawable_width * drawable_height * 2 );
+          settings->alpha_format = babl_format_with_space ( "A u8", space );
           if ( out_linear )
             {
-              file_format = babl_format_with_space ( "YA u8", space );
+              settings->file_format = babl_format_with_space ( "Y u8", space );
             }
           else
             {
-              file_format = babl_format_with_space ( "Y'A u8", space );
+              settings->file_format = babl_format_with_space ( "Y' u8", space );
             }
         }
       else
         {
-          pixels = g_new ( guchar, drawable_width * drawable_height * 4 );
+          settings->alpha_format = babl_format_with_space ( "A u16", space );
           if ( out_linear )
             {
-              file_format = babl_format_with_space ( "YA u16", space );
+              settings->file_format = babl_format_with_space ( "Y u16", space );
             }
           else
             {
-              file_format = babl_format_with_space ( "Y'A u16", space );
+              settings->file_format = babl_format_with_space ( "Y' u16", space );
             }
         }
       break;
     case GIMP_GRAY_IMAGE:
-      save_alpha = FALSE;
-      is_gray = TRUE;
+      settings->save_alpha = FALSE;
+      settings->is_gray = TRUE;
 
       if ( savedepth == 8 )
         {
-          pixels = g_new ( guchar, drawable_width * drawable_height );
           if ( out_linear )
             {
-              file_format = babl_format_with_space ( "Y u8", space );
+              settings->file_format = babl_format_with_space ( "Y u8", space );
             }
           else
             {
-              file_format = babl_format_with_space ( "Y' u8", space );
+              settings->file_format = babl_format_with_space ( "Y' u8", space );
             }
         }
       else
         {
-          pixels = g_new ( guchar, drawable_width * drawable_height * 2 );
           if ( out_linear )
             {
-              file_format = babl_format_with_space ( "Y u16", space );
+              settings->file_format = babl_format_with_space ( "Y u16", space );
             }
           else
             {
-              file_format = babl_format_with_space ( "Y' u16", space );
+              settings->file_format = babl_format_with_space ( "Y' u16", space );
             }
         }
       break;
@@ -428,13 +452,27 @@ gboolean   save_layer ( GFile         *file,
       g_assert_not_reached ();
     }
 
-  avifImage * avif = avifImageCreate ( drawable_width, drawable_height, savedepth, pixel_format );
+  /* Only aom can encode monochrome YUV400, rav1e (also picked by auto when aom is missing)
+     gets the gray as R=G=B, that is luma with neutral chroma in the chosen pixel format */
+  if ( settings->is_gray &&
+       g_strcmp0 ( avifCodecName ( codec_choice, AVIF_CODEC_FLAG_CAN_ENCODE ), "aom" ) == 0 )
+    {
+      settings->pixel_format = AVIF_PIXEL_FORMAT_YUV400;
+    }
+}
 
-  if ( save_icc_profile )
+static avifImage *
+avifplugin_avif_new ( const AvifPluginExportSettings *settings,
+                      gint                            width,
+                      gint                            height )
+{
+  avifImage * avif = avifImageCreate ( width, height, settings->savedepth, settings->pixel_format );
+
+  if ( settings->save_icc_profile )
     {
       const uint8_t *icc_data;
       size_t         icc_length;
-      icc_data = gimp_color_profile_get_icc_profile ( profile, &icc_length );
+      icc_data = gimp_color_profile_get_icc_profile ( settings->profile, &icc_length );
       avifImageSetProfileICC ( avif, icc_data, icc_length );
 
     }
@@ -442,9 +480,16 @@ gboolean   save_layer ( GFile         *file,
     {
       avifImageSetProfileNone ( avif );
     }
+  return avif;
+}
 
-  g_object_unref ( profile );
-
+static void
+avifplugin_set_metadata ( avifImage     *avif,
+                          GimpMetadata  *metadata,
+                          gboolean       save_exif,
+                          gboolean       save_xmp )
+{
+  gint i;
 
   if ( save_exif && metadata )
     {
@@ -591,151 +636,111 @@ gboolean   save_layer ( GFile         *file,
           g_object_unref ( new_metadata );
         }
     }
+}
 
+/* Reads the avif-sized area at ( x, y ) of buffer into the planes of avif */
+static avifResult
+avifplugin_buffer_to_avif ( GeglBuffer                     *buffer,
+                            gint                            x,
+                            gint                            y,
+                            avifImage                      *avif,
+                            const AvifPluginExportSettings *settings,
+                            AvifPluginStats                *stats )
+{
+  gint       i, j;
+  avifResult res;
+  gint64     start_time = g_get_monotonic_time ();
 
-  /* fetch the image */
-  gegl_buffer_get ( buffer, GEGL_RECTANGLE ( 0, 0,
-                    drawable_width, drawable_height ), 1.0,
-                    file_format, pixels,
-                    GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE );
+  if ( settings->is_gray ) //Gray export: full range luma needs no matrix, R=G=B gives Y=gray
+    {
+      avif->yuvRange = AVIF_RANGE_FULL;
+      avifImageAllocatePlanes ( avif, AVIF_PLANES_YUV );
+      gegl_buffer_get ( buffer, GEGL_RECTANGLE ( x, y,
+                        avif->width, avif->height ), 1.0,
+                        settings->file_format, avif->yuvPlanes[AVIF_CHAN_Y],
+                        avif->yuvRowBytes[AVIF_CHAN_Y], GEGL_ABYSS_NONE );
+
+      if ( settings->save_alpha )
+        {
+          avif->alphaRange = AVIF_RANGE_FULL;
+          avifImageAllocatePlanes ( avif, AVIF_PLANES_A );
+          gegl_buffer_get ( buffer, GEGL_RECTANGLE ( x, y,
+                            avif->width, avif->height ), 1.0,
+                            settings->alpha_format, avif->alphaPlane,
+                            avif->alphaRowBytes, GEGL_ABYSS_NONE );
+        }
+      stats->buffer_time += g_get_monotonic_time () - start_time;
 
-  g_object_unref ( buffer );
+      start_time = g_get_monotonic_time ();
+      if ( avif->yuvFormat != AVIF_PIXEL_FORMAT_YUV400 ) //R=G=B has neutral chroma
+        {
+          avifPixelFormatInfo info;
+          const uint32_t      neutral = 1 << ( avif->depth - 1 );
+          uint32_t            uv_width, uv_height, plane, k;
 
-  avifRGBImage rgb;
-  rgb.width = avif->width;
-  rgb.height = avif->height;
+          avifGetPixelFormatInfo ( avif->yuvFormat, &info );
+          uv_width = ( avif->width + info.chromaShiftX ) >> info.chromaShiftX;
+          uv_height = ( avif->height + info.chromaShiftY ) >> info.chromaShiftY;
 
-  if ( is_gray ) //Gray export
-    {
-      if ( avifImageUsesU16 ( avif ) )
-        {
-          rgb.depth = 16;
-          
-          const uint16_t  *graypixels_src = (const uint16_t*) pixels;
-          uint16_t  *graypixels_dest,tmpval16;
-          
-          if ( save_alpha )
+          for ( plane = AVIF_CHAN_U; plane <= AVIF_CHAN_V; ++plane )
             {
-              rgb.format = AVIF_RGB_FORMAT_RGBA;
-              rgb.rowBytes = rgb.width * 8;
-              rgb.pixels = g_malloc_n ( rgb.height, rgb.rowBytes );
-              graypixels_dest = (uint16_t*) rgb.pixels;
-
-              for ( j = 0; j < drawable_height; ++j )
+              for ( k = 0; k < uv_height; ++k )
                 {
-                  for ( i = 0; i < drawable_width; ++i )
+                  uint8_t *row = &avif->yuvPlanes[plane][k * avif->yuvRowBytes[plane]];
+
+                  if ( avifImageUsesU16 ( avif ) )
                     {
-                      tmpval16 = *graypixels_src;
-                      graypixels_src++;
-                      
-                      *graypixels_dest = tmpval16; //R=G=B
-                      graypixels_dest++;
-                      *graypixels_dest = tmpval16; //G
-                      graypixels_dest++;
-                      *graypixels_dest = tmpval16; //B
-                      graypixels_dest++;
-                      
-                      tmpval16 = *graypixels_src;
-                      graypixels_src++;
-                      *graypixels_dest = tmpval16; //A
-                      graypixels_dest++;
+                      for ( i = 0; i < ( gint ) uv_width; ++i )
+                        {
+                          ( ( uint16_t * ) row )[i] = ( uint16_t ) neutral;
+                        }
                     }
-                }
-            }
-          else
-            {
-              rgb.format = AVIF_RGB_FORMAT_RGB;
-              rgb.rowBytes = rgb.width * 6;
-              rgb.pixels = g_malloc_n ( rgb.height, rgb.rowBytes );
-              graypixels_dest = (uint16_t*) rgb.pixels;
-
-              for ( j = 0; j < drawable_height; ++j )
-                {
-                  for ( i = 0; i < drawable_width; ++i )
+                  else
                     {
-                      tmpval16 = *graypixels_src;
-                      graypixels_src++;
-                      
-                      *graypixels_dest = tmpval16; //R=G=B
-                      graypixels_dest++;
-                      *graypixels_dest = tmpval16; //G
-                      graypixels_dest++;
-                      *graypixels_dest = tmpval16; //B
-                      graypixels_dest++;
+                      memset ( row, neutral, uv_width );
                     }
                 }
             }
         }
-      else //8bit gray
+
+      if ( avifImageUsesU16 ( avif ) )
         {
-          rgb.depth = 8;
-          
-          const uint8_t  *graypixels8_src = (const uint8_t*) pixels;
-          uint8_t  *graypixels8_dest,tmpval8;
-          if ( save_alpha )
+          //rescale u16 in place to 10 or 12 bits, rounding like avifImageRGBToYUV
+          const uint32_t max_channel = ( 1 << avif->depth ) - 1;
+          uint16_t      *row;
+
+          for ( j = 0; j < ( gint ) avif->height; ++j )
             {
-              rgb.format = AVIF_RGB_FORMAT_RGBA;
-              rgb.rowBytes = rgb.width * 4;
-              rgb.pixels = g_malloc_n ( rgb.height, rgb.rowBytes );
-              graypixels8_dest = rgb.pixels;
-              
-              for ( j = 0; j < drawable_height; ++j )
+              row = ( uint16_t * ) &avif->yuvPlanes[AVIF_CHAN_Y][j * avif->yuvRowBytes[AVIF_CHAN_Y]];
+              for ( i = 0; i < ( gint ) avif->width; ++i )
                 {
-                  for ( i = 0; i < drawable_width; ++i )
-                    {
-                      tmpval8 = *graypixels8_src;
-                      graypixels8_src++;
-                      
-                      *graypixels8_dest = tmpval8; //R=G=B
-                      graypixels8_dest++;
-                      *graypixels8_dest = tmpval8; //G
-                      graypixels8_dest++;
-                      *graypixels8_dest = tmpval8; //B
-                      graypixels8_dest++;
-                      
-                      tmpval8 = *graypixels8_src;
-                      graypixels8_src++;
-                      *graypixels8_dest = tmpval8; //A
-                      graypixels8_dest++;
-                    }
+                  row[i] = ( uint16_t ) ( ( row[i] * max_channel + 32767 ) / 65535 );
                 }
-            }
-          else
-            {
-              rgb.format = AVIF_RGB_FORMAT_RGB;
-              rgb.rowBytes = rgb.width * 3;
-              rgb.pixels = g_malloc_n ( rgb.height, rgb.rowBytes );
-              graypixels8_dest = rgb.pixels;
-              
-              for ( j = 0; j < drawable_height; ++j )
+
+              if ( settings->save_alpha )
                 {
-                  for ( i = 0; i < drawable_width; ++i )
+                  row = ( uint16_t * ) &avif->alphaPlane[j * avif->alphaRowBytes];
+                  for ( i = 0; i < ( gint ) avif->width; ++i )
                     {
-                      tmpval8 = *graypixels8_src;
-                      graypixels8_src++;
-                      
-                      *graypixels8_dest = tmpval8; //R=G=B
-                      graypixels8_dest++;
-                      *graypixels8_dest = tmpval8; //G
-                      graypixels8_dest++;
-                      *graypixels8_dest = tmpval8; //B
-                      graypixels8_dest++;
+                      row[i] = ( uint16_t ) ( ( row[i] * max_channel + 32767 ) / 65535 );
                     }
                 }
             }
         }
-        
-        res = avifImageRGBToYUV ( avif, &rgb);
-        g_free ( rgb.pixels );
+      stats->convert_time += g_get_monotonic_time () - start_time;
+
+      res = AVIF_RESULT_OK;
     }
   else //color export
     {
-      rgb.pixels = pixels;
+      avifRGBImage rgb;
+      avifRGBImageSetDefaults ( &rgb, avif );
+      rgb.maxThreads = settings->num_threads;
 
       if ( avifImageUsesU16 ( avif ) ) //10 and 12 bit depth export
         {
           rgb.depth = 16;
-          if ( save_alpha )
+          if ( settings->save_alpha )
             {
               rgb.format = AVIF_RGB_FORMAT_RGBA;
               rgb.rowBytes = rgb.width * 8;
@@ -749,7 +754,7 @@ gboolean   save_layer ( GFile         *file,
       else //8 bit depth export
         {
           rgb.depth = 8;
-          if ( save_alpha )
+          if ( settings->save_alpha )
             {
               rgb.format = AVIF_RGB_FORMAT_RGBA;
               rgb.rowBytes = rgb.width * 4;
@@ -760,17 +765,93 @@ gboolean   save_layer ( GFile         *file,
               rgb.rowBytes = rgb.width * 3;
             }
         }
-        
-        res = avifImageRGBToYUV ( avif, &rgb);
-    }
 
-  g_free ( pixels );
+      /* Fetch and convert in bands of whole GEGL tile rows straight into the avif planes,
+         which the encoder reads in place, so only a band-sized RGB buffer is needed. */
+      gint tile_height = 64;
+      g_object_get ( buffer, "tile-height", &tile_height, NULL );
+      if ( tile_height < 1 )
+        {
+          tile_height = 64;
+        }
+
+      /* One tile row per thread, kept even so no 4:2:0 chroma row straddles two bands */
+      uint32_t band_height = ( ( uint32_t ) tile_height * settings->num_threads + 1 ) & ~1u;
+      band_height = MIN ( band_height, rgb.height );
+      rgb.pixels = g_malloc_n ( band_height, rgb.rowBytes );
+
+      res = AVIF_RESULT_OK;
+      for ( uint32_t band_y = 0; band_y < rgb.height; band_y += band_height )
+        {
+          uint32_t rows = MIN ( band_height, rgb.height - band_y );
+
+          start_time = g_get_monotonic_time ();
+          gegl_buffer_get ( buffer, GEGL_RECTANGLE ( x, y + ( gint ) band_y, rgb.width, rows ), 1.0,
+                            settings->file_format, rgb.pixels,
+                            rgb.rowBytes, GEGL_ABYSS_NONE );
+          stats->buffer_time += g_get_monotonic_time () - start_time;
+
+          start_time = g_get_monotonic_time ();
+          res = avifImageRGBToYUVRows ( avif, &rgb, band_y, rows );
+          stats->convert_time += g_get_monotonic_time () - start_time;
+          if ( res != AVIF_RESULT_OK )
+            {
+              break;
+            }
+        }
+
+      g_free ( rgb.pixels );
+    }
 
   if ( res != AVIF_RESULT_OK )
   {
     g_message ( "ERROR in avifImageRGBToYUV: %s\n", avifResultToString ( res ) );
   }
-  
+  return res;
+}
+
+/* Creates an encoder with the quantizer, speed and codec settings of config. The quality
+   target only applies to still images, sequences ignore it and keep the quantizers. */
+static avifEncoder *
+avifplugin_encoder_new ( GObject  *config,
+                         gint      num_threads,
+                         gboolean  save_alpha,
+                         gboolean  still )
+{
+  int             min_quantizer = AVIF_QUANTIZER_BEST_QUALITY;
+  int             max_quantizer = 40;
+  int             alpha_quantizer = AVIF_QUANTIZER_BEST_QUALITY;
+  double          retval_double = max_quantizer;
+  double          retval_double2 = min_quantizer;
+  double          retval_double3;
+  double          retval_double4 = alpha_quantizer;
+  avifCodecChoice codec_choice = AVIF_CODEC_CHOICE_AUTO;
+  gint            encoder_speed;
+  gint            target_mode = AVIF_ENCODER_TARGET_NONE;
+  double          target_size = 100;
+  double          target_psnr = 40;
+  double          target_ssim = 0.95;
+
+  g_object_get ( config, "max-quantizer", &retval_double,
+                 "min-quantizer", &retval_double2,
+                 "alpha-quantizer", &retval_double4,
+                 "av1-encoder", &codec_choice,
+                 "encoder-speed", &retval_double3,
+                 "target-mode", &target_mode,
+                 "target-size", &target_size,
+                 "target-psnr", &target_psnr,
+                 "target-ssim", &target_ssim,
+                 NULL );
+  max_quantizer = ( int ) ( retval_double + 0.5 );
+  min_quantizer = ( int ) ( retval_double2 + 0.5 );
+  encoder_speed = ( int ) ( retval_double3 + 0.5 );
+  alpha_quantizer = ( int ) ( retval_double4 + 0.5 );
+
+  if ( ! still )
+    {
+      target_mode = AVIF_ENCODER_TARGET_NONE;
+    }
+
   if ( max_quantizer > AVIF_QUANTIZER_WORST_QUALITY )
     {
       max_quantizer = AVIF_QUANTIZER_WORST_QUALITY;
@@ -798,9 +879,6 @@ gboolean   save_layer ( GFile         *file,
       encoder_speed = AVIF_SPEED_FASTEST;
     }
 
-  gimp_progress_update ( 0.5 );
-
-  avifRWData raw = AVIF_DATA_EMPTY;
   avifEncoder * encoder = avifEncoderCreate();
   encoder->maxThreads = num_threads;
   encoder->minQuantizer = min_quantizer;
@@ -808,6 +886,30 @@ gboolean   save_layer ( GFile         *file,
   encoder->speed = encoder_speed;
   encoder->codecChoice = codec_choice;
 
+  /* with a target, libavif searches the whole quantizer range for the color quantizer itself */
+  switch ( target_mode )
+    {
+    case AVIF_ENCODER_TARGET_SIZE:
+      encoder->targetSize = ( size_t ) ( target_size * 1024.0 );
+      break;
+    case AVIF_ENCODER_TARGET_PSNR:
+      encoder->targetQuality = target_psnr;
+      break;
+    case AVIF_ENCODER_TARGET_SSIM:
+      encoder->targetQuality = target_ssim;
+      break;
+    default:
+      target_mode = AVIF_ENCODER_TARGET_NONE;
+      break;
+    }
+
+  if ( target_mode != AVIF_ENCODER_TARGET_NONE )
+    {
+      encoder->target = ( avifEncoderTarget ) target_mode;
+      encoder->minQuantizer = AVIF_QUANTIZER_BEST_QUALITY;
+      encoder->maxQuantizer = AVIF_QUANTIZER_WORST_QUALITY;
+    }
+
   if ( save_alpha )
     {
       encoder->minQuantizerAlpha = AVIF_QUANTIZER_LOSSLESS;
@@ -824,48 +926,203 @@ gboolean   save_layer ( GFile         *file,
       encoder->maxQuantizerAlpha = alpha_quantizer;
     }
 
-  avifplugin_set_tiles ( drawable_width, drawable_height, encoder );
   /* debug info to print encoder parameters
   printf ( "Qmin: %d, Qmax: %d, Qalpha: %d, Speed: %d, tileColsLog2: %d, tileRowsLog2 %d, Encoder: %d, threads: %d\n",
            encoder->minQuantizer, encoder->maxQuantizer, encoder->maxQuantizerAlpha,
            encoder->speed, encoder->tileColsLog2, encoder->tileRowsLog2, encoder->codecChoice,encoder->maxThreads );
   */
+  return encoder;
+}
 
-  res = avifEncoderWrite ( encoder, avif, &raw );
-  avifEncoderDestroy ( encoder );
-  avifImageDestroy ( avif );
+/* Stream the file into a temporary next to the target and rename it into place once complete,
+   so a failed export never leaves a truncated file behind or clobbers the previous one.
+   Writes avif as a still image, or finishes the sequence added to encoder when avif is NULL. */
+static gboolean
+avifplugin_write_file_atomic ( const gchar *filename,
+                               avifEncoder *encoder,
+                               avifImage   *avif )
+{
+  FILE       *outfile;
+  avifResult  res;
+  gchar      *tmp_filename = g_strdup_printf ( "%s.XXXXXX", filename );
+  gint        tmp_fd = g_mkstemp_full ( tmp_filename, O_WRONLY | O_BINARY, 0666 );
+
+  outfile = ( tmp_fd != -1 ) ? fdopen ( tmp_fd, "wb" ) : NULL;
+  if ( !outfile )
+    {
+      g_message ( "Could not open '%s' for writing!\n", tmp_filename );
+      if ( tmp_fd != -1 )
+        {
+          g_close ( tmp_fd, NULL );
+          g_unlink ( tmp_filename );
+        }
+      g_free ( tmp_filename );
+      return FALSE;
+    }
+
+  avifIOWriter writer;
+  writer.write = avifplugin_write_file;
+  writer.userData = outfile;
+
+  if ( avif )
+    {
+      res = avifEncoderWriteToIO ( encoder, avif, &writer );
+    }
+  else
+    {
+      res = avifEncoderFinishToIO ( encoder, &writer );
+    }
+
+  if ( fclose ( outfile ) != 0 && res == AVIF_RESULT_OK )
+    {
+      res = AVIF_RESULT_IO_ERROR;
+    }
 
   if ( res == AVIF_RESULT_OK )
     {
-      gimp_progress_update ( 0.75 );
-      /* Let's take some file */
-      outfile = g_fopen ( filename, "wb" );
-      if ( !outfile )
+      if ( g_rename ( tmp_filename, filename ) == 0 )
         {
-          g_message ( "Could not open '%s' for writing!\n",filename );
-          g_free ( filename );
-          avifRWDataFree ( &raw );
-          return FALSE;
+          g_free ( tmp_filename );
+          return TRUE;
         }
 
+      g_message ( "Could not write '%s': %s\n", filename, g_strerror ( errno ) );
+    }
+  else if ( res == AVIF_RESULT_IO_ERROR )
+    {
+      g_message ( "Could not write '%s'!\n", tmp_filename );
+    }
+  else
+    {
+      g_message ( "ERROR: Failed to encode: %s\n", avifResultToString ( res ) );
+    }
+
+  g_unlink ( tmp_filename );
+  g_free ( tmp_filename );
+  return FALSE;
+}
+
+gboolean   save_layer ( GFile         *file,
+                        GimpImage     *image,
+                        GimpDrawable  *drawable,
+                        GObject       *config,
+                        GimpMetadata  *metadata,
+                        GError       **error )
+{
+  gchar                    *filename;
+  GeglBuffer               *buffer;
+  AvifPluginExportSettings  settings;
+  gint                      drawable_width;
+  gint                      drawable_height;
+  gboolean                  save_exif = FALSE;
+  gboolean                  save_xmp = FALSE;
+  gboolean                  success;
+  avifResult                res;
+  AvifPluginStats           stats;
+
+
+  avifplugin_stats_begin ( &stats );
+  filename = g_file_get_path ( file );
+  gimp_progress_init_printf ( "Exporting '%s'. Wait, it is slow.", filename );
+
+  g_object_get ( config, "save-exif", &save_exif,
+                 "save-xmp", &save_xmp,
+                 NULL );
+
+  drawable_width  = gimp_drawable_width ( drawable );
+  drawable_height = gimp_drawable_height ( drawable );
+
+  avifplugin_export_settings_init ( &settings, image, drawable, gimp_drawable_type ( drawable ),
+                                    config, error );
+
+  avifImage * avif = avifplugin_avif_new ( &settings, drawable_width, drawable_height );
+  g_object_unref ( settings.profile );
+
+  avifplugin_set_metadata ( avif, metadata, save_exif, save_xmp );
+
+  buffer = gimp_drawable_get_buffer ( drawable );
+  res = avifplugin_buffer_to_avif ( buffer, 0, 0, avif, &settings, &stats );
+  g_object_unref ( buffer );
+
+  if ( res != AVIF_RESULT_OK )
+    {
+      avifImageDestroy ( avif );
       g_free ( filename );
-      fwrite ( raw.data, 1, raw.size, outfile );
-      fclose ( outfile );
+      return FALSE;
+    }
 
+  gimp_progress_update ( 0.5 );
 
-      gimp_progress_update ( 1.0 );
-      avifRWDataFree ( &raw );
-      return TRUE;
+  avifEncoder * encoder = avifplugin_encoder_new ( config, settings.num_threads, settings.save_alpha, TRUE );
+
+  avifplugin_set_grid ( drawable_width, drawable_height, encoder );
+  if ( encoder->gridCellWidth > 0 )
+    {
+      avifplugin_set_tiles ( encoder->gridCellWidth, encoder->gridCellHeight, encoder );
     }
   else
     {
-      g_message ( "ERROR: Failed to encode: %s\n", avifResultToString ( res ) );
+      avifplugin_set_tiles ( drawable_width, drawable_height, encoder );
     }
 
+  success = avifplugin_write_file_atomic ( filename, encoder, avif );
+  if ( success )
+    {
+      if ( encoder->target != AVIF_ENCODER_TARGET_NONE )
+        {
+          g_debug ( "%s: quantizer %d picked after %u candidates, quality %.4f", G_STRFUNC,
+                    encoder->ioStats.targetQuantizer, encoder->ioStats.targetCandidates,
+                    encoder->ioStats.targetQuality );
+          if ( ! encoder->ioStats.targetMet )
+            {
+              g_message ( "The quality target could not be reached, '%s' was exported with quantizer %d instead.\n",
+                          filename, encoder->ioStats.targetQuantizer );
+            }
+        }
+      avifplugin_stats_log ( &stats, "save", filename, &encoder->ioStats, NULL );
+    }
+  avifEncoderDestroy ( encoder );
+  avifImageDestroy ( avif );
+
+  if ( success )
+    {
+      gimp_progress_update ( 1.0 );
+    }
   g_free ( filename );
-  return FALSE;
+  return success;
 }
 
+/* GIMP's animation playback takes the frame duration from "(NNms)" in the layer name */
+static gint
+avifplugin_layer_duration ( GimpLayer *layer,
+                            gint       default_duration )
+{
+  gchar       *name = gimp_item_get_name ( GIMP_ITEM ( layer ) );
+  gint         duration = default_duration;
+  const gchar *p;
+
+  for ( p = strchr ( name, '(' ); p; p = strchr ( p + 1, '(' ) )
+    {
+      gchar  *end;
+      gint64  value = g_ascii_strtoll ( p + 1, &end, 10 );
+
+      while ( *end == ' ' )
+        {
+          end++;
+        }
+      if ( end != p + 1 && g_str_has_prefix ( end, "ms)" ) && value > 0 && value <= G_MAXINT )
+        {
+          duration = ( gint ) value;
+          break;
+        }
+    }
+
+  g_free ( name );
+  return duration;
+}
+
+/* Every layer, bottom to top, is a frame of the sequence, shown on its own at canvas size.
+   The frames go through one AV1 stream, so each is predicted from the ones before it. */
 gboolean   save_animation ( GFile         *file,
                             GimpImage     *image,
                             GimpDrawable  *drawable,
@@ -873,7 +1130,212 @@ gboolean   save_animation ( GFile         *file,
                             GimpMetadata  *metadata,
                             GError       **error )
 {
-  g_message ( "save_animation NOT IMPLEMENTED YET!!!\n" );
-  return FALSE;
+  gchar                    *filename;
+  AvifPluginExportSettings  settings;
+  GimpLayer               **layers;
+  gint32                    nlayers;
+  GimpImageType             frame_type;
+  gint                      image_width;
+  gint                      image_height;
+  gboolean                  save_alpha = FALSE;
+  gboolean                  save_exif = FALSE;
+  gboolean                  save_xmp = FALSE;
+  gboolean                  success = TRUE;
+  gint                      i;
+  AvifPluginStats           stats;
+
+  avifplugin_stats_begin ( &stats );
+  filename = g_file_get_path ( file );
+  gimp_progress_init_printf ( "Exporting '%s'. Wait, it is slow.", filename );
+
+  g_object_get ( config, "save-exif", &save_exif,
+                 "save-xmp", &save_xmp,
+                 NULL );
+
+  image_width = gimp_image_width ( image );
+  image_height = gimp_image_height ( image );
+  layers = gimp_image_get_layers ( image, &nlayers );
+
+  /* A layer which has alpha or doesn't cover the canvas needs an alpha plane in every frame */
+  for ( i = 0; i < nlayers; i++ )
+    {
+      GimpDrawable *layer = GIMP_DRAWABLE ( layers[i] );
+      gint          offset_x, offset_y;
+
+      gimp_drawable_offsets ( layer, &offset_x, &offset_y );
+      if ( gimp_drawable_has_alpha ( layer ) ||
+           offset_x > 0 || offset_y > 0 ||
+           offset_x + gimp_drawable_width ( layer ) < image_width ||
+           offset_y + gimp_drawable_height ( layer ) < image_height )
+        {
+          save_alpha = TRUE;
+          break;
+        }
+    }
+
+  if ( gimp_image_base_type ( image ) == GIMP_GRAY )
+    {
+      frame_type = save_alpha ? GIMP_GRAYA_IMAGE : GIMP_GRAY_IMAGE;
+    }
+  else
+    {
+      frame_type = save_alpha ? GIMP_RGBA_IMAGE : GIMP_RGB_IMAGE;
+    }
+
+  avifplugin_export_settings_init ( &settings, image, drawable, frame_type, config, error );
+
+  avifEncoder * encoder = avifplugin_encoder_new ( config, settings.num_threads, settings.save_alpha, FALSE );
+  encoder->timescale = 1000;
+  /* Sequences are not split into a grid, only into tiles */
+  avifplugin_set_tiles ( image_width, image_height, encoder );
+
+  for ( i = nlayers - 1; i >= 0 && success; i-- )
+    {
+      GimpDrawable *layer = GIMP_DRAWABLE ( layers[i] );
+      GeglBuffer   *buffer;
+      gint          offset_x, offset_y;
+      avifResult    res;
+
+      avifImage * avif = avifplugin_avif_new ( &settings, image_width, image_height );
+      if ( i == nlayers - 1 )
+        {
+          /* The first frame is also the still image, which carries the metadata */
+          avifplugin_set_metadata ( avif, metadata, save_exif, save_xmp );
+        }
+
+      /* Reading from the canvas origin leaves the area outside of the layer transparent */
+      gimp_drawable_offsets ( layer, &offset_x, &offset_y );
+      buffer = gimp_drawable_get_buffer ( layer );
+      res = avifplugin_buffer_to_avif ( buffer, -offset_x, -offset_y, avif, &settings, &stats );
+      g_object_unref ( buffer );
+
+      if ( res == AVIF_RESULT_OK )
+        {
+          res = avifEncoderAddImage ( encoder, avif,
+                                      avifplugin_layer_duration ( layers[i], 100 ) );
+          if ( res != AVIF_RESULT_OK )
+            {
+              g_message ( "ERROR: Failed to encode: %s\n", avifResultToString ( res ) );
+            }
+        }
+      avifImageDestroy ( avif );
+
+      success = ( res == AVIF_RESULT_OK );
+      gimp_progress_update ( ( gdouble ) ( nlayers - i ) / ( nlayers + 1 ) );
+    }
+
+  g_free ( layers );
+  g_object_unref ( settings.profile );
+
+  if ( success )
+    {
+      success = avifplugin_write_file_atomic ( filename, encoder, NULL );
+    }
+  if ( success )
+    {
+      avifplugin_stats_log ( &stats, "save-animation", filename, &encoder->ioStats, NULL );
+    }
+  avifEncoderDestroy ( encoder );
+
+  if ( success )
+    {
+      gimp_progress_update ( 1.0 );
+    }
+  g_free ( filename );
+  return success;
+}
+
+/* The export dialog's estimate encodes a sample instead of the whole drawable: a grid of
+   tiles_per_side x tiles_per_side crops of tile_size pixels spread over it, kept at full
+   resolution so the encoder sees the real detail. Along a side which is not longer than the
+   crops together, the whole side is taken. Returns NULL if the drawable can't be read as it
+   will be exported (indexed drawables are converted by gimp_export_image () first). */
+avifImage *
+save_preview_sample ( GimpImage    *image,
+                      GimpDrawable *drawable,
+                      GObject      *config,
+                      gint          tile_size,
+                      gint          tiles_per_side,
+                      gint         *num_threads )
+{
+  AvifPluginExportSettings  settings;
+  AvifPluginStats           stats;
+  GeglBuffer               *buffer;
+  GeglBuffer               *sample_buffer;
+  GimpImageType             drawable_type;
+  GError                   *error = NULL;
+  gboolean                  save_alpha_channel = TRUE;
+  gint                      width, height;
+  gint                      crop_width, crop_height;
+  gint                      crops_x, crops_y;
+  gint                      i, j;
+  avifResult                res;
+
+  if ( gimp_drawable_is_indexed ( drawable ) )
+    {
+      return NULL;
+    }
+
+  g_object_get ( config, "save-alpha-channel", &save_alpha_channel, NULL );
+  drawable_type = gimp_drawable_type ( drawable );
+  if ( ! save_alpha_channel )
+    {
+      drawable_type = ( drawable_type == GIMP_GRAYA_IMAGE ) ? GIMP_GRAY_IMAGE :
+                      ( drawable_type == GIMP_RGBA_IMAGE ) ? GIMP_RGB_IMAGE : drawable_type;
+    }
+
+  avifplugin_export_settings_init ( &settings, image, drawable, drawable_type, config, &error );
+  *num_threads = settings.num_threads;
+
+  width = gimp_drawable_width ( drawable );
+  height = gimp_drawable_height ( drawable );
+  tile_size &= ~1; //even crops keep the chroma of 4:2:0 and 4:2:2 aligned with the drawable
+  crops_x = ( width > tile_size * tiles_per_side ) ? tiles_per_side : 1;
+  crops_y = ( height > tile_size * tiles_per_side ) ? tiles_per_side : 1;
+  crop_width = ( crops_x > 1 ) ? tile_size : width;
+  crop_height = ( crops_y > 1 ) ? tile_size : height;
+
+  buffer = gimp_drawable_get_buffer ( drawable );
+  sample_buffer = gegl_buffer_new ( GEGL_RECTANGLE ( 0, 0, crop_width * crops_x, crop_height * crops_y ),
+                                    gegl_buffer_get_format ( buffer ) );
+  for ( j = 0; j < crops_y; j++ )
+    {
+      gint src_y = ( crops_y > 1 ) ? ( ( height - crop_height ) * j / ( crops_y - 1 ) ) & ~1 : 0;
+
+      for ( i = 0; i < crops_x; i++ )
+        {
+          gint src_x = ( crops_x > 1 ) ? ( ( width - crop_width ) * i / ( crops_x - 1 ) ) & ~1 : 0;
+
+          gegl_buffer_copy ( buffer, GEGL_RECTANGLE ( src_x, src_y, crop_width, crop_height ),
+                             GEGL_ABYSS_NONE, sample_buffer,
+                             GEGL_RECTANGLE ( i * crop_width, j * crop_height, crop_width, crop_height ) );
+        }
+    }
+  g_object_unref ( buffer );
+
+  avifImage * avif = avifplugin_avif_new ( &settings, crop_width * crops_x, crop_height * crops_y );
+  g_object_unref ( settings.profile );
+
+  avifplugin_stats_begin ( &stats );
+  res = avifplugin_buffer_to_avif ( sample_buffer, 0, 0, avif, &settings, &stats );
+  g_object_unref ( sample_buffer );
+
+  if ( res != AVIF_RESULT_OK )
+    {
+      avifImageDestroy ( avif );
+      return NULL;
+    }
+  return avif;
 }
 
+/* An encoder set up like the export's, for encoding the sample of save_preview_sample () */
+avifEncoder *
+save_preview_encoder ( GObject *config,
+                       gint     num_threads,
+                       gboolean save_alpha )
+{
+  gboolean animation = FALSE;
+
+  g_object_get ( config, "animation", &animation, NULL );
+  return avifplugin_encoder_new ( config, num_threads, save_alpha, ! animation );
+}
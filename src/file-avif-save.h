@@ -18,5 +18,16 @@ gboolean   save_animation (GFile         *file,
                            GimpMetadata  *metadata,
                            GError       **error);
 
+avifImage   * save_preview_sample  (GimpImage     *image,
+                                    GimpDrawable  *drawable,
+                                    GObject       *config,
+                                    gint           tile_size,
+                                    gint           tiles_per_side,
+                                    gint          *num_threads);
+
+avifEncoder * save_preview_encoder (GObject       *config,
+                                    gint           num_threads,
+                                    gboolean       save_alpha);
+
 
 #endif /* __AVIF_SAVE_H__ */
@@ -0,0 +1,136 @@
+/*
+ * GIMP plug-in to allow import/export in AVIF image format.
+ * Author: Daniel Novomesky
+ */
+
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+This software uses libavif
+URL: https://github.com/AOMediaCodec/libavif/
+
+Copyright 2019 Joe Drago. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <libgimp/gimp.h>
+
+#include <avif/avif.h>
+#include <glib/gstdio.h>
+
+#ifdef G_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#include "file-avif-stats.h"
+
+glong avifplugin_peak_rss_kb ( void )
+{
+#ifdef G_OS_UNIX
+  struct rusage usage;
+
+  if ( getrusage ( RUSAGE_SELF, &usage ) == 0 )
+    {
+#ifdef __APPLE__
+      return ( glong ) ( usage.ru_maxrss / 1024 ); /* bytes on macOS */
+#else
+      return ( glong ) usage.ru_maxrss;
+#endif
+    }
+#endif
+  return 0;
+}
+
+void avifplugin_stats_begin ( AvifPluginStats *stats )
+{
+  stats->start_time = g_get_monotonic_time ();
+  stats->buffer_time = 0;
+  stats->convert_time = 0;
+  stats->peak_rss_kb = avifplugin_peak_rss_kb ();
+}
+
+void avifplugin_stats_log ( const AvifPluginStats *stats,
+                            const gchar           *operation,
+                            const gchar           *filename,
+                            const avifIOStats     *io_stats,
+                            const avifDecoder     *decoder )
+{
+  const gchar *destination = g_getenv ( "AVIFPLUGIN_STATS" );
+  gdouble      slowest_tile = 0.0;
+  FILE        *log_file;
+  gchar       *line;
+
+  if ( ! destination || ! *destination )
+    {
+      return;
+    }
+
+  for ( uint32_t tile_index = 0; decoder && tile_index < io_stats->tileCount; tile_index++ )
+    {
+      slowest_tile = MAX ( slowest_tile, avifDecoderTileSeconds ( decoder, tile_index ) );
+    }
+
+  /* one line of key=value pairs per operation, times in seconds, so logs are easy to aggregate */
+  line = g_strdup_printf ( "file-avif: op=%s file=\"%s\" total=%.4f buffer=%.4f convert=%.4f"
+                           " parse=%.4f color=%.4f alpha=%.4f grid=%.4f write=%.4f"
+                           " tiles=%u slowest_tile=%.4f plane_kb=%" G_GSIZE_FORMAT
+                           " color_obu=%" G_GSIZE_FORMAT " alpha_obu=%" G_GSIZE_FORMAT " peak_rss_growth_kb=%ld\n",
+                           operation, filename,
+                           ( g_get_monotonic_time () - stats->start_time ) / ( gdouble ) G_USEC_PER_SEC,
+                           stats->buffer_time / ( gdouble ) G_USEC_PER_SEC,
+                           stats->convert_time / ( gdouble ) G_USEC_PER_SEC,
+                           io_stats->parseSeconds, io_stats->colorCodecSeconds, io_stats->alphaCodecSeconds,
+                           io_stats->gridSeconds, io_stats->writeSeconds,
+                           io_stats->tileCount, slowest_tile, ( gsize ) ( io_stats->planeBytes / 1024 ),
+                           ( gsize ) io_stats->colorOBUSize, ( gsize ) io_stats->alphaOBUSize,
+                           avifplugin_peak_rss_kb () - stats->peak_rss_kb );
+
+  /* "1" logs to stderr, anything else names a file the lines are appended to */
+  if ( g_strcmp0 ( destination, "1" ) == 0 )
+    {
+      g_printerr ( "%s", line );
+    }
+  else if ( ( log_file = g_fopen ( destination, "a" ) ) )
+    {
+      fputs ( line, log_file );
+      fclose ( log_file );
+    }
+  else
+    {
+      g_printerr ( "%s: Cannot open %s for appending, logging to stderr\n%s", G_STRFUNC, destination, line );
+    }
+  g_free ( line );
+}
@@ -0,0 +1,27 @@
+#ifndef __AVIF_STATS_H__
+#define __AVIF_STATS_H__
+
+
+/* Where the time of a load or export went, on top of what libavif reports in avifIOStats.
+   Written out by avifplugin_stats_log () when the AVIFPLUGIN_STATS environment variable is set:
+   to stderr if it is "1", otherwise appended to the file it names. */
+typedef struct
+{
+  gint64 start_time;   /* g_get_monotonic_time () when the operation began */
+  gint64 buffer_time;  /* microseconds in gegl_buffer_get () / gegl_buffer_set () */
+  gint64 convert_time; /* microseconds converting between RGB and YUV */
+  glong  peak_rss_kb;  /* peak RSS when the operation began */
+} AvifPluginStats;
+
+glong      avifplugin_peak_rss_kb (void);
+
+void       avifplugin_stats_begin (AvifPluginStats       *stats);
+
+void       avifplugin_stats_log   (const AvifPluginStats *stats,
+                                   const gchar           *operation,
+                                   const gchar           *filename,
+                                   const avifIOStats     *io_stats,
+                                   const avifDecoder     *decoder);
+
+
+#endif /* __AVIF_STATS_H__ */
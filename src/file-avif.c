@@ -57,6 +57,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 #define LOAD_PROC      "file-avif-load"
+#define LOAD_THUMB_PROC "file-avif-load-thumb"
 #define SAVE_PROC      "file-avif-save"
 #define PLUG_IN_BINARY "file-avif"
 #define PLUG_IN_ROLE   "gimp-file-avif"
@@ -89,6 +90,11 @@ static GimpValueArray * avif_load ( GimpProcedure        *procedure,
                                     GFile                *file,
                                     const GimpValueArray *args,
                                     gpointer              run_data );
+static GimpValueArray * avif_load_thumb ( GimpProcedure        *procedure,
+                                          GFile                *file,
+                                          gint                  size,
+                                          const GimpValueArray *args,
+                                          gpointer              run_data );
 static GimpValueArray * avif_save ( GimpProcedure        *procedure,
                                     GimpRunMode           run_mode,
                                     GimpImage            *image,
@@ -123,6 +129,7 @@ avif_query_procedures ( GimpPlugIn *plug_in )
   GList *list = NULL;
 
   list = g_list_append ( list, g_strdup ( LOAD_PROC ) );
+  list = g_list_append ( list, g_strdup ( LOAD_THUMB_PROC ) );
   list = g_list_append ( list, g_strdup ( SAVE_PROC ) );
 
   return list;
@@ -157,6 +164,25 @@ avif_create_procedure ( GimpPlugIn  *plug_in,
                                            "avif,avifs" );
       gimp_file_procedure_set_magics ( GIMP_FILE_PROCEDURE ( procedure ),
                                        "4,string,ftypmif1,4,string,ftypavif,4,string,ftypavis" );
+
+      gimp_load_procedure_set_thumbnail_loader ( GIMP_LOAD_PROCEDURE ( procedure ),
+                                                 LOAD_THUMB_PROC );
+    }
+  else if ( ! strcmp ( name, LOAD_THUMB_PROC ) )
+    {
+      procedure = gimp_thumbnail_procedure_new ( plug_in, name,
+                                                 GIMP_PDB_PROC_TYPE_PLUGIN,
+                                                 avif_load_thumb, NULL, NULL );
+
+      gimp_procedure_set_documentation ( procedure,
+                                         "Loads a thumbnail from an AVIF image",
+                                         "Uses the embedded thumbnail when present, "
+                                         "otherwise scales the image down while converting it",
+                                         name );
+      gimp_procedure_set_attribution ( procedure,
+                                       "Daniel Novomesky",
+                                       "(C) 2020 Daniel Novomesky",
+                                       "2020" );
     }
   else if ( ! strcmp ( name, SAVE_PROC ) )
     {
@@ -254,6 +280,30 @@ avif_create_procedure ( GimpPlugIn  *plug_in,
                               gimp_export_xmp (),
                               G_PARAM_READWRITE );
 
+      GIMP_PROC_ARG_INT ( procedure, "target-mode",
+                          "Quality target",
+                          "0 - use the quantizers, 1 - file size, 2 - PSNR, 3 - SSIM",
+                          AVIF_ENCODER_TARGET_NONE, AVIF_ENCODER_TARGET_SSIM, AVIF_ENCODER_TARGET_NONE,
+                          G_PARAM_READWRITE );
+
+      GIMP_PROC_ARG_DOUBLE ( procedure, "target-size",
+                             "Target file size",
+                             "Largest file size in KiB, for target-mode 1",
+                             1, 1048576, 100,
+                             G_PARAM_READWRITE );
+
+      GIMP_PROC_ARG_DOUBLE ( procedure, "target-psnr",
+                             "Target PSNR",
+                             "Lowest PSNR in dB, for target-mode 2: 30 - poor, 40 - good, 50 - excellent",
+                             20, 60, 40,
+                             G_PARAM_READWRITE );
+
+      GIMP_PROC_ARG_DOUBLE ( procedure, "target-ssim",
+                             "Target SSIM",
+                             "Lowest SSIM, for target-mode 3: 0.9 - poor, 0.95 - good, 0.99 - excellent",
+                             0.5, 1.0, 0.95,
+                             G_PARAM_READWRITE );
+
     }
 
   return procedure;
@@ -289,6 +339,43 @@ avif_load ( GimpProcedure        *procedure,
   return return_vals;
 }
 
+static GimpValueArray *
+avif_load_thumb ( GimpProcedure        *procedure,
+                  GFile                *file,
+                  gint                  size,
+                  const GimpValueArray *args,
+                  gpointer              run_data )
+{
+  GimpValueArray *return_vals;
+  GimpImage      *image;
+  gint            width  = 0;
+  gint            height = 0;
+  GimpImageType   type   = GIMP_RGB_IMAGE;
+  GError         *error  = NULL;
+
+
+  gegl_init ( NULL, NULL );
+
+  image = load_thumbnail_image ( file, size, &width, &height, &type, &error );
+
+  if ( ! image )
+    return gimp_procedure_new_return_values ( procedure,
+           GIMP_PDB_EXECUTION_ERROR,
+           error );
+
+  return_vals = gimp_procedure_new_return_values ( procedure,
+                GIMP_PDB_SUCCESS,
+                NULL );
+
+  GIMP_VALUES_SET_IMAGE ( return_vals, 1, image );
+  GIMP_VALUES_SET_INT   ( return_vals, 2, width );
+  GIMP_VALUES_SET_INT   ( return_vals, 3, height );
+  GIMP_VALUES_SET_ENUM  ( return_vals, 4, type );
+  GIMP_VALUES_SET_INT   ( return_vals, 5, 1 );
+
+  return return_vals;
+}
+
 static GimpValueArray *
 avif_save ( GimpProcedure        *procedure,
             GimpRunMode           run_mode,
@@ -320,7 +407,7 @@ avif_save ( GimpProcedure        *procedure,
 
   if ( run_mode == GIMP_RUN_INTERACTIVE )
     {
-      if ( ! save_dialog ( image, procedure, G_OBJECT ( config ) ) )
+      if ( ! save_dialog ( image, drawable, procedure, G_OBJECT ( config ) ) )
         return gimp_procedure_new_return_values ( procedure,
                GIMP_PDB_CANCEL,
                NULL );